@@ -0,0 +1,90 @@
+/*
+ *  Narfduino Libraries - NarfduinoADC
+ *  
+ *  Non-blocking ADC conversions for the other Narfduino libraries. 
+ *  
+ *  (c) 2019 - Ireland Software
+ *  License: 
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier), 
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *    
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *  
+ */
+
+#include "NarfduinoADC.h"
+
+volatile bool NarfduinoADC::Busy = false;
+NarfduinoADC::ConversionCallback NarfduinoADC::PendingCallback = NULL;
+void *NarfduinoADC::PendingContext = NULL;
+
+// Conversion complete
+#ifdef _NARFDUINO_ENABLE_ADC_INTERRUPT
+ISR( ADC_vect )
+{
+  NarfduinoADC::HandleInterrupt();
+}
+#endif
+
+// Start a conversion. The core has already enabled the ADC and set the prescaler.
+bool NarfduinoADC::StartConversion( byte Pin, ConversionCallback Callback, void *Context )
+{
+  // Same pin numbering as analogRead()
+  if( Pin >= A0 )
+    Pin -= A0;
+
+  Poll();
+
+  uint8_t OldSREG = SREG;
+  cli();
+  if( Busy )
+  {
+    SREG = OldSREG;
+    return false;
+  }
+  Busy = true;
+  PendingCallback = Callback;
+  PendingContext = Context;
+
+  // AVcc reference, same as analogRead() with the default reference
+  ADMUX = (1 << REFS0) | (Pin & 0x07);
+  #ifdef _NARFDUINO_ENABLE_ADC_INTERRUPT
+    ADCSRA |= (1 << ADIE) | (1 << ADSC);
+  #else
+    ADCSRA |= (1 << ADSC);
+  #endif
+  SREG = OldSREG;
+  return true;
+}
+
+bool NarfduinoADC::IsBusy()
+{
+  Poll();
+  return Busy;
+}
+
+// Without the interrupt, the conversion is done once ADSC drops
+void NarfduinoADC::Poll()
+{
+  #ifndef _NARFDUINO_ENABLE_ADC_INTERRUPT
+    uint8_t OldSREG = SREG;
+    cli();
+    if( Busy && !(ADCSRA & (1 << ADSC)) )
+      HandleInterrupt();
+    SREG = OldSREG;
+  #endif
+}
+
+// Hand the result back, and release the ADC
+void NarfduinoADC::HandleInterrupt()
+{
+  uint16_t Value = ADC;
+  ADCSRA &= ~(1 << ADIE);
+  Busy = false;
+  if( PendingCallback != NULL )
+    PendingCallback( PendingContext, Value );
+}
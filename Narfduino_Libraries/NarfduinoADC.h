@@ -0,0 +1,58 @@
+/*
+ *  Narfduino Libraries - NarfduinoADC
+ *  
+ *  Non-blocking ADC conversions for the other Narfduino libraries. 
+ *  A conversion is started, and the result is handed back later, so the main loop never waits ~110us on analogRead().
+ *  There is only one ADC - if it's busy, try again later.
+ *  
+ *  !!!!! WARNING !!!!!
+ *  Don't call analogRead() while a conversion started here is running. They share the hardware.
+ *  
+ *  (c) 2019 - Ireland Software
+ *  License: 
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier), 
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *    
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *  
+ */
+
+#ifndef _NARFDUINO_ADC_LIB
+#define _NARFDUINO_ADC_LIB
+
+#include "Arduino.h"
+
+// Uncomment this (or add it to your build flags) to hand the results back from the ADC interrupt, as soon as they are ready.
+// It takes ADC_vect. Without it a finished conversion is picked up the next time a library polls - see Poll().
+//#define _NARFDUINO_ENABLE_ADC_INTERRUPT
+
+class NarfduinoADC
+{
+  public:
+    // Called with the 10-bit result, from the ADC interrupt or Poll(). Keep it short.
+    typedef void (*ConversionCallback)( void *Context, uint16_t Value );
+
+    // Start a conversion on an analog pin (A0 - A7). Returns false if the ADC is already busy.
+    static bool StartConversion( byte Pin, ConversionCallback Callback, void *Context );
+
+    // Is there a conversion running?
+    static bool IsBusy();
+
+    // Hand back a finished conversion, if there is one. Call before looking for a result. 
+    // Nothing to do with _NARFDUINO_ENABLE_ADC_INTERRUPT - the interrupt has already done it.
+    static void Poll();
+
+    // Internal - called from the ADC interrupt, or Poll()
+    static void HandleInterrupt();
+
+  private:
+    static volatile bool Busy;
+    static ConversionCallback PendingCallback;
+    static void *PendingContext;
+};
+
+#endif
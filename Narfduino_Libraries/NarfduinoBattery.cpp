@@ -19,6 +19,86 @@
 
 
 #include "NarfduinoBattery.h"
+#include "NarfduinoProfiler.h"
+#include "NarfduinoADC.h"
+
+// Fixed-point conversions. All of these fold down to constants at compile time.
+
+// Volts (from the config defines) to mV, rounded
+#define _NARFDUINO_BATTERY_VOLTS_TO_MV(v) ((long)((v) * 1000.0 + ((v) < 0 ? -0.5 : 0.5)))
+
+// Calibration adjustment in mV
+#define _NARFDUINO_BATTERY_CALFACTOR_MV _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_CALFACTOR )
+
+// Battery voltage when the ADC reads full scale (1024), in mV
+#define _NARFDUINO_BATTERY_FULL_SCALE_MV ((unsigned long)_NARFDUINO_BATTERY_VREF_MV * (_NARFDUINO_BATTERY_DIVIDER_HIGH + _NARFDUINO_BATTERY_DIVIDER_LOW) / _NARFDUINO_BATTERY_DIVIDER_LOW)
+
+// Sample total to mV is (Total * SCALE) >> 16. SCALE = FULL_SCALE * 65536 / (1024 * NUM_SAMPLES). Fits 32 bits for any number of samples.
+#define _NARFDUINO_BATTERY_TOTAL_SCALE ((_NARFDUINO_BATTERY_FULL_SCALE_MV * 64UL + _NARFDUINO_BATTERY_NUM_SAMPLES / 2) / _NARFDUINO_BATTERY_NUM_SAMPLES)
+
+// mV to the sample total that reads as that voltage. For the thresholds.
+#define _NARFDUINO_BATTERY_MV_TO_TOTAL(mv) ((uint16_t)((((long)(mv) - _NARFDUINO_BATTERY_CALFACTOR_MV) * 1024L * _NARFDUINO_BATTERY_NUM_SAMPLES) / (long)_NARFDUINO_BATTERY_FULL_SCALE_MV))
+
+// Below this, there is no battery - we are probably debugging on USB power
+#define _NARFDUINO_BATTERY_NO_BATTERY_TOTAL _NARFDUINO_BATTERY_MV_TO_TOTAL( 1600 )
+
+// Internal resistance learning. Estimates above this (mOhms) are thrown away, and each new estimate moves it 1/FILTER of the way.
+#define _NARFDUINO_BATTERY_IR_MAX_MOHMS 1000
+#define _NARFDUINO_BATTERY_IR_FILTER 4
+
+// Readings in a row a long way from the voltage before the BatteryS is detected again. One stray reading won't do it.
+#define _NARFDUINO_BATTERY_REDETECT_CONFIRM 2
+
+// Resting cell voltage (mV) at 0%, 10% .. 100%, for the selected chemistry
+#if _NARFDUINO_BATTERY_CHEMISTRY == _NARFDUINO_BATTERY_CHEMISTRY_LIPO
+  static const uint16_t CellDischargeCurve[11] PROGMEM = { 3270, 3690, 3730, 3770, 3790, 3820, 3870, 3930, 4000, 4080, 4200 };
+#elif _NARFDUINO_BATTERY_CHEMISTRY == _NARFDUINO_BATTERY_CHEMISTRY_LIION
+  static const uint16_t CellDischargeCurve[11] PROGMEM = { 3000, 3300, 3450, 3550, 3620, 3690, 3770, 3850, 3940, 4050, 4200 };
+#elif _NARFDUINO_BATTERY_CHEMISTRY == _NARFDUINO_BATTERY_CHEMISTRY_LIHV
+  static const uint16_t CellDischargeCurve[11] PROGMEM = { 3300, 3700, 3760, 3800, 3840, 3880, 3940, 4020, 4110, 4220, 4350 };
+#elif _NARFDUINO_BATTERY_CHEMISTRY != _NARFDUINO_BATTERY_CHEMISTRY_LINEAR
+  #error "Unknown _NARFDUINO_BATTERY_CHEMISTRY"
+#endif
+
+#if _NARFDUINO_BATTERY_CHEMISTRY != _NARFDUINO_BATTERY_CHEMISTRY_LINEAR
+// Percentage remaining for a cell voltage. Walks the curve to the right 10% step, and interpolates inside it.
+static byte CellMillivoltsToPercent( unsigned int CellMillivolts )
+{
+  uint16_t Lower = pgm_read_word( &CellDischargeCurve[0] );
+  if( CellMillivolts <= Lower )
+    return 0;
+  for( byte Step = 1; Step < 11; Step++ )
+  {
+    uint16_t Upper = pgm_read_word( &CellDischargeCurve[Step] );
+    if( CellMillivolts < Upper )
+      return (Step - 1) * 10 + (byte)(((CellMillivolts - Lower) * 10U) / (Upper - Lower));
+    Lower = Upper;
+  }
+  return 100;
+}
+#endif
+
+// Convert a total of _NARFDUINO_BATTERY_NUM_SAMPLES readings into mV
+static unsigned int SampleTotalToMillivolts( uint16_t SampleTotal )
+{
+  long Millivolts = (long)(((uint32_t)SampleTotal * _NARFDUINO_BATTERY_TOTAL_SCALE + 32768UL) >> 16) + _NARFDUINO_BATTERY_CALFACTOR_MV;
+  if( Millivolts < 0 )
+    return 0;
+  return Millivolts;
+}
+
+// Work out the BatteryS from a voltage
+static byte MillivoltsToBatteryS( unsigned int Millivolts )
+{
+  if( Millivolts < _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_4S_MIN ) )
+  {
+    if( Millivolts < _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_3S_MIN ) )
+      return 2;
+    else
+      return 3;
+  }
+  return 4;
+}
 
 
 NarfduinoBattery::NarfduinoBattery( byte _BatteryPin )
@@ -45,7 +125,51 @@ bool NarfduinoBattery::Init()
 // Returns the current battery voltage. Will return 99.0 if the voltage hasn't been calculated yet.
 float NarfduinoBattery::GetCurrentVoltage()
 {
-  return BatteryCurrentVoltage;
+  if( BatteryCurrentMillivolts == 65535 )
+    return 99.0;
+  return BatteryCurrentMillivolts / 1000.0;
+}
+
+// Returns the current battery voltage in mV. Will return 65535 if the voltage hasn't been calculated yet.
+unsigned int NarfduinoBattery::GetCurrentMillivolts()
+{
+  return BatteryCurrentMillivolts;
+}
+
+// Returns the estimated voltage with no load, in mV
+unsigned int NarfduinoBattery::GetRestingMillivolts()
+{
+  return BatteryRestingMillivolts;
+}
+
+// Returns how far the voltage is being pulled down by the load, in mV
+unsigned int NarfduinoBattery::GetSagMillivolts()
+{
+  return BatterySagMillivolts;
+}
+
+// Returns the pack internal resistance learnt so far, in mOhms
+unsigned int NarfduinoBattery::GetInternalResistance()
+{
+  return InternalResistance;
+}
+
+// Load hint for the bridge. Speed from 1 to 100
+void NarfduinoBattery::SetBridgeLoad( bool Running, byte Speed )
+{
+  if( !Running )
+    BridgeLoadMilliamps = 0;
+  else if( Speed >= 100 )
+    BridgeLoadMilliamps = _NARFDUINO_BATTERY_BRIDGE_FULL_LOAD_MA;
+  else
+    BridgeLoadMilliamps = (uint32_t)_NARFDUINO_BATTERY_BRIDGE_FULL_LOAD_MA * Speed / 100;
+}
+
+// Load hint for the brushless flywheels. Throttle from 1000 - 2000us
+void NarfduinoBattery::SetBrushlessLoad( int Throttle )
+{
+  Throttle = constrain( Throttle, 1000, 2000 );
+  BrushlessLoadMilliamps = (uint32_t)_NARFDUINO_BATTERY_BRUSHLESS_FULL_LOAD_MA * (Throttle - 1000) / 1000;
 }
 
 // Gets the current BatteryS 
@@ -66,65 +190,287 @@ bool NarfduinoBattery::IsBatteryFlat()
   return BatteryFlat;
 }
 
+// Gets where the auto-detection is up to.
+byte NarfduinoBattery::GetDetectionState()
+{
+  return DetectionState;
+}
+
 // Sets the Battery S. Use this if you want to manually define the BatteryS instead of auto detecting it.
 void NarfduinoBattery::SetBatteryS( byte NewBatteryS )
+{
+  DetectionState = _NARFDUINO_BATTERY_DETECT_OFF;
+  ApplyBatteryS( NewBatteryS );
+}
+
+// Start auto-detecting the BatteryS. ProcessBatteryMonitor() does the work.
+void NarfduinoBattery::StartBatteryDetection()
+{
+  DetectionState = _NARFDUINO_BATTERY_DETECTING;
+  DetectionSamples = 0;
+  DetectionSampleTotal = 0;
+  RedetectCount = 0;
+  BatteryFlat = false;
+  // Start sampling at the detection rate straight away
+  LastCheck = millis() - _NARFDUINO_BATTERY_CHECK_INTERVAL;
+}
+
+// Auto-detection. Collect a full set of samples, quickly, then work out the BatteryS.
+// Once detected, watch for readings a long way off the resting voltage - the pack has been swapped.
+void NarfduinoBattery::ProcessDetectionSample( uint16_t Sample )
+{
+  if( DetectionState == _NARFDUINO_BATTERY_DETECTED )
+  {
+    // Only with nothing running. The sag can be more than the step - 32A through 120mOhms is 3.8V - and a pack can't be swapped mid-shot.
+    // With no load the sample is a resting one, so it's held against the resting voltage - the average can still have loaded samples in it.
+    if( BridgeLoadMilliamps != 0 || BrushlessLoadMilliamps != 0 || BatteryRestingMillivolts == 65535 )
+    {
+      RedetectCount = 0;
+      return;
+    }
+    unsigned int SampleMillivolts = SampleTotalToMillivolts( Sample * _NARFDUINO_BATTERY_NUM_SAMPLES );
+    unsigned int Step = (SampleMillivolts > BatteryRestingMillivolts) ? (SampleMillivolts - BatteryRestingMillivolts) : (BatteryRestingMillivolts - SampleMillivolts);
+    if( Step < _NARFDUINO_BATTERY_REDETECT_STEP_MV )
+    {
+      RedetectCount = 0;
+      return;
+    }
+    if( ++RedetectCount < _NARFDUINO_BATTERY_REDETECT_CONFIRM )
+      return;
+    StartBatteryDetection();
+  }
+
+  if( DetectionState != _NARFDUINO_BATTERY_DETECTING )
+    return;
+
+  DetectionSampleTotal += Sample;
+  if( ++DetectionSamples < _NARFDUINO_BATTERY_NUM_SAMPLES )
+    return;
+
+  uint16_t Total = DetectionSampleTotal;
+  DetectionSamples = 0;
+  DetectionSampleTotal = 0;
+
+  // No battery yet - keep looking
+  if( Total <= _NARFDUINO_BATTERY_NO_BATTERY_TOTAL )
+    return;
+
+  ApplyBatteryS( MillivoltsToBatteryS( SampleTotalToMillivolts( Total ) ) );
+  DetectionState = _NARFDUINO_BATTERY_DETECTED;
+  RedetectCount = 0;
+
+  // Start the average again from this pack
+  ResetSamples();
+  ProcessSampleTotal( Total, (uint32_t)(BridgeLoadMilliamps + BrushlessLoadMilliamps) * _NARFDUINO_BATTERY_NUM_SAMPLES );
+}
+
+// Throw away the samples collected so far
+void NarfduinoBattery::ResetSamples()
+{
+  CollectedSamples = 0;
+  CollectedSampleTotal = 0;
+  CollectedLoadTotal = 0;
+  LoadRingTotal = 0;
+  LoadRingHead = 0;
+  LoadRingCount = 0;
+  LastLoadSampleMillivolts = 65535;
+  uint8_t OldSREG = SREG;
+  cli();
+  SampleRingTotal = 0;
+  SampleRingHead = 0;
+  SampleRingCount = 0;
+  SREG = OldSREG;
+}
+
+// Sets up the thresholds for a BatteryS
+void NarfduinoBattery::ApplyBatteryS( byte NewBatteryS )
 {
   BatteryS = NewBatteryS;
   switch( BatteryS )
   {
     case 4:
-      BatteryMaxVoltage = _NARFDUINO_BATTERY_4S_MAX;
-      BatteryMinVoltage = _NARFDUINO_BATTERY_4S_MIN;
+      BatteryMaxMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_4S_MAX );
+      BatteryMinMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_4S_MIN );
       break;
     case 3:
-      BatteryMaxVoltage = _NARFDUINO_BATTERY_3S_MAX;
-      BatteryMinVoltage = _NARFDUINO_BATTERY_3S_MIN;
+      BatteryMaxMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_3S_MAX );
+      BatteryMinMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_3S_MIN );
       break;
     default:
-      BatteryMaxVoltage = _NARFDUINO_BATTERY_2S_MAX;
-      BatteryMinVoltage = _NARFDUINO_BATTERY_2S_MIN;
+      BatteryMaxMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_2S_MAX );
+      BatteryMinMillivolts = _NARFDUINO_BATTERY_VOLTS_TO_MV( _NARFDUINO_BATTERY_2S_MIN );
   }      
 }
 
+// Turn on background sampling.
+void NarfduinoBattery::EnableBackgroundSampling()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  SampleRingTotal = 0;
+  SampleRingHead = 0;
+  SampleRingCount = 0;
+  NewSampleReady = false;
+  BackgroundSampling = true;
+  SREG = OldSREG;
+  CollectedSamples = 0;
+  CollectedSampleTotal = 0;
+  CollectedLoadTotal = 0;
+  LoadRingTotal = 0;
+  LoadRingHead = 0;
+  LoadRingCount = 0;
+}
+
+// Called from the ADC interrupt, or NarfduinoADC::Poll(). Drop the sample into the ring, and keep the total up to date.
+void NarfduinoBattery::BackgroundSampleComplete( void *Context, uint16_t Value )
+{
+  NarfduinoBattery *Battery = (NarfduinoBattery *)Context;
+
+  if( Battery->SampleRingCount < _NARFDUINO_BATTERY_NUM_SAMPLES )
+    Battery->SampleRingCount++;
+  else
+    Battery->SampleRingTotal -= Battery->SampleRing[Battery->SampleRingHead];
+  Battery->SampleRing[Battery->SampleRingHead] = Value;
+  Battery->SampleRingTotal += Value;
+  Battery->LastSample = Value;
+  Battery->SampleRingHead++;
+  if( Battery->SampleRingHead >= _NARFDUINO_BATTERY_NUM_SAMPLES )
+    Battery->SampleRingHead = 0;
+  Battery->NewSampleReady = true;
+}
+
 // Run the battery monitor. This needs to be run at regular intervals.
 void NarfduinoBattery::ProcessBatteryMonitor()
 {
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_BATTERY );
+  // Sample quicker while detecting the BatteryS
+  unsigned int CheckInterval = _NARFDUINO_BATTERY_CHECK_INTERVAL;
+  if( DetectionState == _NARFDUINO_BATTERY_DETECTING )
+    CheckInterval = _NARFDUINO_BATTERY_DETECT_INTERVAL;
+
+  if( BackgroundSampling )
+  {
+    // Pick up any finished sample. Once the ring is full, every new sample updates the voltage.
+    NarfduinoADC::Poll();
+    if( NewSampleReady )
+    {
+      uint8_t OldSREG = SREG;
+      cli();
+      uint16_t Total = SampleRingTotal;
+      byte Count = SampleRingCount;
+      uint16_t Sample = LastSample;
+      NewSampleReady = false;
+      SREG = OldSREG;
+
+      ProcessDetectionSample( Sample );
+      if( DetectionState != _NARFDUINO_BATTERY_DETECTING )
+      {
+        ProcessLoadSample( Sample );
+
+        // Keep the load ring in step with the sample ring
+        unsigned int LoadMilliamps = BridgeLoadMilliamps + BrushlessLoadMilliamps;
+        if( LoadRingCount < _NARFDUINO_BATTERY_NUM_SAMPLES )
+          LoadRingCount++;
+        else
+          LoadRingTotal -= LoadRing[LoadRingHead];
+        LoadRing[LoadRingHead] = LoadMilliamps;
+        LoadRingTotal += LoadMilliamps;
+        LoadRingHead++;
+        if( LoadRingHead >= _NARFDUINO_BATTERY_NUM_SAMPLES )
+          LoadRingHead = 0;
+
+        if( Count >= _NARFDUINO_BATTERY_NUM_SAMPLES && LoadRingCount >= _NARFDUINO_BATTERY_NUM_SAMPLES )
+          ProcessSampleTotal( Total, LoadRingTotal );
+      }
+    }
+
+    // Kick off the next sample every 500ms. If the ADC is busy, try again next time.
+    if( millis() - LastCheck < CheckInterval )
+      return;
+    if( NarfduinoADC::StartConversion( BatteryPin, BackgroundSampleComplete, this ) )
+      LastCheck = millis();
+    return;
+  }
+
   // Check Battery every 500ms
-  if( millis() - LastCheck < _NARFDUINO_BATTERY_CHECK_INTERVAL )
+  if( millis() - LastCheck < CheckInterval )
   {
     return;
   }
   LastCheck = millis();
 
-  static byte CollectedSamples = 0;
-  static float SampleAverage = 0;
-  float SensorValue = analogRead( _NARFDUINO_PIN_BATTERY );
+  uint16_t SensorValue = analogRead( BatteryPin );
+  ProcessDetectionSample( SensorValue );
+  if( DetectionState == _NARFDUINO_BATTERY_DETECTING )
+    return;
+  ProcessLoadSample( SensorValue );
+
   if( CollectedSamples < _NARFDUINO_BATTERY_NUM_SAMPLES )
   {
     CollectedSamples ++;
-    SampleAverage += SensorValue;
+    CollectedSampleTotal += SensorValue;
+    CollectedLoadTotal += BridgeLoadMilliamps + BrushlessLoadMilliamps;
   }
   else
   {
-    BatteryCurrentVoltage = (((float)SampleAverage / (float)CollectedSamples * 5.0)  / 1024.0 * (float)((47.0 + 10.0) / 10.0)) + (float)_NARFDUINO_BATTERY_CALFACTOR;  // Voltage dividor - 47k and 10k
-    if( BatteryCurrentVoltage < BatteryMinVoltage )
+    ProcessSampleTotal( CollectedSampleTotal, CollectedLoadTotal );
+    CollectedSamples = 0;
+    CollectedSampleTotal = 0;
+    CollectedLoadTotal = 0;
+  }
+}
+
+// Learn the internal resistance from two readings at different loads - the voltage drops by the resistance times the extra current.
+void NarfduinoBattery::ProcessLoadSample( uint16_t Sample )
+{
+  unsigned int SampleMillivolts = SampleTotalToMillivolts( Sample * _NARFDUINO_BATTERY_NUM_SAMPLES );
+  unsigned int LoadMilliamps = BridgeLoadMilliamps + BrushlessLoadMilliamps;
+
+  if( LastLoadSampleMillivolts != 65535 )
+  {
+    long LoadStep = (long)LoadMilliamps - LastLoadSampleMilliamps;
+    if( LoadStep >= _NARFDUINO_BATTERY_IR_MIN_STEP_MA || LoadStep <= -_NARFDUINO_BATTERY_IR_MIN_STEP_MA )
     {
-      if( BatteryCurrentVoltage > 1.6 ) // If the current voltage is 0, we are probably debugging
-      {
-        BatteryFlat = true;
-      }
-      else
-      {
-        BatteryFlat = false;
-      }
+      // mV * 1000 / mA = mOhms. Anything outside the sensible range is a transient, and is ignored.
+      long Resistance = ((long)LastLoadSampleMillivolts - SampleMillivolts) * 1000L / LoadStep;
+      if( Resistance > 0 && Resistance < _NARFDUINO_BATTERY_IR_MAX_MOHMS )
+        InternalResistance += (Resistance - (long)InternalResistance) / _NARFDUINO_BATTERY_IR_FILTER;
     }
-    else
-    {
-      BatteryFlat = false;
-    } 
-    BatteryPercent = map( (int)(BatteryCurrentVoltage * 10), (int)(BatteryMinVoltage * 10), (int)(BatteryMaxVoltage * 10), 1, 100 );
-    CollectedSamples = 0;
-    SampleAverage = 0;
+  }
+  LastLoadSampleMillivolts = SampleMillivolts;
+  LastLoadSampleMilliamps = LoadMilliamps;
+}
+
+// Works out the voltage, flat state and percentage from the total of _NARFDUINO_BATTERY_NUM_SAMPLES ADC readings
+void NarfduinoBattery::ProcessSampleTotal( uint16_t SampleTotal, uint32_t LoadTotal )
+{
+  BatteryCurrentMillivolts = SampleTotalToMillivolts( SampleTotal );
+
+  // Put back what the load is pulling off. mA * mOhms = uV.
+  BatterySagMillivolts = (((LoadTotal + _NARFDUINO_BATTERY_NUM_SAMPLES / 2) / _NARFDUINO_BATTERY_NUM_SAMPLES) * InternalResistance + 500UL) / 1000UL;
+  BatteryRestingMillivolts = BatteryCurrentMillivolts + BatterySagMillivolts;
+
+  // The flat check uses the resting voltage, so it doesn't trip under load. It compares mV, not a sample total worked out 
+  // in ApplyBatteryS() - the sag is in mV, from the learnt resistance, and the percentage needs the resting mV anyway, 
+  // so a sample total threshold would only add a conversion of the sag back to ADC counts.
+  if( BatteryRestingMillivolts < BatteryMinMillivolts && SampleTotal > _NARFDUINO_BATTERY_NO_BATTERY_TOTAL ) // If the current voltage is 0, we are probably debugging
+    BatteryFlat = true;
+  else
+    BatteryFlat = false;
+
+  if( BatteryRestingMillivolts <= BatteryMinMillivolts )
+    BatteryPercent = 1;
+  else if( BatteryRestingMillivolts >= BatteryMaxMillivolts )
+    BatteryPercent = 100;
+  else
+  {
+#if _NARFDUINO_BATTERY_CHEMISTRY == _NARFDUINO_BATTERY_CHEMISTRY_LINEAR
+    BatteryPercent = map( BatteryRestingMillivolts, BatteryMinMillivolts, BatteryMaxMillivolts, 1, 100 );
+#else
+    BatteryPercent = CellMillivoltsToPercent( BatteryRestingMillivolts / BatteryS );
+    if( BatteryPercent < 1 )
+      BatteryPercent = 1;
+#endif
   }
 }
 
@@ -135,28 +481,18 @@ void NarfduinoBattery::SetupSelectBattery()
 {
   #define SAMPLE_DELAY 10
 
-  byte CollectedSamples = 0;
-  float SampleAverage = 0;
+  uint16_t SampleTotal = 0;
 
   for( byte c = 0; c < _NARFDUINO_BATTERY_NUM_SAMPLES; c++)
   {
-    float SensorValue = analogRead( _NARFDUINO_PIN_BATTERY );
-    CollectedSamples ++;
-    SampleAverage += SensorValue;
+    uint16_t SensorValue = analogRead( BatteryPin );
+    SampleTotal += SensorValue;
     delay( SAMPLE_DELAY );
   }
 
-  BatteryCurrentVoltage = (((float)SampleAverage / (float)CollectedSamples * 5.0)  / 1024.0 * (float)((47.0 + 10.0) / 10.0)) + (float)_NARFDUINO_BATTERY_CALFACTOR;  // Voltage dividor - 47k and 10k
-  
-  if( BatteryCurrentVoltage < _NARFDUINO_BATTERY_4S_MIN )
-  {
-    if( BatteryCurrentVoltage < _NARFDUINO_BATTERY_3S_MIN )
-      SetBatteryS( 2 );
-    else
-      SetBatteryS( 3 );
-  }
-  else
-    SetBatteryS( 4 );
+  BatteryCurrentMillivolts = SampleTotalToMillivolts( SampleTotal );
+  BatteryRestingMillivolts = BatteryCurrentMillivolts;
+  SetBatteryS( MillivoltsToBatteryS( BatteryCurrentMillivolts ) );
 
 }
     
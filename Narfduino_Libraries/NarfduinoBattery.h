@@ -35,6 +35,7 @@
 #endif
 
 // This is to check the number of samples before the voltage is calculated. Increase to improve accuracy and ride out sags. Decrease to get a snappier battery read
+// Max 64.
 #ifndef _NARFDUINO_BATTERY_NUM_SAMPLES
   #define _NARFDUINO_BATTERY_NUM_SAMPLES 6
 #endif
@@ -44,6 +45,57 @@
   #define _NARFDUINO_BATTERY_CALFACTOR 0.0
 #endif
 
+// The voltage divider on the battery pin (top and bottom resistor, in k), and the ADC reference in mV. Narfduino is 47k / 10k on 5V.
+#ifndef _NARFDUINO_BATTERY_DIVIDER_HIGH
+  #define _NARFDUINO_BATTERY_DIVIDER_HIGH 47
+#endif
+#ifndef _NARFDUINO_BATTERY_DIVIDER_LOW
+  #define _NARFDUINO_BATTERY_DIVIDER_LOW 10
+#endif
+#ifndef _NARFDUINO_BATTERY_VREF_MV
+  #define _NARFDUINO_BATTERY_VREF_MV 5000
+#endif
+
+
+// Time between samples while auto-detecting the BatteryS, in ms
+#ifndef _NARFDUINO_BATTERY_DETECT_INTERVAL
+  #define _NARFDUINO_BATTERY_DETECT_INTERVAL 10
+#endif
+
+// If auto-detection is on, a reading this far from the resting voltage (in mV) means the pack has been swapped. The BatteryS is detected again.
+// Only checked while both load hints are 0 - see SetBridgeLoad() / SetBrushlessLoad().
+#ifndef _NARFDUINO_BATTERY_REDETECT_STEP_MV
+  #define _NARFDUINO_BATTERY_REDETECT_STEP_MV 3000
+#endif
+
+// Load hints - the current the pack supplies with the bridge at 100%, and the flywheels at full throttle, in mA.
+// Used with SetBridgeLoad() / SetBrushlessLoad() to work out the sag under load. Only needs to be in the right ballpark.
+#ifndef _NARFDUINO_BATTERY_BRIDGE_FULL_LOAD_MA
+  #define _NARFDUINO_BATTERY_BRIDGE_FULL_LOAD_MA 12000
+#endif
+#ifndef _NARFDUINO_BATTERY_BRUSHLESS_FULL_LOAD_MA
+  #define _NARFDUINO_BATTERY_BRUSHLESS_FULL_LOAD_MA 20000
+#endif
+
+// Pack internal resistance (including wiring) to start from, in mOhms. It is learnt from the readings as the load changes.
+#ifndef _NARFDUINO_BATTERY_DEFAULT_IR_MOHMS
+  #define _NARFDUINO_BATTERY_DEFAULT_IR_MOHMS 50
+#endif
+
+// The load has to change by at least this much between readings (in mA) before they are used to learn the internal resistance
+#ifndef _NARFDUINO_BATTERY_IR_MIN_STEP_MA
+  #define _NARFDUINO_BATTERY_IR_MIN_STEP_MA 3000
+#endif
+
+// Battery chemistry, for the discharge curve GetBatteryPercent() follows. Pick one of the chemistries below.
+// _NARFDUINO_BATTERY_CHEMISTRY_LINEAR is a straight line between the Min and Max voltages.
+#define _NARFDUINO_BATTERY_CHEMISTRY_LINEAR 0
+#define _NARFDUINO_BATTERY_CHEMISTRY_LIPO 1
+#define _NARFDUINO_BATTERY_CHEMISTRY_LIION 2
+#define _NARFDUINO_BATTERY_CHEMISTRY_LIHV 3
+#ifndef _NARFDUINO_BATTERY_CHEMISTRY
+  #define _NARFDUINO_BATTERY_CHEMISTRY _NARFDUINO_BATTERY_CHEMISTRY_LIPO
+#endif
 
 // This defines the Min and Max voltage thresholds for 2s, 3s, and 4s batteries
 #ifndef _NARFDUINO_BATTERY_2S_MIN
@@ -66,6 +118,11 @@
 #endif
 
 
+// Auto-detection states - GetDetectionState()
+#define _NARFDUINO_BATTERY_DETECT_OFF 0   // Auto-detection is off. BatteryS is from SetBatteryS() or SetupSelectBattery()
+#define _NARFDUINO_BATTERY_DETECTING 1    // Sampling to work out the BatteryS. Voltage, percent and flat are not updated yet.
+#define _NARFDUINO_BATTERY_DETECTED 2     // BatteryS has been detected. Watching for a pack swap.
+
 // Header definitions
 
 class NarfduinoBattery
@@ -88,8 +145,25 @@ class NarfduinoBattery
     void SetupSelectBattery();
     
     // Sets the Battery S. Use this if you want to manually define the BatteryS instead of auto detecting it.
+    // Turns off StartBatteryDetection()
     void SetBatteryS( byte NewBatteryS );
 
+    // Auto-detect the BatteryS without blocking. The detection runs from ProcessBatteryMonitor().
+    // Once detected, it will detect again by itself if the voltage jumps - e.g. a pack swap - so you don't need to reboot.
+    void StartBatteryDetection();
+
+    // Load hints. Keep these up to date from your main loop, and the monitor will take the sag under load out of the readings.
+    // The resting voltage is used for the percentage and the flat check, so firing doesn't trip IsBatteryFlat().
+    // e.g. Battery.SetBridgeLoad( Bridge.IsBridgeRunning(), Bridge.GetBridgeSpeed() ); Battery.SetBrushlessLoad( Brushless.GetSpeed() );
+    void SetBridgeLoad( bool Running, byte Speed ); // Speed from 1 to 100
+    void SetBrushlessLoad( int Throttle ); // Throttle from 1000 - 2000us, as passed to UpdateSpeed()
+
+    // Sample the battery in the background through NarfduinoADC, instead of waiting on analogRead() in ProcessBatteryMonitor().
+    // The samples come back from the ADC interrupt with _NARFDUINO_ENABLE_ADC_INTERRUPT, otherwise on the next ProcessBatteryMonitor().
+    // The last _NARFDUINO_BATTERY_NUM_SAMPLES samples are kept, and the voltage is their average - updated with every new sample.
+    // Don't use analogRead() elsewhere in your code while this is on.
+    void EnableBackgroundSampling();
+
 
     // ************************************
     // Runtime Functions - Call as required
@@ -97,11 +171,26 @@ class NarfduinoBattery
     
     // Returns the current battery voltage. Will return 99.0 if the voltage hasn't been calculated yet.
     float GetCurrentVoltage();
+
+    // Returns the current battery voltage in mV. Cheaper than GetCurrentVoltage(). Will return 65535 if the voltage hasn't been calculated yet.
+    unsigned int GetCurrentMillivolts();
     
+    // Returns the estimated voltage with no load, in mV. This is the voltage the percentage and flat check use. Will return 65535 if the voltage hasn't been calculated yet.
+    unsigned int GetRestingMillivolts();
+
+    // Returns how far the voltage is being pulled down by the load, in mV
+    unsigned int GetSagMillivolts();
+
+    // Returns the pack internal resistance learnt so far, in mOhms
+    unsigned int GetInternalResistance();
+
     // Gets the current BatteryS 
     byte GetBatteryS();
+
+    // Gets where the auto-detection is up to. _NARFDUINO_BATTERY_DETECT_OFF, _NARFDUINO_BATTERY_DETECTING or _NARFDUINO_BATTERY_DETECTED
+    byte GetDetectionState();
     
-    // Gets the current percentage of battery remaining
+    // Gets the current percentage of battery remaining. Follows the discharge curve for _NARFDUINO_BATTERY_CHEMISTRY.
     byte GetBatteryPercent();
     
     // Gets an indication if the battery is flat
@@ -111,14 +200,66 @@ class NarfduinoBattery
     void ProcessBatteryMonitor();
 
   private:
+    // Works out the voltage, flat state and percentage from the total of _NARFDUINO_BATTERY_NUM_SAMPLES ADC readings, 
+    // and the total of the load hints at the time of each reading
+    void ProcessSampleTotal( uint16_t SampleTotal, uint32_t LoadTotal );
+
+    // Takes every raw sample with the load hint when it was taken. Learns the internal resistance, and keeps the load total for the average.
+    void ProcessLoadSample( uint16_t Sample );
+
+    // Sets up the thresholds for a BatteryS
+    void ApplyBatteryS( byte NewBatteryS );
+
+    // Auto-detection - takes every raw sample
+    void ProcessDetectionSample( uint16_t Sample );
+
+    // Throws away the samples collected so far. The average starts again.
+    void ResetSamples();
+
+    // Background sampling - called from the ADC interrupt or NarfduinoADC::Poll() with a finished sample
+    static void BackgroundSampleComplete( void *Context, uint16_t Value );
+
     byte BatteryPin = 255;
     unsigned long LastCheck = 0;
-    float BatteryCurrentVoltage = 99.0;
+    unsigned int BatteryCurrentMillivolts = 65535;
     bool BatteryFlat = false;
     byte BatteryPercent = 100;
-    float BatteryMaxVoltage;
-    float BatteryMinVoltage;
+    unsigned int BatteryMaxMillivolts;
+    unsigned int BatteryMinMillivolts;
+
+    // Load compensation
+    unsigned int BatteryRestingMillivolts = 65535;
+    unsigned int BatterySagMillivolts = 0;
+    unsigned int BridgeLoadMilliamps = 0;
+    unsigned int BrushlessLoadMilliamps = 0;
+    unsigned int InternalResistance = _NARFDUINO_BATTERY_DEFAULT_IR_MOHMS;
+    unsigned int LastLoadSampleMillivolts = 65535; // The last sample, and the load it was taken at, for the resistance estimate
+    unsigned int LastLoadSampleMilliamps = 0;
+
+    // Samples collected with analogRead()
+    byte CollectedSamples = 0;
+    uint16_t CollectedSampleTotal = 0;
+    uint32_t CollectedLoadTotal = 0;
+
+    // Auto-detection
+    byte DetectionState = _NARFDUINO_BATTERY_DETECT_OFF;
+    byte DetectionSamples = 0;
+    uint16_t DetectionSampleTotal = 0;
+    byte RedetectCount = 0; // Readings in a row that are a long way from the voltage
     byte BatteryS = 3;    
+
+    // Background sampling. The ring and its running total are filled by the ADC interrupt.
+    bool BackgroundSampling = false;
+    volatile uint16_t SampleRing[_NARFDUINO_BATTERY_NUM_SAMPLES];
+    volatile uint16_t SampleRingTotal = 0;
+    volatile byte SampleRingHead = 0;
+    volatile byte SampleRingCount = 0;
+    volatile uint16_t LastSample = 0;
+    volatile bool NewSampleReady = false;
+    unsigned int LoadRing[_NARFDUINO_BATTERY_NUM_SAMPLES]; // The load hint for each sample in the ring. Kept in step by the main loop.
+    uint32_t LoadRingTotal = 0;
+    byte LoadRingHead = 0;
+    byte LoadRingCount = 0;
 };
 
 #endif 
\ No newline at end of file
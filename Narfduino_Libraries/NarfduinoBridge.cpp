@@ -26,227 +26,645 @@
 
 #include "Arduino.h"
 #include "NarfduinoBridge.h"
+#include "NarfduinoBridgeDriver.h"
+
+NarfduinoBridgeBase *NarfduinoBridgeBase::TimedDeadTimeBridge = NULL;
+NarfduinoBridgeBase::TransitionFunction NarfduinoBridgeBase::TimedTransitionStart = NULL;
+NarfduinoBridgeBase::TransitionFunction NarfduinoBridgeBase::TimedTransitionFinish = NULL;
+NarfduinoBridgeBase *NarfduinoBridgeBase::PWMTimerBridge[2] = { NULL, NULL };
+NarfduinoBridgeBase *NarfduinoBridgeBase::SwitchBridges[3] = { NULL, NULL, NULL };
+NarfduinoBridgeBase *NarfduinoBridgeBase::BatchBridge = NULL;
+NarfduinoBridgeGroup *NarfduinoBridgeBase::BatchGroup = NULL;
+
+// Fewest duty steps a timer PWM mode will accept. Any fewer and the frequency is too high to be any use.
+#define _NARFDUINO_BRIDGE_PWM_MIN_STEPS 20
+
+// Timer2 compare B - the dead-time is up. Compare B is used as tone() already has compare A.
+#ifdef _NARFDUINO_ENABLE_TIMED_DEAD_TIME
+ISR( TIMER2_COMPB_vect )
+{
+  NarfduinoBridgeBase::HandleDeadTimeInterrupt();
+}
+#endif
+
+#ifdef _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT
+// Pin change interrupts for the pusher switch, one per port
+ISR( PCINT0_vect )
+{
+  NarfduinoBridgeBase::HandleSwitchInterrupt( 0 );
+}
+
+ISR( PCINT1_vect )
+{
+  NarfduinoBridgeBase::HandleSwitchInterrupt( 1 );
+}
+
+ISR( PCINT2_vect )
+{
+  NarfduinoBridgeBase::HandleSwitchInterrupt( 2 );
+}
+#endif
+
+
+// Constructors - simple stuff. The packed flags can't have defaults where they're declared, so they start here.
+NarfduinoBridgeBase::NarfduinoBridgeBase() :
+  LastBridgeRequest( true ), BridgeRequest( false ), AdaptiveAntiJam( true ), CycleRunning( false ), JamDetected( false ),
+  BridgeStopping( false ), AntiJamEnabled( true ), TimedDeadTime( false ), SwitchActiveHigh( false ), Initialised( false )
+{
+}
 
-// Constructors - simple stuff
 NarfduinoBridge::NarfduinoBridge( byte RunPin, byte StopPin )
 {
   BridgeRunPin = RunPin;
   BridgeStopPin = StopPin;
 }
 
-NarfduinoBridge::NarfduinoBridge()
+NarfduinoBridge::NarfduinoBridge() : NarfduinoBridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP )
 {
-  NarfduinoBridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
 }
 
-// Init code. Set the pin modes and take them low.
-bool NarfduinoBridge::Init()
+// Resolve the port registers once, so the processing loop can write them directly
+void NarfduinoBridge::ResolvePins()
 {
-  if( BridgeRunPin == 255 )
-    return false;
-  if( BridgeStopPin == 255 )
-    return false;
-      
-  pinMode( BridgeRunPin, OUTPUT );
-  digitalWrite( BridgeRunPin, LOW );  
-  pinMode( BridgeStopPin, OUTPUT );
-  digitalWrite( BridgeStopPin, LOW );    
-  
-  return true;      
+  BridgeRunPort = portOutputRegister( digitalPinToPort( BridgeRunPin ) );
+  BridgeRunMask = digitalPinToBitMask( BridgeRunPin );
+  BridgeStopPort = portOutputRegister( digitalPinToPort( BridgeStopPin ) );
+  BridgeStopMask = digitalPinToBitMask( BridgeStopPin );
+}
+
+// The port can be shared with other outputs an interrupt writes, so the read-modify-write is done with interrupts off.
+void NarfduinoBridge::WriteRunPin( bool High )
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  if( High )
+    *BridgeRunPort |= BridgeRunMask;
+  else
+    *BridgeRunPort &= ~BridgeRunMask;
+  SREG = OldSREG;
+}
+
+void NarfduinoBridge::WriteStopPin( bool High )
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  if( High )
+    *BridgeStopPort |= BridgeStopMask;
+  else
+    *BridgeStopPort &= ~BridgeStopMask;
+  SREG = OldSREG;
 }
 
 
+unsigned int NarfduinoBridgeBase::GetPWMSteps()
+{
+  if( PWMMode == _NARFDUINO_BRIDGE_PWM_ANALOGWRITE )
+    return 255;
+  return PWMTop + 1;
+}
+
+// Find the smallest prescaler that can make the frequency, for the finest duty.
+bool NarfduinoBridgeBase::CalculatePWMTop( unsigned long Frequency, const unsigned int *Prescalers, byte NumPrescalers, uint16_t MaxTop, uint16_t &Top, uint8_t &ClockSelect )
+{
+  if( Frequency == 0 )
+    return false;
+  for( byte c = 0; c < NumPrescalers; c++ )
+  {
+    unsigned long Ticks = (F_CPU / Prescalers[c] + Frequency / 2) / Frequency;
+    if( Ticks <= (unsigned long)MaxTop + 1 )
+    {
+      if( Ticks < _NARFDUINO_BRIDGE_PWM_MIN_STEPS )
+        return false;
+      Top = Ticks - 1;
+      ClockSelect = c + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
 // Start the bridge. Change the status variables - the main processor will pick up the change and run it
-void NarfduinoBridge::StartBridge()
+// In timer mode, the dead-time starts straight away, from the driver that owns Timer2.
+void NarfduinoBridgeBase::StartBridge()
 {  
   BridgeStopping = false;
   BridgeRequest = true;
+  // The first cycle has the dead-time and spin-up in it as well, and isn't learnt
+  uint8_t OldSREG = SREG;
+  cli();
+  CycleRunning = false;
+  JamTimeout = min( GetLearntJamTimeout( RunSpeed ) + _NARFDUINO_ANTIJAM_START_ALLOWANCE + SoftStartTime, _NARFDUINO_PUSHER_MAX_CYCLE_TIME );
+  SREG = OldSREG;
   TimeLastPusherResetOrActivated = millis();
+  if( TimedDeadTime )
+    TimedTransitionStart( this );
 }
 
 // Stop  the bridge. Change the status variables - the main processor will pick up the change and stop it
-void NarfduinoBridge::StopBridge()
+// In timer mode, the dead-time starts straight away, from the driver that owns Timer2.
+void NarfduinoBridgeBase::StopBridge()
 {
   BridgeRequest = false;
+  CycleRunning = false;
+  if( TimedDeadTime )
+    TimedTransitionStart( this );
 }
 
 // This resets the Jam state. Bridge will not run in this state.
-void NarfduinoBridge::ResetJam()
+void NarfduinoBridgeBase::ResetJam()
 {
   JamDetected = false;
 }
 
 // Check to see if a Jam state has occurred.
-bool NarfduinoBridge::HasJammed()
+bool NarfduinoBridgeBase::HasJammed()
 {
   return JamDetected;
 }
 
 // Call every time a pusher resets home. This resets the Jam timer
-void NarfduinoBridge::PusherHeartbeat()
+void NarfduinoBridgeBase::PusherHeartbeat()
 {
-  TimeLastPusherResetOrActivated = millis();
+  RecordHeartbeat( micros(), millis() );
 }
 
-// Set the bridge speed. 1 - 100%
-void NarfduinoBridge::SetBridgeSpeed( byte NewBridgeSpeed )
+// The cycle it finishes is learnt if the bridge ran all the way through it.
+void NarfduinoBridgeBase::RecordHeartbeat( unsigned long Micros, unsigned long Millis )
 {
-  BridgeSpeed = NewBridgeSpeed;
+  TimeLastPusherResetOrActivated = Millis;
+  if( CycleRunning && !JamDetected )
+    LearnCycle( Micros - LastHeartbeatMicros );
+  CycleRunning = BridgeRequest;
+  LastHeartbeatMicros = Micros;
+  HeartbeatCount++;
+  if( BridgeRequest )
+    JamTimeout = GetLearntJamTimeout( RunSpeed );
 }
 
-byte NarfduinoBridge::GetBridgeSpeed()
+// Take the switch over. It starts in whatever state it's in now - a pusher sitting on home isn't a heartbeat.
+bool NarfduinoBridgeBase::AttachPusherSwitch( byte Pin, byte ActiveLevel, unsigned int DebounceMicros )
 {
-  return BridgeSpeed;
+#ifndef _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT
+  (void)Pin;
+  (void)ActiveLevel;
+  (void)DebounceMicros;
+  return false;
+#else
+  if( digitalPinToPCICR( Pin ) == 0 )
+    return false;
+  byte Port = digitalPinToPCICRbit( Pin );
+  if( SwitchBridges[Port] != NULL && SwitchBridges[Port] != this )
+    return false;
+  DetachPusherSwitch();
+
+  pinMode( Pin, (ActiveLevel == LOW) ? INPUT_PULLUP : INPUT );
+  SwitchInputPort = portInputRegister( digitalPinToPort( Pin ) );
+  SwitchMask = digitalPinToBitMask( Pin );
+  SwitchActiveHigh = (ActiveLevel != LOW);
+  SwitchDebounce = DebounceMicros;
+
+  uint8_t OldSREG = SREG;
+  cli();
+  SwitchPressed = (((*SwitchInputPort & SwitchMask) != 0) == SwitchActiveHigh);
+  SwitchChangeMicros = micros();
+  SwitchPressesSeen = SwitchPresses;
+  SwitchPin = Pin;
+  SwitchBridges[Port] = this;
+  *digitalPinToPCMSK( Pin ) |= (1 << digitalPinToPCMSKbit( Pin ));
+  PCIFR = (1 << Port);
+  PCICR |= (1 << Port);
+  SREG = OldSREG;
+  return true;
+#endif
 }
 
+void NarfduinoBridgeBase::DetachPusherSwitch()
+{
+  if( SwitchPin == 255 )
+    return;
+  byte Port = digitalPinToPCICRbit( SwitchPin );
+  uint8_t OldSREG = SREG;
+  cli();
+  volatile uint8_t *Mask = digitalPinToPCMSK( SwitchPin );
+  *Mask &= ~(1 << digitalPinToPCMSKbit( SwitchPin ));
+  if( *Mask == 0 )
+    PCICR &= ~(1 << Port);
+  SwitchBridges[Port] = NULL;
+  SwitchPin = 255;
+  SREG = OldSREG;
+}
 
-// Turns off anti-jam detection.. For flywheels or something.
-void NarfduinoBridge::DisableAntiJam()
+// Called from the pin change interrupts. Any pin on the port could have changed.
+void NarfduinoBridgeBase::HandleSwitchInterrupt( byte Port )
 {
-  AntiJamEnabled = false;
-  ResetJam();
+  if( SwitchBridges[Port] != NULL )
+    SwitchBridges[Port]->ReadPusherSwitch();
 }
 
-// Turns on anti-jam detection. Default state
-void NarfduinoBridge::EnableAntiJam()
+size_t NarfduinoBridgeBase::GetSharedRAM()
 {
-  AntiJamEnabled = true;
+  return sizeof( TimedDeadTimeBridge ) + sizeof( TimedTransitionStart ) + sizeof( TimedTransitionFinish ) + sizeof( SwitchBridges ) + 
+    sizeof( PWMTimerBridge ) + sizeof( BatchBridge ) + sizeof( BatchGroup );
 }
 
-// Processes the bridge and handle dead-time generation.
-void NarfduinoBridge::ProcessBridge()
+// Debounce by time. The first change after the switch has been still for the debounce time counts, and the bounce after it doesn't.
+// Bounce can leave the pin either way when the interrupt reads it, but the last edge always brings another interrupt with the settled level.
+void NarfduinoBridgeBase::ReadPusherSwitch()
 {
-  // Logic:
-  // 1 - Do we need to change? If so, initiate transition
-  // 2 - Are we in transition? If so, write digital 0 to both fets. Keep doing that
-  // 3 - Are we out of transition? If so, 
-  // 4.a  - Are we wanting to run? Are we already running or just out of transition?
-  //        If so, turn on Bridge fet, ensure brake fet is off
-  //        Else turn fets off, and start transition timer
-  // 4.b  - Are we wanting to stop? Are we already stoppedor just out of transition?
-  //        If so, turn off Bridge fet, and turn on brake fet
-  //        Else turn fets off and start transition timer
+  bool Pressed = (((*SwitchInputPort & SwitchMask) != 0) == SwitchActiveHigh);
+  if( Pressed == SwitchPressed )
+    return;
+  unsigned long Now = micros();
+  if( Now - SwitchChangeMicros < SwitchDebounce )
+    return;
+  SwitchPressed = Pressed;
+  SwitchChangeMicros = Now;
+  if( Pressed )
+  {
+    SwitchPressMicros[(byte)(SwitchPresses + 1) & 1] = Now;
+    SwitchPresses++;
+  }
+}
 
+// Pick up the presses the interrupt has seen, as heartbeats at the time they happened.
+void NarfduinoBridgeBase::CollectSwitchPresses()
+{
+  byte Presses;
+  unsigned long PressMicros;
+  do
+  {
+    Presses = SwitchPresses;
+    PressMicros = SwitchPressMicros[Presses & 1];
+  } while( Presses != SwitchPresses );
 
-  // Step 1 - initiate transition
-  if( LastBridgeRequest != BridgeRequest )
+  byte NewPresses = Presses - SwitchPressesSeen;
+  if( NewPresses )
   {
-    CurrentBridgeStatus = _NARFDUINO_BRIDGE_TRANSITION;
-    if( BridgeRequest )
+    SwitchPressesSeen = Presses;
+    // More than one since the last look - count them, but there's no telling how long each cycle took
+    if( NewPresses > 1 )
     {
-      SelectedTransitionTime = _NARFDUINO_BRIDGE_ON_TRANSITION_TIME;
+      CycleRunning = false;
+      HeartbeatCount += NewPresses - 1;
     }
-    else
+    unsigned long Now = micros();
+    RecordHeartbeat( PressMicros, millis() - (Now - PressMicros) / 1000 );
+  }
+
+  // A press shorter than the debounce time has its release lost in the bounce. Catch it up once the pin has settled.
+  if( SwitchPressed && (((*SwitchInputPort & SwitchMask) != 0) != SwitchActiveHigh) )
+  {
+    uint8_t OldSREG = SREG;
+    cli();
+    if( micros() - SwitchChangeMicros >= SwitchDebounce )
     {
-      SelectedTransitionTime = _NARFDUINO_BRIDGE_OFF_TRANSITION_TIME;
+      SwitchPressed = false;
+      SwitchChangeMicros = micros();
     }
-    BridgeTransitionStart = millis();
-    LastBridgeRequest = BridgeRequest;
+    SREG = OldSREG;
+  }
+}
+
+unsigned int NarfduinoBridgeBase::GetHeartbeatCount()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  unsigned int Count = HeartbeatCount;
+  SREG = OldSREG;
+  return Count;
+}
+
+unsigned long NarfduinoBridgeBase::GetLastHeartbeatMicros()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  unsigned long Micros = LastHeartbeatMicros;
+  SREG = OldSREG;
+  return Micros;
+}
+
+// Set the bridge speed. 1 - 100%
+void NarfduinoBridgeBase::SetBridgeSpeed( byte NewBridgeSpeed )
+{
+  SetBridgeSpeedFine( (unsigned int)NewBridgeSpeed * 10 );
+}
+
+// Set the bridge speed. 1 - 1000, in 0.1%
+void NarfduinoBridgeBase::SetBridgeSpeedFine( unsigned int NewBridgeSpeedFine )
+{
+  if( NewBridgeSpeedFine > 1000 )
+    NewBridgeSpeedFine = 1000;
+  BridgeSpeed = ToWholePercent( NewBridgeSpeedFine );
+  BridgeSpeedFine = NewBridgeSpeedFine;
+  UpdateRunSpeed();
+}
+
+// Hold the run FET at or below a speed. 1 - 100%
+void NarfduinoBridgeBase::SetSpeedLimit( byte MaxSpeed )
+{
+  SetSpeedLimitFine( (unsigned int)MaxSpeed * 10 );
+}
+
+// 1 - 1000, in 0.1%
+void NarfduinoBridgeBase::SetSpeedLimitFine( unsigned int MaxSpeedFine )
+{
+  MaxSpeedFine = constrain( MaxSpeedFine, 1, 1000 );
+  if( MaxSpeedFine == SpeedLimitFine )
     return;
+  SpeedLimitFine = MaxSpeedFine;
+  UpdateRunSpeed();
+}
+
+unsigned int NarfduinoBridgeBase::GetSpeedLimitFine()
+{
+  return SpeedLimitFine;
+}
+
+// The anti-jam works in whole percent. Anything above 0 is at least 1%.
+byte NarfduinoBridgeBase::ToWholePercent( unsigned int SpeedFine )
+{
+  byte Speed = (SpeedFine + 5) / 10;
+  if( SpeedFine && !Speed )
+    Speed = 1;
+  return Speed;
+}
+
+// The run FET is driven at the bridge speed, held under the speed limit
+void NarfduinoBridgeBase::UpdateRunSpeed()
+{
+  byte NewRunSpeed = ToWholePercent( min( BridgeSpeedFine, SpeedLimitFine ) );
+
+  // A cycle that started quicker gets the longer of the two timeouts
+  if( BridgeRequest && NewRunSpeed != RunSpeed )
+  {
+    unsigned int NewTimeout = GetLearntJamTimeout( NewRunSpeed );
+    uint8_t OldSREG = SREG;
+    cli();
+    if( NewTimeout > JamTimeout )
+      JamTimeout = NewTimeout;
+    SREG = OldSREG;
   }
+  RunSpeed = NewRunSpeed;
+  CalculateRunDuty();
+}
 
-  // Step 2 - wait for transition to complete. This is the dead-time.
-  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_TRANSITION )
+// Work out the duties here rather than every time through the loop. 
+void NarfduinoBridgeBase::CalculateRunDuty()
+{
+  uint16_t Duty = SpeedToDuty( min( BridgeSpeedFine, SpeedLimitFine ) );
+  uint16_t StartDuty = SpeedToDuty( (unsigned int)SoftStartSpeed * 10 );
+  // The soft start ramps to the top step rather than fully on, and hands over to fully on at the end
+  uint16_t Target = (Duty == _NARFDUINO_BRIDGE_FULL_DUTY) ? GetPWMSteps() : Duty;
+  uint32_t Step = 0;
+  if( SoftStartTime && Target > StartDuty )
+    Step = ((uint32_t)(Target - StartDuty) << 8) / SoftStartTime;
+
+  // The dead-time interrupt reads them
+  uint8_t OldSREG = SREG;
+  cli();
+  BridgeRunDuty = Duty;
+  SoftStartDuty = StartDuty;
+  SoftStartStep = Step;
+  SREG = OldSREG;
+}
+
+// Out of 255 for analogWrite, or in timer ticks - rounded, but never all the way to off or fully on.
+uint16_t NarfduinoBridgeBase::SpeedToDuty( unsigned int SpeedFine )
+{
+  if( SpeedFine >= 1000 )
+    return _NARFDUINO_BRIDGE_FULL_DUTY;
+  if( SpeedFine == 0 )
+    return 0;
+  uint16_t Steps = GetPWMSteps();
+  uint16_t Duty = ((uint32_t)SpeedFine * Steps + 500) / 1000;
+  return constrain( Duty, 1, Steps - 1 );
+}
+
+void NarfduinoBridgeBase::SetSoftStart( unsigned int RampTime, byte StartSpeed )
+{
+  SoftStartTime = RampTime;
+  SoftStartSpeed = constrain( StartSpeed, 1, 100 );
+  CalculateRunDuty();
+}
+
+void NarfduinoBridgeBase::SetBrakeStrength( byte Strength, unsigned int BrakeTime )
+{
+  BrakeStrength = constrain( Strength, 1, 100 );
+  this->BrakeTime = BrakeTime;
+  BrakeOnMicros = (unsigned long)_NARFDUINO_BRIDGE_BRAKE_PERIOD * BrakeStrength / 100;
+}
+
+// The run FET is coming on. Ramp it if the soft start has anywhere to go.
+void NarfduinoBridgeBase::StartSoftStart()
+{
+  SoftStartMillis = millis();
+  SoftStarting = (SoftStartStep != 0);
+}
+
+// The brake is coming on. Pulse it if it's not at full strength.
+void NarfduinoBridgeBase::StartSoftBrake()
+{
+  BrakeStartMicros = micros();
+  BrakePeriodStart = BrakeStartMicros;
+  SoftBraking = (BrakeStrength < 100);
+}
+
+uint16_t NarfduinoBridgeBase::GetRunDuty()
+{
+  if( !SoftStarting )
+    return BridgeRunDuty;
+  unsigned long Elapsed = millis() - SoftStartMillis;
+  uint16_t Target = (BridgeRunDuty == _NARFDUINO_BRIDGE_FULL_DUTY) ? GetPWMSteps() : BridgeRunDuty;
+  uint32_t Duty = SoftStartDuty + ((SoftStartStep * Elapsed) >> 8);
+  if( Elapsed >= SoftStartTime || Duty >= Target )
   {
-    digitalWrite( BridgeRunPin, LOW );
-    BridgePWMFETOn = false;
-    digitalWrite( BridgeStopPin, LOW );
-    BridgeBrakeFETOn = false;
-    if( millis() - BridgeTransitionStart <= SelectedTransitionTime )
-      return;
+    SoftStarting = false;
+    return BridgeRunDuty;
+  }
+  return Duty;
+}
 
-    // We are now out of transition
-    if( BridgeRequest )
-    {
-      CurrentBridgeStatus = _NARFDUINO_BRIDGE_RUN;
-    }
-    else
-    {
-      CurrentBridgeStatus = _NARFDUINO_BRIDGE_STOP;
-    }
-    
-    return;
+bool NarfduinoBridgeBase::IsBrakePulseOn()
+{
+  if( !SoftBraking )
+    return true;
+  unsigned long Now = micros();
+  if( BrakeTime && Now - BrakeStartMicros >= (unsigned long)BrakeTime * 1000UL )
+  {
+    SoftBraking = false;
+    return true;
   }
+  // Next period. If the loop has stalled for more than one, start again from now.
+  unsigned long InPeriod = Now - BrakePeriodStart;
+  if( InPeriod >= 2 * _NARFDUINO_BRIDGE_BRAKE_PERIOD )
+    BrakePeriodStart = Now;
+  else if( InPeriod >= _NARFDUINO_BRIDGE_BRAKE_PERIOD )
+    BrakePeriodStart += _NARFDUINO_BRIDGE_BRAKE_PERIOD;
+  return Now - BrakePeriodStart < BrakeOnMicros;
+}
 
-  // Bridge should now turn on.
-  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_RUN )
+byte NarfduinoBridgeBase::GetBridgeSpeed()
+{
+  return BridgeSpeed;
+}
+
+// Is the run FET on?
+bool NarfduinoBridgeBase::IsBridgeRunning()
+{
+  return CurrentBridgeStatus == _NARFDUINO_BRIDGE_RUN;
+}
+
+// Turns off anti-jam detection.. For flywheels or something.
+void NarfduinoBridgeBase::DisableAntiJam()
+{
+  AntiJamEnabled = false;
+  ResetJam();
+}
+
+// Turns on anti-jam detection. Default state
+void NarfduinoBridgeBase::EnableAntiJam()
+{
+  AntiJamEnabled = true;
+}
+
+void NarfduinoBridgeBase::EnableAdaptiveAntiJam()
+{
+  AdaptiveAntiJam = true;
+}
+
+void NarfduinoBridgeBase::DisableAdaptiveAntiJam()
+{
+  AdaptiveAntiJam = false;
+  JamTimeout = _NARFDUINO_PUSHER_MAX_CYCLE_TIME;
+}
+
+void NarfduinoBridgeBase::ResetAntiJamLearning()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  for( byte Band = 0; Band < _NARFDUINO_ANTIJAM_SPEED_BANDS; Band++ )
   {
-    // Check to make sure high fet is not on
-    if( BridgeBrakeFETOn )
-    {
-      return;
-    }
-    // Check to make sure that the Jam state isn't set
-    if( JamDetected )
-    {
-      digitalWrite( BridgeRunPin, LOW );
-      digitalWrite( BridgeStopPin, LOW );
-      return;
-    }
-    // Check to see if we have Jammed, if anti-jam is turned on. If so, halt the bridge and set the Jam state.
-    if( AntiJamEnabled )
-    {
-      if( (millis() - TimeLastPusherResetOrActivated) > _NARFDUINO_PUSHER_MAX_CYCLE_TIME )
-      {
-        // Jam detected, shut down fets.
-        digitalWrite( BridgeRunPin, LOW );
-        digitalWrite( BridgeStopPin, LOW );
-        JamDetected = true;
-        return;
-      }
-      else
-      {
-        JamDetected = false;
-      }
-    }
-    else
-    {
-      JamDetected = false;
-    }
+    CycleMean[Band] = 0;
+    CycleDeviation[Band] = 0;
+    CycleSamples[Band] = 0;
+  }
+  CycleRunning = false;
+  JamTimeout = _NARFDUINO_PUSHER_MAX_CYCLE_TIME;
+  SREG = OldSREG;
+}
 
-    // Ensure that the high side stays off.
-    digitalWrite( BridgeStopPin, LOW );
-    BridgeBrakeFETOn = false;
+unsigned int NarfduinoBridgeBase::GetJamTimeout()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  unsigned int Timeout = JamTimeout;
+  SREG = OldSREG;
+  return Timeout;
+}
 
-    // Handle a few different speed conditions.
-    if( BridgeSpeed == 100 )
-    {
-      // Digital write HIGH for 100%
-      digitalWrite( BridgeRunPin, HIGH );
-    }
-    else if( BridgeSpeed == 0 )
-    {
-      // Just in case we want 0%
-      digitalWrite( BridgeRunPin, LOW );
-    }
-    else
-    {
-      // PWM Write
-      int PWM = map( BridgeSpeed, 0, 100, 0, 255 );
-      analogWrite( BridgeRunPin, PWM );
-    }
-    BridgePWMFETOn = true;
-    
+byte NarfduinoBridgeBase::GetSpeedBand( byte Speed )
+{
+  if( Speed > 100 )
+    Speed = 100;
+  if( Speed == 0 )
+    Speed = 1;
+  return (unsigned int)(Speed - 1) * _NARFDUINO_ANTIJAM_SPEED_BANDS / 100;
+}
+
+// Mean + deviations + margin, scaled back from 100% to this speed.
+unsigned int NarfduinoBridgeBase::GetLearntJamTimeout( byte Speed )
+{
+  byte Band = GetSpeedBand( Speed );
+  if( !AdaptiveAntiJam || CycleSamples[Band] < _NARFDUINO_ANTIJAM_MIN_SAMPLES )
+    return _NARFDUINO_PUSHER_MAX_CYCLE_TIME;
+  if( Speed == 0 )
+    Speed = 1;
+  unsigned long Limit = (unsigned long)CycleMean[Band] + (unsigned long)_NARFDUINO_ANTIJAM_DEVIATIONS * CycleDeviation[Band];
+  Limit = Limit * 100UL / min( Speed, (byte)100 ) / 16 + _NARFDUINO_ANTIJAM_MARGIN;
+  return min( Limit, (unsigned long)_NARFDUINO_PUSHER_MAX_CYCLE_TIME );
+}
+
+// Running average and average deviation of the cycle time for the band, 1/8th of the way to each new cycle.
+// The first few go in harder so it settles quickly.
+void NarfduinoBridgeBase::LearnCycle( unsigned long CycleMicros )
+{
+  byte Band = GetSpeedBand( RunSpeed );
+  unsigned long Normalised = CycleMicros * min( RunSpeed, (byte)100 ) / 100UL * 16UL / 1000UL;
+  if( Normalised > 65535UL )
+    return;
+  if( CycleSamples[Band] == 0 )
+  {
+    CycleMean[Band] = Normalised;
+    CycleDeviation[Band] = Normalised / 16;
+    CycleSamples[Band] = 1;
     return;
   }
 
-  // Bridge should now turn off
-  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_STOP )
+  byte Shift = (CycleSamples[Band] < _NARFDUINO_ANTIJAM_MIN_SAMPLES) ? 2 : 3;
+  int32_t Error = (int32_t)Normalised - CycleMean[Band];
+  CycleMean[Band] += Error / (1 << Shift);
+  int32_t Deviation = (Error < 0) ? -Error : Error;
+  CycleDeviation[Band] += (Deviation - (int32_t)CycleDeviation[Band]) / (1 << Shift);
+  if( CycleSamples[Band] < 255 )
+    CycleSamples[Band]++;
+}
+
+// Hand Timer2 back. ProcessBridge() picks up from where the bridge is.
+void NarfduinoBridgeBase::DisableTimedDeadTime()
+{
+  if( TimedDeadTimeBridge != this )
+    return;
+
+  uint8_t OldSREG = SREG;
+  cli();
+  TCCR2B = 0;
+  TIMSK2 = 0;
+  TimedDeadTimeBridge = NULL;
+  TimedDeadTime = false;
+  // If we were part way through a dead-time, let ProcessBridge() run a full one
+  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_TRANSITION )
+    LastBridgeRequest = !BridgeRequest;
+  SREG = OldSREG;
+}
+
+// Set the dead-times for the timer mode.
+void NarfduinoBridgeBase::SetDeadTime( unsigned int OnTransitionMicros, unsigned int OffTransitionMicros )
+{
+  CalculateDeadTime( OnTransitionMicros, OnTransitionCompare, OnTransitionClock );
+  CalculateDeadTime( OffTransitionMicros, OffTransitionCompare, OffTransitionClock );
+}
+
+// Find the smallest Timer2 prescaler that can count the dead-time, for the best resolution.
+void NarfduinoBridgeBase::CalculateDeadTime( unsigned int Micros, uint8_t &Compare, uint8_t &ClockSelect )
+{
+  static const unsigned int Prescalers[] = { 1, 8, 32, 64, 128, 256, 1024 };
+
+  if( Micros > 16000 )
+    Micros = 16000;
+  for( byte c = 0; c < sizeof( Prescalers ) / sizeof( Prescalers[0] ); c++ )
   {
-    // Check to make sure low fet is not on
-    if( BridgePWMFETOn )
+    // Round up - the dead-time must never come out short.
+    unsigned long Ticks = ((unsigned long)Micros * (F_CPU / 1000000UL) + Prescalers[c] - 1) / Prescalers[c];
+    if( Ticks <= 255 )
     {
+      if( Ticks == 0 )
+        Ticks = 1;
+      Compare = Ticks;
+      ClockSelect = c + 1;
       return;
     }
-
-    // Ensure the low fet stays off
-    digitalWrite( BridgeRunPin, LOW );
-    BridgePWMFETOn = false;
-
-    // Activate the brake
-    digitalWrite( BridgeStopPin, HIGH );
-    BridgeBrakeFETOn = true;
-
-    return;
   }
 }
+
+// Called from the Timer2 interrupt.
+void NarfduinoBridgeBase::HandleDeadTimeInterrupt()
+{
+  // One-shot. Stop the timer until the next transition
+  TCCR2B = 0;
+  TIMSK2 = 0;
+  if( TimedDeadTimeBridge != NULL )
+    TimedTransitionFinish( TimedDeadTimeBridge );
+}
+
+// The FET driving half of NarfduinoBridge. NarfduinoBridgePins builds its own, for its pins, wherever it's used.
+template class NarfduinoBridgeDriver<NarfduinoBridge>;
@@ -29,6 +29,8 @@
 
 #include "Arduino.h"
 
+class NarfduinoBridgeGroup;
+
 // Default Definitions
 
 // This is the time it takes for the Stop FETs to discharge in ms
@@ -41,12 +43,85 @@
   #define _NARFDUINO_BRIDGE_OFF_TRANSITION_TIME 2 
 #endif
 
+// Uncomment this (or add it to your build flags) to let the bridge generate the dead-time with Timer2 - see EnableTimedDeadTime().
+// It takes the Timer2 compare B vector, so it can't be used alongside other Timer2 libraries. Without it EnableTimedDeadTime() returns false.
+//#define _NARFDUINO_ENABLE_TIMED_DEAD_TIME
+
+// Dead-times in us used when the hardware timer generates the dead-time - see EnableTimedDeadTime(). Max 16000us.
+// Defaults match the ms values above. Bring them down to what your FETs actually need.
+#ifndef _NARFDUINO_BRIDGE_ON_TRANSITION_MICROS
+  #define _NARFDUINO_BRIDGE_ON_TRANSITION_MICROS ((unsigned int)_NARFDUINO_BRIDGE_ON_TRANSITION_TIME * 1000)
+#endif
+#ifndef _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS
+  #define _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS ((unsigned int)_NARFDUINO_BRIDGE_OFF_TRANSITION_TIME * 1000)
+#endif
+
+// Run FET PWM frequency in Hz for the timer PWM modes - see SetPWMMode(). 20kHz is above hearing.
+#ifndef _NARFDUINO_BRIDGE_PWM_FREQUENCY
+  #define _NARFDUINO_BRIDGE_PWM_FREQUENCY 20000
+#endif
+
+// Soft start. Each time the run FET comes on, its duty ramps up from the start speed (%) to the bridge speed over this many ms. 0 = off.
+#ifndef _NARFDUINO_BRIDGE_SOFT_START_TIME
+  #define _NARFDUINO_BRIDGE_SOFT_START_TIME 0
+#endif
+#ifndef _NARFDUINO_BRIDGE_SOFT_START_SPEED
+  #define _NARFDUINO_BRIDGE_SOFT_START_SPEED 30
+#endif
+
+// Brake strength in %. Below 100, the brake FET is pulsed for the brake time (ms) after the dead-time, then held fully on.
+// The pulses are timed by ProcessBridge(), over a period in us - call it a good few times a period.
+#ifndef _NARFDUINO_BRIDGE_BRAKE_STRENGTH
+  #define _NARFDUINO_BRIDGE_BRAKE_STRENGTH 100
+#endif
+#ifndef _NARFDUINO_BRIDGE_BRAKE_TIME
+  #define _NARFDUINO_BRIDGE_BRAKE_TIME 20
+#endif
+#ifndef _NARFDUINO_BRIDGE_BRAKE_PERIOD
+  #define _NARFDUINO_BRIDGE_BRAKE_PERIOD 1000
+#endif
+
 // This is the Pusher Reset Switch heartbeat interval time in ms. 
 // If we don't hear it, we have probably stalled the pusher. Stop the bridge before something burns out.
 #ifndef _NARFDUINO_PUSHER_MAX_CYCLE_TIME
   #define _NARFDUINO_PUSHER_MAX_CYCLE_TIME 500   
 #endif
 
+// Pusher reset switch debounce in us, when the bridge reads the switch itself - see AttachPusherSwitch().
+// A change within this long of the last one is bounce.
+#ifndef _NARFDUINO_PUSHER_DEBOUNCE_MICROS
+  #define _NARFDUINO_PUSHER_DEBOUNCE_MICROS 2000
+#endif
+
+// Uncomment this (or add it to your build flags) to let the bridge read the pusher switch from the pin change interrupts.
+// It takes all three PCINT vectors, so it can't be used alongside SoftwareSerial and the like. Without it AttachPusherSwitch() 
+// returns false, and the sketch polls the switch and calls PusherHeartbeat().
+//#define _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT
+
+// Adaptive anti-jam. The bridge learns how long a pusher cycle takes at each speed, and trips once a cycle runs 
+// this many average deviations plus the margin (ms) over the average. Never slower than _NARFDUINO_PUSHER_MAX_CYCLE_TIME.
+#ifndef _NARFDUINO_ANTIJAM_DEVIATIONS
+  #define _NARFDUINO_ANTIJAM_DEVIATIONS 4
+#endif
+#ifndef _NARFDUINO_ANTIJAM_MARGIN
+  #define _NARFDUINO_ANTIJAM_MARGIN 10
+#endif
+
+// Extra time allowed for the first cycle after StartBridge(), for the dead-time and spin-up, in ms
+#ifndef _NARFDUINO_ANTIJAM_START_ALLOWANCE
+  #define _NARFDUINO_ANTIJAM_START_ALLOWANCE 60
+#endif
+
+// Cycles learnt at a speed before the learnt time is used there
+#ifndef _NARFDUINO_ANTIJAM_MIN_SAMPLES
+  #define _NARFDUINO_ANTIJAM_MIN_SAMPLES 8
+#endif
+
+// Speed bands the cycle times are learnt in. Each costs 5 bytes of RAM.
+#ifndef _NARFDUINO_ANTIJAM_SPEED_BANDS
+  #define _NARFDUINO_ANTIJAM_SPEED_BANDS 4
+#endif
+
 
 // Pin Definitions
 // Gate for the N Fet
@@ -59,24 +134,27 @@
 #endif
 
 
+// Run FET PWM modes
+#define _NARFDUINO_BRIDGE_PWM_ANALOGWRITE 0 // analogWrite() - Timer0 on pin 5 at 980Hz, 255 steps. Default.
+#define _NARFDUINO_BRIDGE_PWM_TIMER1 1      // Timer1 on pin 9 or 10. 16 bit - can't be used with NarfduinoBrushless
+#define _NARFDUINO_BRIDGE_PWM_TIMER2 2      // Timer2 on pin 3. Can't be used with EnableTimedDeadTime()
+
+
 // Internal flags
 #define _NARFDUINO_BRIDGE_STOP 0     // Bridge brake is on, PWM is off
 #define _NARFDUINO_BRIDGE_TRANSITION 1  // Bridge brake is off, PWM is off, waiting for fet caps to discharge
 #define _NARFDUINO_BRIDGE_RUN 2         // Bridge brake is off, PWM is on
 
-class NarfduinoBridge
+// Run FET duty for fully on
+#define _NARFDUINO_BRIDGE_FULL_DUTY 0xFFFF
+
+// Everything about a bridge but its pins - the speeds, anti-jam, pusher switch and dead-time settings.
+// Take one of these when you don't need to know which pins a bridge is on - NarfduinoPusher, NarfduinoGovernor and the like do. 
+// The bridges themselves are NarfduinoBridge, or NarfduinoBridgePins in NarfduinoBridgePins.h.
+class NarfduinoBridgeBase
 {
     public:
 
-      // Constructors
-      NarfduinoBridge();
-      NarfduinoBridge( byte RunPin, byte StopPin ); // Use if you want to override the default pins - such as adding an additional bridge
-      
-
-      // Initialisation function - Call only once in your startup code
-      bool Init();
-
-
       // **********************************
       // Status and configuration functions
       // **********************************
@@ -84,18 +162,63 @@ class NarfduinoBridge
       // Determines if the pusher has jammed.
       bool HasJammed();
       
+      // Determines if the bridge is driving the motor - the run FET is on. False while stopped, or in the dead-time.
+      bool IsBridgeRunning();
+
       // Find out what the current bridge speed is - from 1 to 100 
       byte GetBridgeSpeed();
       
       // Set the bridge speed - from 1 to 100.
       void SetBridgeSpeed( byte NewBridgeSpeed );
 
+      // Set the bridge speed in 0.1% steps - from 1 to 1000. Use with a timer PWM mode for smoother low speed control.
+      void SetBridgeSpeedFine( unsigned int NewBridgeSpeed );
+
+      // Hold the run FET at or below MaxSpeed (1 - 100), whatever the bridge speed is set to. 100 = no limit, which is the default.
+      // GetBridgeSpeed() still gives the speed that was set, and the bridge goes back to it when the limit lifts. The anti-jam goes by the limited speed.
+      // Used by NarfduinoPowerGovernor to keep the pack up on a tired battery.
+      void SetSpeedLimit( byte MaxSpeed );
+
+      // The same, in 0.1% steps - from 1 to 1000
+      void SetSpeedLimitFine( unsigned int MaxSpeedFine );
+      unsigned int GetSpeedLimitFine();
+
+      // Ramp the run FET up from StartSpeed (1 - 100%) to the bridge speed over RampTime ms, every time the bridge starts. 
+      // Takes the edge off the inrush current. RampTime 0 = off. Default off.
+      void SetSoftStart( unsigned int RampTime, byte StartSpeed = _NARFDUINO_BRIDGE_SOFT_START_SPEED );
+
+      // Brake at Strength (1 - 100%) for BrakeTime ms after stopping, then fully on to hold. BrakeTime 0 = brake at this strength until the next start. 
+      // Less brake current and motor heating, at the cost of stopping a little later. The run FET stays off the whole time, so every pulse has its dead-time.
+      void SetBrakeStrength( byte Strength, unsigned int BrakeTime = _NARFDUINO_BRIDGE_BRAKE_TIME );
+
+      // Number of duty steps the run FET PWM has. 255 for analogWrite, 800 for Timer1 at 20kHz, 100 for Timer2 at 20kHz.
+      unsigned int GetPWMSteps();
+
       // Turns off anti-jam detection.. For flywheels or something.
       void DisableAntiJam();
 
       // Turns on anti-jam detection. Default state
       void EnableAntiJam();
 
+      // Learn the pusher cycle time, and trip the anti-jam as soon as a cycle runs well over it. Default state.
+      // Until enough cycles have been seen at a speed, it uses _NARFDUINO_PUSHER_MAX_CYCLE_TIME.
+      void EnableAdaptiveAntiJam();
+
+      // Back to the fixed _NARFDUINO_PUSHER_MAX_CYCLE_TIME. Keeps what has been learnt.
+      void DisableAdaptiveAntiJam();
+
+      // Forget the learnt cycle times - e.g. after changing the pusher motor or spring
+      void ResetAntiJamLearning();
+
+      // How long the current pusher cycle can take before it counts as a jam, in ms
+      unsigned int GetJamTimeout();
+
+      // Hand Timer2 back and return to generating dead-time in ProcessBridge()
+      void DisableTimedDeadTime();
+
+      // Set the dead-times in us for the timer mode. Max 16000us.
+      void SetDeadTime( unsigned int OnTransitionMicros, unsigned int OffTransitionMicros );
+
       
       // ********************
       // Processing functions
@@ -114,28 +237,256 @@ class NarfduinoBridge
       // This needs to be called every time you have a pusher reset otherwise the anti-jam will trigger (if enabled)
       void PusherHeartbeat();
 
+      // Number of pusher heartbeats since Init. Wraps around at 65535 - compare counts by subtracting.
+      unsigned int GetHeartbeatCount();
+
+      // micros() at the last pusher heartbeat
+      unsigned long GetLastHeartbeatMicros();
+
+      // Let the bridge read the pusher reset switch itself, from a pin change interrupt - any pin will do. Each press is timestamped 
+      // to the us as it happens, so a slow loop can't cause a false jam or throw the cycle timing out. Don't call PusherHeartbeat() as well.
+      // ActiveLevel is the level when the switch is pressed - LOW for a switch to ground, with the pullup on.
+      // Returns false if the pin has no pin change interrupt, or another bridge has a switch on the same port, 
+      // or _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT isn't defined.
+      bool AttachPusherSwitch( byte Pin, byte ActiveLevel = LOW, unsigned int DebounceMicros = _NARFDUINO_PUSHER_DEBOUNCE_MICROS );
+
+      // Back to calling PusherHeartbeat() from the sketch
+      void DetachPusherSwitch();
+
+      // Internal - called from the Timer2 interrupt when the dead-time is up.
+      static void HandleDeadTimeInterrupt();
+
+      // Internal - called from the pin change interrupt for a port. 0 = pins 8 - 13, 1 = A0 - A5, 2 = pins 0 - 7
+      static void HandleSwitchInterrupt( byte Port );
+
+      // Internal - RAM taken by the statics every bridge shares, in bytes. For the host benchmark's size report.
+      static size_t GetSharedRAM();
+
+
+      // The FET driving half is NarfduinoBridgeDriver, below
+    protected:
+      NarfduinoBridgeBase();
+
+      // Convert the bridge speed to the run FET duty for the PWM mode
+      void CalculateRunDuty();
+      void UpdateRunSpeed();
+      byte ToWholePercent( unsigned int SpeedFine );
+      uint16_t SpeedToDuty( unsigned int SpeedFine );
+
+      // Soft start and soft brake. Started when the dead-time is up - from ProcessBridge(), or the Timer2 interrupt.
+      void StartSoftStart();
+      void StartSoftBrake();
+      uint16_t GetRunDuty(); // Run FET duty now, part way up the soft start
+      bool IsBrakePulseOn(); // Brake FET state now, part way through the soft brake
+      static bool CalculatePWMTop( unsigned long Frequency, const unsigned int *Prescalers, byte NumPrescalers, uint16_t MaxTop, uint16_t &Top, uint8_t &ClockSelect );
+      static void CalculateDeadTime( unsigned int Micros, uint8_t &Compare, uint8_t &ClockSelect );
+
+      // Heartbeat from the sketch, or a switch press. Micros / Millis are when it happened.
+      void RecordHeartbeat( unsigned long Micros, unsigned long Millis );
+
+      // Pusher switch - debounced in the interrupt, and picked up by ProcessBridge()
+      void ReadPusherSwitch();
+      void CollectSwitchPresses();
+
+      // Adaptive anti-jam
+      byte GetSpeedBand( byte Speed );
+      unsigned int GetLearntJamTimeout( byte Speed );
+      void LearnCycle( unsigned long CycleMicros );
+
+      // Flags only the sketch side writes, packed. The ones an interrupt writes have a byte each below, so an update
+      // from the loop can't write back a stale copy of one.
+      bool LastBridgeRequest : 1;
+      bool BridgeRequest : 1; // False = stop Bridge, true = run Bridge
+      bool AdaptiveAntiJam : 1;
+      bool CycleRunning : 1; // The last heartbeat was with the bridge running, so the next one times a full cycle
+      bool JamDetected : 1;
+      bool BridgeStopping : 1;
+      bool AntiJamEnabled : 1;
+      bool TimedDeadTime : 1;
+      bool SwitchActiveHigh : 1;
+      bool Initialised : 1; // Init() has set the pins up
+
+      unsigned int SelectedTransitionTime = 100; // ms
+      volatile bool BridgePWMFETOn = false; // Keep track of the PWM FET
+      volatile bool BridgeBrakeFETOn = false; // Keep track of the brake fet
+      volatile byte CurrentBridgeStatus = _NARFDUINO_BRIDGE_TRANSITION; // Start in transition mode for boot.
+      unsigned long BridgeTransitionStart = 0; // Time transition started
+      unsigned long TimeLastPusherResetOrActivated = 0; // We are keeping track when the pusher was last reset for anti-jam purposes.
+      volatile unsigned int HeartbeatCount = 0;
+      volatile unsigned long LastHeartbeatMicros = 0;
+
+      // Adaptive anti-jam. Cycle times are learnt as if at 100% speed - cycle * speed / 100 - in 1/16ms, so the speeds in a band compare.
+      volatile unsigned int JamTimeout = _NARFDUINO_PUSHER_MAX_CYCLE_TIME; // ms
+      uint16_t CycleMean[_NARFDUINO_ANTIJAM_SPEED_BANDS];
+      uint16_t CycleDeviation[_NARFDUINO_ANTIJAM_SPEED_BANDS];
+      byte CycleSamples[_NARFDUINO_ANTIJAM_SPEED_BANDS];
+      byte BridgeSpeed = 0; // ROF Percentage
+      unsigned int BridgeSpeedFine = 0; // ROF in 0.1%
+      unsigned int SpeedLimitFine = 1000; // In 0.1%. 1000 = no limit
+      byte RunSpeed = 0; // The speed the run FET is driven at - BridgeSpeed under the limit - for the anti-jam
+      volatile uint16_t BridgeRunDuty = 0; // BridgeSpeedFine converted to the duty the run FET is driven at
+
+      // Output cache - what the FETs were last commanded to
+      volatile uint16_t RunFETDuty = 0;
+      volatile bool StopFETOn = false;
+
+      // Timer mode. The compare value and clock select for each dead-time are worked out in SetDeadTime()
+      uint8_t OnTransitionCompare = 0;
+      uint8_t OnTransitionClock = 0;
+      uint8_t OffTransitionCompare = 0;
+      uint8_t OffTransitionClock = 0;
+      static NarfduinoBridgeBase *TimedDeadTimeBridge; // The bridge that owns Timer2
+
+      // Its transitions. The FETs are written by its driver, which EnableTimedDeadTime() puts here.
+      typedef void (*TransitionFunction)( NarfduinoBridgeBase *Bridge );
+      static TransitionFunction TimedTransitionStart;
+      static TransitionFunction TimedTransitionFinish;
+
+      // Pusher switch. The interrupt writes the press time, then bumps SwitchPresses. ProcessBridge() reads the count either side of 
+      // the time, so there's nothing to lock - if the count didn't change, the time goes with it.
+      byte SwitchPin = 255;
+      volatile uint8_t *SwitchInputPort = NULL;
+      uint8_t SwitchMask = 0;
+      unsigned int SwitchDebounce = _NARFDUINO_PUSHER_DEBOUNCE_MICROS;
+      volatile byte SwitchPresses = 0;
+      volatile unsigned long SwitchPressMicros[2];
+      byte SwitchPressesSeen = 0;
+      volatile bool SwitchPressed = false; // Debounced switch state
+      volatile unsigned long SwitchChangeMicros = 0; // When it last changed
+      static NarfduinoBridgeBase *SwitchBridges[3]; // The bridge with a switch on each port
+
+      // Soft start. The duty climbs by SoftStartStep / 256 a ms from SoftStartDuty.
+      unsigned int SoftStartTime = _NARFDUINO_BRIDGE_SOFT_START_TIME; // ms
+      byte SoftStartSpeed = _NARFDUINO_BRIDGE_SOFT_START_SPEED;
+      uint16_t SoftStartDuty = 0;
+      uint32_t SoftStartStep = 0;
+      volatile bool SoftStarting = false;
+      volatile unsigned long SoftStartMillis = 0;
+
+      // Soft brake
+      byte BrakeStrength = _NARFDUINO_BRIDGE_BRAKE_STRENGTH;
+      unsigned int BrakeTime = _NARFDUINO_BRIDGE_BRAKE_TIME; // ms
+      unsigned int BrakeOnMicros = _NARFDUINO_BRIDGE_BRAKE_PERIOD; // Per period
+      volatile bool SoftBraking = false;
+      volatile unsigned long BrakeStartMicros = 0;
+      volatile unsigned long BrakePeriodStart = 0;
+
+      // Run FET PWM mode. Duties are out of PWMTop + 1 timer ticks in the timer modes.
+      byte PWMMode = _NARFDUINO_BRIDGE_PWM_ANALOGWRITE;
+      uint16_t PWMTop = 0;
+      static NarfduinoBridgeBase *PWMTimerBridge[2]; // The bridges that own Timer1 and Timer2 for PWM
+
+      // The bridge a group is stepping, and the group its FET writes go to
+      static NarfduinoBridgeBase *BatchBridge;
+      static NarfduinoBridgeGroup *BatchGroup;
+};
+
+
+// The FET driving half of a bridge - Init(), the dead-time state machine and the output writers. 
+// Bridge is the class deriving from it, which says where the FETs are: 
+//   byte GetRunPin(), GetStopPin()                      - the pins
+//   void ResolvePins()                                  - called from Init(), once the pins are outputs
+//   volatile uint8_t *GetRunPort(), GetStopPort()       - their output registers, for NarfduinoBridgeGroup
+//   uint8_t GetRunMask(), GetStopMask()
+//   void WriteRunPin( bool High ), WriteStopPin( bool High ) - switch a FET fully on or off
+// They're called directly, not through a vtable, so a bridge with its pins known at compile time has them inlined.
+// The code is in NarfduinoBridgeDriver.h.
+template <class Bridge>
+class NarfduinoBridgeDriver : public NarfduinoBridgeBase
+{
+    public:
+
+      // Initialisation function - Call only once in your startup code
+      bool Init();
+
+      // Drive the run FET PWM from a dedicated timer, so it can run at an ultrasonic frequency and finer duty without touching millis().
+      // The Narfduino's run FET is on pin 5, which belongs to Timer0 - the gate has to be wired to the timer's pin, 
+      // and the bridge constructed with that run pin. Call after Init().
+      // Returns false if the run pin isn't on the timer, the frequency can't be made, or the timer is in use by another bridge.
+      bool SetPWMMode( byte Mode, unsigned long Frequency = _NARFDUINO_BRIDGE_PWM_FREQUENCY );
+
+      // Generate the dead-time with Timer2 instead of ProcessBridge(). Call after Init().
+      // StartBridge / StopBridge switch the FETs over in the timer interrupt as soon as the dead-time is up, 
+      // so the timing no longer depends on how often ProcessBridge() is called.
+      // Timer2 is taken over - tone() and PWM on pins 3 and 11 won't work. Only one bridge can use this at a time.
+      // Returns false if another bridge already has the timer, for dead-time or for _NARFDUINO_BRIDGE_PWM_TIMER2, 
+      // or _NARFDUINO_ENABLE_TIMED_DEAD_TIME isn't defined.
+      bool EnableTimedDeadTime();
+
       // Handles the bridge processing. 
       // This needs to be called on regular intervals - such as every time through your main loop
       // Handles dead-time generation and state changes. Bridge won't do anything without this running.
       void ProcessBridge();
 
+      // Internal - ProcessBridge() at NowMillis, for NarfduinoBridgeGroup. The on / off FET writes go to the group, to be written a port at a time.
+      void StepBridge( unsigned long NowMillis, NarfduinoBridgeGroup *Group );
+      static void StepGroupBridge( NarfduinoBridgeBase *GroupBridge, unsigned long NowMillis, NarfduinoBridgeGroup *Group );
+
+
+    protected:
+      NarfduinoBridgeDriver() {}
+
 
       // Private stuff
     private:
-      bool LastBridgeRequest = true;
-      int SelectedTransitionTime = 100;
-      bool BridgePWMFETOn = false; // Keep track of the PWM FET
-      bool BridgeBrakeFETOn = false; // Keep track of the brake fet
-      bool BridgeRequest = false; // False = stop Bridge, true = run Bridge
-      byte CurrentBridgeStatus = _NARFDUINO_BRIDGE_TRANSITION; // Start in transition mode for boot.
-      unsigned long BridgeTransitionStart = 0; // Time transition started
-      unsigned long TimeLastPusherResetOrActivated = 0; // We are keeping track when the pusher was last reset for anti-jam purposes.
-      bool JamDetected = false;
-      bool BridgeStopping = false;
-      byte BridgeSpeed = 0; // ROF Percentage
+      Bridge &Pins() { return *static_cast<Bridge *>( this ); }
+
+      // The dead-time state machine, at Now ms
+      void UpdateBridge( unsigned long Now );
+
+      // Output writers. These only touch the hardware when the commanded output changes.
+      void SetRunFET( uint16_t Duty ); // 0 = off, 0xFFFF = fully on, anything else is PWM
+      void WriteRunPWM( uint16_t Compare );
+      void ConnectRunPWM( bool Connect );
+      void SetStopFET( bool On );
+
+      // Timer mode - start the dead-time for the current request, and finish it from the interrupt.
+      void StartTimedTransition();
+      void FinishTimedTransition();
+      static void StartTimedTransition( NarfduinoBridgeBase *TimedBridge );
+      static void FinishTimedTransition( NarfduinoBridgeBase *TimedBridge );
+};
+
+
+// A bridge on any pins, picked when it's constructed.
+class NarfduinoBridge : public NarfduinoBridgeDriver<NarfduinoBridge>
+{
+    public:
+
+      // Constructors
+      NarfduinoBridge();
+      NarfduinoBridge( byte RunPin, byte StopPin ); // Use if you want to override the default pins - such as adding an additional bridge
+      // If the pins are fixed when you write the sketch, NarfduinoBridgePins<RunPin, StopPin> in NarfduinoBridgePins.h does the same 
+      // with quicker FET writes, and without storing the pins.
+
+
+      // Private stuff
+    private:
+      friend class NarfduinoBridgeDriver<NarfduinoBridge>;
+
+      byte GetRunPin() { return BridgeRunPin; }
+      byte GetStopPin() { return BridgeStopPin; }
+      void ResolvePins();
+      volatile uint8_t *GetRunPort() { return BridgeRunPort; }
+      volatile uint8_t *GetStopPort() { return BridgeStopPort; }
+      uint8_t GetRunMask() { return BridgeRunMask; }
+      uint8_t GetStopMask() { return BridgeStopMask; }
+
+      // Switch a FET fully on or off, through the port registers resolved in Init(), with interrupts off around the read-modify-write.
+      void WriteRunPin( bool High );
+      void WriteStopPin( bool High );
+
       byte BridgeRunPin = 255;
       byte BridgeStopPin = 255;
-      bool AntiJamEnabled = true; 
+
+      // Where to write the FETs directly. Resolved in Init()
+      volatile uint8_t *BridgeRunPort = NULL;
+      volatile uint8_t *BridgeStopPort = NULL;
+      uint8_t BridgeRunMask = 0;
+      uint8_t BridgeStopMask = 0;
 };
 
+// Built once, in NarfduinoBridge.cpp
+extern template class NarfduinoBridgeDriver<NarfduinoBridge>;
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,497 @@
+/*
+ *  Narfduino Libraries - NarfduinoBridgeDriver
+ *  
+ *  The FET driving half of NarfduinoBridge and NarfduinoBridgePins - Init(), the dead-time state machine and the output writers.
+ *  It's a template on the bridge class, so the FET writes are called directly and a bridge on fixed pins has them inlined. 
+ *  Included by NarfduinoBridge.cpp and NarfduinoBridgePins.h - there's no need to include it in a sketch.
+ *  
+ *  !!!!! WARNING !!!!!
+ *  This library handles deadtime generation for the bridge. Modify at your own risk!
+ *  Without appropriate deadtime, explosions will happen. Possibly fire. 
+ *  
+ *  
+ *  (c) 2019 - Ireland Software
+ *  License: 
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier), 
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *    
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk. 
+ *    - Especially if you change it and blow up your board.
+ *  
+ */
+
+#ifndef  _NARFDUINO_BRIDGE_DRIVER_LIBRARY
+#define  _NARFDUINO_BRIDGE_DRIVER_LIBRARY
+
+#include "Arduino.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBridgeGroup.h"
+#include "NarfduinoProfiler.h"
+
+// Init code. Set the pin modes and take them low.
+template <class Bridge>
+bool NarfduinoBridgeDriver<Bridge>::Init()
+{
+  if( Pins().GetRunPin() == 255 )
+    return false;
+  if( Pins().GetStopPin() == 255 )
+    return false;
+      
+  pinMode( Pins().GetRunPin(), OUTPUT );
+  digitalWrite( Pins().GetRunPin(), LOW );  
+  pinMode( Pins().GetStopPin(), OUTPUT );
+  digitalWrite( Pins().GetStopPin(), LOW );    
+
+  Pins().ResolvePins();
+  RunFETDuty = 0;
+  StopFETOn = false;
+  HeartbeatCount = 0;
+  ResetAntiJamLearning();
+  Initialised = true;
+  
+  return true;      
+}
+
+// Drive the run FET. Only touches the hardware when the duty changes.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::SetRunFET( uint16_t Duty )
+{
+  if( Duty == RunFETDuty )
+    return;
+
+  bool PWM = (Duty != 0 && Duty != _NARFDUINO_BRIDGE_FULL_DUTY);
+  bool WasPWM = (RunFETDuty != 0 && RunFETDuty != _NARFDUINO_BRIDGE_FULL_DUTY);
+  uint8_t OldSREG = SREG;
+  cli();
+  if( PWMMode == _NARFDUINO_BRIDGE_PWM_ANALOGWRITE && (PWM || WasPWM) )
+  {
+    // Going to or from PWM needs the core, as it connects / disconnects the timer from the pin.
+    analogWrite( Pins().GetRunPin(), PWM ? Duty : (Duty ? 255 : 0) );
+  }
+  else if( PWM )
+  {
+    // Timer modes - the timer is only connected to the pin while it's PWMing. The port bit is cleared as it's connected,
+    // so the pin drops low the moment the timer lets go of it, even if a group holds the next write back until FlushWrites().
+    WriteRunPWM( Duty - 1 );
+    if( !WasPWM )
+    {
+      Pins().WriteRunPin( false );
+      ConnectRunPWM( true );
+    }
+  }
+  else
+  {
+    if( BatchBridge == this )
+      BatchGroup->QueueWrite( Pins().GetRunPort(), Pins().GetRunMask(), Duty != 0 );
+    else
+      Pins().WriteRunPin( Duty != 0 );
+    if( WasPWM )
+      ConnectRunPWM( false );
+  }
+  RunFETDuty = Duty;
+  SREG = OldSREG;
+}
+
+// Timer modes. The output is high for Compare + 1 ticks of each period.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::WriteRunPWM( uint16_t Compare )
+{
+  switch( Pins().GetRunPin() )
+  {
+    case 9:
+      OCR1A = Compare;
+      break;
+    case 10:
+      OCR1B = Compare;
+      break;
+    case 3:
+      OCR2B = Compare;
+      break;
+  }
+}
+
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::ConnectRunPWM( bool Connect )
+{
+  switch( Pins().GetRunPin() )
+  {
+    case 9:
+      TCCR1A = Connect ? (TCCR1A | (1 << COM1A1)) : (TCCR1A & ~(1 << COM1A1));
+      break;
+    case 10:
+      TCCR1A = Connect ? (TCCR1A | (1 << COM1B1)) : (TCCR1A & ~(1 << COM1B1));
+      break;
+    case 3:
+      TCCR2A = Connect ? (TCCR2A | (1 << COM2B1)) : (TCCR2A & ~(1 << COM2B1));
+      break;
+  }
+}
+
+// Take a timer over for the run FET PWM, or hand it back to analogWrite(). 
+// The run FET goes off while the timer is set up, and back on at the same speed.
+template <class Bridge>
+bool NarfduinoBridgeDriver<Bridge>::SetPWMMode( byte Mode, unsigned long Frequency )
+{
+  static const unsigned int Timer1Prescalers[] = { 1, 8, 64, 256, 1024 };
+  static const unsigned int Timer2Prescalers[] = { 1, 8, 32, 64, 128, 256, 1024 };
+
+  if( !Initialised )
+    return false;
+
+  byte Timer = 0;
+  uint16_t Top = 0;
+  uint8_t ClockSelect = 0;
+  if( Mode == _NARFDUINO_BRIDGE_PWM_TIMER1 )
+  {
+    if( Pins().GetRunPin() != 9 && Pins().GetRunPin() != 10 )
+      return false;
+    if( !CalculatePWMTop( Frequency, Timer1Prescalers, sizeof( Timer1Prescalers ) / sizeof( Timer1Prescalers[0] ), 0xFFFE, Top, ClockSelect ) )
+      return false;
+  }
+  else if( Mode == _NARFDUINO_BRIDGE_PWM_TIMER2 )
+  {
+    Timer = 1;
+    if( Pins().GetRunPin() != 3 || TimedDeadTimeBridge != NULL )
+      return false;
+    if( !CalculatePWMTop( Frequency, Timer2Prescalers, sizeof( Timer2Prescalers ) / sizeof( Timer2Prescalers[0] ), 0xFF, Top, ClockSelect ) )
+      return false;
+  }
+  else if( Mode != _NARFDUINO_BRIDGE_PWM_ANALOGWRITE )
+    return false;
+  if( Mode != _NARFDUINO_BRIDGE_PWM_ANALOGWRITE && PWMTimerBridge[Timer] != NULL && PWMTimerBridge[Timer] != this )
+    return false;
+
+  uint8_t OldSREG = SREG;
+  cli();
+  bool WasOn = (RunFETDuty != 0);
+  SetRunFET( 0 );
+
+  // Hand back the timer we had
+  if( PWMMode == _NARFDUINO_BRIDGE_PWM_TIMER1 )
+  {
+    TCCR1B = 0;
+    TCCR1A = 0;
+    PWMTimerBridge[0] = NULL;
+  }
+  else if( PWMMode == _NARFDUINO_BRIDGE_PWM_TIMER2 )
+  {
+    TCCR2B = 0;
+    TCCR2A = 0;
+    PWMTimerBridge[1] = NULL;
+  }
+
+  // Fast PWM with TOP set for the frequency. Timer1 has TOP in ICR1 (mode 14), Timer2 in OCR2A (mode 7), which is why only OC2B can be used.
+  if( Mode == _NARFDUINO_BRIDGE_PWM_TIMER1 )
+  {
+    TCCR1B = 0;
+    TCCR1A = (1 << WGM11);
+    ICR1 = Top;
+    TCNT1 = 0;
+    TCCR1B = (1 << WGM13) | (1 << WGM12) | ClockSelect;
+    PWMTimerBridge[0] = this;
+  }
+  else if( Mode == _NARFDUINO_BRIDGE_PWM_TIMER2 )
+  {
+    TCCR2B = 0;
+    TIMSK2 = 0;
+    TCCR2A = (1 << WGM21) | (1 << WGM20);
+    OCR2A = Top;
+    TCNT2 = 0;
+    TCCR2B = (1 << WGM22) | ClockSelect;
+    PWMTimerBridge[1] = this;
+  }
+  PWMMode = Mode;
+  PWMTop = Top;
+
+  CalculateRunDuty();
+  if( WasOn )
+    SetRunFET( GetRunDuty() );
+  SREG = OldSREG;
+  return true;
+}
+
+// Drive the stop FET. Only touches the hardware when the state changes.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::SetStopFET( bool On )
+{
+  if( On == StopFETOn )
+    return;
+
+  if( BatchBridge == this )
+    BatchGroup->QueueWrite( Pins().GetStopPort(), Pins().GetStopMask(), On );
+  else
+    Pins().WriteStopPin( On );
+  StopFETOn = On;
+}
+
+// Take over Timer2 for dead-time generation.
+template <class Bridge>
+bool NarfduinoBridgeDriver<Bridge>::EnableTimedDeadTime()
+{
+#ifndef _NARFDUINO_ENABLE_TIMED_DEAD_TIME
+  return false;
+#else
+  if( !Initialised )
+    return false;
+  if( TimedDeadTimeBridge != NULL && TimedDeadTimeBridge != this )
+    return false;
+  if( PWMTimerBridge[1] != NULL )
+    return false;
+
+  if( OnTransitionClock == 0 )
+    SetDeadTime( _NARFDUINO_BRIDGE_ON_TRANSITION_MICROS, _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS );
+
+  // Timer2 in normal mode, stopped until a transition needs it.
+  uint8_t OldSREG = SREG;
+  cli();
+  TCCR2B = 0;
+  TCCR2A = 0;
+  TIMSK2 = 0;
+  TimedDeadTimeBridge = this;
+  TimedTransitionStart = StartTimedTransition;
+  TimedTransitionFinish = FinishTimedTransition;
+  TimedDeadTime = true;
+  SREG = OldSREG;
+
+  // Bring the bridge to a known state through a full transition
+  LastBridgeRequest = !BridgeRequest;
+  StartTimedTransition();
+  return true;
+#endif
+}
+
+// Timer mode. Both FETs off now, and time the dead-time for the current request.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::StartTimedTransition()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  if( LastBridgeRequest == BridgeRequest )
+  {
+    SREG = OldSREG;
+    return;
+  }
+  LastBridgeRequest = BridgeRequest;
+  CurrentBridgeStatus = _NARFDUINO_BRIDGE_TRANSITION;
+  SetRunFET( 0 );
+  BridgePWMFETOn = false;
+  SetStopFET( false );
+  BridgeBrakeFETOn = false;
+
+  // Restart Timer2 from 0 and interrupt when it gets to the compare value
+  TCCR2B = 0;
+  TCNT2 = 0;
+  OCR2B = BridgeRequest ? OnTransitionCompare : OffTransitionCompare;
+  TIFR2 = (1 << OCF2B);
+  TIMSK2 = (1 << OCIE2B);
+  TCCR2B = BridgeRequest ? OnTransitionClock : OffTransitionClock;
+  SREG = OldSREG;
+}
+
+// Dead-time is up. Switch on the FET for the request straight away - ProcessBridge() takes over from here.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::FinishTimedTransition()
+{
+  if( CurrentBridgeStatus != _NARFDUINO_BRIDGE_TRANSITION )
+    return;
+
+  if( BridgeRequest )
+  {
+    CurrentBridgeStatus = _NARFDUINO_BRIDGE_RUN;
+    if( !JamDetected )
+    {
+      StartSoftStart();
+      SetRunFET( GetRunDuty() );
+      BridgePWMFETOn = true;
+    }
+  }
+  else
+  {
+    CurrentBridgeStatus = _NARFDUINO_BRIDGE_STOP;
+    StartSoftBrake();
+    SetStopFET( true );
+    BridgeBrakeFETOn = true;
+  }
+}
+
+// StartBridge / StopBridge and the Timer2 interrupt come in here, for the bridge that has the timer.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::StartTimedTransition( NarfduinoBridgeBase *TimedBridge )
+{
+  static_cast<NarfduinoBridgeDriver *>( TimedBridge )->StartTimedTransition();
+}
+
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::FinishTimedTransition( NarfduinoBridgeBase *TimedBridge )
+{
+  static_cast<NarfduinoBridgeDriver *>( TimedBridge )->FinishTimedTransition();
+}
+
+// Processes the bridge and handle dead-time generation.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::ProcessBridge()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_BRIDGE );
+  UpdateBridge( millis() );
+}
+
+// The group writes the FETs once every bridge in it has been stepped. A bridge on the timed dead-time writes its own - 
+// its interrupt does, and the two mustn't cross.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::StepBridge( unsigned long NowMillis, NarfduinoBridgeGroup *Group )
+{
+  if( Group && !TimedDeadTime )
+  {
+    BatchGroup = Group;
+    BatchBridge = this;
+  }
+  UpdateBridge( NowMillis );
+  BatchBridge = NULL;
+}
+
+// NarfduinoBridgeGroup steps its bridges through here, as it doesn't know which pins each is on.
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::StepGroupBridge( NarfduinoBridgeBase *GroupBridge, unsigned long NowMillis, NarfduinoBridgeGroup *Group )
+{
+  static_cast<NarfduinoBridgeDriver *>( GroupBridge )->StepBridge( NowMillis, Group );
+}
+
+template <class Bridge>
+void NarfduinoBridgeDriver<Bridge>::UpdateBridge( unsigned long Now )
+{
+  // Logic:
+  // 1 - Do we need to change? If so, initiate transition
+  // 2 - Are we in transition? If so, write digital 0 to both fets. Keep doing that
+  // 3 - Are we out of transition? If so, 
+  // 4.a  - Are we wanting to run? Are we already running or just out of transition?
+  //        If so, turn on Bridge fet, ensure brake fet is off
+  //        Else turn fets off, and start transition timer
+  // 4.b  - Are we wanting to stop? Are we already stoppedor just out of transition?
+  //        If so, turn off Bridge fet, and turn on brake fet
+  //        Else turn fets off and start transition timer
+
+
+  // Heartbeats from the switch interrupt
+  if( SwitchPin != 255 )
+    CollectSwitchPresses();
+
+  // In timer mode, StartBridge / StopBridge and the timer interrupt handle the transitions. Leave the FETs alone until it's done.
+  if( TimedDeadTime && CurrentBridgeStatus == _NARFDUINO_BRIDGE_TRANSITION )
+    return;
+
+  // Step 1 - initiate transition
+  if( LastBridgeRequest != BridgeRequest )
+  {
+    CurrentBridgeStatus = _NARFDUINO_BRIDGE_TRANSITION;
+    if( BridgeRequest )
+    {
+      SelectedTransitionTime = _NARFDUINO_BRIDGE_ON_TRANSITION_TIME;
+    }
+    else
+    {
+      SelectedTransitionTime = _NARFDUINO_BRIDGE_OFF_TRANSITION_TIME;
+    }
+    BridgeTransitionStart = Now;
+    LastBridgeRequest = BridgeRequest;
+    return;
+  }
+
+  // Step 2 - wait for transition to complete. This is the dead-time.
+  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_TRANSITION )
+  {
+    SetRunFET( 0 );
+    BridgePWMFETOn = false;
+    SetStopFET( false );
+    BridgeBrakeFETOn = false;
+    if( Now - BridgeTransitionStart <= SelectedTransitionTime )
+      return;
+
+    // We are now out of transition
+    if( BridgeRequest )
+    {
+      CurrentBridgeStatus = _NARFDUINO_BRIDGE_RUN;
+      StartSoftStart();
+    }
+    else
+    {
+      CurrentBridgeStatus = _NARFDUINO_BRIDGE_STOP;
+      StartSoftBrake();
+    }
+    
+    return;
+  }
+
+  // Bridge should now turn on.
+  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_RUN )
+  {
+    // Check to make sure high fet is not on
+    if( BridgeBrakeFETOn )
+    {
+      return;
+    }
+    // Check to make sure that the Jam state isn't set
+    if( JamDetected )
+    {
+      SetRunFET( 0 );
+      SetStopFET( false );
+      return;
+    }
+    // Check to see if we have Jammed, if anti-jam is turned on. If so, halt the bridge and set the Jam state.
+    if( AntiJamEnabled )
+    {
+      // Signed - a heartbeat or start since Now was read is later than it
+      if( (long)(Now - TimeLastPusherResetOrActivated) > (long)JamTimeout )
+      {
+        // Jam detected, shut down fets.
+        SetRunFET( 0 );
+        SetStopFET( false );
+        JamDetected = true;
+        return;
+      }
+      else
+      {
+        JamDetected = false;
+      }
+    }
+    else
+    {
+      JamDetected = false;
+    }
+
+    // Ensure that the high side stays off.
+    SetStopFET( false );
+    BridgeBrakeFETOn = false;
+
+    // 100% is a digital HIGH, 0% is LOW, anything else is PWM. The duty was worked out in SetBridgeSpeed, and climbs to it in the soft start.
+    SetRunFET( GetRunDuty() );
+    BridgePWMFETOn = true;
+    
+    return;
+  }
+
+  // Bridge should now turn off
+  if( CurrentBridgeStatus == _NARFDUINO_BRIDGE_STOP )
+  {
+    // Check to make sure low fet is not on
+    if( BridgePWMFETOn )
+    {
+      return;
+    }
+
+    // Ensure the low fet stays off
+    SetRunFET( 0 );
+    BridgePWMFETOn = false;
+
+    // Activate the brake. The soft brake pulses it - the run FET is off, so it can go straight back on.
+    SetStopFET( IsBrakePulseOn() );
+    BridgeBrakeFETOn = true;
+
+    return;
+  }
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ *  Narfduino Libraries - NarfduinoBridgeGroup
+ *
+ *  Use this to run more than one bridge - a flywheel bridge and a pusher bridge, say - from one call in the loop.
+ *  Every bridge is stepped from the same millis(), and their FETs are written a port at a time.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *    - Especially if you change it and blow up your board.
+ *
+ */
+
+
+#include "NarfduinoBridgeGroup.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoProfiler.h"
+
+bool NarfduinoBridgeGroup::AddBridge( NarfduinoBridgeBase *Bridge, StepFunction Step )
+{
+  if( !Bridge || BridgeCount >= _NARFDUINO_BRIDGE_GROUP_MAX_BRIDGES )
+    return false;
+  Bridges[BridgeCount] = Bridge;
+  Steps[BridgeCount++] = Step;
+  return true;
+}
+
+void NarfduinoBridgeGroup::ProcessBridges()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_BRIDGE );
+  unsigned long Now = millis();
+  PortCount = 0;
+  for( byte i = 0; i < BridgeCount; i++ )
+    Steps[i]( Bridges[i], Now, this );
+  FlushWrites();
+}
+
+// The last write to a pin in a step wins
+void NarfduinoBridgeGroup::QueueWrite( volatile uint8_t *Port, uint8_t Mask, bool High )
+{
+  byte i = 0;
+  while( i < PortCount && Ports[i] != Port )
+    i++;
+  if( i == PortCount )
+  {
+    if( PortCount >= 3 )
+      return; // Can't happen on a 328P
+    Ports[i] = Port;
+    SetMasks[i] = ClearMasks[i] = 0;
+    PortCount++;
+  }
+
+  if( High )
+  {
+    SetMasks[i] |= Mask;
+    ClearMasks[i] &= ~Mask;
+  }
+  else
+  {
+    ClearMasks[i] |= Mask;
+    SetMasks[i] &= ~Mask;
+  }
+}
+
+// A bridge's run and stop FETs can be on different ports. The ports with something going off are written first,
+// so nothing comes on before everything going off this step is off.
+void NarfduinoBridgeGroup::FlushWrites()
+{
+  if( !PortCount )
+    return;
+
+  uint8_t OldSREG = SREG;
+  cli();
+  for( byte i = 0; i < PortCount; i++ )
+    if( ClearMasks[i] )
+      *Ports[i] = (*Ports[i] & ~ClearMasks[i]) | SetMasks[i];
+  for( byte i = 0; i < PortCount; i++ )
+    if( !ClearMasks[i] && SetMasks[i] )
+      *Ports[i] |= SetMasks[i];
+  SREG = OldSREG;
+  PortCount = 0;
+}
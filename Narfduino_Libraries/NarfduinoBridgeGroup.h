@@ -0,0 +1,83 @@
+/*
+ *  Narfduino Libraries - NarfduinoBridgeGroup
+ *
+ *  Use this to run more than one bridge - a flywheel bridge and a pusher bridge, say - from one call in the loop.
+ *  Every bridge is stepped from the same millis(), so bridges started together come on together. The FETs that change are
+ *  then written a port at a time, with interrupts off, rather than a pin at a time as each bridge gets to them.
+ *
+ *  Each bridge keeps its own dead-time. A bridge only turns a FET on in a later step than the one that turned the other FET off,
+ *  and anything going off is written before anything coming on.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *    - Especially if you change it and blow up your board.
+ *
+ */
+
+#ifndef _NARFDUINO_BRIDGE_GROUP_LIB
+#define _NARFDUINO_BRIDGE_GROUP_LIB
+
+#include "Arduino.h"
+
+class NarfduinoBridgeBase;
+
+// Default Definitions
+
+// Most bridges a group can hold
+#ifndef _NARFDUINO_BRIDGE_GROUP_MAX_BRIDGES
+  #define _NARFDUINO_BRIDGE_GROUP_MAX_BRIDGES 4
+#endif
+
+class NarfduinoBridgeGroup
+{
+  public:
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Add a bridge, after its Init() - a NarfduinoBridge or a NarfduinoBridgePins. Returns false if the group is full.
+    // Call ProcessBridges() instead of ProcessBridge() on each of them. Bridges on the timed dead-time, and PWM speeds,
+    // still write their own FETs.
+    template <class Bridge> bool AddBridge( Bridge *NewBridge )
+    {
+      return AddBridge( NewBridge, Bridge::StepGroupBridge );
+    }
+
+    // ***************************************
+    // Runtime Functions - Use in Loop
+    // ***************************************
+
+    // Steps every bridge and writes out their FETs. Call every time through the loop.
+    void ProcessBridges();
+
+    // Internal - a FET write from a bridge being stepped
+    void QueueWrite( volatile uint8_t *Port, uint8_t Mask, bool High );
+
+    // Internal - steps a bridge, through its own driver
+    typedef void (*StepFunction)( NarfduinoBridgeBase *Bridge, unsigned long NowMillis, NarfduinoBridgeGroup *Group );
+    bool AddBridge( NarfduinoBridgeBase *Bridge, StepFunction Step );
+
+  // Private stuff
+  private:
+    void FlushWrites();
+
+    NarfduinoBridgeBase *Bridges[_NARFDUINO_BRIDGE_GROUP_MAX_BRIDGES];
+    StepFunction Steps[_NARFDUINO_BRIDGE_GROUP_MAX_BRIDGES];
+    byte BridgeCount = 0;
+
+    // The pins to set and clear on each port. The 328P only has B, C and D.
+    volatile uint8_t *Ports[3];
+    uint8_t SetMasks[3];
+    uint8_t ClearMasks[3];
+    byte PortCount = 0;
+};
+
+#endif
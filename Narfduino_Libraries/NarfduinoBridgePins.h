@@ -0,0 +1,79 @@
+/*
+ *  Narfduino Libraries - NarfduinoBridgePins
+ *
+ *  NarfduinoBridge with the pins fixed when the sketch is compiled:
+ *    NarfduinoBridgePins<_NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP> Bridge;
+ *
+ *  The ports and bits are worked out by the compiler, so switching a FET is a single sbi / cbi instruction, with no port lookup
+ *  and no need to turn interrupts off around it. A pin that isn't on the ATmega328P fails to compile, rather than Init() failing.
+ *  The pins and their port registers aren't stored, so it takes less RAM than a NarfduinoBridge - make avr-sizes in extras/host measures it.
+ *  Everything else is the same as NarfduinoBridge. It can be passed to anything that takes a NarfduinoBridgeBase *, and added to
+ *  a NarfduinoBridgeGroup or NarfduinoScheduler.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *    - Especially if you change it and blow up your board.
+ *
+ */
+
+#ifndef _NARFDUINO_BRIDGE_PINS_LIBRARY
+#define _NARFDUINO_BRIDGE_PINS_LIBRARY
+
+#include "NarfduinoBridge.h"
+#include "NarfduinoBridgeDriver.h"
+
+template <byte RunPin, byte StopPin>
+class NarfduinoBridgePins : public NarfduinoBridgeDriver<NarfduinoBridgePins<RunPin, StopPin> >
+{
+    static_assert( RunPin <= 19 && StopPin <= 19, "Bridge pins have to be digital pins 0 - 19 (A0 - A5 are 14 - 19)" );
+    static_assert( RunPin != StopPin, "The run and stop FETs need a pin each" );
+
+      // Private stuff
+    private:
+      friend class NarfduinoBridgeDriver<NarfduinoBridgePins>;
+
+      // Pins 0 - 7 are on port D, 8 - 13 on port B, and A0 - A5 on port C
+      static volatile uint8_t &PinPort( byte Pin )
+      {
+        return (Pin < 8) ? PORTD : ((Pin < 14) ? PORTB : PORTC);
+      }
+
+      static constexpr uint8_t PinMask( byte Pin )
+      {
+        return 1 << ((Pin < 8) ? Pin : ((Pin < 14) ? Pin - 8 : Pin - 14));
+      }
+
+      byte GetRunPin() { return RunPin; }
+      byte GetStopPin() { return StopPin; }
+      void ResolvePins() {}
+      volatile uint8_t *GetRunPort() { return &PinPort( RunPin ); }
+      volatile uint8_t *GetStopPort() { return &PinPort( StopPin ); }
+      uint8_t GetRunMask() { return PinMask( RunPin ); }
+      uint8_t GetStopMask() { return PinMask( StopPin ); }
+
+      void WriteRunPin( bool High )
+      {
+        if( High )
+          PinPort( RunPin ) |= PinMask( RunPin );
+        else
+          PinPort( RunPin ) &= ~PinMask( RunPin );
+      }
+
+      void WriteStopPin( bool High )
+      {
+        if( High )
+          PinPort( StopPin ) |= PinMask( StopPin );
+        else
+          PinPort( StopPin ) &= ~PinMask( StopPin );
+      }
+};
+
+#endif
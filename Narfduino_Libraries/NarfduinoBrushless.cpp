@@ -17,6 +17,47 @@
  */
 
 #include "NarfduinoBrushless.h"
+#include "NarfduinoProfiler.h"
+
+// DShot bit timings in CPU cycles at 16MHz - the whole bit, and the high time for a 1 and a 0
+#define _NARFDUINO_DSHOT150_BIT_CYCLES 107
+#define _NARFDUINO_DSHOT150_ONE_CYCLES 80
+#define _NARFDUINO_DSHOT150_ZERO_CYCLES 40
+#define _NARFDUINO_DSHOT300_BIT_CYCLES 53
+#define _NARFDUINO_DSHOT300_ONE_CYCLES 40
+#define _NARFDUINO_DSHOT300_ZERO_CYCLES 20
+
+// Sends the 16 bits of a DShot frame. All the enabled pins go high together, the ones sending a 0 drop at the zero time, and the rest at the one time.
+#define _NARFDUINO_DSHOT_SEND_FRAME( BitCycles, OneCycles, ZeroCycles ) \
+  for( byte Bit = 0; Bit < 16; Bit++ ) \
+  { \
+    uint8_t Middle = Low | Bits[Bit]; \
+    _NARFDUINO_DSHOT_PORT_WRITE( High ); \
+    _NARFDUINO_DSHOT_DELAY_CYCLES( (ZeroCycles) - _NARFDUINO_DSHOT_WRITE_CYCLES ); \
+    _NARFDUINO_DSHOT_PORT_WRITE( Middle ); \
+    _NARFDUINO_DSHOT_DELAY_CYCLES( (OneCycles) - (ZeroCycles) - _NARFDUINO_DSHOT_WRITE_CYCLES ); \
+    _NARFDUINO_DSHOT_PORT_WRITE( Low ); \
+    _NARFDUINO_DSHOT_DELAY_CYCLES( (BitCycles) - (OneCycles) - _NARFDUINO_DSHOT_WRITE_CYCLES - _NARFDUINO_DSHOT_LOOP_CYCLES ); \
+  }
+
+// Speeds are kept in 1/64ths of a unit
+#define _NARFDUINO_BRUSHLESS_SPEED_SHIFT 6
+
+NarfduinoBrushless *NarfduinoBrushless::TimerBrushless = NULL;
+
+// Timer1 frame interrupts. Overflow is the end of a frame for the pulse protocols - only enabled while ramping.
+// Compare A is the start of a DShot frame.
+#ifdef _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS
+ISR( TIMER1_OVF_vect )
+{
+  NarfduinoBrushless::HandleFrameInterrupt();
+}
+
+ISR( TIMER1_COMPA_vect )
+{
+  NarfduinoBrushless::HandleFrameInterrupt();
+}
+#endif
 
 // Call once in setup to initialise the pins and OC1 timer.
 void NarfduinoBrushless::Init()
@@ -33,31 +74,391 @@ void NarfduinoBrushless::Init()
   #endif
 
   // Initialise the PWM registers for OC1 
-  TCCR1A = 0;
-  TCCR1A = (1 << WGM11);
+  if( Protocol == 255 && !SetProtocol( _NARFDUINO_BRUSHLESS_PROTOCOL, _NARFDUINO_BRUSHLESS_FRAME_RATE ) )
+    SetProtocol( _NARFDUINO_BRUSHLESS_PWM );
+  Initialised = true;
+  ApplyProtocol();
+
+  // Minimum throttle
+  UpdateSpeed( 1000 );
+}
+
+// Select the output protocol and frame rate.
+bool NarfduinoBrushless::SetProtocol( byte NewProtocol, unsigned int FrameRate )
+{
+  // Pulse widths in timer ticks. PWM and DShot run the timer at 2MHz, the others at 16MHz for the resolution.
+  byte NewClockSelect = (1 << CS10);
+  unsigned long TimerClock = F_CPU;
+  uint16_t NewMinPulseTicks = 0;
+  uint16_t PulseSpanTicks = 0;
+  unsigned int DefaultFrameRate;
+  switch( NewProtocol )
+  {
+    case _NARFDUINO_BRUSHLESS_PWM:
+      NewClockSelect = (1 << CS11);
+      TimerClock = F_CPU / 8;
+      NewMinPulseTicks = 2000;
+      PulseSpanTicks = 2000;
+      DefaultFrameRate = 50;
+      break;
+    case _NARFDUINO_BRUSHLESS_ONESHOT125:
+      NewMinPulseTicks = 2000;
+      PulseSpanTicks = 2000;
+      DefaultFrameRate = 2000;
+      break;
+    case _NARFDUINO_BRUSHLESS_ONESHOT42:
+      NewMinPulseTicks = 672;
+      PulseSpanTicks = 672;
+      DefaultFrameRate = 4000;
+      break;
+    case _NARFDUINO_BRUSHLESS_MULTISHOT:
+      NewMinPulseTicks = 80;
+      PulseSpanTicks = 320;
+      DefaultFrameRate = 8000;
+      break;
+    case _NARFDUINO_BRUSHLESS_DSHOT150:
+    case _NARFDUINO_BRUSHLESS_DSHOT300:
+      #ifndef _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS
+        return false;
+      #endif
+      NewClockSelect = (1 << CS11);
+      TimerClock = F_CPU / 8;
+      DefaultFrameRate = (NewProtocol == _NARFDUINO_BRUSHLESS_DSHOT150) ? 1000 : 2000;
+      break;
+    default:
+      return false;
+  }
+  if( FrameRate == 0 )
+    FrameRate = DefaultFrameRate;
+
+  // The frame has to fit the timer, and leave a gap after the longest pulse. 
+  // DShot needs at least as long again as the frame takes to send, so the interrupt can't take over the CPU.
+  unsigned long MinFrameTicks = (unsigned long)NewMinPulseTicks + PulseSpanTicks;
+  MinFrameTicks += MinFrameTicks / 16;
+  if( NewProtocol == _NARFDUINO_BRUSHLESS_DSHOT150 )
+    MinFrameTicks = 2UL * 16 * _NARFDUINO_DSHOT150_BIT_CYCLES / 8;
+  else if( NewProtocol == _NARFDUINO_BRUSHLESS_DSHOT300 )
+    MinFrameTicks = 2UL * 16 * _NARFDUINO_DSHOT300_BIT_CYCLES / 8;
+  unsigned long NewFrameTicks = TimerClock / FrameRate;
+  if( NewFrameTicks > 65536UL || NewFrameTicks < MinFrameTicks )
+    return false;
+
+  Protocol = NewProtocol;
+  ClockSelect = NewClockSelect;
+  FrameTicks = NewFrameTicks - 1;
+  this->FrameRate = FrameRate;
+  MinPulseTicks = NewMinPulseTicks;
+  PulseScale = ((uint32_t)PulseSpanTicks * 65536UL + 500UL) / 1000UL;
+  DShotMask = 0;
   #ifdef _NARFDUINO_ENABLE_BRUSHLESS_9
-    TCCR1A |= (1 << COM1A1);
+    DShotMask |= digitalPinToBitMask( _NARFDUINO_PIN_MOTOR_9 );
   #endif
   #ifdef _NARFDUINO_ENABLE_BRUSHLESS_10
-    TCCR1A |= (1 << COM1B1);
+    DShotMask |= digitalPinToBitMask( _NARFDUINO_PIN_MOTOR_10 );
   #endif
+
+  CalculateRampSteps();
+
+  if( Initialised )
+    ApplyProtocol();
+  return true;
+}
+
+// Change the frame rate for the current protocol.
+bool NarfduinoBrushless::SetFrameRate( unsigned int FrameRate )
+{
+  if( Protocol == 255 )
+    return SetProtocol( _NARFDUINO_BRUSHLESS_PROTOCOL, FrameRate );
+  return SetProtocol( Protocol, FrameRate );
+}
+
+bool NarfduinoBrushless::IsDShot()
+{
+  return Protocol == _NARFDUINO_BRUSHLESS_DSHOT150 || Protocol == _NARFDUINO_BRUSHLESS_DSHOT300;
+}
+
+// Fast PWM, TOP = ICR1 for the pulse protocols. DShot uses CTC, TOP = OCR1A, and sends a frame from the compare interrupt.
+// The timer is stopped and restarted from 0 so a shorter frame takes effect straight away.
+void NarfduinoBrushless::ApplyProtocol()
+{
+  uint8_t OldSREG = SREG;
+  cli();
   TCCR1B = 0;
-  TCCR1B = (1 << WGM13) | (1 << WGM12) | (1 << CS11);
-  ICR1 = 40000;
+  TCNT1 = 0;
+  TimerBrushless = this;
+  if( IsDShot() )
+  {
+    // The pins go back to plain outputs, low between frames
+    TIMSK1 &= ~(1 << TOIE1);
+    TCCR1A = 0;
+    PORTB &= ~DShotMask;
+    DShotFrameChanged = true;
+    OCR1A = FrameTicks;
+    TIMSK1 |= (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | ClockSelect;
+  }
+  else
+  {
+    TIMSK1 &= ~(1 << OCIE1A);
+    TCCR1A = (1 << WGM11);
+    #ifdef _NARFDUINO_ENABLE_BRUSHLESS_9
+      TCCR1A |= (1 << COM1A1);
+    #endif
+    #ifdef _NARFDUINO_ENABLE_BRUSHLESS_10
+      TCCR1A |= (1 << COM1B1);
+    #endif
+    ICR1 = FrameTicks;
+    WriteChannel( _NARFDUINO_BRUSHLESS_CHANNEL_9 );
+    WriteChannel( _NARFDUINO_BRUSHLESS_CHANNEL_10 );
+    if( Ramping )
+      TIMSK1 |= (1 << TOIE1);
+    TCCR1B = (1 << WGM13) | (1 << WGM12) | ClockSelect;
+  }
+  SREG = OldSREG;
+}
 
-  // Pulse 1000us
-  UpdateSpeed( 1000 );
+// Ramp rates per second, to steps per frame. The interrupt reads the steps.
+void NarfduinoBrushless::CalculateRampSteps()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  for( byte Channel = 0; Channel < 2; Channel++ )
+  {
+    AccelerationStep[Channel] = 0;
+    DecelerationStep[Channel] = 0;
+    if( !FrameRate )
+      continue;
+    // Nothing to run a ramp without the frame interrupt, so every change goes straight out
+    #ifndef _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS
+      continue;
+    #endif
+    // Never round a ramp down to nothing
+    if( ChannelAcceleration[Channel] )
+      AccelerationStep[Channel] = max( 1UL, ((uint32_t)ChannelAcceleration[Channel] << _NARFDUINO_BRUSHLESS_SPEED_SHIFT) / FrameRate );
+    if( ChannelDeceleration[Channel] )
+      DecelerationStep[Channel] = max( 1UL, ((uint32_t)ChannelDeceleration[Channel] << _NARFDUINO_BRUSHLESS_SPEED_SHIFT) / FrameRate );
+  }
+  SREG = OldSREG;
 }
 
-// Updates the PWM Timers. Take a value from 1000 - 2000us, and adjust it to a value that the timer can use.
-void NarfduinoBrushless::UpdateSpeed( int NewSpeed )
+// Set the ramp for a channel
+void NarfduinoBrushless::SetRamp( byte Channel, unsigned int Acceleration, unsigned int Deceleration )
+{
+  if( Channel > _NARFDUINO_BRUSHLESS_CHANNEL_10 )
+    return;
+  ChannelAcceleration[Channel] = Acceleration;
+  ChannelDeceleration[Channel] = Deceleration;
+  CalculateRampSteps();
+}
+
+// Puts a channel's current speed on its pin. For DShot, the next frame picks it up.
+// Interrupts need to be off - the 16 bit timer registers share a temporary register with the interrupt.
+void NarfduinoBrushless::WriteChannel( byte Channel )
+{
+  if( IsDShot() )
+  {
+    DShotFrameChanged = true;
+    return;
+  }
+
+  // The pulse runs from BOTTOM to the compare match, inclusive
+  uint16_t Units = (ChannelSpeed[Channel] + (1 << (_NARFDUINO_BRUSHLESS_SPEED_SHIFT - 1))) >> _NARFDUINO_BRUSHLESS_SPEED_SHIFT;
+  uint16_t Compare = MinPulseTicks - 1 + (uint16_t)(((uint32_t)Units * PulseScale + 32768UL) >> 16);
+
+  if( Channel == _NARFDUINO_BRUSHLESS_CHANNEL_9 )
+  {
+    #ifdef _NARFDUINO_ENABLE_BRUSHLESS_9
+      OCR1A = Compare;
+    #endif
+  }
+  else
+  {
+    #ifdef _NARFDUINO_ENABLE_BRUSHLESS_10
+      OCR1B = Compare;
+    #endif
+  }
+}
+
+// Move the ramping channels on by one frame. When they have all arrived, the pulse protocols turn the overflow interrupt back off.
+void NarfduinoBrushless::ProcessRamp()
 {
-  NewSpeed = (NewSpeed * 2) + 2; // Adjust for the prescalar
-  
+  bool StillRamping = false;
+  for( byte Channel = 0; Channel < 2; Channel++ )
+  {
+    uint16_t Speed = ChannelSpeed[Channel];
+    uint16_t Target = ChannelTarget[Channel];
+    if( Speed == Target )
+      continue;
+
+    if( Target > Speed )
+    {
+      uint16_t Step = AccelerationStep[Channel];
+      Speed = (Step && Target - Speed > Step) ? Speed + Step : Target;
+    }
+    else
+    {
+      uint16_t Step = DecelerationStep[Channel];
+      Speed = (Step && Speed - Target > Step) ? Speed - Step : Target;
+    }
+    ChannelSpeed[Channel] = Speed;
+    WriteChannel( Channel );
+    if( Speed != Target )
+      StillRamping = true;
+  }
+
+  Ramping = StillRamping;
+  if( !StillRamping )
+    TIMSK1 &= ~(1 << TOIE1);
+}
+
+// Builds the DShot frames for both channels. 1000 is the stop command (0). 1001 - 2000 is throttle 49 - 2047. 
+// The telemetry request bit is always off.
+void NarfduinoBrushless::BuildDShotFrame()
+{
+  uint16_t Frames[2];
+  for( byte Channel = 0; Channel < 2; Channel++ )
+  {
+    uint16_t Units = (ChannelSpeed[Channel] + (1 << (_NARFDUINO_BRUSHLESS_SPEED_SHIFT - 1))) >> _NARFDUINO_BRUSHLESS_SPEED_SHIFT;
+    uint16_t Value = 0;
+    if( Units )
+      Value = 47 + Units * 2;
+    Value <<= 1;
+    Frames[Channel] = (Value << 4) | ((Value ^ (Value >> 4) ^ (Value >> 8)) & 0x0F);
+  }
+
+  uint8_t Mask9 = 0;
+  uint8_t Mask10 = 0;
   #ifdef _NARFDUINO_ENABLE_BRUSHLESS_9
-    OCR1A = NewSpeed;
+    Mask9 = digitalPinToBitMask( _NARFDUINO_PIN_MOTOR_9 );
   #endif
   #ifdef _NARFDUINO_ENABLE_BRUSHLESS_10
-    OCR1B = NewSpeed;
+    Mask10 = digitalPinToBitMask( _NARFDUINO_PIN_MOTOR_10 );
   #endif
+  for( byte Bit = 0; Bit < 16; Bit++ )
+  {
+    DShotBits[Bit] = ((Frames[0] & 0x8000) ? Mask9 : 0) | ((Frames[1] & 0x8000) ? Mask10 : 0);
+    Frames[0] <<= 1;
+    Frames[1] <<= 1;
+  }
+}
+
+// Send the current frame. Interrupts are already off, and nothing else can touch PORTB until it's done.
+void NarfduinoBrushless::SendDShotFrame()
+{
+  if( DShotFrameChanged )
+  {
+    DShotFrameChanged = false;
+    BuildDShotFrame();
+  }
+
+  const uint8_t *Bits = DShotBits;
+  uint8_t Low = PORTB & ~DShotMask;
+  uint8_t High = Low | DShotMask;
+
+  if( Protocol == _NARFDUINO_BRUSHLESS_DSHOT150 )
+  {
+    _NARFDUINO_DSHOT_SEND_FRAME( _NARFDUINO_DSHOT150_BIT_CYCLES, _NARFDUINO_DSHOT150_ONE_CYCLES, _NARFDUINO_DSHOT150_ZERO_CYCLES );
+  }
+  else
+  {
+    _NARFDUINO_DSHOT_SEND_FRAME( _NARFDUINO_DSHOT300_BIT_CYCLES, _NARFDUINO_DSHOT300_ONE_CYCLES, _NARFDUINO_DSHOT300_ZERO_CYCLES );
+  }
+}
+
+// Called from the Timer1 interrupts, once a frame
+void NarfduinoBrushless::HandleFrameInterrupt()
+{
+  NarfduinoBrushless *Brushless = TimerBrushless;
+  if( !Brushless )
+    return;
+  if( Brushless->Ramping )
+    Brushless->ProcessRamp();
+  if( Brushless->IsDShot() )
+    Brushless->SendDShotFrame();
+}
+
+
+// Updates the PWM Timers. Take a value from 1000 - 2000us, and adjust it to a value that the timer can use.
+void NarfduinoBrushless::UpdateSpeed( int NewSpeed )
+{
+  UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9, NewSpeed );
+  UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10, NewSpeed );
+}
+
+// Sets one channel. With no ramp in that direction it goes straight out, otherwise the interrupt ramps it there.
+void NarfduinoBrushless::UpdateSpeed( byte Channel, int NewSpeed )
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_BRUSHLESS );
+  if( Channel > _NARFDUINO_BRUSHLESS_CHANNEL_10 )
+    return;
+  NewSpeed = constrain( NewSpeed, 1000, 2000 );
+  ChannelRequest[Channel] = (uint16_t)(NewSpeed - 1000) << _NARFDUINO_BRUSHLESS_SPEED_SHIFT;
+  ApplyTarget( Channel );
+}
+
+// Both channels are held to the limit. The speeds they were set to are kept, and go back out when the limit lifts.
+void NarfduinoBrushless::SetSpeedLimit( int MaxSpeed )
+{
+  MaxSpeed = constrain( MaxSpeed, 1000, 2000 );
+  uint16_t NewLimit = (MaxSpeed == 2000) ? 0xFFFF : (uint16_t)(MaxSpeed - 1000) << _NARFDUINO_BRUSHLESS_SPEED_SHIFT;
+  if( NewLimit == SpeedLimit )
+    return;
+  SpeedLimit = NewLimit;
+  ApplyTarget( _NARFDUINO_BRUSHLESS_CHANNEL_9 );
+  ApplyTarget( _NARFDUINO_BRUSHLESS_CHANNEL_10 );
+}
+
+int NarfduinoBrushless::GetSpeedLimit()
+{
+  return min( 1000 + (SpeedLimit >> _NARFDUINO_BRUSHLESS_SPEED_SHIFT), 2000 );
+}
+
+// The requested speed, under the limit, goes out straight away or through the ramp
+void NarfduinoBrushless::ApplyTarget( byte Channel )
+{
+  uint16_t Target = min( ChannelRequest[Channel], SpeedLimit );
+
+  uint8_t OldSREG = SREG;
+  cli();
+  ChannelTarget[Channel] = Target;
+  uint16_t Step = (Target > ChannelSpeed[Channel]) ? AccelerationStep[Channel] : DecelerationStep[Channel];
+  if( !Step )
+  {
+    ChannelSpeed[Channel] = Target;
+    if( Protocol != 255 )
+      WriteChannel( Channel );
+  }
+  else if( ChannelSpeed[Channel] != Target )
+  {
+    Ramping = true;
+    if( Initialised && !IsDShot() )
+      TIMSK1 |= (1 << TOIE1);
+  }
+  SREG = OldSREG;
+}
+
+// The speed a channel is being driven at right now
+int NarfduinoBrushless::GetSpeed( byte Channel )
+{
+  if( Channel > _NARFDUINO_BRUSHLESS_CHANNEL_10 )
+    return 1000;
+  uint8_t OldSREG = SREG;
+  cli();
+  uint16_t Speed = ChannelSpeed[Channel];
+  SREG = OldSREG;
+  return 1000 + ((Speed + (1 << (_NARFDUINO_BRUSHLESS_SPEED_SHIFT - 1))) >> _NARFDUINO_BRUSHLESS_SPEED_SHIFT);
+}
+
+// The speed a channel was last set to, whatever the limit
+int NarfduinoBrushless::GetTargetSpeed( byte Channel )
+{
+  if( Channel > _NARFDUINO_BRUSHLESS_CHANNEL_10 )
+    return 1000;
+  return 1000 + (ChannelRequest[Channel] >> _NARFDUINO_BRUSHLESS_SPEED_SHIFT);
+}
+
+// The higher of the two channels - for the load on the battery
+int NarfduinoBrushless::GetSpeed()
+{
+  return max( GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9 ), GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10 ) );
 }
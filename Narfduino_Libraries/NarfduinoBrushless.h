@@ -25,10 +25,56 @@
 #define _NARFDUINO_ENABLE_BRUSHLESS_9
 #define _NARFDUINO_ENABLE_BRUSHLESS_10
 
+// Uncomment this (or add it to your build flags) for the ramp and DShot. They run from the Timer1 overflow and compare A interrupts, 
+// which Servo, TimerOne and the like take too. Without it SetRamp() has no effect, and SetProtocol() turns DShot down.
+//#define _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS
+
 // The pins are fixed.
 #define _NARFDUINO_PIN_MOTOR_9 9
 #define _NARFDUINO_PIN_MOTOR_10 10
 
+// Output protocols. Check what your ESC supports - the faster protocols get a throttle change to the ESC much sooner.
+#define _NARFDUINO_BRUSHLESS_PWM 0          // Standard servo pulses, 1000 - 2000us. Any ESC.
+#define _NARFDUINO_BRUSHLESS_ONESHOT125 1   // 125 - 250us
+#define _NARFDUINO_BRUSHLESS_ONESHOT42 2    // 42 - 84us
+#define _NARFDUINO_BRUSHLESS_MULTISHOT 3    // 5 - 25us
+#define _NARFDUINO_BRUSHLESS_DSHOT150 4     // Digital, 150kbit. No calibration, and every frame is checksummed.
+#define _NARFDUINO_BRUSHLESS_DSHOT300 5     // Digital, 300kbit
+
+// The protocol Init() sets up, if SetProtocol() hasn't been called.
+#ifndef _NARFDUINO_BRUSHLESS_PROTOCOL
+  #define _NARFDUINO_BRUSHLESS_PROTOCOL _NARFDUINO_BRUSHLESS_PWM
+#endif
+
+// Frames per second, in Hz. 0 = the default for the protocol - 50Hz PWM, 2kHz OneShot125, 4kHz OneShot42, 8kHz Multishot, 
+// 1kHz DShot150, 2kHz DShot300
+#ifndef _NARFDUINO_BRUSHLESS_FRAME_RATE
+  #define _NARFDUINO_BRUSHLESS_FRAME_RATE 0
+#endif
+
+// DShot is bit-banged on PORTB from the Timer1 interrupt, with interrupts off for the frame - 107us on DShot150, 53us on DShot300.
+// Each phase of a bit is a port write and a counted delay. The instructions around the delays are taken off them:
+// _WRITE_CYCLES after every port write, and _LOOP_CYCLES more at the end of every bit. These are estimates for avr-gcc -Os at 16MHz, 
+// not yet checked on a board - an out for the write, and the loop count, branch and next bit load for the loop. Check them against 
+// avr-objdump -d of HandleFrameInterrupt() from your build, and scope the output, before running DShot300 into an ESC - it has little margin.
+// The host simulation leaves them out, so its bit timing checks only cover the delays.
+#ifndef _NARFDUINO_DSHOT_PORT_WRITE
+  #define _NARFDUINO_DSHOT_PORT_WRITE(Value) PORTB = (Value)
+#endif
+#ifndef _NARFDUINO_DSHOT_DELAY_CYCLES
+  #define _NARFDUINO_DSHOT_DELAY_CYCLES(Cycles) __builtin_avr_delay_cycles( Cycles )
+#endif
+#ifndef _NARFDUINO_DSHOT_WRITE_CYCLES
+  #define _NARFDUINO_DSHOT_WRITE_CYCLES 1
+#endif
+#ifndef _NARFDUINO_DSHOT_LOOP_CYCLES
+  #define _NARFDUINO_DSHOT_LOOP_CYCLES 6
+#endif
+
+// Channels, for the functions that drive the pins separately
+#define _NARFDUINO_BRUSHLESS_CHANNEL_9 0
+#define _NARFDUINO_BRUSHLESS_CHANNEL_10 1
+
 
 class NarfduinoBrushless
 {
@@ -36,10 +82,98 @@ class NarfduinoBrushless
 
     // Call once in setup to initialise the pins and OC1 timer.
     void Init();
+
+    // Select the output protocol and frame rate (Hz, 0 = the protocol default). Can be called before or after Init().
+    // PWM runs from 31 - 470Hz. The others need at least 245Hz, and a frame a little longer than their longest pulse.
+    // DShot runs from 31Hz, up to 4.6kHz on DShot150 and 9.3kHz on DShot300 - the frame has to be at least twice the time it takes to send.
+    // DShot needs _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS.
+    // Returns false, and leaves the output alone, if the protocol or frame rate can't be done.
+    bool SetProtocol( byte NewProtocol, unsigned int FrameRate = 0 );
+
+    // Change the frame rate for the current protocol. Returns false if it can't be done.
+    bool SetFrameRate( unsigned int FrameRate );
+
+    // Ramp a channel towards its speed instead of jumping straight to it. Rates are in speed units (1000 - 2000) per second - 
+    // e.g. 2000 goes from stopped to full in half a second. 0 = no ramp, which is the default.
+    // The ramp runs in the Timer1 interrupt, once per frame, so it costs the main loop nothing. Use for smooth spin-up.
+    // Needs _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS.
+    void SetRamp( byte Channel, unsigned int Acceleration, unsigned int Deceleration );
     
     // Updates the PWM Timers. Take a value from 1000 - 2000us, and adjust it to a value that the timer can use.
+    // The value is always 1000 - 2000, whatever the protocol - it is scaled to the protocol's pulse width.
+    // Sets both channels.
     void UpdateSpeed( int NewSpeed );
 
+    // Same, for one channel - _NARFDUINO_BRUSHLESS_CHANNEL_9 or _NARFDUINO_BRUSHLESS_CHANNEL_10
+    void UpdateSpeed( byte Channel, int NewSpeed );
+
+    // The speed a channel is being driven at right now, from 1000 - 2000. Part way up the ramp if it's ramping.
+    int GetSpeed( byte Channel );
+
+    // The speed a channel was last set to, from 1000 - 2000. This is what it goes back to when the speed limit lifts.
+    int GetTargetSpeed( byte Channel );
+
+    // Hold both channels at or below MaxSpeed (1000 - 2000), whatever UpdateSpeed() asks for. 2000 = no limit, which is the default.
+    // Used by NarfduinoPowerGovernor to keep the pack up on a tired battery. Changes go through the ramp, like any other.
+    void SetSpeedLimit( int MaxSpeed );
+    int GetSpeedLimit();
+
+    // The higher of the two channels' current speeds. Use this for NarfduinoBattery::SetBrushlessLoad()
+    int GetSpeed();
+
+    // Internal - called from the Timer1 interrupts, once a frame.
+    static void HandleFrameInterrupt();
+
+  private:
+    // Write the timer setup for the current protocol
+    void ApplyProtocol();
+
+    // Work out the ramp steps per frame for the current frame rate
+    void CalculateRampSteps();
+
+    // Send a channel's requested speed, under the limit, to the output or the ramp
+    void ApplyTarget( byte Channel );
+
+    // Put a channel's current speed on its pin
+    void WriteChannel( byte Channel );
+
+    // Move the ramping channels on by a frame. Called from the interrupt.
+    void ProcessRamp();
+
+    // DShot - build the frame for the channels' current speeds, and send it
+    void BuildDShotFrame();
+    void SendDShotFrame();
+
+    bool IsDShot();
+
+    bool Initialised = false;
+    byte Protocol = 255; // Not selected yet
+
+    // Worked out in SetProtocol(), so writing a speed is a multiply and a shift
+    byte ClockSelect = 0;
+    uint16_t FrameTicks = 0;
+    unsigned int FrameRate = 0;
+    uint16_t MinPulseTicks = 0;
+    uint32_t PulseScale = 0; // Timer ticks per speed unit, * 65536
+
+    // Per channel. Speeds are kept as 1/64ths of a unit above 1000, so slow ramps still move every frame.
+    volatile uint16_t ChannelSpeed[2] = { 0, 0 };
+    volatile uint16_t ChannelTarget[2] = { 0, 0 };
+    uint16_t ChannelRequest[2] = { 0, 0 }; // As set by UpdateSpeed(), before the limit
+    uint16_t SpeedLimit = 0xFFFF; // In 1/64ths too. 0xFFFF = no limit
+    unsigned int ChannelAcceleration[2] = { 0, 0 };
+    unsigned int ChannelDeceleration[2] = { 0, 0 };
+    uint16_t AccelerationStep[2] = { 0, 0 }; // Per frame, in 1/64ths. 0 = no ramp
+    uint16_t DecelerationStep[2] = { 0, 0 };
+    volatile bool Ramping = false;
+
+    // DShot. The frame is kept as the PORTB bits that are high in the middle of each bit, MSB first.
+    // The interrupt builds it when a speed has changed, just before it sends it, so it never sends half a frame.
+    uint8_t DShotBits[16];
+    volatile bool DShotFrameChanged = true;
+    uint8_t DShotMask = 0; // The PORTB bits for the enabled motor pins
+
+    static NarfduinoBrushless *TimerBrushless; // The instance that owns Timer1, for the interrupts
 };
 
 #endif
\ No newline at end of file
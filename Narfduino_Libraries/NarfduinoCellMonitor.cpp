@@ -0,0 +1,200 @@
+/*
+ *  Narfduino Libraries - NarfduinoCellMonitor
+ *  
+ *  Use this to monitor the individual cells of a pack through its balance lead.
+ *  
+ *  (c) 2019 - Ireland Software
+ *  License: 
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier), 
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *    
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *  
+ */
+
+
+#include "NarfduinoCellMonitor.h"
+#include "NarfduinoProfiler.h"
+#include "NarfduinoADC.h"
+
+
+// Add a balance tap. Taps go in order from cell 1 up.
+byte NarfduinoCellMonitor::AddChannel( byte Pin, unsigned int DividerHigh, unsigned int DividerLow )
+{
+  if( NumChannels >= _NARFDUINO_CELL_MONITOR_MAX_CHANNELS || DividerLow == 0 )
+    return 255;
+
+  Channel *NewChannel = &Channels[NumChannels];
+  NewChannel->Pin = Pin;
+
+  // Tap voltage at full scale (1024), then the same (Total * Scale) >> 16 conversion NarfduinoBattery uses
+  uint32_t FullScaleMillivolts = ((uint32_t)_NARFDUINO_BATTERY_VREF_MV * ((uint32_t)DividerHigh + DividerLow) + DividerLow / 2) / DividerLow;
+  NewChannel->Scale = (FullScaleMillivolts * 64UL + _NARFDUINO_CELL_MONITOR_NUM_SAMPLES / 2) / _NARFDUINO_CELL_MONITOR_NUM_SAMPLES;
+
+  NewChannel->RingTotal = 0;
+  NewChannel->RingHead = 0;
+  NewChannel->RingCount = 0;
+  NewChannel->Millivolts = 65535;
+
+  return NumChannels++;
+}
+
+// Call this once, after adding the taps.
+bool NarfduinoCellMonitor::Init()
+{
+  for( byte Count = 0; Count < NumChannels; Count++ )
+    pinMode( Channels[Count].Pin, INPUT );
+
+  NextChannel = 0;
+  LastConversion = millis();
+  WeakestCell = 255;
+  WeakestCellMillivolts = 65535;
+
+  return NumChannels > 0;
+}
+
+byte NarfduinoCellMonitor::GetNumChannels()
+{
+  return NumChannels;
+}
+
+unsigned int NarfduinoCellMonitor::GetTapMillivolts( byte Channel )
+{
+  if( Channel >= NumChannels )
+    return 65535;
+  return Channels[Channel].Millivolts;
+}
+
+// Each cell is its tap, less the tap below it
+unsigned int NarfduinoCellMonitor::GetCellMillivolts( byte Cell )
+{
+  if( Cell >= NumChannels )
+    return 65535;
+
+  unsigned int TapMillivolts = Channels[Cell].Millivolts;
+  if( Cell == 0 || TapMillivolts == 65535 )
+    return TapMillivolts;
+
+  unsigned int BelowMillivolts = Channels[Cell - 1].Millivolts;
+  if( BelowMillivolts == 65535 )
+    return 65535;
+  if( BelowMillivolts >= TapMillivolts )
+    return 0;
+  return TapMillivolts - BelowMillivolts;
+}
+
+byte NarfduinoCellMonitor::GetWeakestCell()
+{
+  return WeakestCell;
+}
+
+unsigned int NarfduinoCellMonitor::GetWeakestCellMillivolts()
+{
+  return WeakestCellMillivolts;
+}
+
+bool NarfduinoCellMonitor::IsCellFlat()
+{
+  return WeakestCellMillivolts < _NARFDUINO_CELL_MONITOR_CELL_MIN_MV;
+}
+
+// Called from the ADC interrupt. Drop the sample into the ring for the tap being converted.
+void NarfduinoCellMonitor::SampleComplete( void *Context, uint16_t Value )
+{
+  NarfduinoCellMonitor *Monitor = (NarfduinoCellMonitor *)Context;
+  byte ChannelNumber = Monitor->ConvertingChannel;
+  Channel *SampledChannel = &Monitor->Channels[ChannelNumber];
+
+  if( SampledChannel->RingCount < _NARFDUINO_CELL_MONITOR_NUM_SAMPLES )
+    SampledChannel->RingCount++;
+  else
+    SampledChannel->RingTotal -= SampledChannel->Ring[SampledChannel->RingHead];
+  SampledChannel->Ring[SampledChannel->RingHead] = Value;
+  SampledChannel->RingTotal += Value;
+  SampledChannel->RingHead++;
+  if( SampledChannel->RingHead >= _NARFDUINO_CELL_MONITOR_NUM_SAMPLES )
+    SampledChannel->RingHead = 0;
+
+  Monitor->ConvertingChannel = 255;
+  Monitor->NewSampleChannel = ChannelNumber;
+}
+
+// A tap has a new sample. Convert it, and find the weakest cell again.
+void NarfduinoCellMonitor::UpdateChannel( byte ChannelNumber )
+{
+  Channel *UpdatedChannel = &Channels[ChannelNumber];
+
+  uint8_t OldSREG = SREG;
+  cli();
+  uint16_t Total = UpdatedChannel->RingTotal;
+  byte Count = UpdatedChannel->RingCount;
+  SREG = OldSREG;
+
+  // Wait for a full ring before reporting anything
+  if( Count < _NARFDUINO_CELL_MONITOR_NUM_SAMPLES )
+    return;
+  UpdatedChannel->Millivolts = ((uint32_t)Total * UpdatedChannel->Scale + 32768UL) >> 16;
+
+  // Only one tap changed, so this runs once per sample, not once per loop
+  WeakestCell = 255;
+  WeakestCellMillivolts = 65535;
+  for( byte Cell = 0; Cell < NumChannels; Cell++ )
+  {
+    unsigned int CellMillivolts = GetCellMillivolts( Cell );
+    if( CellMillivolts == 65535 )
+    {
+      // Not every tap has been read yet
+      WeakestCell = 255;
+      WeakestCellMillivolts = 65535;
+      return;
+    }
+    if( CellMillivolts < WeakestCellMillivolts )
+    {
+      WeakestCell = Cell;
+      WeakestCellMillivolts = CellMillivolts;
+    }
+  }
+}
+
+// Run the monitor. This needs to be run at regular intervals.
+void NarfduinoCellMonitor::ProcessCellMonitor()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_CELL_MONITOR );
+  if( NumChannels == 0 )
+    return;
+
+  // Pick up a finished sample
+  NarfduinoADC::Poll();
+  if( NewSampleChannel != 255 )
+  {
+    uint8_t OldSREG = SREG;
+    cli();
+    byte ChannelNumber = NewSampleChannel;
+    NewSampleChannel = 255;
+    SREG = OldSREG;
+
+    UpdateChannel( ChannelNumber );
+  }
+
+  // The taps share the check interval between them - one conversion per slot, round-robin.
+  if( millis() - LastConversion < (unsigned long)(_NARFDUINO_CELL_MONITOR_CHECK_INTERVAL / NumChannels) )
+    return;
+  if( ConvertingChannel != 255 )
+    return;
+
+  // If the ADC is busy, try again next time.
+  ConvertingChannel = NextChannel;
+  if( !NarfduinoADC::StartConversion( Channels[NextChannel].Pin, SampleComplete, this ) )
+  {
+    ConvertingChannel = 255;
+    return;
+  }
+  LastConversion = millis();
+  NextChannel++;
+  if( NextChannel >= NumChannels )
+    NextChannel = 0;
+}
@@ -0,0 +1,122 @@
+/*
+ *  Narfduino Libraries - NarfduinoCellMonitor
+ *  
+ *  Use this to monitor the individual cells of a pack through its balance lead.
+ *  Each balance tap goes to an analog pin through its own voltage divider. Add the taps in order, from cell 1 up.
+ *  
+ *  The taps share one ADC and one rate budget - the monitor converts one tap at a time, round-robin, in the background.
+ *  Adding more taps doesn't make ProcessCellMonitor() any more expensive, each tap is just sampled less often.
+ *  
+ *  Uses NarfduinoADC - don't use analogRead() elsewhere in your code while this is running.
+ *  
+ *  (c) 2019 - Ireland Software
+ *  License: 
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier), 
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *    
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *  
+ */
+
+#ifndef _NARFDUINO_CELL_MONITOR_LIB
+#define _NARFDUINO_CELL_MONITOR_LIB
+
+#include "Arduino.h"
+#include "NarfduinoBattery.h"
+
+// Default Definitions
+
+// Most balance taps the monitor can handle. Each one costs about 20 bytes of RAM.
+#ifndef _NARFDUINO_CELL_MONITOR_MAX_CHANNELS
+  #define _NARFDUINO_CELL_MONITOR_MAX_CHANNELS 6
+#endif
+
+// The rate budget, shared by all taps. Every tap is sampled once in this time, in ms
+#ifndef _NARFDUINO_CELL_MONITOR_CHECK_INTERVAL
+  #define _NARFDUINO_CELL_MONITOR_CHECK_INTERVAL 500
+#endif
+
+// Samples averaged for each tap. Max 64.
+#ifndef _NARFDUINO_CELL_MONITOR_NUM_SAMPLES
+  #define _NARFDUINO_CELL_MONITOR_NUM_SAMPLES 4
+#endif
+
+// A cell below this is flat, in mV
+#ifndef _NARFDUINO_CELL_MONITOR_CELL_MIN_MV
+  #define _NARFDUINO_CELL_MONITOR_CELL_MIN_MV 3200
+#endif
+
+
+class NarfduinoCellMonitor
+{
+  public:
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Add a balance tap. Add them in order - cell 1 first, then the tap above cell 2, and so on.
+    // DividerHigh and DividerLow are the divider resistors on this tap, in any unit. Use 0 and 1 for a tap with no divider.
+    // Returns the tap number, or 255 if there is no room left.
+    byte AddChannel( byte Pin, unsigned int DividerHigh, unsigned int DividerLow );
+
+    // Call this once, after adding the taps.
+    bool Init();
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Number of taps - which is also the number of cells
+    byte GetNumChannels();
+
+    // Voltage at a balance tap, in mV. This is cells 1 to Channel + 1 together. Returns 65535 if it hasn't been read yet.
+    unsigned int GetTapMillivolts( byte Channel );
+
+    // Voltage of a single cell, in mV. Cells start at 0. Returns 65535 if it hasn't been read yet.
+    unsigned int GetCellMillivolts( byte Cell );
+
+    // The cell with the lowest voltage, and its voltage. Returns 255 / 65535 until every tap has been read.
+    byte GetWeakestCell();
+    unsigned int GetWeakestCellMillivolts();
+
+    // Gets an indication if any cell is flat
+    bool IsCellFlat();
+
+    // Run the monitor. This needs to be run at regular intervals - it starts the next conversion when it's due, and picks up finished ones.
+    void ProcessCellMonitor();
+
+  private:
+    // Called from the ADC interrupt with a finished sample
+    static void SampleComplete( void *Context, uint16_t Value );
+
+    // Work out the tap and cell voltages after a new sample
+    void UpdateChannel( byte Channel );
+
+    struct Channel
+    {
+      byte Pin;
+      uint32_t Scale; // Sample total to mV is (Total * Scale) >> 16
+      volatile uint16_t Ring[_NARFDUINO_CELL_MONITOR_NUM_SAMPLES];
+      volatile uint16_t RingTotal;
+      volatile byte RingHead;
+      volatile byte RingCount;
+      unsigned int Millivolts;
+    };
+
+    Channel Channels[_NARFDUINO_CELL_MONITOR_MAX_CHANNELS];
+    byte NumChannels = 0;
+    byte NextChannel = 0;
+    volatile byte ConvertingChannel = 255;
+    volatile byte NewSampleChannel = 255; // 255 = nothing new
+    unsigned long LastConversion = 0;
+    byte WeakestCell = 255;
+    unsigned int WeakestCellMillivolts = 65535;
+};
+
+#endif
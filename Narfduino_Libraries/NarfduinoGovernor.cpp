@@ -0,0 +1,269 @@
+/*
+ *  Narfduino Libraries - NarfduinoGovernor
+ *
+ *  Use this to hold a flywheel at a set RPM, using a tachometer input. Knows when the wheels are up to speed, so you can fire straight away.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoGovernor.h"
+#include "NarfduinoProfiler.h"
+#include "NarfduinoBrushless.h"
+#include "NarfduinoBridge.h"
+
+// No pulse for this long and the flywheel is stopped, in us. Also the longest period that gets timed - about 300RPM at 1 pulse per rev.
+#define _NARFDUINO_GOVERNOR_TACH_TIMEOUT 200000UL
+
+// Full throttle, in the governor's units
+#define _NARFDUINO_GOVERNOR_FULL_OUTPUT 1000
+
+NarfduinoGovernor *NarfduinoGovernor::TachGovernors[2] = { NULL, NULL };
+
+
+// Set up the tach input
+bool NarfduinoGovernor::Init( byte TachPin, byte PulsesPerRev )
+{
+  int Interrupt = digitalPinToInterrupt( TachPin );
+  if( Interrupt == NOT_AN_INTERRUPT || Interrupt > 1 || PulsesPerRev == 0 )
+    return false;
+  if( TachGovernors[Interrupt] && TachGovernors[Interrupt] != this )
+    return false;
+
+  this->PulsesPerRev = PulsesPerRev;
+  SetMaxRPM( MaxRPM );
+  CalculateIntegralStep();
+
+  pinMode( TachPin, INPUT_PULLUP );
+  TachInterrupt = Interrupt;
+  TachGovernors[Interrupt] = this;
+  attachInterrupt( Interrupt, (Interrupt == 0) ? TachInterrupt0 : TachInterrupt1, RISING );
+
+  LastProcess = millis();
+  return true;
+}
+
+void NarfduinoGovernor::AttachBrushless( NarfduinoBrushless *Brushless, byte Channel )
+{
+  this->Brushless = Brushless;
+  BrushlessChannel = Channel;
+  Bridge = NULL;
+  LastOutput = -1;
+}
+
+void NarfduinoGovernor::AttachBridge( NarfduinoBridgeBase *Bridge )
+{
+  this->Bridge = Bridge;
+  Brushless = NULL;
+  LastOutput = -1;
+}
+
+void NarfduinoGovernor::SetMaxRPM( unsigned int MaxRPM )
+{
+  if( MaxRPM == 0 )
+    return;
+  this->MaxRPM = MaxRPM;
+  // Pulses more than twice as quick as full speed can only be noise
+  unsigned long PulsesPerMinute = (unsigned long)MaxRPM * PulsesPerRev * 2;
+  unsigned long NewMinPeriod = 60000000UL / PulsesPerMinute;
+  uint8_t OldSREG = SREG;
+  cli();
+  MinPeriodMicros = NewMinPeriod;
+  SREG = OldSREG;
+}
+
+void NarfduinoGovernor::SetGains( unsigned int Kp, unsigned int Ki )
+{
+  this->Kp = Kp;
+  this->Ki = Ki;
+  CalculateIntegralStep();
+}
+
+// Ki is per second and per 1000 RPM. Per interval and per RPM, * 65536, so the interval only needs a multiply.
+void NarfduinoGovernor::CalculateIntegralStep()
+{
+  IntegralStep = ((uint32_t)Ki * _NARFDUINO_GOVERNOR_INTERVAL * 65536UL + 500000UL) / 1000000UL;
+  if( Ki && !IntegralStep )
+    IntegralStep = 1;
+}
+
+// The RPM to hold. 0 = stop.
+void NarfduinoGovernor::SetTargetRPM( unsigned int TargetRPM )
+{
+  if( TargetRPM == this->TargetRPM )
+    return;
+  this->TargetRPM = TargetRPM;
+  AtSpeedCount = 0;
+  if( TargetRPM == 0 )
+  {
+    Integral = 0;
+    Output = 0;
+    WriteOutput();
+  }
+}
+
+unsigned int NarfduinoGovernor::GetTargetRPM()
+{
+  return TargetRPM;
+}
+
+unsigned int NarfduinoGovernor::GetRPM()
+{
+  return CurrentRPM;
+}
+
+int NarfduinoGovernor::GetOutput()
+{
+  return Output;
+}
+
+bool NarfduinoGovernor::IsAtSpeed()
+{
+  return TargetRPM && AtSpeedCount >= _NARFDUINO_GOVERNOR_AT_SPEED_INTERVALS;
+}
+
+
+// Tach interrupts
+void NarfduinoGovernor::TachInterrupt0()
+{
+  if( TachGovernors[0] )
+    TachGovernors[0]->HandleTachPulse();
+}
+
+void NarfduinoGovernor::TachInterrupt1()
+{
+  if( TachGovernors[1] )
+    TachGovernors[1]->HandleTachPulse();
+}
+
+// Time the pulse against the last one. Glitches are ignored, and a pulse after a long gap just starts the timing again.
+void NarfduinoGovernor::HandleTachPulse()
+{
+  unsigned long Now = micros();
+  unsigned long Period = Now - LastPulseMicros;
+  if( TachRunning && Period < MinPeriodMicros )
+    return;
+  LastPulseMicros = Now;
+
+  if( !TachRunning || Period > _NARFDUINO_GOVERNOR_TACH_TIMEOUT )
+  {
+    TachRunning = true;
+    return;
+  }
+  // Keep the total in range if the main loop stalls
+  if( PeriodCount == 255 )
+    return;
+  PeriodTotal += Period;
+  PeriodCount++;
+}
+
+// Average the periods since the last interval. With no pulse, the gap since the last one is as quick as it could be going.
+void NarfduinoGovernor::UpdateRPM()
+{
+  uint8_t OldSREG = SREG;
+  cli();
+  unsigned long Total = PeriodTotal;
+  byte Count = PeriodCount;
+  unsigned long LastPulse = LastPulseMicros;
+  bool Running = TachRunning;
+  PeriodTotal = 0;
+  PeriodCount = 0;
+  SREG = OldSREG;
+
+  unsigned long Gap = micros() - LastPulse;
+  if( !Running || Gap > _NARFDUINO_GOVERNOR_TACH_TIMEOUT )
+  {
+    CurrentRPM = 0;
+    return;
+  }
+
+  // It can't be going any quicker than the gap since the last pulse allows
+  unsigned long GapRPM = 60000000UL / PulsesPerRev / max( Gap, 1UL );
+  unsigned long RPM = CurrentRPM;
+  if( Count )
+    RPM = 60000000UL / PulsesPerRev / ((Total + Count / 2) / Count);
+  if( GapRPM < RPM )
+    RPM = GapRPM;
+  CurrentRPM = min( RPM, 65535UL );
+}
+
+void NarfduinoGovernor::WriteOutput()
+{
+  if( Output == LastOutput )
+    return;
+  LastOutput = Output;
+  if( Brushless )
+    Brushless->UpdateSpeed( BrushlessChannel, 1000 + Output );
+  else if( Bridge )
+    Bridge->SetBridgeSpeedFine( Output );
+}
+
+// Run the governor. Starts from the throttle the target should need, and a PI controller trims out the rest -
+// battery sag, wheel wear, and the speed lost on each shot.
+void NarfduinoGovernor::ProcessGovernor()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_GOVERNOR );
+  if( millis() - LastProcess < _NARFDUINO_GOVERNOR_INTERVAL )
+    return;
+  LastProcess += _NARFDUINO_GOVERNOR_INTERVAL;
+  // Don't try to catch up after a stall
+  if( millis() - LastProcess >= _NARFDUINO_GOVERNOR_INTERVAL )
+    LastProcess = millis();
+
+  if( TachInterrupt == 255 )
+    return;
+  UpdateRPM();
+
+  if( !TargetRPM )
+  {
+    AtSpeedCount = 0;
+    return;
+  }
+
+  int32_t Error = (int32_t)TargetRPM - (int32_t)CurrentRPM;
+
+  // At speed check
+  uint32_t Tolerance = (uint32_t)TargetRPM * _NARFDUINO_GOVERNOR_AT_SPEED_PERCENT / 100;
+  if( (uint32_t)abs( Error ) <= Tolerance )
+  {
+    if( AtSpeedCount < 255 )
+      AtSpeedCount++;
+  }
+  else
+    AtSpeedCount = 0;
+
+  int32_t FeedForward = (int32_t)((uint32_t)TargetRPM * _NARFDUINO_GOVERNOR_FULL_OUTPUT / MaxRPM);
+  int32_t Proportional = Error * (int32_t)Kp / 1000;
+  int32_t NewIntegral = Integral + Error * IntegralStep;
+  NewIntegral = constrain( NewIntegral, -((int32_t)_NARFDUINO_GOVERNOR_FULL_OUTPUT << 16), ((int32_t)_NARFDUINO_GOVERNOR_FULL_OUTPUT << 16) );
+
+  int32_t NewOutput = FeedForward + Proportional + (NewIntegral >> 16);
+  // At a limit, the integral only moves if it brings the output back off it
+  if( NewOutput > _NARFDUINO_GOVERNOR_FULL_OUTPUT )
+  {
+    NewOutput = _NARFDUINO_GOVERNOR_FULL_OUTPUT;
+    if( Error < 0 )
+      Integral = NewIntegral;
+  }
+  else if( NewOutput < 0 )
+  {
+    NewOutput = 0;
+    if( Error > 0 )
+      Integral = NewIntegral;
+  }
+  else
+    Integral = NewIntegral;
+
+  Output = NewOutput;
+  WriteOutput();
+}
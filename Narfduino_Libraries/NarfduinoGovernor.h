@@ -0,0 +1,155 @@
+/*
+ *  Narfduino Libraries - NarfduinoGovernor
+ *
+ *  Use this to hold a flywheel at a set RPM, using a tachometer input. Knows when the wheels are up to speed, so you can fire straight away.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_GOVERNOR_LIB
+#define _NARFDUINO_GOVERNOR_LIB
+
+#include "Arduino.h"
+
+class NarfduinoBrushless;
+class NarfduinoBridgeBase;
+
+// Default Definitions
+
+// Tach pulses per revolution of the flywheel. 1 for a hall sensor or optical sensor with one mark.
+// For ESC RPM output, this is usually the motor poles / 2.
+#ifndef _NARFDUINO_GOVERNOR_PULSES_PER_REV
+  #define _NARFDUINO_GOVERNOR_PULSES_PER_REV 1
+#endif
+
+// Flywheel RPM at full throttle on a full battery. Used to work out a starting throttle for a target, which the controller then corrects.
+#ifndef _NARFDUINO_GOVERNOR_MAX_RPM
+  #define _NARFDUINO_GOVERNOR_MAX_RPM 40000
+#endif
+
+// Proportional gain - throttle (0 - 1000) per 1000 RPM of error
+#ifndef _NARFDUINO_GOVERNOR_KP
+  #define _NARFDUINO_GOVERNOR_KP 100
+#endif
+
+// Integral gain - throttle (0 - 1000) per second, per 1000 RPM of error
+#ifndef _NARFDUINO_GOVERNOR_KI
+  #define _NARFDUINO_GOVERNOR_KI 400
+#endif
+
+// How often the controller runs, in ms
+#ifndef _NARFDUINO_GOVERNOR_INTERVAL
+  #define _NARFDUINO_GOVERNOR_INTERVAL 5
+#endif
+
+// At speed is within this percentage of the target...
+#ifndef _NARFDUINO_GOVERNOR_AT_SPEED_PERCENT
+  #define _NARFDUINO_GOVERNOR_AT_SPEED_PERCENT 5
+#endif
+
+// ... for this many control intervals in a row
+#ifndef _NARFDUINO_GOVERNOR_AT_SPEED_INTERVALS
+  #define _NARFDUINO_GOVERNOR_AT_SPEED_INTERVALS 2
+#endif
+
+
+class NarfduinoGovernor
+{
+  public:
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Set up the tach input. It has to be an external interrupt pin - 2 or 3 on the Narfduino.
+    // Returns false if the pin can't be used, or another governor already has it.
+    bool Init( byte TachPin, byte PulsesPerRev = _NARFDUINO_GOVERNOR_PULSES_PER_REV );
+
+    // Drive a brushless channel (_NARFDUINO_BRUSHLESS_CHANNEL_9 / _10) ...
+    void AttachBrushless( NarfduinoBrushless *Brushless, byte Channel );
+
+    // ... or a brushed flywheel on the bridge. Start and stop the bridge as usual - the governor only sets the speed.
+    void AttachBridge( NarfduinoBridgeBase *Bridge );
+
+    // Flywheel RPM at full throttle on a full battery
+    void SetMaxRPM( unsigned int MaxRPM );
+
+    // Controller gains. See _NARFDUINO_GOVERNOR_KP and _NARFDUINO_GOVERNOR_KI
+    void SetGains( unsigned int Kp, unsigned int Ki );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // The RPM to hold. 0 = stop.
+    void SetTargetRPM( unsigned int TargetRPM );
+    unsigned int GetTargetRPM();
+
+    // Measured flywheel RPM
+    unsigned int GetRPM();
+
+    // Throttle the governor is asking for, 0 - 1000
+    int GetOutput();
+
+    // True when the flywheel has been at the target for a couple of control intervals. Fire when this goes true.
+    bool IsAtSpeed();
+
+    // Run the governor. This needs to be run at regular intervals.
+    void ProcessGovernor();
+
+  private:
+    // Tach interrupts - one per external interrupt
+    static void TachInterrupt0();
+    static void TachInterrupt1();
+    void HandleTachPulse();
+
+    // Measure the RPM from the pulses since the last interval
+    void UpdateRPM();
+
+    // Send the throttle to the motor
+    void WriteOutput();
+
+    void CalculateIntegralStep();
+
+    static NarfduinoGovernor *TachGovernors[2];
+
+    byte TachInterrupt = 255;
+    byte PulsesPerRev = _NARFDUINO_GOVERNOR_PULSES_PER_REV;
+    unsigned long MinPeriodMicros = 0; // Anything quicker than this is noise
+
+    // Written by the interrupt
+    volatile unsigned long LastPulseMicros = 0;
+    volatile unsigned long PeriodTotal = 0; // Pulse periods since the main loop last looked, in us
+    volatile byte PeriodCount = 0;
+    volatile bool TachRunning = false; // The last pulse had one before it that was close enough to time
+
+    NarfduinoBrushless *Brushless = NULL;
+    byte BrushlessChannel = 0;
+    NarfduinoBridgeBase *Bridge = NULL;
+
+    unsigned int MaxRPM = _NARFDUINO_GOVERNOR_MAX_RPM;
+    unsigned int Kp = _NARFDUINO_GOVERNOR_KP;
+    unsigned int Ki = _NARFDUINO_GOVERNOR_KI;
+    int32_t IntegralStep = 0; // Throttle * 65536 added per interval, per RPM of error
+
+    unsigned int TargetRPM = 0;
+    unsigned int CurrentRPM = 0;
+    int32_t Integral = 0; // Throttle * 65536
+    int Output = 0;
+    int LastOutput = -1;
+    byte AtSpeedCount = 0;
+    unsigned long LastProcess = 0;
+};
+
+#endif
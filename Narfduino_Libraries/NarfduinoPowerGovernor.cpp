@@ -0,0 +1,168 @@
+/*
+ *  Narfduino Libraries - NarfduinoPowerGovernor
+ *
+ *  Use this to keep a tired battery from browning out the board. The bridge speed and brushless throttle are scaled back
+ *  together, to keep the pack above a floor under load.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoPowerGovernor.h"
+#include "NarfduinoProfiler.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBrushless.h"
+
+// The correction never takes the allowed current below this, in 0.1%
+#define _NARFDUINO_POWER_GOVERNOR_MIN_CORRECTION 250
+
+// The trend is measured over this long, in ms, so a step in the load doesn't look like the pack falling away
+#define _NARFDUINO_POWER_GOVERNOR_TREND_PERIOD 250
+
+void NarfduinoPowerGovernor::AttachBattery( NarfduinoBattery *Battery )
+{
+  this->Battery = Battery;
+  LastRestingMillivolts = 65535;
+  RestingTrend = 0;
+  Correction = 1000;
+}
+
+void NarfduinoPowerGovernor::AttachBridge( NarfduinoBridgeBase *Bridge )
+{
+  this->Bridge = Bridge;
+  ApplyLimit();
+}
+
+void NarfduinoPowerGovernor::AttachBrushless( NarfduinoBrushless *Brushless )
+{
+  this->Brushless = Brushless;
+  PeakThrottle = 1000;
+  ApplyLimit();
+}
+
+void NarfduinoPowerGovernor::SetFloor( unsigned int Millivolts )
+{
+  FloorMillivolts = Millivolts;
+}
+
+unsigned int NarfduinoPowerGovernor::GetFloorMillivolts()
+{
+  if( FloorMillivolts )
+    return FloorMillivolts;
+  unsigned int CellFloor = (unsigned int)_NARFDUINO_POWER_GOVERNOR_CELL_FLOOR_MV * (Battery ? Battery->GetBatteryS() : 0);
+  return max( CellFloor, (unsigned int)_NARFDUINO_POWER_GOVERNOR_MIN_FLOOR_MV );
+}
+
+unsigned int NarfduinoPowerGovernor::GetPowerLimit()
+{
+  return PowerLimit;
+}
+
+bool NarfduinoPowerGovernor::IsLimiting()
+{
+  return PowerLimit < 1000;
+}
+
+// The same load model as the battery's hints. The limits have to be in place before the trigger is pulled, so this is the most
+// the outputs can be asked for - the bridge at its speed whether it's running or not, and the flywheels at the most they've been revved to.
+unsigned long NarfduinoPowerGovernor::GetDemandMilliamps()
+{
+  unsigned long Demand = 0;
+  if( Bridge )
+    Demand += (unsigned long)_NARFDUINO_BATTERY_BRIDGE_FULL_LOAD_MA * Bridge->GetBridgeSpeed() / 100;
+  if( Brushless )
+  {
+    int Throttle = max( Brushless->GetTargetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9 ), Brushless->GetTargetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10 ) );
+    PeakThrottle = max( PeakThrottle, Throttle );
+    Demand += (unsigned long)_NARFDUINO_BATTERY_BRUSHLESS_FULL_LOAD_MA * (PeakThrottle - 1000) / 1000;
+  }
+  return Demand;
+}
+
+void NarfduinoPowerGovernor::ApplyLimit()
+{
+  if( Bridge )
+  {
+    unsigned int SpeedFine = (unsigned int)Bridge->GetBridgeSpeed() * 10;
+    unsigned int LimitFine = (PowerLimit >= 1000) ? 1000 : max( (unsigned long)SpeedFine * PowerLimit / 1000, 1UL );
+    Bridge->SetSpeedLimitFine( LimitFine );
+    if( Battery )
+      Battery->SetBridgeLoad( Bridge->IsBridgeRunning(), (min( SpeedFine, LimitFine ) + 5) / 10 );
+  }
+  if( Brushless )
+  {
+    Brushless->SetSpeedLimit( (PowerLimit >= 1000) ? 2000 : 1000 + (int)((long)(PeakThrottle - 1000) * PowerLimit / 1000) );
+    if( Battery )
+      Battery->SetBrushlessLoad( Brushless->GetSpeed() );
+  }
+}
+
+// Logic:
+// 1 - Project the resting voltage ahead on its trend
+// 2 - The current the pack can give before it sags to the floor is the headroom over its internal resistance
+// 3 - If the outputs would draw more than that at the speeds they're set to, scale them all back by the same amount
+// The learnt resistance is only as good as the load model, so if the voltage under load is still seen below the floor, 
+// the allowed current is cut in proportion, and eased back up once the pack is clear of it.
+void NarfduinoPowerGovernor::ProcessPowerGovernor()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_GOVERNOR );
+  unsigned long Now = millis();
+  if( Now - LastProcess < _NARFDUINO_POWER_GOVERNOR_INTERVAL )
+    return;
+  unsigned long Elapsed = Now - LastProcess;
+  LastProcess = Now;
+
+  unsigned int Resting = Battery ? Battery->GetRestingMillivolts() : 65535;
+  if( Resting == 65535 )
+  {
+    // No voltage yet
+    PowerLimit = 1000;
+    ApplyLimit();
+    return;
+  }
+
+  // A quarter of the way to each new slope
+  if( LastRestingMillivolts == 65535 )
+  {
+    LastRestingMillivolts = Resting;
+    LastTrend = Now;
+  }
+  else if( Now - LastTrend >= _NARFDUINO_POWER_GOVERNOR_TREND_PERIOD )
+  {
+    long Slope = ((long)Resting - (long)LastRestingMillivolts) * 1000L / (long)(Now - LastTrend);
+    RestingTrend += (Slope - RestingTrend) / 4;
+    LastRestingMillivolts = Resting;
+    LastTrend = Now;
+  }
+  long Projected = (long)Resting + min( RestingTrend, 0L ) * _NARFDUINO_POWER_GOVERNOR_TREND_HORIZON / 1000L;
+
+  unsigned int Floor = GetFloorMillivolts();
+  unsigned int Loaded = Battery->GetCurrentMillivolts();
+  if( Loaded < Floor )
+    Correction = max( (unsigned long)Correction * Loaded / Floor, (unsigned long)_NARFDUINO_POWER_GOVERNOR_MIN_CORRECTION );
+  else
+    Correction = min( Correction + (unsigned int)((unsigned long)_NARFDUINO_POWER_GOVERNOR_RECOVERY * Elapsed / 1000UL + 1), 1000U );
+
+  // mV / mOhms = A. The correction is in 0.1%, so this comes out in mA.
+  unsigned long Demand = GetDemandMilliamps();
+  unsigned long Allowed = 0;
+  if( Projected > (long)Floor )
+    Allowed = (unsigned long)(Projected - Floor) * Correction / max( Battery->GetInternalResistance(), 1U );
+
+  if( Demand <= Allowed )
+    PowerLimit = 1000;
+  else
+    PowerLimit = max( Allowed * 1000UL / Demand, (unsigned long)_NARFDUINO_POWER_GOVERNOR_MIN_OUTPUT );
+  ApplyLimit();
+}
@@ -0,0 +1,128 @@
+/*
+ *  Narfduino Libraries - NarfduinoPowerGovernor
+ *
+ *  Use this to keep a tired battery from browning out the board. It works out how much current the pack can give before its
+ *  voltage under load drops to the floor - from the resting voltage and internal resistance NarfduinoBattery learns - and
+ *  scales the bridge speed and brushless throttle back together to stay inside it. The blaster fires slower instead of resetting.
+ *
+ *  The speeds you set are kept. The governor only sets a speed limit on each output, and lifts it when the pack recovers.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_POWER_GOVERNOR_LIB
+#define _NARFDUINO_POWER_GOVERNOR_LIB
+
+#include "Arduino.h"
+
+class NarfduinoBattery;
+class NarfduinoBridgeBase;
+class NarfduinoBrushless;
+
+// Default Definitions
+
+// The lowest the pack is allowed to go under load, per cell, in mV
+#ifndef _NARFDUINO_POWER_GOVERNOR_CELL_FLOOR_MV
+  #define _NARFDUINO_POWER_GOVERNOR_CELL_FLOOR_MV 2800
+#endif
+
+// ... and never below this for the whole pack, whatever the cell count. Leave room above where the board resets.
+#ifndef _NARFDUINO_POWER_GOVERNOR_MIN_FLOOR_MV
+  #define _NARFDUINO_POWER_GOVERNOR_MIN_FLOOR_MV 6000
+#endif
+
+// How often the limits are worked out, in ms
+#ifndef _NARFDUINO_POWER_GOVERNOR_INTERVAL
+  #define _NARFDUINO_POWER_GOVERNOR_INTERVAL 10
+#endif
+
+// The outputs are never held below this much of what was asked for, in 0.1%. The pusher still has to get home.
+#ifndef _NARFDUINO_POWER_GOVERNOR_MIN_OUTPUT
+  #define _NARFDUINO_POWER_GOVERNOR_MIN_OUTPUT 200
+#endif
+
+// The resting voltage is projected this far ahead on its trend, in ms, so a pack that is falling away is limited before it gets there
+#ifndef _NARFDUINO_POWER_GOVERNOR_TREND_HORIZON
+  #define _NARFDUINO_POWER_GOVERNOR_TREND_HORIZON 500
+#endif
+
+// How quickly the correction for a pack that sags more than its learnt resistance says comes back off, in 0.1% per second
+#ifndef _NARFDUINO_POWER_GOVERNOR_RECOVERY
+  #define _NARFDUINO_POWER_GOVERNOR_RECOVERY 100
+#endif
+
+
+class NarfduinoPowerGovernor
+{
+  public:
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // The battery to watch. Turn on its background sampling, so the voltage under load is current.
+    // The governor sets the battery's load hints from the limited outputs - don't call SetBridgeLoad() / SetBrushlessLoad() as well.
+    void AttachBattery( NarfduinoBattery *Battery );
+
+    // The outputs to hold back. Either or both. The flywheels are limited from the most they've been revved to, so the limit
+    // is already there when they rev up again.
+    void AttachBridge( NarfduinoBridgeBase *Bridge );
+    void AttachBrushless( NarfduinoBrushless *Brushless );
+
+    // The lowest the pack can go under load, in mV. 0 = work it out from the cell count - see _NARFDUINO_POWER_GOVERNOR_CELL_FLOOR_MV
+    void SetFloor( unsigned int Millivolts );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // The floor in use, in mV
+    unsigned int GetFloorMillivolts();
+
+    // How much of the asked for speed the outputs are getting, in 0.1%. 1000 = not limited.
+    unsigned int GetPowerLimit();
+
+    // True while the outputs are being held back
+    bool IsLimiting();
+
+    // Run the governor. Call every time through the loop, after ProcessBatteryMonitor().
+    void ProcessPowerGovernor();
+
+  private:
+    // The current the outputs would draw at the speeds they've been asked for, in mA
+    unsigned long GetDemandMilliamps();
+
+    // Set the output limits, and the battery load hints to match
+    void ApplyLimit();
+
+    NarfduinoBattery *Battery = NULL;
+    NarfduinoBridgeBase *Bridge = NULL;
+    NarfduinoBrushless *Brushless = NULL;
+
+    unsigned int FloorMillivolts = 0; // 0 = from the cell count
+    unsigned int PowerLimit = 1000; // 0.1%
+    int PeakThrottle = 1000; // The most the flywheels have been asked for
+
+    // Resting voltage trend, in mV per second
+    unsigned int LastRestingMillivolts = 65535;
+    unsigned long LastTrend = 0;
+    long RestingTrend = 0;
+
+    // Scales the current the pack is allowed, in 0.1%. Comes down when the voltage under load is seen below the floor anyway.
+    unsigned int Correction = 1000;
+
+    unsigned long LastProcess = 0;
+};
+
+#endif
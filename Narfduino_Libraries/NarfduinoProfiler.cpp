@@ -0,0 +1,152 @@
+/*
+ *  Narfduino Libraries - NarfduinoProfiler
+ *
+ *  Use this to see how long the library calls take on the board. Each call is timed from entry to exit,
+ *  and the times are kept as a histogram per function, which you can print out whenever you like.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoProfiler.h"
+
+#ifdef _NARFDUINO_ENABLE_PROFILER
+
+unsigned long NarfduinoProfiler::Count[_NARFDUINO_PROFILER_SLOTS];
+unsigned long NarfduinoProfiler::Total[_NARFDUINO_PROFILER_SLOTS];
+NarfduinoProfiler::Ticks NarfduinoProfiler::Max[_NARFDUINO_PROFILER_SLOTS];
+uint16_t NarfduinoProfiler::Buckets[_NARFDUINO_PROFILER_SLOTS][_NARFDUINO_PROFILER_BUCKETS];
+
+
+bool NarfduinoProfiler::Init()
+{
+  Reset();
+#if _NARFDUINO_PROFILER_CLOCK == _NARFDUINO_PROFILER_CLOCK_TIMER1
+  if( !IsTimer1Free() )
+    return false;
+  // Normal mode, no prescaler, no interrupts
+  TCCR1A = 0;
+  TCCR1B = (1 << CS10);
+  TCNT1 = 0;
+#endif
+  return true;
+}
+
+// The core's init() leaves Timer1 running at /64 in 8 bit phase correct PWM, ready for analogWrite(), so the clock bits don't say 
+// whether anyone is using it. An owner turns on an interrupt (Servo, the brushless ramp and DShot), connects a pin (analogWrite(), 
+// the brushless outputs and the bridge PWM), or sets a mode of its own (TimerOne and the rest).
+bool NarfduinoProfiler::IsTimer1Free()
+{
+  if( TIMSK1 != 0 )
+    return false;
+  if( TCCR1A & ((1 << COM1A1) | (1 << COM1A0) | (1 << COM1B1) | (1 << COM1B0) | (1 << WGM11)) )
+    return false;
+  if( TCCR1B & ((1 << WGM13) | (1 << WGM12)) )
+    return false;
+  return true;
+}
+
+void NarfduinoProfiler::Reset()
+{
+  memset( Count, 0, sizeof( Count ) );
+  memset( Total, 0, sizeof( Total ) );
+  memset( Max, 0, sizeof( Max ) );
+  memset( Buckets, 0, sizeof( Buckets ) );
+}
+
+// Called on the way out of every timed block, so keep it short. The bucket is the number of bits above the first bucket's.
+void NarfduinoProfiler::Record( byte Slot, Ticks Elapsed )
+{
+  if( Slot >= _NARFDUINO_PROFILER_SLOTS )
+    return;
+  Count[Slot]++;
+  Total[Slot] += Elapsed;
+  if( Elapsed > Max[Slot] )
+    Max[Slot] = Elapsed;
+
+  byte Bucket = 0;
+  Ticks Width = Elapsed >> _NARFDUINO_PROFILER_FIRST_BUCKET;
+  while( Width && Bucket < _NARFDUINO_PROFILER_BUCKETS - 1 )
+  {
+    Width >>= 1;
+    Bucket++;
+  }
+  if( Buckets[Slot][Bucket] != 0xFFFF )
+    Buckets[Slot][Bucket]++;
+}
+
+unsigned long NarfduinoProfiler::GetCount( byte Slot )
+{
+  if( Slot >= _NARFDUINO_PROFILER_SLOTS )
+    return 0;
+  return Count[Slot];
+}
+
+NarfduinoProfiler::Ticks NarfduinoProfiler::GetMax( byte Slot )
+{
+  if( Slot >= _NARFDUINO_PROFILER_SLOTS )
+    return 0;
+  return Max[Slot];
+}
+
+unsigned long NarfduinoProfiler::GetTotal( byte Slot )
+{
+  if( Slot >= _NARFDUINO_PROFILER_SLOTS )
+    return 0;
+  return Total[Slot];
+}
+
+uint16_t NarfduinoProfiler::GetBucket( byte Slot, byte Bucket )
+{
+  if( Slot >= _NARFDUINO_PROFILER_SLOTS || Bucket >= _NARFDUINO_PROFILER_BUCKETS )
+    return 0;
+  return Buckets[Slot][Bucket];
+}
+
+// One line per slot, tab separated so it pastes straight into a spreadsheet. The header gives the top of each bucket.
+void NarfduinoProfiler::Dump( Print &Out )
+{
+#if _NARFDUINO_PROFILER_CLOCK == _NARFDUINO_PROFILER_CLOCK_TIMER1
+  Out.println( F("Profile, times in CPU cycles") );
+#else
+  Out.println( F("Profile, times in us") );
+#endif
+  Out.print( F("Slot\tCount\tAvg\tMax") );
+  for( byte Bucket = 0; Bucket < _NARFDUINO_PROFILER_BUCKETS - 1; Bucket++ )
+  {
+    Out.print( F("\t<") );
+    Out.print( 1UL << (_NARFDUINO_PROFILER_FIRST_BUCKET + Bucket) );
+  }
+  Out.println( F("\tMore") );
+
+  for( byte Slot = 0; Slot < _NARFDUINO_PROFILER_SLOTS; Slot++ )
+  {
+    if( !Count[Slot] )
+      continue;
+    Out.print( Slot );
+    Out.print( '\t' );
+    Out.print( Count[Slot] );
+    Out.print( '\t' );
+    Out.print( Total[Slot] / Count[Slot] );
+    Out.print( '\t' );
+    Out.print( (unsigned long)Max[Slot] );
+    for( byte Bucket = 0; Bucket < _NARFDUINO_PROFILER_BUCKETS; Bucket++ )
+    {
+      Out.print( '\t' );
+      Out.print( Buckets[Slot][Bucket] );
+    }
+    Out.println();
+  }
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  Narfduino Libraries - NarfduinoProfiler
+ *
+ *  Use this to see how long the library calls take on the board. Each call is timed from entry to exit,
+ *  and the times are kept as a histogram per function, which you can print out whenever you like.
+ *
+ *  It's switched off to begin with, and costs nothing at all until it's switched on - uncomment _NARFDUINO_ENABLE_PROFILER below.
+ *  Switched on, it takes about 300 bytes of RAM, and the timing itself adds a little to every call it times.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_PROFILER_LIB
+#define _NARFDUINO_PROFILER_LIB
+
+#include "Arduino.h"
+
+// Uncomment this (or add it to your build flags) to time the library calls.
+//#define _NARFDUINO_ENABLE_PROFILER
+
+// What the profiler times with
+#define _NARFDUINO_PROFILER_CLOCK_MICROS 0 // micros() - 4us resolution. Works alongside everything.
+#define _NARFDUINO_PROFILER_CLOCK_TIMER1 1 // Timer1 running free at the CPU clock - to the cycle, for calls up to 4ms. Can't be used with the brushless outputs, 
+                                           // the bridge Timer1 PWM, or analogWrite() on pins 9 and 10.
+
+#ifndef _NARFDUINO_PROFILER_CLOCK
+  #define _NARFDUINO_PROFILER_CLOCK _NARFDUINO_PROFILER_CLOCK_MICROS
+#endif
+
+// Number of functions that can be timed. The library uses the first 6, the rest are free for your own code.
+#ifndef _NARFDUINO_PROFILER_SLOTS
+  #define _NARFDUINO_PROFILER_SLOTS 8
+#endif
+
+// Histogram buckets. Each bucket is twice as wide as the one before, and the last one takes everything longer.
+#ifndef _NARFDUINO_PROFILER_BUCKETS
+  #define _NARFDUINO_PROFILER_BUCKETS 12
+#endif
+
+// The first bucket is anything under 2 ^ this, in clock ticks. 8us with micros(), 32 cycles (2us) with Timer1.
+#ifndef _NARFDUINO_PROFILER_FIRST_BUCKET
+  #if _NARFDUINO_PROFILER_CLOCK == _NARFDUINO_PROFILER_CLOCK_TIMER1
+    #define _NARFDUINO_PROFILER_FIRST_BUCKET 5
+  #else
+    #define _NARFDUINO_PROFILER_FIRST_BUCKET 3
+  #endif
+#endif
+
+
+// Slots
+#define _NARFDUINO_PROFILE_BRIDGE 0       // NarfduinoBridge::ProcessBridge()
+#define _NARFDUINO_PROFILE_PUSHER 1       // NarfduinoPusher::ProcessPusher()
+#define _NARFDUINO_PROFILE_BATTERY 2      // NarfduinoBattery::ProcessBatteryMonitor()
+#define _NARFDUINO_PROFILE_CELL_MONITOR 3 // NarfduinoCellMonitor::ProcessCellMonitor()
+#define _NARFDUINO_PROFILE_GOVERNOR 4     // NarfduinoGovernor::ProcessGovernor() and NarfduinoPowerGovernor::ProcessPowerGovernor()
+#define _NARFDUINO_PROFILE_BRUSHLESS 5    // NarfduinoBrushless::UpdateSpeed(), per channel
+#define _NARFDUINO_PROFILE_USER 6         // The first slot for your own code
+
+
+// Put this at the top of a function to time it, to the end of the block. Switched off, it's nothing at all.
+#ifdef _NARFDUINO_ENABLE_PROFILER
+  #define _NARFDUINO_PROFILE( Slot ) NarfduinoProfiler::Scope _NarfduinoProfileScope( Slot )
+#else
+  #define _NARFDUINO_PROFILE( Slot )
+#endif
+
+
+class NarfduinoProfiler
+{
+  public:
+#if _NARFDUINO_PROFILER_CLOCK == _NARFDUINO_PROFILER_CLOCK_TIMER1
+    typedef uint16_t Ticks;
+#else
+    typedef unsigned long Ticks;
+#endif
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Start the clock, and clear the figures. Returns false if the clock can't be used - something else already has Timer1.
+    static bool Init();
+
+    // Is Timer1 free for _NARFDUINO_PROFILER_CLOCK_TIMER1? Nothing has its interrupts on, a pin on it, or a mode of its own.
+    static bool IsTimer1Free();
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Print the figures for every slot that has been used - count, average, max, and the histogram
+    static void Dump( Print &Out );
+
+    // Clear the figures
+    static void Reset();
+
+    // The figures for a slot, in clock ticks
+    static unsigned long GetCount( byte Slot );
+    static Ticks GetMax( byte Slot );
+    static unsigned long GetTotal( byte Slot );
+    static uint16_t GetBucket( byte Slot, byte Bucket ); // Stops at 65535
+
+    // Internal - times a block. Use _NARFDUINO_PROFILE()
+    class Scope
+    {
+      public:
+        Scope( byte Slot ) { this->Slot = Slot; Start = Now(); }
+        ~Scope() { Record( Slot, Now() - Start ); }
+      private:
+        byte Slot;
+        Ticks Start;
+    };
+
+#ifdef _NARFDUINO_ENABLE_PROFILER
+    static inline Ticks Now()
+    {
+#if _NARFDUINO_PROFILER_CLOCK == _NARFDUINO_PROFILER_CLOCK_TIMER1
+      // 16 bit reads go through the shared TEMP register, so keep interrupts out of the way
+      uint8_t OldSREG = SREG;
+      cli();
+      Ticks Value = TCNT1;
+      SREG = OldSREG;
+      return Value;
+#else
+      return micros();
+#endif
+    }
+
+    static void Record( byte Slot, Ticks Elapsed );
+
+  private:
+    static unsigned long Count[_NARFDUINO_PROFILER_SLOTS];
+    static unsigned long Total[_NARFDUINO_PROFILER_SLOTS];
+    static Ticks Max[_NARFDUINO_PROFILER_SLOTS];
+    static uint16_t Buckets[_NARFDUINO_PROFILER_SLOTS][_NARFDUINO_PROFILER_BUCKETS];
+#else
+    static inline Ticks Now() { return 0; }
+    static inline void Record( byte, Ticks ) {}
+#endif
+};
+
+// Switched off, the profiler does nothing, so a sketch can leave its calls in
+#ifndef _NARFDUINO_ENABLE_PROFILER
+inline bool NarfduinoProfiler::Init() { return false; }
+inline bool NarfduinoProfiler::IsTimer1Free() { return false; }
+inline void NarfduinoProfiler::Dump( Print & ) {}
+inline void NarfduinoProfiler::Reset() {}
+inline unsigned long NarfduinoProfiler::GetCount( byte ) { return 0; }
+inline NarfduinoProfiler::Ticks NarfduinoProfiler::GetMax( byte ) { return 0; }
+inline unsigned long NarfduinoProfiler::GetTotal( byte ) { return 0; }
+inline uint16_t NarfduinoProfiler::GetBucket( byte, byte ) { return 0; }
+#endif
+
+#endif
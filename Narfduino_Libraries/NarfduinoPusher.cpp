@@ -0,0 +1,271 @@
+/*
+ *  Narfduino Libraries - NarfduinoPusher
+ *
+ *  Use this to run a pusher on the bridge - single shot, burst and full auto, with a rate of fire limit.
+ *  Counts the darts from the pusher heartbeats, and learns when to stop so the pusher lands on home.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoPusher.h"
+#include "NarfduinoProfiler.h"
+
+// Full auto, in the dart counters
+#define _NARFDUINO_PUSHER_FULL_AUTO 255
+
+// Stop lead learning, in 1/256ths of a cycle. Every stop that makes it home tries a little earlier next time.
+// Stopping short costs a creep home, so it backs off further.
+#define _NARFDUINO_PUSHER_LEAD_STEP_UP 1
+#define _NARFDUINO_PUSHER_LEAD_STEP_DOWN 8
+#define _NARFDUINO_PUSHER_LEAD_LATE 4
+#define _NARFDUINO_PUSHER_MAX_LEAD 128
+
+
+bool NarfduinoPusher::Init( NarfduinoBridgeBase *Bridge )
+{
+  if( Bridge == NULL )
+    return false;
+  this->Bridge = Bridge;
+  LastHeartbeatCount = Bridge->GetHeartbeatCount();
+  FireSpeed = MaxSpeed;
+  State = _NARFDUINO_PUSHER_IDLE;
+  return true;
+}
+
+void NarfduinoPusher::SetFireMode( byte Mode, byte BurstSize )
+{
+  FireMode = Mode;
+  if( BurstSize > 0 && BurstSize < _NARFDUINO_PUSHER_FULL_AUTO )
+    this->BurstSize = BurstSize;
+}
+
+void NarfduinoPusher::SetRateOfFire( byte DartsPerSecond )
+{
+  RateOfFire = DartsPerSecond;
+  if( !RateOfFire )
+    FireSpeed = MaxSpeed;
+}
+
+void NarfduinoPusher::SetMaxSpeed( byte MaxSpeed )
+{
+  this->MaxSpeed = constrain( MaxSpeed, 1, 100 );
+  if( !RateOfFire || FireSpeed > this->MaxSpeed )
+    FireSpeed = this->MaxSpeed;
+}
+
+// Trigger edges. A release in full auto finishes the dart that's under way.
+void NarfduinoPusher::SetTrigger( bool Pulled )
+{
+  if( Pulled == TriggerPulled )
+    return;
+  TriggerPulled = Pulled;
+
+  if( Pulled )
+  {
+    if( FireMode == _NARFDUINO_PUSHER_AUTO )
+      Fire( _NARFDUINO_PUSHER_FULL_AUTO );
+    else if( FireMode == _NARFDUINO_PUSHER_BURST )
+      Fire( BurstSize );
+    else
+      Fire( 1 );
+    return;
+  }
+
+  if( FireMode != _NARFDUINO_PUSHER_AUTO )
+    return;
+  if( QueuedDarts == _NARFDUINO_PUSHER_FULL_AUTO )
+    QueuedDarts = 1;
+  if( State == _NARFDUINO_PUSHER_FIRING && DartsRemaining == _NARFDUINO_PUSHER_FULL_AUTO )
+    DartsRemaining = 1;
+}
+
+// Fire straight away if we're at rest, otherwise as soon as the last shot has settled
+void NarfduinoPusher::Fire( byte Darts )
+{
+  if( Darts == 0 || !Bridge )
+    return;
+  if( State == _NARFDUINO_PUSHER_FIRING )
+    return;
+  QueuedDarts = Darts;
+  if( State == _NARFDUINO_PUSHER_IDLE )
+    StartFiring();
+}
+
+bool NarfduinoPusher::IsFiring()
+{
+  return State != _NARFDUINO_PUSHER_IDLE;
+}
+
+unsigned long NarfduinoPusher::GetDartsFired()
+{
+  return DartsFired;
+}
+
+unsigned long NarfduinoPusher::GetCycleTime()
+{
+  return Cycle;
+}
+
+void NarfduinoPusher::StartFiring()
+{
+  DartsRemaining = QueuedDarts;
+  QueuedDarts = 0;
+  DartsThisRun = 0;
+  State = _NARFDUINO_PUSHER_FIRING;
+  Bridge->SetBridgeSpeed( RateOfFire ? FireSpeed : MaxSpeed );
+  StartMicros = micros();
+  Bridge->StartBridge();
+}
+
+// Start stopping. HomeReached is true when it's stopping on the heartbeat, rather than ahead of it.
+void NarfduinoPusher::StopFiring( bool HomeReached )
+{
+  Bridge->StopBridge();
+  StopMicros = micros();
+  this->HomeReached = HomeReached;
+  State = _NARFDUINO_PUSHER_STOPPING;
+}
+
+// Trim the bridge speed towards the rate of fire. Pusher speed is near enough in proportion to the bridge speed,
+// so scale it by how far off the cycle time is, and go half way to damp it.
+void NarfduinoPusher::AdjustRate()
+{
+  if( !RateOfFire || !Cycle )
+    return;
+  unsigned long TargetCycle = 1000000UL / RateOfFire;
+  long Wanted = (long)((unsigned long)FireSpeed * Cycle / TargetCycle);
+  long NewSpeed = FireSpeed + (Wanted - FireSpeed) / 2;
+  FireSpeed = constrain( NewSpeed, (long)min( _NARFDUINO_PUSHER_MIN_SPEED, MaxSpeed ), (long)MaxSpeed );
+  Bridge->SetBridgeSpeed( FireSpeed );
+}
+
+// Run the pusher.
+void NarfduinoPusher::ProcessPusher()
+{
+  _NARFDUINO_PROFILE( _NARFDUINO_PROFILE_PUSHER );
+  if( !Bridge )
+    return;
+
+  unsigned int HeartbeatCount = Bridge->GetHeartbeatCount();
+  unsigned int NewHeartbeats = HeartbeatCount - LastHeartbeatCount;
+  LastHeartbeatCount = HeartbeatCount;
+  unsigned long HeartbeatMicros = Bridge->GetLastHeartbeatMicros();
+
+  // The bridge has stopped itself. Leave it to the sketch to reset.
+  if( Bridge->HasJammed() )
+  {
+    if( State != _NARFDUINO_PUSHER_IDLE )
+      Bridge->StopBridge();
+    State = _NARFDUINO_PUSHER_IDLE;
+    QueuedDarts = 0;
+    return;
+  }
+
+  switch( State )
+  {
+    case _NARFDUINO_PUSHER_IDLE:
+      if( QueuedDarts )
+        StartFiring();
+      break;
+
+    case _NARFDUINO_PUSHER_FIRING:
+      if( NewHeartbeats )
+      {
+        // Got home on the last dart before it was time to stop - start earlier next time
+        byte Lead = DartsThisRun ? 1 : 0;
+        if( DartsRemaining == 1 && (DartsThisRun ? Cycle : FirstCycle) )
+          StopLead[Lead] = min( StopLead[Lead] + _NARFDUINO_PUSHER_LEAD_LATE, _NARFDUINO_PUSHER_MAX_LEAD );
+
+        DartsFired += NewHeartbeats;
+        // More than one heartbeat since the last pass means the time since the last covers that many cycles. 
+        // From the start there's no telling the first cycle from the ones after it, so the first cycle isn't learnt.
+        if( DartsThisRun == 0 )
+        {
+          if( NewHeartbeats == 1 )
+            FirstCycle = HeartbeatMicros - StartMicros;
+        }
+        else
+        {
+          Cycle = (HeartbeatMicros - LastHeartbeatMicros) / NewHeartbeats;
+          AdjustRate();
+        }
+        LastHeartbeatMicros = HeartbeatMicros;
+        DartsThisRun = min( DartsThisRun + NewHeartbeats, 254 );
+
+        if( DartsRemaining != _NARFDUINO_PUSHER_FULL_AUTO )
+        {
+          if( NewHeartbeats >= DartsRemaining )
+          {
+            DartsRemaining = 0;
+            StopLeadUsed = 255;
+            StopFiring( true );
+            break;
+          }
+          DartsRemaining -= NewHeartbeats;
+        }
+      }
+
+      // The last dart. Stop ahead of home, so it coasts onto it instead of past it.
+      if( DartsRemaining == 1 )
+      {
+        byte Lead = DartsThisRun ? 1 : 0;
+        unsigned long Expected = DartsThisRun ? Cycle : FirstCycle;
+        unsigned long From = DartsThisRun ? LastHeartbeatMicros : StartMicros;
+        if( Expected && micros() - From >= Expected - ((Expected * StopLead[Lead]) >> 8) )
+        {
+          StopLeadUsed = Lead;
+          StopFiring( false );
+        }
+      }
+      break;
+
+    case _NARFDUINO_PUSHER_STOPPING:
+      if( NewHeartbeats && !HomeReached )
+      {
+        HomeReached = true;
+        DartsFired++;
+      }
+      if( micros() - StopMicros < (unsigned long)_NARFDUINO_PUSHER_SETTLE_TIME * 1000UL )
+        break;
+
+      // At rest. Learn from where it ended up.
+      if( StopLeadUsed != 255 )
+      {
+        if( HomeReached )
+          StopLead[StopLeadUsed] = min( StopLead[StopLeadUsed] + _NARFDUINO_PUSHER_LEAD_STEP_UP, _NARFDUINO_PUSHER_MAX_LEAD );
+        else
+          StopLead[StopLeadUsed] = max( StopLead[StopLeadUsed] - _NARFDUINO_PUSHER_LEAD_STEP_DOWN, 0 );
+        StopLeadUsed = 255;
+      }
+      if( !HomeReached )
+      {
+        Bridge->SetBridgeSpeed( min( _NARFDUINO_PUSHER_CREEP_SPEED, MaxSpeed ) );
+        Bridge->StartBridge();
+        State = _NARFDUINO_PUSHER_HOMING;
+        break;
+      }
+      State = _NARFDUINO_PUSHER_IDLE;
+      if( QueuedDarts )
+        StartFiring();
+      break;
+
+    case _NARFDUINO_PUSHER_HOMING:
+      if( NewHeartbeats )
+      {
+        DartsFired++;
+        StopFiring( true );
+      }
+      break;
+  }
+}
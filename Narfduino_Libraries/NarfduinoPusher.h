@@ -0,0 +1,137 @@
+/*
+ *  Narfduino Libraries - NarfduinoPusher
+ *
+ *  Use this to run a pusher on the bridge - single shot, burst and full auto, with a rate of fire limit.
+ *  Counts the darts from the pusher heartbeats, and learns when to stop so the pusher lands on home.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_PUSHER_LIB
+#define _NARFDUINO_PUSHER_LIB
+
+#include "Arduino.h"
+#include "NarfduinoBridge.h"
+
+// Default Definitions
+
+// Slowest bridge speed the rate of fire limit will run the pusher at, in %. Below this the pusher may stall.
+#ifndef _NARFDUINO_PUSHER_MIN_SPEED
+  #define _NARFDUINO_PUSHER_MIN_SPEED 30
+#endif
+
+// Bridge speed used to bring a pusher that stopped short of home the rest of the way, in %
+#ifndef _NARFDUINO_PUSHER_CREEP_SPEED
+  #define _NARFDUINO_PUSHER_CREEP_SPEED 30
+#endif
+
+// How long after stopping the pusher should have come to rest, in ms. If it hasn't reached home by then, it stopped short.
+#ifndef _NARFDUINO_PUSHER_SETTLE_TIME
+  #define _NARFDUINO_PUSHER_SETTLE_TIME 40
+#endif
+
+// How far before home the last shot starts stopping, to begin with - in 1/256ths of a cycle. This is learnt as it runs.
+#ifndef _NARFDUINO_PUSHER_STOP_LEAD
+  #define _NARFDUINO_PUSHER_STOP_LEAD 32
+#endif
+
+
+// Fire modes
+#define _NARFDUINO_PUSHER_SINGLE 0
+#define _NARFDUINO_PUSHER_BURST 1
+#define _NARFDUINO_PUSHER_AUTO 2
+
+// Internal states
+#define _NARFDUINO_PUSHER_IDLE 0      // Stopped on home
+#define _NARFDUINO_PUSHER_FIRING 1    // Running
+#define _NARFDUINO_PUSHER_STOPPING 2  // Stopped, waiting for the pusher to come to rest
+#define _NARFDUINO_PUSHER_HOMING 3    // Stopped short - creeping the rest of the way home
+
+class NarfduinoPusher
+{
+  public:
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Give the pusher its bridge. Init the bridge first, and keep calling ProcessBridge() and PusherHeartbeat() as normal.
+    bool Init( NarfduinoBridgeBase *Bridge );
+
+    // Fire mode - _NARFDUINO_PUSHER_SINGLE, _NARFDUINO_PUSHER_BURST (with the number of darts) or _NARFDUINO_PUSHER_AUTO
+    void SetFireMode( byte Mode, byte BurstSize = 3 );
+
+    // Rate of fire limit in darts per second. 0 = as fast as it will go.
+    // The bridge speed is trimmed from the measured cycle time to hit it.
+    void SetRateOfFire( byte DartsPerSecond );
+
+    // Fastest the pusher is allowed to run, 1 - 100%. Default 100.
+    void SetMaxSpeed( byte MaxSpeed );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Pass the trigger state in every time through the loop. The fire mode decides what a pull does.
+    void SetTrigger( bool Pulled );
+
+    // Fire a number of darts, whatever the fire mode. Ignored while it's already firing.
+    void Fire( byte Darts );
+
+    // True from the start of firing until the pusher is back at rest on home
+    bool IsFiring();
+
+    // Darts fired since Init
+    unsigned long GetDartsFired();
+
+    // Last measured time for a pusher cycle at speed, in us. 0 until it has been measured.
+    unsigned long GetCycleTime();
+
+    // Run the pusher. This needs to be run at regular intervals, alongside ProcessBridge().
+    void ProcessPusher();
+
+  private:
+    void StartFiring();
+    void StopFiring( bool HomeReached );
+    void AdjustRate();
+
+    NarfduinoBridgeBase *Bridge = NULL;
+    byte FireMode = _NARFDUINO_PUSHER_SINGLE;
+    byte BurstSize = 3;
+    byte RateOfFire = 0;
+    byte MaxSpeed = 100;
+    byte FireSpeed = 100; // Bridge speed the rate of fire limit has settled on
+
+    byte State = _NARFDUINO_PUSHER_IDLE;
+    bool TriggerPulled = false;
+    byte QueuedDarts = 0; // Pulled while the last shot was still coming to rest. 255 = full auto
+    byte DartsRemaining = 0; // 255 = full auto
+    byte DartsThisRun = 0;
+    unsigned long DartsFired = 0;
+    unsigned int LastHeartbeatCount = 0;
+
+    // Timing, in us
+    unsigned long StartMicros = 0;
+    unsigned long LastHeartbeatMicros = 0;
+    unsigned long StopMicros = 0;
+    unsigned long FirstCycle = 0; // From the start to the first heartbeat
+    unsigned long Cycle = 0; // Heartbeat to heartbeat
+
+    // Stop lead in 1/256ths of a cycle, for a single shot from rest [0] and for the last shot of a run [1]
+    byte StopLead[2] = { _NARFDUINO_PUSHER_STOP_LEAD, _NARFDUINO_PUSHER_STOP_LEAD };
+    byte StopLeadUsed = 255; // The lead the current stop used - 255 = it stopped on the heartbeat
+    bool HomeReached = false;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ *  Narfduino Libraries - NarfduinoRecorder
+ *
+ *  Use this as a black box. Jams, flat batteries, the pack size and the bridge starting and stopping are logged to EEPROM,
+ *  so when a blaster comes back from the field you can see what happened to it. Read it back with Dump(), or pull the EEPROM
+ *  off with avrdude and use the narfduino_blackbox tool in extras/host.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include <avr/eeprom.h>
+
+#include "NarfduinoRecorder.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBattery.h"
+
+#if (_NARFDUINO_RECORDER_SIZE % _NARFDUINO_RECORDER_RECORD_SIZE) || _NARFDUINO_RECORDER_SLOTS < 2 || _NARFDUINO_RECORDER_SLOTS > 255
+  #error _NARFDUINO_RECORDER_SIZE has to be a multiple of 8 bytes, from 2 to 255 records
+#endif
+
+#if _NARFDUINO_RECORDER_START + _NARFDUINO_RECORDER_SIZE > E2END + 1
+  #error The recorder runs off the end of the EEPROM - check _NARFDUINO_RECORDER_START and _NARFDUINO_RECORDER_SIZE
+#endif
+
+
+// The check byte for a packed record
+static byte RecordCheck( const byte *Packed )
+{
+  byte Sum = 0;
+  for( byte i = 0; i < _NARFDUINO_RECORDER_RECORD_SIZE - 1; i++ )
+    Sum += Packed[i];
+  return ~Sum;
+}
+
+void NarfduinoRecorder::Init()
+{
+  QueueOldest = QueueCount = 0;
+  WriteOffset = 0;
+  DroppedEvents = 0;
+  NextSlot = 0;
+  NextSequence = 0;
+
+  // The newest record is the one furthest on in sequence. Any valid record will do to measure from -
+  // they're all within 255 of each other, so the sequence going round doesn't matter.
+  Record Newest;
+  bool Found = false;
+  byte NewestSlot = 0;
+  for( byte Slot = 0; Slot < _NARFDUINO_RECORDER_SLOTS; Slot++ )
+  {
+    Record Current;
+    if( !ReadSlot( Slot, Current ) )
+      continue;
+    if( !Found || (int16_t)(Current.Sequence - Newest.Sequence) > 0 )
+    {
+      Newest = Current;
+      NewestSlot = Slot;
+      Found = true;
+    }
+  }
+  if( Found )
+  {
+    NextSlot = (NewestSlot + 1) % _NARFDUINO_RECORDER_SLOTS;
+    NextSequence = Newest.Sequence + 1;
+  }
+
+  LogEvent( _NARFDUINO_RECORDER_POWER_ON, 0 );
+}
+
+void NarfduinoRecorder::AttachBridge( NarfduinoBridgeBase *Bridge )
+{
+  this->Bridge = Bridge;
+  WasRunning = Bridge ? Bridge->IsBridgeRunning() : false;
+  WasJammed = Bridge ? Bridge->HasJammed() : false;
+}
+
+void NarfduinoRecorder::AttachBattery( NarfduinoBattery *Battery )
+{
+  this->Battery = Battery;
+  WasFlat = false;
+  LastS = 0;
+}
+
+void NarfduinoRecorder::SetLogBridgeTransitions( bool Enabled )
+{
+  LogBridgeTransitions = Enabled;
+}
+
+bool NarfduinoRecorder::LogEvent( byte Event, byte Data )
+{
+  if( QueueCount >= _NARFDUINO_RECORDER_QUEUE )
+  {
+    DroppedEvents++;
+    return false;
+  }
+
+  byte *Packed = Queue[(QueueOldest + QueueCount) % _NARFDUINO_RECORDER_QUEUE];
+  unsigned long Now = millis();
+  Packed[0] = NextSequence & 0xFF;
+  Packed[1] = NextSequence >> 8;
+  Packed[2] = Event;
+  Packed[3] = Data;
+  Packed[4] = Now & 0xFF;
+  Packed[5] = (Now >> 8) & 0xFF;
+  Packed[6] = (Now >> 16) & 0xFF;
+  Packed[7] = RecordCheck( Packed );
+  NextSequence++;
+  QueueCount++;
+  return true;
+}
+
+bool NarfduinoRecorder::IsIdle()
+{
+  return QueueCount == 0 && eeprom_is_ready();
+}
+
+unsigned int NarfduinoRecorder::GetDroppedEvents()
+{
+  return DroppedEvents;
+}
+
+
+uint8_t *NarfduinoRecorder::SlotAddress( byte Slot )
+{
+  return (uint8_t *)(uintptr_t)(_NARFDUINO_RECORDER_START + (unsigned int)Slot * _NARFDUINO_RECORDER_RECORD_SIZE);
+}
+
+bool NarfduinoRecorder::ReadSlot( byte Slot, Record &Out )
+{
+  byte Packed[_NARFDUINO_RECORDER_RECORD_SIZE];
+  uint8_t *Address = SlotAddress( Slot );
+  for( byte i = 0; i < _NARFDUINO_RECORDER_RECORD_SIZE; i++ )
+    Packed[i] = eeprom_read_byte( Address + i );
+  if( Packed[7] != RecordCheck( Packed ) )
+    return false;
+
+  Out.Sequence = Packed[0] | (Packed[1] << 8);
+  Out.Event = Packed[2];
+  Out.Data = Packed[3];
+  Out.Millis = Packed[4] | ((unsigned long)Packed[5] << 8) | ((unsigned long)Packed[6] << 16);
+  return true;
+}
+
+byte NarfduinoRecorder::GetRecordCount()
+{
+  byte Count = 0;
+  Record Current;
+  for( byte Slot = 0; Slot < _NARFDUINO_RECORDER_SLOTS; Slot++ )
+    if( ReadSlot( Slot, Current ) )
+      Count++;
+  return Count;
+}
+
+// The log runs from the next slot to be written - the oldest, once it's gone round - to the newest
+bool NarfduinoRecorder::GetRecord( byte Index, Record &Out )
+{
+  for( byte i = 0; i < _NARFDUINO_RECORDER_SLOTS; i++ )
+  {
+    if( !ReadSlot( (NextSlot + i) % _NARFDUINO_RECORDER_SLOTS, Out ) )
+      continue;
+    if( Index == 0 )
+      return true;
+    Index--;
+  }
+  return false;
+}
+
+void NarfduinoRecorder::Dump( Print &Out )
+{
+  Out.println( F( "sequence,millis,event,data" ) );
+  Record Current;
+  for( byte i = 0; i < _NARFDUINO_RECORDER_SLOTS; i++ )
+  {
+    if( !ReadSlot( (NextSlot + i) % _NARFDUINO_RECORDER_SLOTS, Current ) )
+      continue;
+    Out.print( Current.Sequence );
+    Out.print( ',' );
+    Out.print( Current.Millis );
+    Out.print( ',' );
+    Out.print( Current.Event );
+    Out.print( ',' );
+    Out.println( Current.Data );
+  }
+}
+
+void NarfduinoRecorder::Clear()
+{
+  for( unsigned int i = 0; i < _NARFDUINO_RECORDER_SIZE; i++ )
+    eeprom_update_byte( (uint8_t *)_NARFDUINO_RECORDER_START + i, 0xFF );
+  QueueOldest = QueueCount = 0;
+  WriteOffset = 0;
+  NextSlot = 0;
+  NextSequence = 0;
+}
+
+
+void NarfduinoRecorder::WatchEvents()
+{
+  if( Bridge )
+  {
+    bool Jammed = Bridge->HasJammed();
+    if( Jammed && !WasJammed )
+      LogEvent( _NARFDUINO_RECORDER_JAM, Bridge->GetBridgeSpeed() );
+    WasJammed = Jammed;
+
+    bool Running = Bridge->IsBridgeRunning();
+    if( Running != WasRunning && LogBridgeTransitions )
+    {
+      if( Running )
+        LogEvent( _NARFDUINO_RECORDER_BRIDGE_START, Bridge->GetBridgeSpeed() );
+      else
+        LogEvent( _NARFDUINO_RECORDER_BRIDGE_STOP, 0 );
+    }
+    WasRunning = Running;
+  }
+
+  if( Battery )
+  {
+    bool Flat = Battery->IsBatteryFlat();
+    if( Flat && !WasFlat )
+      LogEvent( _NARFDUINO_RECORDER_BATTERY_FLAT, min( Battery->GetCurrentMillivolts() / 100, 255U ) );
+    WasFlat = Flat;
+
+    byte S = Battery->GetBatteryS();
+    if( S != LastS && S != 0 )
+      LogEvent( _NARFDUINO_RECORDER_BATTERY_S, S );
+    LastS = S;
+  }
+}
+
+void NarfduinoRecorder::ProcessRecorder()
+{
+  WatchEvents();
+
+  // One byte a call, and only once the last one is done. Reading while a write is going would wait for it.
+  if( !QueueCount || !eeprom_is_ready() )
+    return;
+
+  // Bytes that are already right are skipped - it saves the wear, and the 3.4ms
+  const byte *Packed = Queue[QueueOldest];
+  uint8_t *Address = SlotAddress( NextSlot );
+  while( WriteOffset < _NARFDUINO_RECORDER_RECORD_SIZE )
+  {
+    byte Offset = WriteOffset++;
+    if( eeprom_read_byte( Address + Offset ) != Packed[Offset] )
+    {
+      eeprom_write_byte( Address + Offset, Packed[Offset] );
+      break;
+    }
+  }
+
+  // The check byte goes last, so a record cut off by a power loss fails the check, and Init writes over it
+  if( WriteOffset >= _NARFDUINO_RECORDER_RECORD_SIZE )
+  {
+    WriteOffset = 0;
+    NextSlot = (NextSlot + 1) % _NARFDUINO_RECORDER_SLOTS;
+    QueueOldest = (QueueOldest + 1) % _NARFDUINO_RECORDER_QUEUE;
+    QueueCount--;
+  }
+}
@@ -0,0 +1,151 @@
+/*
+ *  Narfduino Libraries - NarfduinoRecorder
+ *
+ *  Use this as a black box. Jams, flat batteries, the pack size and the bridge starting and stopping are logged to EEPROM,
+ *  so when a blaster comes back from the field you can see what happened to it. Read it back with Dump(), or pull the EEPROM
+ *  off with avrdude and use the narfduino_blackbox tool in extras/host.
+ *
+ *  The log goes round in a circle, so every EEPROM byte in it wears at the same rate, and the oldest records make way for the new ones.
+ *  An EEPROM write takes 3.4ms, and the next one can't start until it's done, so events are queued in RAM and written a byte at
+ *  a time from ProcessRecorder() as the EEPROM comes free. The loop never waits on it.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_RECORDER_LIB
+#define _NARFDUINO_RECORDER_LIB
+
+#include "Arduino.h"
+
+class NarfduinoBridgeBase;
+class NarfduinoBattery;
+
+// Default Definitions
+
+// Where the log lives in EEPROM, in bytes. The default leaves the first half of the EEPROM free for your own settings.
+#ifndef _NARFDUINO_RECORDER_START
+  #define _NARFDUINO_RECORDER_START 512
+#endif
+
+// In bytes. A multiple of the record size, up to 255 records.
+#ifndef _NARFDUINO_RECORDER_SIZE
+  #define _NARFDUINO_RECORDER_SIZE 512
+#endif
+
+// Events waiting to be written. Each one takes 8 bytes of RAM. A record takes up to 27ms to write.
+#ifndef _NARFDUINO_RECORDER_QUEUE
+  #define _NARFDUINO_RECORDER_QUEUE 4
+#endif
+
+
+// Record layout, 8 bytes
+//   uint16 sequence | uint8 event | uint8 data | uint24 millis | uint8 check
+// The sequence goes up by one a record, so the newest one can be found at power on. The check is 0xFF minus the sum of the
+// other bytes - an empty or half written record fails it.
+#define _NARFDUINO_RECORDER_RECORD_SIZE 8
+#define _NARFDUINO_RECORDER_SLOTS (_NARFDUINO_RECORDER_SIZE / _NARFDUINO_RECORDER_RECORD_SIZE)
+
+// Events, and what goes in the data byte
+#define _NARFDUINO_RECORDER_POWER_ON 1      // 0
+#define _NARFDUINO_RECORDER_JAM 2           // Bridge speed, %
+#define _NARFDUINO_RECORDER_BATTERY_FLAT 3  // Battery voltage, in 0.1V
+#define _NARFDUINO_RECORDER_BATTERY_S 4     // Battery S, once it's known
+#define _NARFDUINO_RECORDER_BRIDGE_START 5  // Bridge speed, %
+#define _NARFDUINO_RECORDER_BRIDGE_STOP 6   // 0
+#define _NARFDUINO_RECORDER_USER 0x80       // Your own events can use anything from here up
+
+
+class NarfduinoRecorder
+{
+  public:
+    struct Record
+    {
+      uint16_t Sequence;
+      byte Event;
+      byte Data;
+      unsigned long Millis; // Since power on. Goes round every 4.6 hours.
+    };
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Find the end of the log, and log the power on
+    void Init();
+
+    // What to watch. The recorder picks up the events itself from ProcessRecorder().
+    void AttachBridge( NarfduinoBridgeBase *Bridge );
+    void AttachBattery( NarfduinoBattery *Battery );
+
+    // Log every bridge start and stop. On by default. Turn it off to just keep the faults.
+    void SetLogBridgeTransitions( bool Enabled );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Log an event of your own. Returns false if the queue is full, and the event is lost.
+    bool LogEvent( byte Event, byte Data );
+
+    // True when everything logged has made it to EEPROM
+    bool IsIdle();
+
+    // Events lost to a full queue since Init
+    unsigned int GetDroppedEvents();
+
+    // Read the log back. Index 0 is the oldest. These read the EEPROM, so they wait for any write that's going on.
+    byte GetRecordCount();
+    bool GetRecord( byte Index, Record &Out );
+
+    // Print the log, oldest first, one event a line
+    void Dump( Print &Out );
+
+    // Wipe the log. This waits on every EEPROM write, so it takes a couple of seconds - not while the blaster is in use.
+    void Clear();
+
+    // Run the recorder. This needs to be run every time through the loop. It writes at most one byte, and only when the EEPROM is free.
+    void ProcessRecorder();
+
+  private:
+    // Look for new events on the bridge and battery
+    void WatchEvents();
+
+    // Read a slot, and check it
+    bool ReadSlot( byte Slot, Record &Out );
+
+    // EEPROM address of a slot
+    uint8_t *SlotAddress( byte Slot );
+
+    NarfduinoBridgeBase *Bridge = NULL;
+    NarfduinoBattery *Battery = NULL;
+    bool LogBridgeTransitions = true;
+
+    // What the bridge and battery were doing last time
+    bool WasRunning = false;
+    bool WasJammed = false;
+    bool WasFlat = false;
+    byte LastS = 0;
+
+    // Records waiting to go out, packed as they'll be written
+    byte Queue[_NARFDUINO_RECORDER_QUEUE][_NARFDUINO_RECORDER_RECORD_SIZE];
+    byte QueueOldest = 0; // The one being written
+    byte QueueCount = 0;
+    byte WriteOffset = 0; // Next byte of it to write
+
+    byte NextSlot = 0; // Where the next record goes. The oldest one is here once the log has gone round.
+    uint16_t NextSequence = 0;
+    unsigned int DroppedEvents = 0;
+};
+
+#endif
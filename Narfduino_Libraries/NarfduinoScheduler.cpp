@@ -0,0 +1,253 @@
+/*
+ *  Narfduino Libraries - NarfduinoScheduler
+ *
+ *  Use this to run the other Narfduino libraries, and your own code, from one call in the loop.
+ *  Tasks run when they fall due, most important first, and it keeps track of how late each one starts and how long the loop takes.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoScheduler.h"
+#include "NarfduinoPusher.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoCellMonitor.h"
+#include "NarfduinoGovernor.h"
+
+
+// The library tasks
+static void RunPusher( void *Context )
+{
+  ((NarfduinoPusher *)Context)->ProcessPusher();
+}
+
+static void RunGovernor( void *Context )
+{
+  ((NarfduinoGovernor *)Context)->ProcessGovernor();
+}
+
+static void RunBattery( void *Context )
+{
+  ((NarfduinoBattery *)Context)->ProcessBatteryMonitor();
+}
+
+static void RunCellMonitor( void *Context )
+{
+  ((NarfduinoCellMonitor *)Context)->ProcessCellMonitor();
+}
+
+
+byte NarfduinoScheduler::AddTask( TaskFunction Function, void *Context, unsigned long PeriodMicros, byte Priority )
+{
+  if( Function == NULL || NumTasks >= _NARFDUINO_SCHEDULER_MAX_TASKS )
+    return _NARFDUINO_SCHEDULER_NO_TASK;
+
+  Task &NewTask = Tasks[NumTasks];
+  NewTask.Function = Function;
+  NewTask.Context = Context;
+  NewTask.Period = PeriodMicros;
+  NewTask.NextRun = micros();
+  NewTask.Priority = min( Priority, (byte)_NARFDUINO_SCHEDULER_LOW );
+  NewTask.Runs = 0;
+  NewTask.LateRuns = 0;
+  NewTask.MaxLate = 0;
+  NewTask.MaxRunTime = 0;
+  return NumTasks++;
+}
+
+byte NarfduinoScheduler::AddPusher( NarfduinoPusher *Pusher )
+{
+  if( Pusher == NULL )
+    return _NARFDUINO_SCHEDULER_NO_TASK;
+  return AddTask( RunPusher, Pusher, 0, _NARFDUINO_SCHEDULER_CRITICAL );
+}
+
+byte NarfduinoScheduler::AddGovernor( NarfduinoGovernor *Governor, unsigned long PeriodMicros )
+{
+  if( Governor == NULL )
+    return _NARFDUINO_SCHEDULER_NO_TASK;
+  return AddTask( RunGovernor, Governor, PeriodMicros, _NARFDUINO_SCHEDULER_HIGH );
+}
+
+byte NarfduinoScheduler::AddBattery( NarfduinoBattery *Battery, unsigned long PeriodMicros )
+{
+  if( Battery == NULL )
+    return _NARFDUINO_SCHEDULER_NO_TASK;
+  return AddTask( RunBattery, Battery, PeriodMicros, _NARFDUINO_SCHEDULER_LOW );
+}
+
+byte NarfduinoScheduler::AddCellMonitor( NarfduinoCellMonitor *CellMonitor, unsigned long PeriodMicros )
+{
+  if( CellMonitor == NULL )
+    return _NARFDUINO_SCHEDULER_NO_TASK;
+  return AddTask( RunCellMonitor, CellMonitor, PeriodMicros, _NARFDUINO_SCHEDULER_LOW );
+}
+
+void NarfduinoScheduler::SetLoopBudget( unsigned int BudgetMicros )
+{
+  LoopBudget = BudgetMicros;
+}
+
+
+bool NarfduinoScheduler::IsDue( Task &ThisTask, unsigned long Now )
+{
+  if( ThisTask.Period == 0 )
+    return true;
+  return (long)(Now - ThisTask.NextRun) >= 0;
+}
+
+// Work out how late it is, move the deadline on, and run it
+unsigned long NarfduinoScheduler::RunTask( Task &ThisTask, unsigned long Now )
+{
+  unsigned long Late = 0;
+  if( ThisTask.Period == 0 )
+  {
+    if( ThisTask.Runs )
+      Late = Now - ThisTask.NextRun;
+    ThisTask.NextRun = Now;
+  }
+  else
+  {
+    Late = Now - ThisTask.NextRun;
+    ThisTask.NextRun += ThisTask.Period;
+    // Don't try to catch up after a stall
+    if( (long)(Now - ThisTask.NextRun) >= 0 )
+      ThisTask.NextRun = Now + ThisTask.Period;
+  }
+
+  ThisTask.Runs++;
+  if( Late > _NARFDUINO_SCHEDULER_LATE_TOLERANCE )
+    ThisTask.LateRuns++;
+  if( Late > ThisTask.MaxLate )
+    ThisTask.MaxLate = Late;
+
+  ThisTask.Function( ThisTask.Context );
+
+  unsigned long End = micros();
+  if( End - Now > ThisTask.MaxRunTime )
+    ThisTask.MaxRunTime = End - Now;
+  return End;
+}
+
+// Critical tasks first, in the order they were added. Then whatever else was due at the start of the pass,
+// highest priority first, and the most overdue first within a priority, until the budget runs out.
+// Once a task has run its next deadline is after the start of the pass, so nothing runs twice.
+void NarfduinoScheduler::Run()
+{
+  unsigned long PassStart = micros();
+  if( Started && PassStart - LastPass > MaxLoopTime )
+    MaxLoopTime = PassStart - LastPass;
+  Started = true;
+  LastPass = PassStart;
+  LoopCount++;
+
+  unsigned long Now = PassStart;
+  for( byte i = 0; i < NumTasks; i++ )
+  {
+    if( Tasks[i].Priority == _NARFDUINO_SCHEDULER_CRITICAL && IsDue( Tasks[i], PassStart ) )
+      Now = RunTask( Tasks[i], Now );
+  }
+
+  unsigned long BudgetStart = Now;
+  bool RanOne = false;
+  while( !RanOne || !LoopBudget || Now - BudgetStart < LoopBudget )
+  {
+    byte Next = _NARFDUINO_SCHEDULER_NO_TASK;
+    for( byte i = 0; i < NumTasks; i++ )
+    {
+      Task &ThisTask = Tasks[i];
+      if( ThisTask.Priority == _NARFDUINO_SCHEDULER_CRITICAL || ThisTask.Period == 0 || !IsDue( ThisTask, PassStart ) )
+        continue;
+      if( Next == _NARFDUINO_SCHEDULER_NO_TASK || ThisTask.Priority < Tasks[Next].Priority ||
+          (ThisTask.Priority == Tasks[Next].Priority && (long)(ThisTask.NextRun - Tasks[Next].NextRun) < 0) )
+        Next = i;
+    }
+    if( Next == _NARFDUINO_SCHEDULER_NO_TASK )
+      break;
+    Now = RunTask( Tasks[Next], Now );
+    RanOne = true;
+  }
+
+  // Tasks below critical that run every pass share the budget with the rest, after them
+  for( byte i = 0; i < NumTasks; i++ )
+  {
+    if( Tasks[i].Priority != _NARFDUINO_SCHEDULER_CRITICAL && Tasks[i].Period == 0 )
+    {
+      if( LoopBudget && Now - BudgetStart >= LoopBudget )
+        break;
+      Now = RunTask( Tasks[i], Now );
+    }
+  }
+
+  if( Now - PassStart > MaxPassTime )
+    MaxPassTime = Now - PassStart;
+}
+
+
+unsigned long NarfduinoScheduler::GetTaskRuns( byte Task )
+{
+  if( Task >= NumTasks )
+    return 0;
+  return Tasks[Task].Runs;
+}
+
+unsigned long NarfduinoScheduler::GetTaskLateRuns( byte Task )
+{
+  if( Task >= NumTasks )
+    return 0;
+  return Tasks[Task].LateRuns;
+}
+
+unsigned long NarfduinoScheduler::GetTaskMaxLate( byte Task )
+{
+  if( Task >= NumTasks )
+    return 0;
+  return Tasks[Task].MaxLate;
+}
+
+unsigned long NarfduinoScheduler::GetTaskMaxRunTime( byte Task )
+{
+  if( Task >= NumTasks )
+    return 0;
+  return Tasks[Task].MaxRunTime;
+}
+
+unsigned long NarfduinoScheduler::GetMaxLoopTime()
+{
+  return MaxLoopTime;
+}
+
+unsigned long NarfduinoScheduler::GetMaxPassTime()
+{
+  return MaxPassTime;
+}
+
+unsigned long NarfduinoScheduler::GetLoopCount()
+{
+  return LoopCount;
+}
+
+void NarfduinoScheduler::ResetStats()
+{
+  for( byte i = 0; i < NumTasks; i++ )
+  {
+    Tasks[i].Runs = 0;
+    Tasks[i].LateRuns = 0;
+    Tasks[i].MaxLate = 0;
+    Tasks[i].MaxRunTime = 0;
+  }
+  Started = false;
+  LoopCount = 0;
+  MaxLoopTime = 0;
+  MaxPassTime = 0;
+}
@@ -0,0 +1,166 @@
+/*
+ *  Narfduino Libraries - NarfduinoScheduler
+ *
+ *  Use this to run the other Narfduino libraries, and your own code, from one call in the loop.
+ *  Tasks run when they fall due, most important first, and it keeps track of how late each one starts and how long the loop takes.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_SCHEDULER_LIB
+#define _NARFDUINO_SCHEDULER_LIB
+
+#include "Arduino.h"
+
+class NarfduinoPusher;
+class NarfduinoBattery;
+class NarfduinoCellMonitor;
+class NarfduinoGovernor;
+
+// Default Definitions
+
+// Most tasks the scheduler can hold. Each one takes about 30 bytes of RAM.
+#ifndef _NARFDUINO_SCHEDULER_MAX_TASKS
+  #define _NARFDUINO_SCHEDULER_MAX_TASKS 6
+#endif
+
+// A task that starts this many us after it was due counts as a late run
+#ifndef _NARFDUINO_SCHEDULER_LATE_TOLERANCE
+  #define _NARFDUINO_SCHEDULER_LATE_TOLERANCE 1000
+#endif
+
+// How long a pass through Run() can spend on tasks below critical, in us. Whatever is still due after that waits for the next pass.
+// 0 = no limit.
+#ifndef _NARFDUINO_SCHEDULER_LOOP_BUDGET
+  #define _NARFDUINO_SCHEDULER_LOOP_BUDGET 0
+#endif
+
+// How often the library tasks are run, in us. The libraries keep their own interval checks, so these only need to be quicker than them.
+#ifndef _NARFDUINO_SCHEDULER_GOVERNOR_PERIOD
+  #define _NARFDUINO_SCHEDULER_GOVERNOR_PERIOD 1000
+#endif
+
+#ifndef _NARFDUINO_SCHEDULER_BATTERY_PERIOD
+  #define _NARFDUINO_SCHEDULER_BATTERY_PERIOD 10000
+#endif
+
+#ifndef _NARFDUINO_SCHEDULER_CELL_MONITOR_PERIOD
+  #define _NARFDUINO_SCHEDULER_CELL_MONITOR_PERIOD 10000
+#endif
+
+
+// Task priorities. Critical tasks run on every pass that they're due, ahead of everything else, and ignore the loop budget.
+#define _NARFDUINO_SCHEDULER_CRITICAL 0
+#define _NARFDUINO_SCHEDULER_HIGH 1
+#define _NARFDUINO_SCHEDULER_NORMAL 2
+#define _NARFDUINO_SCHEDULER_LOW 3
+
+// Returned when there's no room for another task
+#define _NARFDUINO_SCHEDULER_NO_TASK 255
+
+class NarfduinoScheduler
+{
+  public:
+    // A task. Context is whatever was passed in when it was added.
+    typedef void (*TaskFunction)( void *Context );
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Add a task, to run every PeriodMicros. 0 = every pass through Run().
+    // Returns the task number for the Get functions, or _NARFDUINO_SCHEDULER_NO_TASK if it's full.
+    byte AddTask( TaskFunction Function, void *Context, unsigned long PeriodMicros, byte Priority = _NARFDUINO_SCHEDULER_NORMAL );
+
+    // Add the libraries. The bridge and pusher run on every pass, at critical priority - add the bridge first, so it runs first.
+    // Brushless outputs run from their own interrupts - add the governor that drives them, or your own task.
+    // The bridge can be a NarfduinoBridge or a NarfduinoBridgePins.
+    template <class Bridge> byte AddBridge( Bridge *NewBridge )
+    {
+      if( NewBridge == NULL )
+        return _NARFDUINO_SCHEDULER_NO_TASK;
+      return AddTask( RunBridge<Bridge>, NewBridge, 0, _NARFDUINO_SCHEDULER_CRITICAL );
+    }
+    byte AddPusher( NarfduinoPusher *Pusher );
+    byte AddGovernor( NarfduinoGovernor *Governor, unsigned long PeriodMicros = _NARFDUINO_SCHEDULER_GOVERNOR_PERIOD );
+    byte AddBattery( NarfduinoBattery *Battery, unsigned long PeriodMicros = _NARFDUINO_SCHEDULER_BATTERY_PERIOD );
+    byte AddCellMonitor( NarfduinoCellMonitor *CellMonitor, unsigned long PeriodMicros = _NARFDUINO_SCHEDULER_CELL_MONITOR_PERIOD );
+
+    // How long a pass can spend on tasks below critical, in us. 0 = no limit. The most urgent one due always gets to run.
+    void SetLoopBudget( unsigned int BudgetMicros );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Run whatever is due. Call this every time through the loop, in place of the Process functions.
+    void Run();
+
+    // Per task figures, since the start or ResetStats(). For a task that runs every pass, late is the gap between runs.
+    unsigned long GetTaskRuns( byte Task );
+    unsigned long GetTaskLateRuns( byte Task ); // Started more than _NARFDUINO_SCHEDULER_LATE_TOLERANCE late
+    unsigned long GetTaskMaxLate( byte Task ); // in us
+    unsigned long GetTaskMaxRunTime( byte Task ); // in us
+
+    // Longest time between passes through Run() - the worst case loop time, your code included - in us
+    unsigned long GetMaxLoopTime();
+
+    // Longest single pass through Run(), in us
+    unsigned long GetMaxPassTime();
+
+    // Passes through Run()
+    unsigned long GetLoopCount();
+
+    // Start the figures again, say once setup has finished
+    void ResetStats();
+
+  private:
+    // The bridge task, for the bridge's own driver
+    template <class Bridge> static void RunBridge( void *Context )
+    {
+      ((Bridge *)Context)->ProcessBridge();
+    }
+
+    struct Task
+    {
+      TaskFunction Function;
+      void *Context;
+      unsigned long Period;
+      unsigned long NextRun;
+      byte Priority;
+
+      unsigned long Runs;
+      unsigned long LateRuns;
+      unsigned long MaxLate;
+      unsigned long MaxRunTime;
+    };
+
+    // Run a task that has come due, and time it. Returns the time it finished.
+    unsigned long RunTask( Task &ThisTask, unsigned long Now );
+
+    // Is the task due to run?
+    bool IsDue( Task &ThisTask, unsigned long Now );
+
+    Task Tasks[_NARFDUINO_SCHEDULER_MAX_TASKS];
+    byte NumTasks = 0;
+    unsigned int LoopBudget = _NARFDUINO_SCHEDULER_LOOP_BUDGET;
+
+    bool Started = false;
+    unsigned long LastPass = 0;
+    unsigned long LoopCount = 0;
+    unsigned long MaxLoopTime = 0;
+    unsigned long MaxPassTime = 0;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ *  Narfduino Libraries - NarfduinoTelemetry
+ *
+ *  Use this to log what the blaster is doing over Serial, hundreds of times a second, without holding up the loop.
+ *  Battery, bridge, brushless and loop timing go out as small checksummed binary frames. Decode them on the PC with
+ *  the narfduino_telemetry tool in extras/host.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+
+#include "NarfduinoTelemetry.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoBrushless.h"
+
+#define _NARFDUINO_TELEMETRY_MASK (_NARFDUINO_TELEMETRY_BUFFER_SIZE - 1)
+
+#if (_NARFDUINO_TELEMETRY_BUFFER_SIZE & _NARFDUINO_TELEMETRY_MASK) || _NARFDUINO_TELEMETRY_BUFFER_SIZE > 128
+  #error _NARFDUINO_TELEMETRY_BUFFER_SIZE has to be a power of 2, up to 128
+#endif
+
+
+void NarfduinoTelemetry::Init( HardwareSerial &Port, unsigned int RateHz )
+{
+  this->Port = &Port;
+  Head = Tail = 0;
+  Sequence = 0;
+  DroppedFrames = 0;
+  SetRate( RateHz );
+  LastFrame = micros();
+  LoopStarted = false;
+}
+
+void NarfduinoTelemetry::AttachBridge( NarfduinoBridgeBase *Bridge )
+{
+  this->Bridge = Bridge;
+}
+
+void NarfduinoTelemetry::AttachBattery( NarfduinoBattery *Battery )
+{
+  this->Battery = Battery;
+}
+
+void NarfduinoTelemetry::AttachBrushless( NarfduinoBrushless *Brushless )
+{
+  this->Brushless = Brushless;
+}
+
+void NarfduinoTelemetry::SetRate( unsigned int RateHz )
+{
+  Interval = RateHz ? 1000000UL / RateHz : 0;
+}
+
+unsigned int NarfduinoTelemetry::GetDroppedFrames()
+{
+  return DroppedFrames;
+}
+
+
+// One slot is always left empty, so a full queue and an empty one look different
+byte NarfduinoTelemetry::GetFreeSpace()
+{
+  return _NARFDUINO_TELEMETRY_MASK - ((Head - Tail) & _NARFDUINO_TELEMETRY_MASK);
+}
+
+// Fletcher-16, mod 255
+void NarfduinoTelemetry::QueueByte( byte Value )
+{
+  Buffer[Head] = Value;
+  Head = (Head + 1) & _NARFDUINO_TELEMETRY_MASK;
+
+  uint16_t Sum = Sum1 + Value;
+  if( Sum >= 255 )
+    Sum -= 255;
+  Sum1 = Sum;
+  Sum = Sum2 + Sum1;
+  if( Sum >= 255 )
+    Sum -= 255;
+  Sum2 = Sum;
+}
+
+void NarfduinoTelemetry::QueueWord( uint16_t Value )
+{
+  QueueByte( Value & 0xFF );
+  QueueByte( Value >> 8 );
+}
+
+void NarfduinoTelemetry::QueueLong( uint32_t Value )
+{
+  QueueWord( Value & 0xFFFF );
+  QueueWord( Value >> 16 );
+}
+
+// The sync bytes aren't in the checksum - it starts from the length
+void NarfduinoTelemetry::StartFrame( byte Type, byte Length )
+{
+  QueueByte( _NARFDUINO_TELEMETRY_SYNC1 );
+  QueueByte( _NARFDUINO_TELEMETRY_SYNC2 );
+  Sum1 = Sum2 = 0;
+  QueueByte( Length );
+  QueueByte( Type );
+  QueueByte( Sequence++ );
+}
+
+void NarfduinoTelemetry::EndFrame()
+{
+  byte Check1 = Sum1;
+  byte Check2 = Sum2;
+  QueueByte( Check1 );
+  QueueByte( Check2 );
+}
+
+bool NarfduinoTelemetry::SendFrame( byte Type, const void *Payload, byte Length )
+{
+  if( !Port || Length > _NARFDUINO_TELEMETRY_MAX_PAYLOAD ||
+      GetFreeSpace() < _NARFDUINO_TELEMETRY_HEADER_SIZE + Length + _NARFDUINO_TELEMETRY_CHECKSUM_SIZE )
+  {
+    DroppedFrames++;
+    Sequence++;
+    return false;
+  }
+  StartFrame( Type, Length );
+  for( byte i = 0; i < Length; i++ )
+    QueueByte( ((const byte *)Payload)[i] );
+  EndFrame();
+  return true;
+}
+
+void NarfduinoTelemetry::SendStatus()
+{
+  if( GetFreeSpace() < _NARFDUINO_TELEMETRY_HEADER_SIZE + _NARFDUINO_TELEMETRY_STATUS_SIZE + _NARFDUINO_TELEMETRY_CHECKSUM_SIZE )
+  {
+    DroppedFrames++;
+    Sequence++;
+    return;
+  }
+
+  byte Flags = 0;
+  if( Bridge && Bridge->IsBridgeRunning() )
+    Flags |= _NARFDUINO_TELEMETRY_FLAG_RUNNING;
+  if( Bridge && Bridge->HasJammed() )
+    Flags |= _NARFDUINO_TELEMETRY_FLAG_JAMMED;
+  if( Battery && Battery->IsBatteryFlat() )
+    Flags |= _NARFDUINO_TELEMETRY_FLAG_FLAT;
+
+  StartFrame( _NARFDUINO_TELEMETRY_STATUS, _NARFDUINO_TELEMETRY_STATUS_SIZE );
+  QueueLong( millis() );
+  QueueWord( Battery ? Battery->GetCurrentMillivolts() : 0 );
+  QueueByte( Battery ? Battery->GetBatteryPercent() : 0 );
+  QueueByte( Flags );
+  QueueByte( Bridge ? Bridge->GetBridgeSpeed() : 0 );
+  QueueWord( Brushless ? Brushless->GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9 ) : 0 );
+  QueueWord( Brushless ? Brushless->GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10 ) : 0 );
+  QueueWord( LoopMax );
+  QueueWord( LoopCount );
+  EndFrame();
+}
+
+void NarfduinoTelemetry::ProcessTelemetry()
+{
+  if( !Port )
+    return;
+
+  unsigned long Now = micros();
+  if( LoopStarted )
+  {
+    unsigned long LoopTime = Now - LastLoop;
+    if( LoopTime > LoopMax )
+      LoopMax = min( LoopTime, 0xFFFFUL );
+    if( LoopCount < 0xFFFF )
+      LoopCount++;
+  }
+  LoopStarted = true;
+  LastLoop = Now;
+
+  if( Interval && Now - LastFrame >= Interval )
+  {
+    LastFrame += Interval;
+    // Don't try to catch up after a stall
+    if( Now - LastFrame >= Interval )
+      LastFrame = Now;
+    SendStatus();
+    LoopMax = 0;
+    LoopCount = 0;
+  }
+
+  // Only what Serial can take without waiting
+  int Room = Port->availableForWrite();
+  while( Room > 0 && Tail != Head )
+  {
+    Port->write( Buffer[Tail] );
+    Tail = (Tail + 1) & _NARFDUINO_TELEMETRY_MASK;
+    Room--;
+  }
+}
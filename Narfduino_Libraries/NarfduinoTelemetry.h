@@ -0,0 +1,141 @@
+/*
+ *  Narfduino Libraries - NarfduinoTelemetry
+ *
+ *  Use this to log what the blaster is doing over Serial, hundreds of times a second, without holding up the loop.
+ *  Battery, bridge, brushless and loop timing go out as small checksummed binary frames. Decode them on the PC with
+ *  the narfduino_telemetry tool in extras/host.
+ *
+ *  Frames are queued in a ring buffer, and only handed to Serial as fast as it has room for them, so a write never waits.
+ *  If the queue is full, the frame is dropped, and the sequence number lets the decoder see it.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_TELEMETRY_LIB
+#define _NARFDUINO_TELEMETRY_LIB
+
+#include "Arduino.h"
+
+class NarfduinoBridgeBase;
+class NarfduinoBattery;
+class NarfduinoBrushless;
+
+// Default Definitions
+
+// Frames a second
+#ifndef _NARFDUINO_TELEMETRY_RATE
+  #define _NARFDUINO_TELEMETRY_RATE 100
+#endif
+
+// Queue size in bytes. Has to be a power of 2, up to 128. A status frame is 24 bytes.
+#ifndef _NARFDUINO_TELEMETRY_BUFFER_SIZE
+  #define _NARFDUINO_TELEMETRY_BUFFER_SIZE 64
+#endif
+
+
+// Frame layout. All values are little endian.
+//   0xA5 0x5A | Length | Type | Sequence | Payload (Length bytes) | Fletcher-16 sum1, sum2 over Length to the end of the payload
+#define _NARFDUINO_TELEMETRY_SYNC1 0xA5
+#define _NARFDUINO_TELEMETRY_SYNC2 0x5A
+#define _NARFDUINO_TELEMETRY_HEADER_SIZE 5
+#define _NARFDUINO_TELEMETRY_CHECKSUM_SIZE 2
+#define _NARFDUINO_TELEMETRY_MAX_PAYLOAD 32
+
+// Frame types. Your own frames can use anything from _NARFDUINO_TELEMETRY_USER up.
+#define _NARFDUINO_TELEMETRY_STATUS 0x01
+#define _NARFDUINO_TELEMETRY_USER 0x80
+
+// Status frame payload
+//   uint32 millis | uint16 battery mV | uint8 battery % | uint8 flags | uint8 bridge speed % |
+//   uint16 brushless 9 | uint16 brushless 10 (1000 - 2000) | uint16 longest loop since the last frame, us | uint16 loops since the last frame
+#define _NARFDUINO_TELEMETRY_STATUS_SIZE 17
+
+// Status flags
+#define _NARFDUINO_TELEMETRY_FLAG_RUNNING 0x01 // Bridge running
+#define _NARFDUINO_TELEMETRY_FLAG_JAMMED 0x02  // Bridge stopped on a jam
+#define _NARFDUINO_TELEMETRY_FLAG_FLAT 0x04    // Battery flat
+
+
+class NarfduinoTelemetry
+{
+  public:
+
+    // ***************************************
+    // Initialisation Functions - Use in Setup
+    // ***************************************
+
+    // Send on this port. Call Port.begin() first - 115200 or quicker leaves room for a few hundred frames a second.
+    void Init( HardwareSerial &Port, unsigned int RateHz = _NARFDUINO_TELEMETRY_RATE );
+
+    // What to report. Anything not attached is sent as 0.
+    void AttachBridge( NarfduinoBridgeBase *Bridge );
+    void AttachBattery( NarfduinoBattery *Battery );
+    void AttachBrushless( NarfduinoBrushless *Brushless );
+
+    // Status frames a second. 0 = stop sending them.
+    void SetRate( unsigned int RateHz );
+
+
+    // ************************************
+    // Runtime Functions - Call as required
+    // ************************************
+
+    // Queue a frame of your own. Returns false if it was dropped - the queue is full, or it's too long.
+    bool SendFrame( byte Type, const void *Payload, byte Length );
+
+    // Frames dropped since Init
+    unsigned int GetDroppedFrames();
+
+    // Run the telemetry. Call this every time through the loop - it times the loop, sends a status frame when one is due,
+    // and passes on as much of the queue as Serial has room for.
+    void ProcessTelemetry();
+
+  private:
+    // Space left in the queue
+    byte GetFreeSpace();
+
+    void QueueByte( byte Value );
+    void QueueWord( uint16_t Value );
+    void QueueLong( uint32_t Value );
+
+    // Frame start and end. The checksum is worked out as the bytes go in.
+    void StartFrame( byte Type, byte Length );
+    void EndFrame();
+
+    void SendStatus();
+
+    HardwareSerial *Port = NULL;
+    NarfduinoBridgeBase *Bridge = NULL;
+    NarfduinoBattery *Battery = NULL;
+    NarfduinoBrushless *Brushless = NULL;
+
+    // The queue. Head is only moved by QueueByte, Tail by ProcessTelemetry.
+    byte Buffer[_NARFDUINO_TELEMETRY_BUFFER_SIZE];
+    volatile byte Head = 0;
+    volatile byte Tail = 0;
+    byte Sum1 = 0;
+    byte Sum2 = 0;
+    byte Sequence = 0;
+    unsigned int DroppedFrames = 0;
+
+    unsigned long Interval = 0; // in us. 0 = no status frames
+    unsigned long LastFrame = 0;
+
+    // Loop timing since the last status frame
+    bool LoopStarted = false;
+    unsigned long LastLoop = 0;
+    uint16_t LoopMax = 0;
+    uint16_t LoopCount = 0;
+};
+
+#endif
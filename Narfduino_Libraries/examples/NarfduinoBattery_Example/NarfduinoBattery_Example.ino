@@ -20,6 +20,7 @@ void setup() {
   // Detect the battery size here. 
   Battery.SetupSelectBattery();
   // Alternatively use .SetBatteryS( x ); where x is the number of S in the battery
+  // Or use .StartBatteryDetection(); to detect it in the background from ProcessBatteryMonitor(), without holding up setup. This also picks up pack swaps.
 
   // Display the result of the detection
   Serial.print( "Battery Connected S = " );
@@ -30,8 +31,13 @@ void setup() {
 void loop() {
   // We need to keep constant track of the battery. The library will rate limit itself.  
   // However we should rate limit output to the serial port
+  // To log quicker than this without holding up the loop, see the NarfduinoTelemetry example
   static unsigned long LastTimeDisplayed = 0;
 
+  // If you are driving a bridge or flywheels, tell the monitor about the load, so the sag doesn't read as a flat battery.
+  // Battery.SetBridgeLoad( Bridge.IsBridgeRunning(), Bridge.GetBridgeSpeed() );
+  // Battery.SetBrushlessLoad( Brushless.GetSpeed() );
+
   // Run this frequently
   Battery.ProcessBatteryMonitor();
 
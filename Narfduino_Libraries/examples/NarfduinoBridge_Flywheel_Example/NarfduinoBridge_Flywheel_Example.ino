@@ -7,6 +7,9 @@
 // Create our bridge object
 NarfduinoBridge Flywheels = NarfduinoBridge();
 // n.b. You can also use NarfduinoBriodge( x, y ); where x is the PWM enabled pin for "Go" (low side fet) and y is the digital pin for "Stop" (high side fet)
+// Or, with #include "NarfduinoBridgePins.h", NarfduinoBridgePins<x, y> Flywheels; - the pins are fixed at compile time, the FET writes are quicker and it takes less RAM.
+// With a second bridge for the pusher, add both to a NarfduinoBridgeGroup (#include "NarfduinoBridgeGroup.h") and call its ProcessBridges()
+// instead of ProcessBridge() on each. They then start and stop on the same millisecond, and their FETs are written a port at a time.
 
 
 void setup() {
@@ -16,6 +19,14 @@ void setup() {
 
   // Since we are running in flywheel mode, you need to disable the jam detection.
   Flywheels.DisableAntiJam();
+
+  // For quieter, cooler motors, run the PWM at 20kHz on a timer instead. The run FET gate has to be wired to pin 3 (or 9 / 10 for Timer1), 
+  // and the bridge created with NarfduinoBridge( 3, _NARFDUINOPIN_BRIDGE_STOP ).
+  //Flywheels.SetPWMMode( _NARFDUINO_BRIDGE_PWM_TIMER2, 20000 );
+
+  // Ease the flywheels up to speed over 100ms and brake them at half strength, to go easier on the battery and motors.
+  //Flywheels.SetSoftStart( 100 );
+  //Flywheels.SetBrakeStrength( 50, 0 );
 }
 
 void loop() {
@@ -14,6 +14,14 @@ NarfduinoBrushless Brushless = NarfduinoBrushless();
 void setup() {
   // put your setup code here, to run once:
 
+  // If your ESC supports it, pick a faster protocol. Throttle changes reach the ESC in well under 1ms instead of up to 20ms.
+  // Brushless.SetProtocol( _NARFDUINO_BRUSHLESS_ONESHOT125 );
+
+  // Ramp the flywheel on pin 9 up over half a second (2000 units a second), and let it back down twice as fast.
+  // The ramp runs in the background - UpdateSpeed() just sets where it's going. Pin 10 is left to jump straight to its speed.
+  // Uncomment _NARFDUINO_ENABLE_BRUSHLESS_INTERRUPTS in NarfduinoBrushless.h first - it needs the Timer1 interrupts.
+  // Brushless.SetRamp( _NARFDUINO_BRUSHLESS_CHANNEL_9, 2000, 4000 );
+
   // Initialise the PWM Timers
   Brushless.Init();
 
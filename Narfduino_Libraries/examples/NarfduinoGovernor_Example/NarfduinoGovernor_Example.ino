@@ -0,0 +1,48 @@
+// NarfduinoGovernor Example
+// Holds a brushless flywheel on pin 9 at a set RPM, using a tach sensor on pin 2, and only fires once it's up to speed.
+// The tach has to be on pin 2 or 3.
+
+#include "NarfduinoBrushless.h"
+#include "NarfduinoGovernor.h"
+
+#define PIN_TRIGGER 4
+#define PIN_TACH 2
+
+NarfduinoBrushless Brushless = NarfduinoBrushless();
+NarfduinoGovernor Governor = NarfduinoGovernor();
+
+void setup() {
+  // put your setup code here, to run once:
+  pinMode( PIN_TRIGGER, INPUT_PULLUP );
+
+  Brushless.SetProtocol( _NARFDUINO_BRUSHLESS_ONESHOT125 );
+  Brushless.Init();
+  // Arm the ESC
+  Brushless.UpdateSpeed( 1000 );
+  delay( 3000 );
+
+  // One pulse per rev from the sensor. For the ESC's RPM output, use the motor poles / 2.
+  Governor.Init( PIN_TACH, 1 );
+  // RPM the flywheels reach at full throttle on a full battery
+  Governor.SetMaxRPM( 40000 );
+  Governor.AttachBrushless( &Brushless, _NARFDUINO_BRUSHLESS_CHANNEL_9 );
+}
+
+void loop() {
+  // put your main code here, to run repeatedly:
+
+  // Rev while the trigger is held
+  if( digitalRead( PIN_TRIGGER ) == LOW )
+    Governor.SetTargetRPM( 30000 );
+  else
+    Governor.SetTargetRPM( 0 );
+
+  // Fire as soon as the wheels are actually ready, instead of after a fixed delay
+  if( Governor.IsAtSpeed() )
+  {
+    // Run the pusher here
+  }
+
+  // Run this frequently
+  Governor.ProcessGovernor();
+}
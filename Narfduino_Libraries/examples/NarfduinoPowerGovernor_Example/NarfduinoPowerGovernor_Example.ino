@@ -0,0 +1,63 @@
+// NarfduinoPowerGovernor Example
+// Brushless flywheels on pins 9 and 10, and the pusher on the bridge, on a battery that's seen better days.
+// When the pack can't keep up, the pusher and flywheels are both slowed down to hold it above the floor, instead of the board resetting mid-burst.
+
+#include "NarfduinoBattery.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBrushless.h"
+#include "NarfduinoPowerGovernor.h"
+
+#define PIN_TRIGGER 4
+
+NarfduinoBattery Battery = NarfduinoBattery();
+NarfduinoBridge Pusher = NarfduinoBridge();
+NarfduinoBrushless Brushless = NarfduinoBrushless();
+NarfduinoPowerGovernor PowerGovernor = NarfduinoPowerGovernor();
+
+void setup() {
+  // put your setup code here, to run once:
+  pinMode( PIN_TRIGGER, INPUT_PULLUP );
+
+  Battery.Init();
+  Battery.StartBatteryDetection();
+  // The governor needs the voltage under load to be current
+  Battery.EnableBackgroundSampling();
+
+  Pusher.Init();
+  Pusher.SetBridgeSpeed( 100 );
+  // Full auto with no pusher switch
+  Pusher.DisableAntiJam();
+
+  Brushless.Init();
+  // Arm the ESC
+  Brushless.UpdateSpeed( 1000 );
+  delay( 3000 );
+
+  // It sets the battery's load hints too
+  PowerGovernor.AttachBattery( &Battery );
+  PowerGovernor.AttachBridge( &Pusher );
+  PowerGovernor.AttachBrushless( &Brushless );
+  // Or set your own floor for the pack under load, in mV
+  //PowerGovernor.SetFloor( 9000 );
+}
+
+void loop() {
+  // put your main code here, to run repeatedly:
+  static bool LastTrigger = false;
+  bool Trigger = (digitalRead( PIN_TRIGGER ) == LOW);
+  if( Trigger != LastTrigger )
+  {
+    // Ask for full speed as normal. The governor holds it back if it has to.
+    Brushless.UpdateSpeed( Trigger ? 2000 : 1000 );
+    if( Trigger )
+      Pusher.StartBridge();
+    else
+      Pusher.StopBridge();
+    LastTrigger = Trigger;
+  }
+
+  // Run these frequently. The governor goes after the battery monitor, so it has the latest reading.
+  Battery.ProcessBatteryMonitor();
+  PowerGovernor.ProcessPowerGovernor();
+  Pusher.ProcessBridge();
+}
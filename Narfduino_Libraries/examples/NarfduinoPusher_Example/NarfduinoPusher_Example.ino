@@ -0,0 +1,66 @@
+// Example of NarfduinoPusher - select fire on a bridge driven pusher
+// Trigger on pin 4, pusher reset switch on pin 6, fire select switch on pin 7 (closed = full auto, open = burst of 3).
+
+// Include the library
+#include "NarfduinoBridge.h"
+#include "NarfduinoPusher.h"
+
+#define PIN_TRIGGER 4
+#define PIN_PUSHER_SWITCH 6
+#define PIN_SELECT 7
+
+// Create our bridge and pusher objects
+NarfduinoBridge Bridge = NarfduinoBridge();
+NarfduinoPusher Pusher = NarfduinoPusher();
+
+bool SwitchAttached = false;
+
+
+void setup() {
+  pinMode( PIN_TRIGGER, INPUT_PULLUP );
+  pinMode( PIN_SELECT, INPUT_PULLUP );
+
+  // Initialise the bridge, then hand it to the pusher
+  Bridge.Init();
+  Pusher.Init( &Bridge );
+
+  // With _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT defined the bridge reads the pusher reset switch itself, from an interrupt, 
+  // so the heartbeats are timed to the us. Otherwise read it in loop(), and call Bridge.PusherHeartbeat() each time it closes.
+  // The pusher counts the darts from the heartbeats.
+  SwitchAttached = Bridge.AttachPusherSwitch( PIN_PUSHER_SWITCH );
+  if( !SwitchAttached )
+    pinMode( PIN_PUSHER_SWITCH, INPUT_PULLUP );
+
+  // Hold it to 10 darts a second. Leave this out to run flat out.
+  Pusher.SetRateOfFire( 10 );
+}
+
+void loop() {
+  static bool LastSwitch = false;
+  if( !SwitchAttached )
+  {
+    bool Switch = (digitalRead( PIN_PUSHER_SWITCH ) == LOW);
+    if( Switch && !LastSwitch )
+      Bridge.PusherHeartbeat();
+    LastSwitch = Switch;
+  }
+
+  if( digitalRead( PIN_SELECT ) == LOW )
+    Pusher.SetFireMode( _NARFDUINO_PUSHER_AUTO );
+  else
+    Pusher.SetFireMode( _NARFDUINO_PUSHER_BURST, 3 );
+
+  // Pass the trigger in every time - the fire mode decides what a pull does
+  Pusher.SetTrigger( digitalRead( PIN_TRIGGER ) == LOW );
+
+  // If it jams, clear it after a pause
+  if( Bridge.HasJammed() )
+  {
+    delay( 500 );
+    Bridge.ResetJam();
+  }
+
+  // Run both of these frequently
+  Pusher.ProcessPusher();
+  Bridge.ProcessBridge();
+}
@@ -0,0 +1,75 @@
+// Example of NarfduinoRecorder - a black box for jams and flat batteries
+// Pusher on the bridge, with the pusher switch on pin 6 and the trigger on pin 4.
+// Hold the trigger down at power on to print the log over Serial. Or read the EEPROM with avrdude, and use narfduino_blackbox in extras/host.
+
+// Include the library
+#include "NarfduinoBridge.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoRecorder.h"
+
+#define PIN_TRIGGER 4
+#define PIN_PUSHER_SWITCH 6
+
+// Your own event, above the ones the recorder logs itself
+#define EVENT_TRIGGER_PULLED _NARFDUINO_RECORDER_USER
+
+// Create our objects
+NarfduinoBridge Bridge = NarfduinoBridge();
+NarfduinoBattery Battery = NarfduinoBattery();
+NarfduinoRecorder Recorder = NarfduinoRecorder();
+
+bool SwitchAttached = false;
+
+void setup() {
+  pinMode( PIN_TRIGGER, INPUT_PULLUP );
+
+  Bridge.Init();
+  // Polled in loop() unless _NARFDUINO_ENABLE_PUSHER_SWITCH_INTERRUPT is defined
+  SwitchAttached = Bridge.AttachPusherSwitch( PIN_PUSHER_SWITCH );
+  if( !SwitchAttached )
+    pinMode( PIN_PUSHER_SWITCH, INPUT_PULLUP );
+  Battery.Init();
+  Battery.StartBatteryDetection();
+
+  // Finds where the log got up to, and logs the power on
+  Recorder.Init();
+  Recorder.AttachBridge( &Bridge );
+  Recorder.AttachBattery( &Battery );
+
+  if( digitalRead( PIN_TRIGGER ) == LOW )
+  {
+    Serial.begin( 57600 );
+    Recorder.Dump( Serial );
+    // Recorder.Clear(); // To start again. It takes a couple of seconds.
+  }
+}
+
+void loop() {
+  static bool LastTrigger = false;
+  bool Trigger = (digitalRead( PIN_TRIGGER ) == LOW);
+  if( Trigger && !LastTrigger )
+  {
+    Recorder.LogEvent( EVENT_TRIGGER_PULLED, Battery.GetBatteryPercent() );
+    Bridge.ResetJam();
+    Bridge.StartBridge();
+  }
+  else if( !Trigger && LastTrigger )
+    Bridge.StopBridge();
+  LastTrigger = Trigger;
+
+  static bool LastSwitch = false;
+  if( !SwitchAttached )
+  {
+    bool Switch = (digitalRead( PIN_PUSHER_SWITCH ) == LOW);
+    if( Switch && !LastSwitch )
+      Bridge.PusherHeartbeat();
+    LastSwitch = Switch;
+  }
+
+  Bridge.ProcessBridge();
+  Battery.ProcessBatteryMonitor();
+
+  // Run this every time through the loop. It picks up the jams and the battery going flat, and writes them out a byte at a time
+  // as the EEPROM comes free, so the loop never waits on it.
+  Recorder.ProcessRecorder();
+}
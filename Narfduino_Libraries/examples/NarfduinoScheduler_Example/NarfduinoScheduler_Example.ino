@@ -0,0 +1,81 @@
+// Example of NarfduinoScheduler - run the bridge, the battery monitor and the sketch from one call
+// Flywheels on the bridge, rev trigger on pin 4. Prints how late each task has run every 5 seconds.
+
+// Include the library
+#include "NarfduinoBridge.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoScheduler.h"
+#include "NarfduinoProfiler.h"
+
+#define PIN_REV_TRIGGER 4
+
+// Create our objects
+NarfduinoBridge Bridge = NarfduinoBridge();
+NarfduinoBattery Battery = NarfduinoBattery();
+NarfduinoScheduler Scheduler = NarfduinoScheduler();
+
+byte BridgeTask;
+byte BatteryTask;
+byte TriggerTask;
+unsigned long LastReport = 0;
+
+// Our own task. The context is whatever was passed to AddTask() - this one doesn't need it.
+void ReadTrigger( void * )
+{
+  if( digitalRead( PIN_REV_TRIGGER ) == LOW )
+    Bridge.StartBridge();
+  else
+    Bridge.StopBridge();
+}
+
+// Not a task - at 57600 baud this blocks for well over 10ms, which would show up as the loop time and lateness it's reporting.
+// It's printed from loop() between passes instead, and the figures are started again once the tasks it held up have caught up.
+// To send figures like these without blocking, see NarfduinoTelemetry.
+void PrintReport()
+{
+  Serial.print( "Loop max us = " );
+  Serial.println( Scheduler.GetMaxLoopTime() );
+  Serial.print( "Trigger max late us = " );
+  Serial.println( Scheduler.GetTaskMaxLate( TriggerTask ) );
+  Serial.print( "Battery max late us = " );
+  Serial.println( Scheduler.GetTaskMaxLate( BatteryTask ) );
+  Serial.print( "Battery max run us = " );
+  Serial.println( Scheduler.GetTaskMaxRunTime( BatteryTask ) );
+
+  // How long each library call took. This prints nothing unless _NARFDUINO_ENABLE_PROFILER is switched on in NarfduinoProfiler.h
+  NarfduinoProfiler::Dump( Serial );
+  NarfduinoProfiler::Reset();
+}
+
+
+void setup() {
+  Serial.begin( 57600 );
+  NarfduinoProfiler::Init();
+  pinMode( PIN_REV_TRIGGER, INPUT_PULLUP );
+
+  Bridge.Init();
+  Bridge.DisableAntiJam();
+  Battery.Init();
+  Battery.SetupSelectBattery();
+
+  // The bridge runs first, on every pass. The rest run when they're due, most important first.
+  BridgeTask = Scheduler.AddBridge( &Bridge );
+  BatteryTask = Scheduler.AddBattery( &Battery );
+  TriggerTask = Scheduler.AddTask( ReadTrigger, NULL, 2000, _NARFDUINO_SCHEDULER_HIGH );
+
+  // Spend no more than 500us a pass on anything other than the bridge, so the trigger is never held up for long
+  Scheduler.SetLoopBudget( 500 );
+}
+
+void loop() {
+  // This replaces the Process calls
+  Scheduler.Run();
+
+  if( millis() - LastReport >= 5000 )
+  {
+    LastReport = millis();
+    PrintReport();
+    Scheduler.Run();
+    Scheduler.ResetStats();
+  }
+}
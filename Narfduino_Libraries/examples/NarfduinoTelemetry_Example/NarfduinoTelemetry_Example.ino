@@ -0,0 +1,53 @@
+// Example of NarfduinoTelemetry - log the battery, the bridge and the loop timing 200 times a second
+// Flywheels on the bridge, rev trigger on pin 4.
+// On the PC: narfduino_telemetry -b 115200 /dev/ttyUSB0 > session.csv  (build it with make in extras/host)
+
+// Include the library
+#include "NarfduinoBridge.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoTelemetry.h"
+
+#define PIN_REV_TRIGGER 4
+
+// Create our objects
+NarfduinoBridge Bridge = NarfduinoBridge();
+NarfduinoBattery Battery = NarfduinoBattery();
+NarfduinoTelemetry Telemetry = NarfduinoTelemetry();
+
+void setup() {
+  pinMode( PIN_REV_TRIGGER, INPUT_PULLUP );
+
+  Bridge.Init();
+  Bridge.DisableAntiJam();
+  Battery.Init();
+  Battery.SetupSelectBattery();
+
+  // The frames are binary - don't Serial.print anything else, or the decoder will have to skip over it
+  Serial.begin( 115200 );
+  Telemetry.Init( Serial, 200 );
+  Telemetry.AttachBridge( &Bridge );
+  Telemetry.AttachBattery( &Battery );
+}
+
+void loop() {
+  if( digitalRead( PIN_REV_TRIGGER ) == LOW )
+    Bridge.StartBridge();
+  else
+    Bridge.StopBridge();
+
+  // Something of your own - it comes out of the decoder as the type and the bytes in hex
+  static bool LastTrigger = false;
+  bool Trigger = (digitalRead( PIN_REV_TRIGGER ) == LOW);
+  if( Trigger != LastTrigger )
+  {
+    byte Event = Trigger;
+    Telemetry.SendFrame( _NARFDUINO_TELEMETRY_USER, &Event, 1 );
+    LastTrigger = Trigger;
+  }
+
+  Bridge.ProcessBridge();
+  Battery.ProcessBatteryMonitor();
+
+  // Run this every time through the loop. It never waits on Serial.
+  Telemetry.ProcessTelemetry();
+}
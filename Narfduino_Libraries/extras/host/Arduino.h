@@ -0,0 +1,273 @@
+/*
+ *  Narfduino Libraries - Host Simulation HAL
+ *
+ *  Stand-in for the Arduino core so the Narfduino libraries can be built and benchmarked on a Linux build machine.
+ *  Only covers what the Narfduino libraries use, on an ATmega328P (Uno / Nano / Narfduino) pin layout.
+ *  The simulated hardware is driven through the NarfduinoSim API in NarfduinoSim.h
+ *
+ *  This is NOT used when building for the board. The Arduino IDE ignores the extras folder.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_SIM_ARDUINO_H
+#define _NARFDUINO_SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef F_CPU
+  #define F_CPU 16000000UL
+#endif
+
+// Basic types and constants
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+// Analog pins - ATmega328P numbering
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define NUM_DIGITAL_PINS 20
+#define NUM_SIM_PINS 22
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// Program memory. The host has one address space, so these are plain reads.
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+// Port mapping - same values as the AVR core
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+// Simulated registers
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t SREG;
+
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+
+// Timer1 bits
+#define WGM10 0
+#define WGM11 1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+
+// Interrupt flag registers clear the bits that are written as 1, like the hardware. The simulation raises them with Raise().
+class SimFlagRegister
+{
+  public:
+    SimFlagRegister &operator=( uint8_t Clear ) { Value &= ~Clear; return *this; }
+    operator uint8_t() const { return Value; }
+    void Raise( uint8_t Bit ) { Value |= (1 << Bit); }
+    void Reset() { Value = 0; }
+  private:
+    volatile uint8_t Value = 0;
+};
+
+extern volatile uint8_t TIMSK1;
+extern SimFlagRegister TIFR1;
+
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+extern SimFlagRegister TIFR2;
+
+// Timer2 bits
+#define WGM20 0
+#define WGM21 1
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM22 3
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+extern volatile uint16_t ADC;
+
+// ADC bits
+#define MUX0 0
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+// Status register global interrupt flag
+#define SREG_I 7
+
+// Interrupt vectors. The simulation calls these when the simulated hardware raises the interrupt.
+#define ISR(vector, ...) extern "C" void vector( void )
+extern "C" void TIMER1_COMPA_vect( void );
+extern "C" void TIMER1_COMPB_vect( void );
+extern "C" void TIMER1_OVF_vect( void );
+extern "C" void TIMER2_COMPA_vect( void );
+extern "C" void TIMER2_COMPB_vect( void );
+extern "C" void ADC_vect( void );
+extern "C" void PCINT0_vect( void );
+extern "C" void PCINT1_vect( void );
+extern "C" void PCINT2_vect( void );
+
+// External interrupts - INT0 on pin 2, INT1 on pin 3
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+void attachInterrupt( uint8_t interruptNum, void (*userFunc)( void ), int mode );
+void detachInterrupt( uint8_t interruptNum );
+
+// Pin change interrupts - PCINT0 for pins 8 - 13, PCINT1 for A0 - A5, PCINT2 for pins 0 - 7. Same macros as the core's pins_arduino.h
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+extern SimFlagRegister PCIFR;
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+#define digitalPinToPCICR(p) (((p) >= 0 && (p) <= 21) ? (&PCICR) : ((volatile uint8_t *)0))
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (((p) <= 21) ? (&PCMSK1) : ((volatile uint8_t *)0))))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+// Core functions
+unsigned long millis();
+unsigned long micros();
+void delay( unsigned long ms );
+void delayMicroseconds( unsigned int us );
+
+void pinMode( uint8_t pin, uint8_t mode );
+void digitalWrite( uint8_t pin, uint8_t val );
+int digitalRead( uint8_t pin );
+int analogRead( uint8_t pin );
+void analogWrite( uint8_t pin, int val );
+
+long map( long x, long in_min, long in_max, long out_min, long out_max );
+
+void cli();
+void sei();
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+// Port writes that time themselves with counted delays (the DShot output). On the board these are a plain port write and __builtin_avr_delay_cycles.
+// Here the write is seen by the simulation, and the delays move the time the next write lands at. There are no instruction cycles on the host, 
+// so nothing is taken off the delays for them.
+void SimPortWrite( volatile uint8_t *Port, uint8_t Value );
+void SimDelayCycles( unsigned long Cycles );
+#define _NARFDUINO_DSHOT_PORT_WRITE(Value) SimPortWrite( &PORTB, (Value) )
+#define _NARFDUINO_DSHOT_DELAY_CYCLES(Cycles) SimDelayCycles( Cycles )
+#define _NARFDUINO_DSHOT_WRITE_CYCLES 0
+#define _NARFDUINO_DSHOT_LOOP_CYCLES 0
+
+// Print and Serial. Only the parts the libraries use.
+// Once begin() has been called, Serial sends at the baud rate through a 63 byte buffer like the core's, and write() waits when it's full.
+#define DEC 10
+#define HEX 16
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write( uint8_t c ) = 0;
+    virtual size_t write( const uint8_t *buffer, size_t size );
+    size_t write( const char *str ) { return write( (const uint8_t *)str, strlen( str ) ); }
+
+    size_t print( const __FlashStringHelper *str ) { return write( (const char *)str ); }
+    size_t print( const char *str ) { return write( str ); }
+    size_t print( char c ) { return write( (uint8_t)c ); }
+    size_t print( unsigned long n, int base = DEC );
+    size_t print( long n, int base = DEC );
+    size_t print( unsigned int n, int base = DEC ) { return print( (unsigned long)n, base ); }
+    size_t print( int n, int base = DEC ) { return print( (long)n, base ); }
+    size_t print( unsigned char n, int base = DEC ) { return print( (unsigned long)n, base ); }
+    size_t print( double n, int digits = 2 );
+    size_t println() { return write( (const uint8_t *)"\r\n", 2 ); }
+    template<typename T> size_t println( T value ) { size_t n = print( value ); return n + println(); }
+    template<typename T> size_t println( T value, int base ) { size_t n = print( value, base ); return n + println(); }
+};
+
+class HardwareSerial : public Print
+{
+  public:
+    void begin( unsigned long baud );
+    int availableForWrite();
+    size_t write( uint8_t c );
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+// Pin to port lookups. The real core uses PROGMEM tables, these resolve the same answers.
+uint8_t digitalPinToPort( uint8_t pin );
+uint8_t digitalPinToBitMask( uint8_t pin );
+volatile uint8_t *portOutputRegister( uint8_t port );
+volatile uint8_t *portInputRegister( uint8_t port );
+volatile uint8_t *portModeRegister( uint8_t port );
+
+#endif
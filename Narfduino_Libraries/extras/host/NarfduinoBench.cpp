@@ -0,0 +1,2531 @@
+/*
+ *  Narfduino Libraries - Host Benchmark
+ *
+ *  Drives the loop functions through millions of simulated loop iterations on the host simulation HAL
+ *  and reports the per-call cost and the state transitions they caused.
+ *
+ *    - ns/call is host time, including the timer overhead shown at the top. Use it to compare builds on the same machine, not as an AVR figure.
+ *    - core/call and cycles/call are the Arduino core calls made per call, and their estimated AVR cost.
+ *      max cycles is the most estimated core cost seen in a single call - the worst case the main loop sees.
+ *    - The bridge scenarios also check the outputs for shoot-through, and report the shortest dead-time seen.
+ *
+ *  Usage: narfduino_bench [iterations]
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+
+#include "NarfduinoSim.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBridgePins.h"
+#include "NarfduinoBridgeGroup.h"
+#include "NarfduinoBattery.h"
+#include "NarfduinoCellMonitor.h"
+#include "NarfduinoBrushless.h"
+#include "NarfduinoGovernor.h"
+#include "NarfduinoPowerGovernor.h"
+#include "NarfduinoPusher.h"
+#include "NarfduinoScheduler.h"
+#include "NarfduinoProfiler.h"
+#include "NarfduinoTelemetry.h"
+#include "NarfduinoTelemetryDecoder.h"
+#include "NarfduinoRecorder.h"
+#include "NarfduinoRecorderDecoder.h"
+#include "avr/eeprom.h"
+
+// Simulated main loop period in us
+#define BENCH_LOOP_MICROS 50
+
+// Pusher model - one full cycle takes this long at 100% duty
+#define BENCH_PUSHER_CYCLE_MICROS 60000UL
+
+static unsigned long BenchIterations = 2000000UL;
+static bool BenchFailed = false;
+
+// Host time around a single call. Uses the TSC where there is one, as the chrono clocks cost more than the calls being measured.
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  static inline unsigned long long BenchTicks() { return __rdtsc(); }
+#else
+  static inline unsigned long long BenchTicks() { return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count(); }
+#endif
+
+// Also tracks the most estimated AVR core cycles spent in a single call - the worst case the main loop sees.
+class BenchTimer
+{
+  public:
+    void Start()
+    {
+      BeginCycles = NarfduinoSim::EstimatedCoreCycles();
+      Begin = BenchTicks();
+    }
+    void Stop()
+    {
+      TotalTicks += BenchTicks() - Begin;
+      unsigned long long Cycles = NarfduinoSim::EstimatedCoreCycles() - BeginCycles;
+      if( Cycles > MaxCycles )
+        MaxCycles = Cycles;
+    }
+    unsigned long long TotalTicks = 0;
+    unsigned long long MaxCycles = 0;
+
+  private:
+    unsigned long long Begin = 0;
+    unsigned long long BeginCycles = 0;
+};
+
+// Timer overhead and tick length, measured once. The overhead is included in ns/call and shown in the header.
+static double TimerOverheadTicks = 0;
+static double NanosPerTick = 1.0;
+
+static void CalibrateTimer()
+{
+  BenchTimer Timer;
+  auto WallStart = std::chrono::steady_clock::now();
+  unsigned long long TickStart = BenchTicks();
+  for( unsigned long c = 0; c < 1000000UL; c++ )
+  {
+    Timer.Start();
+    Timer.Stop();
+  }
+  TimerOverheadTicks = (double)Timer.TotalTicks / 1000000.0;
+  double WallNanos = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - WallStart ).count();
+  NanosPerTick = WallNanos / (double)(BenchTicks() - TickStart);
+}
+
+static void PrintHeader()
+{
+  printf( "%-32s %10s %9s %10s %11s %10s %12s\n", "Scenario", "calls", "ns/call", "core/call", "cycles/call", "max cycles", "transitions" );
+}
+
+static void PrintResult( const char *Name, unsigned long Calls, BenchTimer &Timer, unsigned long Transitions )
+{
+  double NanosPerCall = (double)Timer.TotalTicks / (double)Calls * NanosPerTick;
+  NarfduinoSim::CoreCounters &C = NarfduinoSim::Counters;
+  unsigned long CoreCalls = C.DigitalWrites + C.DigitalReads + C.AnalogWrites + C.AnalogReads + C.Millis + C.Micros;
+  printf( "%-32s %10lu %9.1f %10.2f %11.1f %10llu %12lu\n", Name, Calls, NanosPerCall,
+    (double)CoreCalls / (double)Calls, (double)NarfduinoSim::EstimatedCoreCycles() / (double)Calls, Timer.MaxCycles, Transitions );
+}
+
+
+// Watches a bridge's two outputs. Counts output phase changes, catches shoot-through, and measures dead-time.
+class BridgeWatcher
+{
+  public:
+    BridgeWatcher( byte _RunPin, byte _StopPin )
+    {
+      RunPin = _RunPin;
+      StopPin = _StopPin;
+    }
+
+    // The bridge has been asked to start. The time until the run FET comes on is the start latency.
+    void StartRequested()
+    {
+      if( !StartPending )
+      {
+        StartPending = true;
+        StartRequestedAt = NarfduinoSim::Now();
+      }
+    }
+
+    void Sample()
+    {
+      int Run = NarfduinoSim::GetPinOutput( RunPin );
+      int Stop = NarfduinoSim::GetPinOutput( StopPin );
+      unsigned long long Now = NarfduinoSim::Now();
+
+      if( Run && Stop )
+        ShootThrough++;
+
+      byte Phase = Run ? 1 : (Stop ? 2 : 0);
+      if( Phase == LastPhase )
+        return;
+
+      Transitions++;
+      if( Phase == 1 && StartPending )
+      {
+        StartPending = false;
+        StartLatencyTotal += Now - StartRequestedAt;
+        StartCount++;
+      }
+      // Measure the gap between one FET releasing and the other one coming on
+      if( Phase == 0 )
+      {
+        OffSince = Now;
+        OffFrom = LastPhase;
+      }
+      else if( LastPhase == 0 && OffFrom != 0 && OffFrom != Phase )
+      {
+        unsigned long long Gap = Now - OffSince;
+        if( Gap < MinDeadTime )
+          MinDeadTime = Gap;
+      }
+      LastPhase = Phase;
+    }
+
+    unsigned long Transitions = 0;
+    unsigned long ShootThrough = 0;
+    unsigned long long MinDeadTime = ~0ULL;
+    unsigned long long StartLatencyTotal = 0;
+    unsigned long StartCount = 0;
+
+  private:
+    bool StartPending = false;
+    unsigned long long StartRequestedAt = 0;
+    byte RunPin;
+    byte StopPin;
+    byte LastPhase = 0;
+    byte OffFrom = 0;
+    unsigned long long OffSince = 0;
+};
+
+static void ReportBridgeSafety( const char *Name, BridgeWatcher &Watcher )
+{
+  printf( "  %s: shoot-through samples %lu, min dead-time ", Name, Watcher.ShootThrough );
+  if( Watcher.MinDeadTime == ~0ULL )
+    printf( "n/a" );
+  else
+    printf( "%lluus", Watcher.MinDeadTime );
+  if( Watcher.StartCount )
+    printf( ", avg start latency %lluus\n", Watcher.StartLatencyTotal / Watcher.StartCount );
+  else
+    printf( "\n" );
+  if( Watcher.ShootThrough )
+    BenchFailed = true;
+}
+
+
+// Simple pusher model. Moves in proportion to the run FET duty, brakes on the stop FET, and hits the reset switch once per cycle.
+class PusherModel
+{
+  public:
+    // Returns true when the pusher passes home
+    bool Step( int RunDuty, int StopDuty, unsigned long Micros )
+    {
+      if( StopDuty )
+        return false;
+      Position += (unsigned long long)Micros * RunDuty;
+      if( Position >= (unsigned long long)BENCH_PUSHER_CYCLE_MICROS * 255 )
+      {
+        Position -= (unsigned long long)BENCH_PUSHER_CYCLE_MICROS * 255;
+        return true;
+      }
+      return false;
+    }
+
+  private:
+    unsigned long long Position = 0;
+};
+
+
+// Pusher use - burst of 3, pause, repeat. Heartbeats come from the pusher model.
+// TimedOnMicros / TimedOffMicros - use the Timer2 dead-time with these times, or 0 for the ProcessBridge() dead-time
+// Bridge - NarfduinoBridge with the default pins, or BenchFixedBridge
+typedef NarfduinoBridgePins<_NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP> BenchFixedBridge;
+
+template <class Bridge = NarfduinoBridge>
+static void BenchBridgePusher( const char *Name, byte Speed, unsigned int TimedOnMicros = 0, unsigned int TimedOffMicros = 0 )
+{
+  NarfduinoSim::Reset();
+  Bridge Pusher;
+  if( !Pusher.Init() )
+  {
+    printf( "%s: Init() failed\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  Pusher.SetBridgeSpeed( Speed );
+  if( TimedOnMicros )
+  {
+    Pusher.SetDeadTime( TimedOnMicros, TimedOffMicros );
+    Pusher.EnableTimedDeadTime();
+  }
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher Watcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  PusherModel Model;
+  BenchTimer Timer;
+  bool Firing = false;
+  byte ShotsFired = 0;
+  unsigned long long IdleUntil = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    // Trigger logic, outside of the measured call. Its core calls are not counted.
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    if( !Firing && NarfduinoSim::Now() >= IdleUntil )
+    {
+      Firing = true;
+      ShotsFired = 0;
+      Pusher.StartBridge();
+      Watcher.StartRequested();
+    }
+    bool Home = Model.Step( NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN ), NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_STOP ), BENCH_LOOP_MICROS );
+    if( Home )
+    {
+      Pusher.PusherHeartbeat();
+      if( Firing && ++ShotsFired >= 3 )
+      {
+        Firing = false;
+        Pusher.StopBridge();
+        IdleUntil = NarfduinoSim::Now() + 200000ULL;
+      }
+    }
+    if( Pusher.HasJammed() )
+    {
+      Pusher.StopBridge();
+      Pusher.ResetJam();
+      Firing = false;
+      IdleUntil = NarfduinoSim::Now() + 200000ULL;
+    }
+    NarfduinoSim::Counters = Outside;
+
+    Timer.Start();
+    Pusher.ProcessBridge();
+    Timer.Stop();
+
+    Watcher.Sample();
+  }
+
+  PrintResult( Name, BenchIterations, Timer, Watcher.Transitions );
+  ReportBridgeSafety( Name, Watcher );
+  Pusher.DisableTimedDeadTime();
+}
+
+// RAM per bridge, and shared by all of them. These are host sizes - pointers are 8 bytes here and 2 on the AVR, and members are padded 
+// to their alignment. make avr-sizes measures the AVR ones.
+static void BenchBridgeSizes()
+{
+  printf( "Bridge RAM, host sizes: NarfduinoBridge %zu bytes, NarfduinoBridgePins %zu bytes each, %zu bytes of statics shared by both\n", 
+    sizeof( NarfduinoBridge ), sizeof( BenchFixedBridge ), NarfduinoBridgeBase::GetSharedRAM() );
+  if( sizeof( BenchFixedBridge ) >= sizeof( NarfduinoBridge ) )
+  {
+    printf( "  Bridge RAM: NarfduinoBridgePins isn't smaller than NarfduinoBridge\n" );
+    BenchFailed = true;
+  }
+}
+
+
+// Anti-jam - bursts of 5 at 40, 70 and 100%, with the pusher slowing as the battery runs down and a few % jitter on every cycle.
+// Every 10th burst the pusher stalls a third of the way through a cycle. Times how long the run FET stays on into the stall - 
+// the rest of the cycle it should have finished, plus the margin. At 40% a cycle is 150ms.
+static void BenchAntiJam( const char *Name, bool Adaptive )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Pusher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Pusher.Init();
+  if( !Adaptive )
+    Pusher.DisableAdaptiveAntiJam();
+  NarfduinoSim::ResetCounters();
+
+  static const byte Speeds[] = { 40, 70, 100 };
+  BenchTimer Timer;
+  unsigned long long Position = 0;
+  unsigned long RatePercent = 100;
+  unsigned long Noise = 12345;
+  unsigned long Bursts = 0;
+  bool Firing = false;
+  byte Shots = 0;
+  bool StallThisBurst = false;
+  bool Stalled = false;
+  unsigned long long StalledAt = 0;
+  unsigned long long IdleUntil = 0;
+  unsigned long Stalls = 0;
+  unsigned long StallsCaught = 0;
+  unsigned long long StallOnMicros = 0;
+  unsigned long long StallOnMax = 0;
+  unsigned long FalseJams = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    if( !Firing && Now >= IdleUntil )
+    {
+      Firing = true;
+      Shots = 0;
+      Pusher.SetBridgeSpeed( Speeds[Bursts % 3] );
+      StallThisBurst = (Bursts % 10) == 9;
+      Bursts++;
+      Pusher.StartBridge();
+    }
+
+    // Pusher model - moves with the run FET duty, slowed by the battery, until it stalls
+    int RunDuty = NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN );
+    if( Stalled && RunDuty )
+      StallOnMicros += BENCH_LOOP_MICROS;
+    if( !Stalled && RunDuty )
+    {
+      Position += (unsigned long long)BENCH_LOOP_MICROS * RunDuty * RatePercent / 100;
+      if( StallThisBurst && Shots >= 2 && Position >= (unsigned long long)BENCH_PUSHER_CYCLE_MICROS * 255 / 3 )
+      {
+        Stalled = true;
+        StalledAt = Now;
+        StallThisBurst = false;
+        Stalls++;
+      }
+      if( Position >= (unsigned long long)BENCH_PUSHER_CYCLE_MICROS * 255 )
+      {
+        Position -= (unsigned long long)BENCH_PUSHER_CYCLE_MICROS * 255;
+        Pusher.PusherHeartbeat();
+        Noise = Noise * 1103515245UL + 12345UL;
+        RatePercent = 100 - 20 * c / BenchIterations - 3 + (Noise >> 16) % 7;
+        if( ++Shots >= 5 )
+        {
+          Firing = false;
+          Pusher.StopBridge();
+          IdleUntil = Now + 200000ULL;
+        }
+      }
+    }
+    if( Pusher.HasJammed() )
+    {
+      if( Stalled )
+      {
+        StallsCaught++;
+        if( Now - StalledAt > StallOnMax )
+          StallOnMax = Now - StalledAt;
+      }
+      else
+        FalseJams++;
+      Stalled = false;
+      Position = 0;
+      Pusher.StopBridge();
+      Pusher.ResetJam();
+      Firing = false;
+      IdleUntil = Now + 200000ULL;
+    }
+    NarfduinoSim::Counters = Outside;
+
+    Timer.Start();
+    Pusher.ProcessBridge();
+    Timer.Stop();
+  }
+
+  PrintResult( Name, BenchIterations, Timer, StallsCaught );
+  printf( "  %s: %lu of %lu stalls caught, run FET on into a stall avg %llums max %llums, false jams %lu\n", Name, StallsCaught, Stalls,
+    StallsCaught ? StallOnMicros / StallsCaught / 1000 : 0, StallOnMax / 1000, FalseJams );
+  if( Adaptive && (FalseJams || StallsCaught != Stalls || !Stalls || StallOnMax > 200000ULL) )
+    BenchFailed = true;
+}
+
+
+// Pusher with inertia - for the stop accuracy. Position is in cycles, home switch closes at 0 and stays closed for the first part of the cycle.
+// The motor takes a while to spin up, coasts slowly with both FETs off, and stops hard on the brake.
+#define BENCH_PUSHER_FULL_CYCLE_MICROS 45000.0f
+#define BENCH_PUSHER_RUN_TAU 10000.0f
+#define BENCH_PUSHER_COAST_TAU 60000.0f
+#define BENCH_PUSHER_BRAKE_TAU 8000.0f
+#define BENCH_PUSHER_HOME_WINDOW 0.12f
+#define BENCH_MOTOR_CURRENT_TAU 500.0f
+
+class InertialPusherModel
+{
+  public:
+    // Returns true when the pusher reaches home
+    bool Step( int RunDuty, int StopDuty, unsigned long Micros )
+    {
+      // Motor current as a fraction of stall - the drive less the back EMF, or the back EMF alone through the brake. 
+      // The winding inductance smooths it.
+      float Speed = Velocity * BENCH_PUSHER_FULL_CYCLE_MICROS;
+      float CurrentTarget = RunDuty ? (RunDuty / 255.0f - Speed) : (StopDuty ? Speed : 0);
+      Current += (CurrentTarget - Current) * Micros / BENCH_MOTOR_CURRENT_TAU;
+
+      float Target = RunDuty / 255.0f / BENCH_PUSHER_FULL_CYCLE_MICROS;
+      if( RunDuty )
+        Velocity += (Target - Velocity) * Micros / BENCH_PUSHER_RUN_TAU;
+      else if( StopDuty )
+        Velocity -= Velocity * Micros / BENCH_PUSHER_BRAKE_TAU;
+      else
+        Velocity -= Velocity * Micros / BENCH_PUSHER_COAST_TAU;
+      if( !RunDuty && Velocity < 0.002f / BENCH_PUSHER_FULL_CYCLE_MICROS )
+        Velocity = 0;
+      Position += Velocity * Micros;
+      if( Position >= 1.0f )
+      {
+        Position -= 1.0f;
+        return true;
+      }
+      return false;
+    }
+    bool AtRest() { return Velocity == 0; }
+    float Position = 0.05f;
+    float Current = 0;
+
+  private:
+    float Velocity = 0;
+};
+
+// Pusher switch - a pusher running flat out, with a switch that bounces as it's pressed and released, and a main loop that 
+// stalls for 12ms every 20ms. The switch is read by the bridge's pin change interrupt, or polled by the sketch with the same debounce.
+#define BENCH_SWITCH_PIN 6
+#define BENCH_SWITCH_PRESS_TICKS 100
+#define BENCH_SWITCH_STALL_EVERY 400
+#define BENCH_SWITCH_STALL_MICROS 12000
+
+static void BenchPusherSwitch( const char *Name, bool Interrupt )
+{
+  NarfduinoSim::Reset();
+  NarfduinoSim::SetPinInput( BENCH_SWITCH_PIN, HIGH );
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.SetBridgeSpeed( 100 );
+  if( Interrupt && !Bridge.AttachPusherSwitch( BENCH_SWITCH_PIN ) )
+  {
+    printf( "  %s: AttachPusherSwitch failed\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  Bridge.StartBridge();
+  NarfduinoSim::ResetCounters();
+
+  PusherModel Model;
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  unsigned long long BusyUntil = 0;
+  unsigned long Homes = 0;
+  unsigned long PressTick = 0; // Ticks since the switch was hit. 0 = not pressed
+  unsigned long long HomeAt = 0; // When the last home happened
+  unsigned int LastCount = 0;
+  unsigned long long LateTotal = 0;
+  unsigned long long LateMax = 0;
+  unsigned long Timed = 0;
+  unsigned long FalseJams = 0;
+  // The sketch's own debounce
+  bool PolledPressed = false;
+  unsigned long long PolledChange = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    // The switch, bouncing for 150us as it's hit and as it's let go
+    if( Model.Step( NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN ), NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_STOP ), BENCH_LOOP_MICROS ) )
+    {
+      HomeAt = Now;
+      Homes++;
+      PressTick = 1;
+    }
+    if( PressTick )
+    {
+      static const unsigned long BounceTicks[] = { 1, 2, 4, BENCH_SWITCH_PRESS_TICKS, BENCH_SWITCH_PRESS_TICKS + 1, BENCH_SWITCH_PRESS_TICKS + 3 };
+      for( byte b = 0; b < sizeof( BounceTicks ) / sizeof( BounceTicks[0] ); b++ )
+      {
+        if( PressTick == BounceTicks[b] )
+          NarfduinoSim::SetPinInput( BENCH_SWITCH_PIN, (b & 1) != 0 );
+      }
+      PressTick = (PressTick >= BENCH_SWITCH_PRESS_TICKS + 3) ? 0 : PressTick + 1;
+    }
+
+    // The main loop, when it isn't stuck on something else
+    if( Now < BusyUntil )
+      continue;
+    if( Calls % BENCH_SWITCH_STALL_EVERY == BENCH_SWITCH_STALL_EVERY - 1 )
+      BusyUntil = Now + BENCH_SWITCH_STALL_MICROS;
+
+    Timer.Start();
+    if( !Interrupt )
+    {
+      bool Pressed = !digitalRead( BENCH_SWITCH_PIN );
+      if( Pressed != PolledPressed && micros() - PolledChange >= _NARFDUINO_PUSHER_DEBOUNCE_MICROS )
+      {
+        PolledPressed = Pressed;
+        PolledChange = micros();
+        if( Pressed )
+          Bridge.PusherHeartbeat();
+      }
+    }
+    Bridge.ProcessBridge();
+    Timer.Stop();
+    Calls++;
+
+    // The pusher never jams here. Start it again, as a sketch would.
+    if( Bridge.HasJammed() )
+    {
+      FalseJams++;
+      Bridge.ResetJam();
+      Bridge.StartBridge();
+    }
+
+    // How late each heartbeat was timestamped. Homes are 60ms apart, so it's always the last one.
+    unsigned int Count = Bridge.GetHeartbeatCount();
+    if( Count != LastCount )
+    {
+      LastCount = Count;
+      unsigned long long Late = (unsigned long long)(Bridge.GetLastHeartbeatMicros() - (unsigned long)HomeAt);
+      LateTotal += Late;
+      if( Late > LateMax )
+        LateMax = Late;
+      Timed++;
+    }
+  }
+
+  unsigned long Counted = Bridge.GetHeartbeatCount();
+  PrintResult( Name, Calls, Timer, Counted );
+  printf( "  %s: %lu of %lu homes counted, heartbeat timestamp late avg %lluus max %lluus, learnt jam timeout %ums, false jams %lu\n", Name,
+    Counted, Homes, Timed ? LateTotal / Timed : 0, LateMax, Bridge.GetJamTimeout(), FalseJams );
+  if( Interrupt && (Counted + 1 < Homes || Counted > Homes || LateMax > 100 || FalseJams) )
+    BenchFailed = true;
+}
+
+
+// Single shots from rest - start, stop on the heartbeat, and brake to a stop. Hard is the default full start and brake,
+// soft ramps the start from 30% over 15ms and brakes at 50% for 20ms.
+static void BenchSoftStart( const char *Name, bool Soft )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.SetBridgeSpeed( 100 );
+  if( Soft )
+  {
+    Bridge.SetSoftStart( 15, 30 );
+    Bridge.SetBrakeStrength( 50, 20 );
+  }
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher Watcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  InertialPusherModel Model;
+  BenchTimer Timer;
+  bool Firing = false;
+  bool Stopping = false;
+  unsigned long long NextShot = 200000ULL;
+  unsigned long long ShotStart = 0;
+  unsigned long long ShotTotal = 0;
+  unsigned long Shots = 0;
+  float PeakRun = 0;
+  float PeakBrake = 0;
+  float Heating = 0; // Current squared * time, in stall current squared ms
+  float LandingTotal = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    unsigned long long Now = NarfduinoSim::Now();
+    if( !Firing && Now >= NextShot )
+    {
+      Bridge.StartBridge();
+      Watcher.StartRequested();
+      Firing = true;
+      ShotStart = Now;
+    }
+
+    Timer.Start();
+    Bridge.ProcessBridge();
+    Timer.Stop();
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    Watcher.Sample();
+
+    bool Home = Model.Step( NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN ), NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_STOP ), BENCH_LOOP_MICROS );
+    if( Model.Current > PeakRun )
+      PeakRun = Model.Current;
+    if( !NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN ) && Model.Current > PeakBrake )
+      PeakBrake = Model.Current;
+    Heating += Model.Current * Model.Current * BENCH_LOOP_MICROS / 1000.0f;
+
+    if( Firing && !Stopping && Home )
+    {
+      Bridge.PusherHeartbeat();
+      Bridge.StopBridge();
+      Stopping = true;
+    }
+    if( Stopping && Model.AtRest() )
+    {
+      Shots++;
+      ShotTotal += NarfduinoSim::Now() - ShotStart;
+      LandingTotal += Model.Position;
+      Firing = false;
+      Stopping = false;
+      NextShot = NarfduinoSim::Now() + 100000ULL;
+    }
+  }
+
+  PrintResult( Name, BenchIterations, Timer, Watcher.Transitions );
+  printf( "  %s: %lu shots, start to rest avg %.1fms, peak current %.0f%% of stall running %.0f%% braking, heating %.1f per shot, avg landing %.3f cycles past home\n", Name,
+    Shots, Shots ? ShotTotal / 1000.0 / Shots : 0.0, PeakRun * 100.0f, PeakBrake * 100.0f, Shots ? Heating / Shots : 0.0f, Shots ? LandingTotal / Shots : 0.0f );
+  ReportBridgeSafety( Name, Watcher );
+  if( Soft && PeakRun > 0.75f )
+    BenchFailed = true;
+}
+
+
+// Single, burst of 3 and a 1.2s pull of full auto in turn, with a rest between. The controller is NarfduinoPusher, or the usual
+// sketch logic of stopping on the heartbeat that completes the burst.
+static void BenchPusher( const char *Name, bool Controlled, byte RateOfFire )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.SetBridgeSpeed( 100 );
+  NarfduinoPusher Pusher;
+  Pusher.Init( &Bridge );
+  Pusher.SetRateOfFire( RateOfFire );
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher Watcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  InertialPusherModel Model;
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  byte Step = 0; // 0 single, 1 burst, 2 auto
+  bool Pulled = false;
+  bool Busy = false;
+  unsigned long long PullAt = 0;
+  unsigned long long RestUntil = 100000ULL;
+  unsigned long Expected = 0;
+  unsigned long Darts = 0;
+  unsigned long Stops = 0;
+  unsigned long Overruns = 0;
+  unsigned long WrongCounts = 0;
+  unsigned long DartsAtPull = 0;
+  byte ManualRemaining = 0;
+  float LandingTotal = 0;
+  unsigned long long AutoFirst = 0;
+  unsigned long long AutoLast = 0;
+  unsigned long AutoDarts = 0;
+  unsigned long long AutoTime = 0;
+  unsigned long AutoIntervals = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    // Trigger and the pusher, outside of the measured call
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    if( !Busy && Now >= RestUntil )
+    {
+      Busy = true;
+      Pulled = true;
+      PullAt = Now;
+      DartsAtPull = Darts;
+      Pusher.SetFireMode( Step == 0 ? _NARFDUINO_PUSHER_SINGLE : (Step == 1 ? _NARFDUINO_PUSHER_BURST : _NARFDUINO_PUSHER_AUTO), 3 );
+      Expected = (Step == 0) ? 1 : 3;
+      AutoFirst = 0;
+      AutoDarts = 0;
+      if( !Controlled )
+      {
+        ManualRemaining = (Step == 2) ? 255 : Expected;
+        Bridge.SetBridgeSpeed( 100 );
+        Bridge.StartBridge();
+      }
+    }
+    if( Pulled && Now - PullAt >= ((Step == 2) ? 1200000ULL : 100000ULL) )
+    {
+      Pulled = false;
+      if( !Controlled && ManualRemaining == 255 )
+        ManualRemaining = 1;
+    }
+    if( Controlled )
+      Pusher.SetTrigger( Pulled );
+
+    bool Home = Model.Step( NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_RUN ), NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_STOP ), BENCH_LOOP_MICROS );
+    if( Home )
+    {
+      Bridge.PusherHeartbeat();
+      Darts++;
+      if( Step == 2 )
+      {
+        if( AutoFirst )
+        {
+          AutoLast = Now;
+          AutoDarts++;
+        }
+        else
+          AutoFirst = Now;
+      }
+      if( !Controlled && ManualRemaining && ManualRemaining != 255 && --ManualRemaining == 0 )
+        Bridge.StopBridge();
+    }
+    NarfduinoSim::Counters = Outside;
+
+    if( Controlled )
+    {
+      Timer.Start();
+      Pusher.ProcessPusher();
+      Timer.Stop();
+      Calls++;
+      Bridge.ProcessBridge();
+    }
+    else
+    {
+      Timer.Start();
+      Bridge.ProcessBridge();
+      Timer.Stop();
+      Calls++;
+    }
+    Watcher.Sample();
+
+    // Finished, and at rest - check where it landed
+    bool Finished = Controlled ? !Pusher.IsFiring() : (ManualRemaining == 0 && !Bridge.IsBridgeRunning());
+    if( Busy && !Pulled && Finished && Model.AtRest() && Now - PullAt > 150000ULL )
+    {
+      Busy = false;
+      Stops++;
+      LandingTotal += Model.Position;
+      if( Model.Position >= BENCH_PUSHER_HOME_WINDOW )
+        Overruns++;
+      if( Step != 2 && Darts - DartsAtPull != Expected )
+        WrongCounts++;
+      if( Step == 2 && AutoDarts )
+      {
+        AutoTime += AutoLast - AutoFirst;
+        AutoIntervals += AutoDarts;
+      }
+      Step = (Step + 1) % 3;
+      RestUntil = Now + 300000ULL;
+    }
+  }
+
+  if( Controlled && Pusher.GetDartsFired() != Darts )
+    WrongCounts++;
+  float Rate = AutoTime ? (float)AutoIntervals * 1000000.0f / (float)AutoTime : 0;
+  PrintResult( Name, Calls ? Calls : 1, Timer, Stops );
+  printf( "  %s: %lu darts, auto %.1f darts/s, overran home %lu of %lu stops, avg landing %.3f cycles past home, wrong dart counts %lu\n", Name,
+    Darts, Rate, Overruns, Stops, Stops ? LandingTotal / Stops : 0.0f, WrongCounts );
+  ReportBridgeSafety( Name, Watcher );
+  if( Controlled && (Overruns > Stops / 20 || WrongCounts || !Stops || (RateOfFire && fabsf( Rate - RateOfFire ) > RateOfFire * 0.1f)) )
+    BenchFailed = true;
+}
+
+
+// Flywheel use - anti-jam off, stepping through 33/66/100% with 3s on, 3s off
+static void BenchBridgeFlywheel( const char *Name )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Flywheels( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Flywheels.Init();
+  Flywheels.DisableAntiJam();
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher Watcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  BenchTimer Timer;
+  bool Running = false;
+  byte Speed = 100;
+  unsigned long long NextChange = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    if( NarfduinoSim::Now() >= NextChange )
+    {
+      NextChange = NarfduinoSim::Now() + 3000000ULL;
+      if( Running )
+      {
+        Flywheels.StopBridge();
+      }
+      else
+      {
+        Speed = (Speed == 33) ? 66 : ((Speed == 66) ? 100 : 33);
+        Flywheels.SetBridgeSpeed( Speed );
+        Flywheels.StartBridge();
+      }
+      Running = !Running;
+    }
+
+    Timer.Start();
+    Flywheels.ProcessBridge();
+    Timer.Stop();
+
+    Watcher.Sample();
+  }
+
+  PrintResult( Name, BenchIterations, Timer, Watcher.Transitions );
+  ReportBridgeSafety( Name, Watcher );
+}
+
+
+// Flywheel and pusher bridges, started and stopped together - 150ms on, 150ms off. The sketch does 200us of other work
+// between the two ProcessBridge() calls. Grouped - one ProcessBridges() call, then the other work.
+// Reports how far apart the two run FETs come on, and checks both bridges' dead-time.
+#define BENCH_GROUP_FLYWHEEL_RUN 6
+#define BENCH_GROUP_FLYWHEEL_STOP 16
+#define BENCH_GROUP_OTHER_MICROS 200
+
+static void BenchBridgeGroup( const char *Name, bool Grouped )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Pusher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  NarfduinoBridge Flywheels( BENCH_GROUP_FLYWHEEL_RUN, BENCH_GROUP_FLYWHEEL_STOP );
+  NarfduinoBridgeGroup Group;
+  if( !Pusher.Init() || !Flywheels.Init() || !Group.AddBridge( &Flywheels ) || !Group.AddBridge( &Pusher ) )
+  {
+    printf( "%s: Init() failed\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  Pusher.SetBridgeSpeed( 100 );
+  Pusher.DisableAntiJam();
+  Flywheels.SetBridgeSpeed( 100 );
+  Flywheels.DisableAntiJam();
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher PusherWatcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  BridgeWatcher FlywheelWatcher( BENCH_GROUP_FLYWHEEL_RUN, BENCH_GROUP_FLYWHEEL_STOP );
+  BenchTimer Timer;
+  bool Running = false;
+  unsigned long long NextChange = 0;
+  unsigned long long RunOnAt[2] = { 0, 0 };
+  unsigned long long MaxSkew = 0;
+  unsigned long long SkewTotal = 0;
+  unsigned long Starts = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    if( NarfduinoSim::Now() >= NextChange )
+    {
+      NextChange = NarfduinoSim::Now() + 150000ULL;
+      if( Running )
+      {
+        Flywheels.StopBridge();
+        Pusher.StopBridge();
+      }
+      else
+      {
+        Flywheels.StartBridge();
+        Pusher.StartBridge();
+        RunOnAt[0] = RunOnAt[1] = 0;
+      }
+      Running = !Running;
+    }
+
+    if( Grouped )
+    {
+      Timer.Start();
+      Group.ProcessBridges();
+      Timer.Stop();
+      FlywheelWatcher.Sample();
+      PusherWatcher.Sample();
+      NarfduinoSim::AdvanceMicros( BENCH_GROUP_OTHER_MICROS );
+    }
+    else
+    {
+      // calls counts a pass through the loop - both bridges. max cycles is the dearer of the two.
+      Timer.Start();
+      Flywheels.ProcessBridge();
+      Timer.Stop();
+      FlywheelWatcher.Sample();
+      NarfduinoSim::AdvanceMicros( BENCH_GROUP_OTHER_MICROS );
+      Timer.Start();
+      Pusher.ProcessBridge();
+      Timer.Stop();
+      PusherWatcher.Sample();
+    }
+
+    // When each run FET first came on after the start
+    if( Running )
+    {
+      for( byte i = 0; i < 2; i++ )
+        if( !RunOnAt[i] && NarfduinoSim::GetPinOutput( i ? _NARFDUINOPIN_BRIDGE_RUN : BENCH_GROUP_FLYWHEEL_RUN ) )
+          RunOnAt[i] = NarfduinoSim::Now();
+      if( RunOnAt[0] && RunOnAt[1] && RunOnAt[0] != ~0ULL )
+      {
+        unsigned long long Skew = (RunOnAt[0] > RunOnAt[1]) ? RunOnAt[0] - RunOnAt[1] : RunOnAt[1] - RunOnAt[0];
+        if( Skew > MaxSkew )
+          MaxSkew = Skew;
+        SkewTotal += Skew;
+        Starts++;
+        RunOnAt[0] = ~0ULL;
+      }
+    }
+  }
+
+  PrintResult( Name, BenchIterations, Timer, FlywheelWatcher.Transitions + PusherWatcher.Transitions );
+  char Label[64];
+  snprintf( Label, sizeof( Label ), "%s flywheel", Name );
+  ReportBridgeSafety( Label, FlywheelWatcher );
+  snprintf( Label, sizeof( Label ), "%s pusher", Name );
+  ReportBridgeSafety( Label, PusherWatcher );
+  printf( "  %s: %lu starts, run FETs on %lluus apart on average, %lluus at most\n", Name, Starts, Starts ? SkewTotal / Starts : 0, MaxSkew );
+  if( FlywheelWatcher.MinDeadTime < _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS || PusherWatcher.MinDeadTime < _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS )
+  {
+    printf( "  %s: dead-time shorter than %uus\n", Name, _NARFDUINO_BRIDGE_OFF_TRANSITION_MICROS );
+    BenchFailed = true;
+  }
+  if( Grouped && MaxSkew )
+  {
+    printf( "  %s: grouped bridges came on apart\n", Name );
+    BenchFailed = true;
+  }
+}
+
+
+// Battery monitor - pack discharging from 12.4V to 9.0V over the run, with some ADC noise
+// Background - sample with the ADC interrupt instead of analogRead()
+static void BenchBattery( const char *Name, bool Background )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+  if( Background )
+    Battery.EnableBackgroundSampling();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Transitions = 0;
+  unsigned long VoltageUpdates = 0;
+  float LastVoltage = Battery.GetCurrentVoltage();
+  bool LastFlat = Battery.IsBatteryFlat();
+  unsigned long Noise = 12345;
+  int NominalPercent = -1; // Percent reported at 11.1V - 3.7V per cell
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    // 12.4V down to 9.0V. Counts = V / 5V * 1024 * 10 / 57
+    float PackVoltage = 12.4f - 3.4f * (float)c / (float)BenchIterations;
+    Noise = Noise * 1103515245UL + 12345UL;
+    int Counts = (int)(PackVoltage / 5.0f * 1024.0f * 10.0f / 57.0f) + (int)((Noise >> 16) % 5) - 2;
+    NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, Counts );
+
+    Timer.Start();
+    Battery.ProcessBatteryMonitor();
+    Timer.Stop();
+
+    if( Battery.GetCurrentVoltage() != LastVoltage )
+    {
+      LastVoltage = Battery.GetCurrentVoltage();
+      VoltageUpdates++;
+      if( NominalPercent < 0 && LastVoltage <= 11.1f )
+        NominalPercent = Battery.GetBatteryPercent();
+    }
+    if( Battery.IsBatteryFlat() != LastFlat )
+    {
+      LastFlat = Battery.IsBatteryFlat();
+      Transitions++;
+    }
+  }
+
+  // Let any background conversion finish while the battery is still around
+  NarfduinoSim::AdvanceMicros( 1000 );
+
+  PrintResult( Name, BenchIterations, Timer, Transitions );
+  printf( "  %s: voltage updates %lu, %d%% at 11.1V, final %.2fV, %u%%, flat %d\n", Name, VoltageUpdates, NominalPercent, LastVoltage, Battery.GetBatteryPercent(), (int)LastFlat );
+}
+
+
+// Battery counts for a pack voltage. Counts = V / 5V * 1024 * 10 / 57
+static int BatteryCounts( float PackVoltage )
+{
+  return (int)(PackVoltage / 5.0f * 1024.0f * 10.0f / 57.0f);
+}
+
+
+// Battery under load - the pusher and flywheels cycle on and off while the pack runs down from 12.6V to 9.0V at rest.
+// The pack has 90mOhms of internal resistance, so the voltage on the pin sags by up to 2.3V while firing.
+// Hints - pass the load to the monitor. Reports how long the pack was reported flat while it wasn't, and the resistance it learnt.
+static void BenchBatteryLoad( const char *Name, bool Hints )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+  Battery.EnableBackgroundSampling();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Transitions = 0;
+  bool LastFlat = Battery.IsBatteryFlat();
+  unsigned long long FalseFlatMicros = 0;
+  unsigned long Noise = 12345;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    // Pusher runs 400ms in every 1.3s, flywheels spin 2s in every 3.7s
+    bool PusherRunning = (Now % 1300000ULL) < 400000ULL;
+    int Throttle = ((Now % 3700000ULL) < 2000000ULL) ? 1700 : 1000;
+    float LoadAmps = (PusherRunning ? 12.0f : 0.0f) + 20.0f * (Throttle - 1000) / 1000.0f;
+
+    float RestingVoltage = 12.6f - 3.6f * (float)c / (float)BenchIterations;
+    Noise = Noise * 1103515245UL + 12345UL;
+    NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( RestingVoltage - LoadAmps * 0.090f ) + (int)((Noise >> 16) % 3) - 1 );
+
+    Timer.Start();
+    if( Hints )
+    {
+      Battery.SetBridgeLoad( PusherRunning, 100 );
+      Battery.SetBrushlessLoad( Throttle );
+    }
+    Battery.ProcessBatteryMonitor();
+    Timer.Stop();
+
+    if( Battery.IsBatteryFlat() && RestingVoltage > _NARFDUINO_BATTERY_3S_MIN + 0.1f )
+      FalseFlatMicros += BENCH_LOOP_MICROS;
+    if( Battery.IsBatteryFlat() != LastFlat )
+    {
+      LastFlat = Battery.IsBatteryFlat();
+      Transitions++;
+    }
+  }
+
+  // Let any background conversion finish while the battery is still around
+  NarfduinoSim::AdvanceMicros( 1000 );
+
+  PrintResult( Name, BenchIterations, Timer, Transitions );
+  printf( "  %s: flat while not flat %llums, learnt IR %umOhm, final resting %umV, sag %umV\n", Name, FalseFlatMicros / 1000, 
+    Battery.GetInternalResistance(), Battery.GetRestingMillivolts(), Battery.GetSagMillivolts() );
+}
+
+// Battery auto-detection - 3S pack at boot, unplugged a third of the way in, and a 4S pack plugged in a second later.
+static void BenchBatteryDetect( const char *Name, bool Background )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  if( Background )
+    Battery.EnableBackgroundSampling();
+  Battery.StartBatteryDetection();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Transitions = 0;
+  byte LastState = Battery.GetDetectionState();
+  unsigned long long UnplugAt = (unsigned long long)BenchIterations * BENCH_LOOP_MICROS / 3;
+  unsigned long long SwapAt = UnplugAt + 1000000ULL;
+  unsigned long long FirstDetect = 0;
+  unsigned long long SwapDetect = 0;
+  byte FirstS = 0;
+
+  NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( 11.8f ) );
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+    if( Now >= SwapAt )
+      NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( 16.2f ) );
+    else if( Now >= UnplugAt )
+      NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, 0 );
+
+    Timer.Start();
+    Battery.ProcessBatteryMonitor();
+    Timer.Stop();
+
+    byte State = Battery.GetDetectionState();
+    if( State != LastState )
+    {
+      LastState = State;
+      Transitions++;
+      if( State == _NARFDUINO_BATTERY_DETECTED && !FirstDetect )
+      {
+        FirstDetect = Now;
+        FirstS = Battery.GetBatteryS();
+      }
+      else if( State == _NARFDUINO_BATTERY_DETECTED && Now > SwapAt && !SwapDetect )
+      {
+        SwapDetect = Now - SwapAt;
+      }
+    }
+  }
+
+  // Let any background conversion finish while the battery is still around
+  NarfduinoSim::AdvanceMicros( 1000 );
+
+  PrintResult( Name, BenchIterations, Timer, Transitions );
+  printf( "  %s: boot detected %uS after %llums, swap detected %uS after %llums\n", Name, FirstS, FirstDetect / 1000, Battery.GetBatteryS(), SwapDetect / 1000 );
+}
+
+
+// Battery auto-detection under load - a 4S pack at 15.6V with 120mOhms of internal resistance, firing in bursts at 32A. 
+// The pin sags by 3.8V, further than the re-detect step, but the load hints are passed in. It should stay 4S throughout.
+static void BenchBatteryDetectLoad( const char *Name )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.EnableBackgroundSampling();
+  Battery.StartBatteryDetection();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Transitions = 0;
+  unsigned long Redetects = 0;
+  byte LastState = Battery.GetDetectionState();
+  byte LowestS = 255;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    // Nothing for the first second, so it detects at rest. Then the pusher and flywheels run together, 600ms in every 1.5s.
+    bool Firing = Now > 1000000ULL && (Now % 1500000ULL) < 600000ULL;
+    float LoadAmps = Firing ? 32.0f : 0.0f;
+    NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( 15.6f - LoadAmps * 0.120f ) );
+
+    Timer.Start();
+    Battery.SetBridgeLoad( Firing, 100 );
+    Battery.SetBrushlessLoad( Firing ? 2000 : 1000 );
+    Battery.ProcessBatteryMonitor();
+    Timer.Stop();
+
+    byte State = Battery.GetDetectionState();
+    if( State != LastState )
+    {
+      LastState = State;
+      Transitions++;
+      if( State == _NARFDUINO_BATTERY_DETECTING )
+        Redetects++;
+    }
+    if( State == _NARFDUINO_BATTERY_DETECTED && Battery.GetBatteryS() < LowestS )
+      LowestS = Battery.GetBatteryS();
+  }
+
+  // Let any background conversion finish while the battery is still around
+  NarfduinoSim::AdvanceMicros( 1000 );
+
+  PrintResult( Name, BenchIterations, Timer, Transitions );
+  printf( "  %s: re-detected %lu times under load, lowest %uS, final %uS\n", Name, Redetects, LowestS, Battery.GetBatteryS() );
+  if( Redetects || LowestS != 4 )
+    BenchFailed = true;
+}
+
+// Cell monitor - balance lead taps on A0 up, tap N through an N+1 : 1 divider. Cells discharge from 4.1V to 3.4V over the run,
+// apart from cell 2, which is weak and goes down to 3.0V. The cost per call should not change with the number of taps.
+static void BenchCellMonitor( const char *Name, byte NumCells )
+{
+  NarfduinoSim::Reset();
+  NarfduinoCellMonitor Monitor;
+  for( byte Cell = 0; Cell < NumCells; Cell++ )
+    Monitor.AddChannel( A0 + Cell, 10 * Cell, 10 );
+  Monitor.Init();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Transitions = 0;
+  bool LastFlat = Monitor.IsCellFlat();
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    float Progress = (float)c / (float)BenchIterations;
+    float TapVoltage = 0;
+    for( byte Cell = 0; Cell < NumCells; Cell++ )
+    {
+      TapVoltage += (Cell == 1) ? 4.1f - 1.1f * Progress : 4.1f - 0.7f * Progress;
+      NarfduinoSim::SetAnalogValue( A0 + Cell, (int)(TapVoltage / (Cell + 1) / 5.0f * 1024.0f) );
+    }
+
+    Timer.Start();
+    Monitor.ProcessCellMonitor();
+    Timer.Stop();
+
+    if( Monitor.IsCellFlat() != LastFlat )
+    {
+      LastFlat = Monitor.IsCellFlat();
+      Transitions++;
+    }
+  }
+
+  // Let any background conversion finish while the monitor is still around
+  NarfduinoSim::AdvanceMicros( 1000 );
+
+  PrintResult( Name, BenchIterations, Timer, Transitions );
+  printf( "  %s: weakest cell %u at %umV, flat %d\n", Name, Monitor.GetWeakestCell() + 1, Monitor.GetWeakestCellMillivolts(), (int)LastFlat );
+}
+
+
+// Brushless output - watches the pulses on pin 9, and times how long a throttle change takes to reach the ESC.
+// The ESC has the new throttle at the end of the first pulse that carries it.
+static struct
+{
+  unsigned long long RiseCycle;
+  unsigned long long CommandCycle;
+  bool CommandPending;
+  float ExpectedMicros;
+  float MinMicros;
+  float SpanMicros;
+  unsigned long long LatencyTotal;
+  unsigned long long LatencyMax;
+  unsigned long Commands;
+  unsigned long BadPulses;
+  float LastPulseMicros;
+} BrushlessWatch;
+
+static void BrushlessEdge( uint8_t Pin, bool Level, unsigned long long Cycle )
+{
+  if( Pin != 9 )
+    return;
+  if( Level )
+  {
+    BrushlessWatch.RiseCycle = Cycle;
+    return;
+  }
+
+  float PulseMicros = (float)(Cycle - BrushlessWatch.RiseCycle) * 1000000.0f / F_CPU;
+  BrushlessWatch.LastPulseMicros = PulseMicros;
+  // A pulse that started on the cycle of the change was already under way
+  if( !BrushlessWatch.CommandPending || BrushlessWatch.RiseCycle <= BrushlessWatch.CommandCycle )
+    return;
+
+  // The first pulse after the change. It should be the new width, within a tick.
+  BrushlessWatch.CommandPending = false;
+  if( fabsf( PulseMicros - BrushlessWatch.ExpectedMicros ) > BrushlessWatch.SpanMicros / 500.0f + 0.07f )
+    BrushlessWatch.BadPulses++;
+  unsigned long long Latency = Cycle - BrushlessWatch.CommandCycle;
+  BrushlessWatch.LatencyTotal += Latency;
+  if( Latency > BrushlessWatch.LatencyMax )
+    BrushlessWatch.LatencyMax = Latency;
+  BrushlessWatch.Commands++;
+}
+
+// Throttle changes 5 - 25ms after the last one reached the ESC, at random points in the frame.
+static void BenchBrushless( const char *Name, byte Protocol, float MinMicros, float SpanMicros )
+{
+  NarfduinoSim::Reset();
+  memset( &BrushlessWatch, 0, sizeof( BrushlessWatch ) );
+  BrushlessWatch.MinMicros = MinMicros;
+  BrushlessWatch.SpanMicros = SpanMicros;
+  NarfduinoSim::SetEdgeCallback( BrushlessEdge );
+
+  NarfduinoBrushless Brushless;
+  if( !Brushless.SetProtocol( Protocol ) )
+  {
+    printf( "%-32s protocol not available\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  Brushless.Init();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  unsigned long Noise = 12345;
+  unsigned long long NextChange = 0;
+  float FramePulseMicros = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    if( BrushlessWatch.CommandPending )
+      continue;
+
+    // Wait a random time after the last change reached the ESC, so the next one lands anywhere in the frame
+    Noise = Noise * 1103515245UL + 12345UL;
+    if( !NextChange )
+    {
+      NextChange = NarfduinoSim::Now() + 5000 + (Noise >> 16) % 20000;
+      continue;
+    }
+    if( NarfduinoSim::Now() < NextChange )
+      continue;
+    NextChange = 0;
+    int Speed = 1000 + (int)((Noise >> 8) % 1001);
+
+    BrushlessWatch.ExpectedMicros = MinMicros + SpanMicros * (Speed - 1000) / 1000.0f;
+    BrushlessWatch.CommandCycle = NarfduinoSim::NowCycles();
+    BrushlessWatch.CommandPending = true;
+    Timer.Start();
+    Brushless.UpdateSpeed( Speed );
+    Timer.Stop();
+    Calls++;
+  }
+
+  // Full throttle pulse width
+  Brushless.UpdateSpeed( 2000 );
+  NarfduinoSim::AdvanceMicros( 50000 );
+  FramePulseMicros = BrushlessWatch.LastPulseMicros;
+  NarfduinoSim::SetEdgeCallback( NULL );
+
+  PrintResult( Name, Calls ? Calls : 1, Timer, BrushlessWatch.Commands );
+  printf( "  %s: full throttle %.2fus, command latency avg %lluus max %lluus, wrong pulses %lu\n", Name, FramePulseMicros,
+    BrushlessWatch.Commands ? BrushlessWatch.LatencyTotal / BrushlessWatch.Commands / (F_CPU / 1000000UL) : 0, BrushlessWatch.LatencyMax / (F_CPU / 1000000UL), BrushlessWatch.BadPulses );
+  if( BrushlessWatch.BadPulses || !BrushlessWatch.Commands )
+    BenchFailed = true;
+}
+
+
+// Brushless ramp - pin 9 ramps up and back down while pin 10 is held, and every pulse on pin 9 is checked to move the right way.
+static struct
+{
+  unsigned long long RiseCycle[2];
+  float LastPulseMicros[2];
+  int Direction; // 1 = up, -1 = down
+  unsigned long Pulses[2];
+  unsigned long OutOfOrder;
+  unsigned long Pin10Changes;
+  float Pin10Micros;
+} RampWatch;
+
+static void RampEdge( uint8_t Pin, bool Level, unsigned long long Cycle )
+{
+  if( Pin != 9 && Pin != 10 )
+    return;
+  byte Channel = Pin - 9;
+  if( Level )
+  {
+    RampWatch.RiseCycle[Channel] = Cycle;
+    return;
+  }
+
+  float PulseMicros = (float)(Cycle - RampWatch.RiseCycle[Channel]) * 1000000.0f / F_CPU;
+  if( Channel == 0 )
+  {
+    // A tick either way is the same speed unit
+    if( RampWatch.Pulses[0] && (PulseMicros - RampWatch.LastPulseMicros[0]) * RampWatch.Direction < -0.01f )
+      RampWatch.OutOfOrder++;
+  }
+  else if( fabsf( PulseMicros - RampWatch.Pin10Micros ) > 0.07f )
+    RampWatch.Pin10Changes++;
+  RampWatch.LastPulseMicros[Channel] = PulseMicros;
+  RampWatch.Pulses[Channel]++;
+}
+
+// Runs until pin 9 is at the width for the speed. Returns how long it took, in ms.
+static float RunRamp( int Speed, unsigned long long StartCycle )
+{
+  float TargetMicros = 125.0f + 0.125f * (Speed - 1000);
+  for( int c = 0; c < 2000000 / BENCH_LOOP_MICROS; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    if( fabsf( RampWatch.LastPulseMicros[0] - TargetMicros ) < 0.07f )
+      return (float)(NarfduinoSim::NowCycles() - StartCycle) * 1000.0f / F_CPU;
+  }
+  return -1.0f;
+}
+
+static void BenchBrushlessRamp( const char *Name )
+{
+  NarfduinoSim::Reset();
+  memset( &RampWatch, 0, sizeof( RampWatch ) );
+  NarfduinoSim::SetEdgeCallback( RampEdge );
+
+  NarfduinoBrushless Brushless;
+  Brushless.SetProtocol( _NARFDUINO_BRUSHLESS_ONESHOT125 );
+  Brushless.SetRamp( _NARFDUINO_BRUSHLESS_CHANNEL_9, 2000, 4000 );
+  Brushless.Init();
+  RampWatch.Pin10Micros = 187.5f;
+  Brushless.UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10, 1500 );
+  NarfduinoSim::AdvanceMicros( 10000 );
+  NarfduinoSim::ResetCounters();
+
+  // Spin up - 1000 units at 2000 a second
+  BenchTimer Timer;
+  RampWatch.Direction = 1;
+  unsigned long long StartCycle = NarfduinoSim::NowCycles();
+  Timer.Start();
+  Brushless.UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9, 2000 );
+  Timer.Stop();
+  unsigned long PulsesAtStart = RampWatch.Pulses[0];
+  float UpMillis = RunRamp( 2000, StartCycle );
+  unsigned long UpPulses = RampWatch.Pulses[0] - PulsesAtStart;
+
+  // Once it's there, the interrupt goes quiet
+  NarfduinoSim::AdvanceMicros( 10000 );
+  unsigned long InterruptsAtRest = NarfduinoSim::InterruptsServiced;
+  NarfduinoSim::AdvanceMicros( 100000 );
+  unsigned long IdleInterrupts = NarfduinoSim::InterruptsServiced - InterruptsAtRest;
+
+  // Spin down - at 4000 a second
+  RampWatch.Direction = -1;
+  StartCycle = NarfduinoSim::NowCycles();
+  Timer.Start();
+  Brushless.UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9, 1000 );
+  Timer.Stop();
+  float DownMillis = RunRamp( 1000, StartCycle );
+  NarfduinoSim::AdvanceMicros( 10000 );
+  NarfduinoSim::SetEdgeCallback( NULL );
+
+  PrintResult( Name, 2, Timer, RampWatch.Pulses[0] );
+  printf( "  %s: spin up %.1fms over %lu pulses, spin down %.1fms, out of order %lu, pin 10 changes %lu, interrupts at rest %lu\n", Name,
+    UpMillis, UpPulses, DownMillis, RampWatch.OutOfOrder, RampWatch.Pin10Changes, IdleInterrupts );
+  // Within a couple of frames of 500ms and 250ms
+  if( fabsf( UpMillis - 500.0f ) > 1.0f || fabsf( DownMillis - 250.0f ) > 1.0f || RampWatch.OutOfOrder || RampWatch.Pin10Changes || IdleInterrupts )
+    BenchFailed = true;
+}
+
+
+// DShot output - decodes the frames on pins 9 and 10 from the port writes, checks the bit timing and the checksum, 
+// and times how long a throttle change takes to reach the ESC - the end of the first frame that carries it.
+static struct
+{
+  unsigned long BitCycles;
+  unsigned long OneCycles;
+  unsigned long ZeroCycles;
+  unsigned long long RiseCycle[2];
+  unsigned long long FrameStart[2];
+  uint16_t Frame[2];
+  byte Bits[2];
+  uint16_t ExpectedValue;
+  unsigned long long CommandCycle;
+  bool CommandPending;
+  unsigned long Frames;
+  unsigned long BadFrames; // Checksum, timing or value wrong
+  unsigned long long LatencyTotal;
+  unsigned long long LatencyMax;
+  unsigned long Commands;
+} DShotWatch;
+
+static void DShotEdge( uint8_t Pin, bool Level, unsigned long long Cycle )
+{
+  if( Pin != 9 && Pin != 10 )
+    return;
+  byte Channel = Pin - 9;
+
+  if( Level )
+  {
+    // Bits follow each other exactly. Anything else part way through a frame means it was cut short.
+    if( DShotWatch.Bits[Channel] && Cycle - DShotWatch.RiseCycle[Channel] != DShotWatch.BitCycles )
+    {
+      DShotWatch.BadFrames++;
+      DShotWatch.Bits[Channel] = 0;
+    }
+    if( !DShotWatch.Bits[Channel] )
+    {
+      DShotWatch.FrameStart[Channel] = Cycle;
+      DShotWatch.Frame[Channel] = 0;
+    }
+    DShotWatch.RiseCycle[Channel] = Cycle;
+    return;
+  }
+
+  unsigned long High = Cycle - DShotWatch.RiseCycle[Channel];
+  if( High != DShotWatch.OneCycles && High != DShotWatch.ZeroCycles )
+    DShotWatch.BadFrames++;
+  DShotWatch.Frame[Channel] = (DShotWatch.Frame[Channel] << 1) | (High > (DShotWatch.OneCycles + DShotWatch.ZeroCycles) / 2);
+  if( ++DShotWatch.Bits[Channel] < 16 )
+    return;
+
+  // A whole frame. 11 bits of value, the telemetry bit, and the checksum of the rest.
+  DShotWatch.Bits[Channel] = 0;
+  DShotWatch.Frames++;
+  uint16_t Frame = DShotWatch.Frame[Channel];
+  uint16_t Data = Frame >> 4;
+  if( ((Data ^ (Data >> 4) ^ (Data >> 8)) & 0x0F) != (Frame & 0x0F) || (Data & 1) )
+  {
+    DShotWatch.BadFrames++;
+    return;
+  }
+  if( !DShotWatch.CommandPending || DShotWatch.FrameStart[Channel] <= DShotWatch.CommandCycle )
+    return;
+
+  // The first frame after the change. Both channels carry the same throttle - time it on pin 9.
+  if( (Data >> 1) != DShotWatch.ExpectedValue )
+    DShotWatch.BadFrames++;
+  if( Channel != 0 )
+    return;
+  DShotWatch.CommandPending = false;
+  unsigned long long Latency = DShotWatch.RiseCycle[Channel] + DShotWatch.BitCycles - DShotWatch.CommandCycle;
+  DShotWatch.LatencyTotal += Latency;
+  if( Latency > DShotWatch.LatencyMax )
+    DShotWatch.LatencyMax = Latency;
+  DShotWatch.Commands++;
+}
+
+static void BenchDShot( const char *Name, byte Protocol, unsigned long BitCycles, unsigned long OneCycles, unsigned long ZeroCycles )
+{
+  NarfduinoSim::Reset();
+  memset( &DShotWatch, 0, sizeof( DShotWatch ) );
+  DShotWatch.BitCycles = BitCycles;
+  DShotWatch.OneCycles = OneCycles;
+  DShotWatch.ZeroCycles = ZeroCycles;
+  NarfduinoSim::SetEdgeCallback( DShotEdge );
+
+  NarfduinoBrushless Brushless;
+  if( !Brushless.SetProtocol( Protocol ) )
+  {
+    printf( "%-32s protocol not available\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  Brushless.Init();
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  unsigned long Noise = 12345;
+  unsigned long long NextChange = 0;
+  unsigned long InterruptsAtStart = NarfduinoSim::InterruptsServiced;
+  unsigned long long StartMicros = NarfduinoSim::Now();
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    if( DShotWatch.CommandPending )
+      continue;
+
+    // Wait a random time after the last change reached the ESC, so the next one lands anywhere in the frame
+    Noise = Noise * 1103515245UL + 12345UL;
+    if( !NextChange )
+    {
+      NextChange = NarfduinoSim::Now() + 5000 + (Noise >> 16) % 20000;
+      continue;
+    }
+    if( NarfduinoSim::Now() < NextChange )
+      continue;
+    NextChange = 0;
+    int Speed = 1000 + (int)((Noise >> 8) % 1001);
+
+    DShotWatch.ExpectedValue = (Speed > 1000) ? 47 + (Speed - 1000) * 2 : 0;
+    DShotWatch.CommandCycle = NarfduinoSim::NowCycles();
+    DShotWatch.CommandPending = true;
+    Timer.Start();
+    Brushless.UpdateSpeed( Speed );
+    Timer.Stop();
+    Calls++;
+  }
+  NarfduinoSim::SetEdgeCallback( NULL );
+
+  // Time spent sending, as a share of the CPU
+  double FrameRate = (double)(NarfduinoSim::InterruptsServiced - InterruptsAtStart) * 1000000.0 / (double)(NarfduinoSim::Now() - StartMicros);
+  double CPULoad = FrameRate * 16.0 * BitCycles / F_CPU * 100.0;
+
+  PrintResult( Name, Calls ? Calls : 1, Timer, DShotWatch.Commands );
+  printf( "  %s: %lu frames at %.0fHz, %.1f%% CPU sending, command latency avg %lluus max %lluus, bad frames %lu\n", Name, DShotWatch.Frames / 2, FrameRate, CPULoad,
+    DShotWatch.Commands ? DShotWatch.LatencyTotal / DShotWatch.Commands / (F_CPU / 1000000UL) : 0, DShotWatch.LatencyMax / (F_CPU / 1000000UL), DShotWatch.BadFrames );
+  if( DShotWatch.BadFrames || !DShotWatch.Commands )
+    BenchFailed = true;
+}
+
+
+// Run FET PWM - sweeps the bridge speed from 0.1% to 99.9% in 0.1% steps, and measures the duty and frequency on the pin.
+// The timer modes are measured from the output edges. Timer0 isn't simulated, so analogWrite is read from the duty the core was given.
+static struct
+{
+  uint8_t Pin;
+  unsigned long long LastRise;
+  unsigned long long LastFall;
+  unsigned long long Period;
+  unsigned long long High;
+} PWMWatch;
+
+static void PWMEdge( uint8_t Pin, bool Level, unsigned long long Cycle )
+{
+  if( Pin != PWMWatch.Pin )
+    return;
+  if( !Level )
+  {
+    PWMWatch.LastFall = Cycle;
+    return;
+  }
+  if( PWMWatch.LastRise && PWMWatch.LastFall > PWMWatch.LastRise )
+  {
+    PWMWatch.Period = Cycle - PWMWatch.LastRise;
+    PWMWatch.High = PWMWatch.LastFall - PWMWatch.LastRise;
+  }
+  PWMWatch.LastRise = Cycle;
+}
+
+static void BenchBridgePWM( const char *Name, byte Mode, byte RunPin )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Bridge( RunPin, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.DisableAntiJam();
+  if( !Bridge.SetPWMMode( Mode, 20000 ) )
+  {
+    printf( "  %s: SetPWMMode failed\n", Name );
+    BenchFailed = true;
+    return;
+  }
+  // Timer2 can't do the PWM and the dead-time at once
+  if( Mode == _NARFDUINO_BRIDGE_PWM_TIMER2 && Bridge.EnableTimedDeadTime() )
+  {
+    printf( "  %s: timed dead-time took Timer2 from the PWM\n", Name );
+    BenchFailed = true;
+  }
+
+  BridgeWatcher Watcher( RunPin, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.SetBridgeSpeedFine( 1 );
+  Bridge.StartBridge();
+  for( unsigned int c = 0; c < 10000 && !Bridge.IsBridgeRunning(); c++ )
+  {
+    Bridge.ProcessBridge();
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    Watcher.Sample();
+  }
+
+  memset( &PWMWatch, 0, sizeof( PWMWatch ) );
+  PWMWatch.Pin = RunPin;
+  NarfduinoSim::SetEdgeCallback( PWMEdge );
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  unsigned long Steps = 0;
+  double LastDuty = -1;
+  double WorstError = 0;
+  double Frequency = 0;
+  for( unsigned int Speed = 1; Speed < 1000; Speed++ )
+  {
+    Timer.Start();
+    Bridge.SetBridgeSpeedFine( Speed );
+    Bridge.ProcessBridge();
+    Timer.Stop();
+    Calls++;
+
+    // A few periods for the new duty to come through
+    NarfduinoSim::AdvanceMicros( 200 );
+    Watcher.Sample();
+    double Duty;
+    if( Mode == _NARFDUINO_BRIDGE_PWM_ANALOGWRITE )
+    {
+      Duty = NarfduinoSim::GetPinOutput( RunPin ) / 255.0;
+      Frequency = F_CPU / 64.0 / 256.0;
+    }
+    else
+    {
+      Duty = PWMWatch.Period ? (double)PWMWatch.High / (double)PWMWatch.Period : 0;
+      Frequency = PWMWatch.Period ? (double)F_CPU / (double)PWMWatch.Period : 0;
+    }
+    if( Duty != LastDuty )
+      Steps++;
+    LastDuty = Duty;
+    double Error = fabs( Duty * 100.0 - Speed / 10.0 );
+    if( Error > WorstError )
+      WorstError = Error;
+  }
+  NarfduinoSim::SetEdgeCallback( NULL );
+
+  PrintResult( Name, Calls, Timer, Steps );
+  printf( "  %s: %.2fkHz, %lu duty steps from 0.1%% to 99.9%%, worst duty error %.2f%%\n", Name, Frequency / 1000.0, Steps, WorstError );
+  ReportBridgeSafety( Name, Watcher );
+  // Within a step - the bottom step is held at one tick so it never drops out - and the timer modes have to be on frequency
+  if( WorstError > 100.0 / Bridge.GetPWMSteps() )
+    BenchFailed = true;
+  if( Mode != _NARFDUINO_BRIDGE_PWM_ANALOGWRITE && fabs( Frequency - 20000.0 ) > 200.0 )
+    BenchFailed = true;
+}
+
+
+// Flywheel governor - a brushless flywheel model, with its speed falling off as the battery runs down and each shot taking speed off it.
+// Revs to 30000RPM for 1.5s with 3 shots, then stops for 1.5s. The tach on pin 2 gives a pulse a rev.
+// Open loop sets the throttle 30000RPM would need on a full battery, and waits out a fixed rev-up delay.
+#define BENCH_FLYWHEEL_MAX_RPM 40000.0f
+#define BENCH_FLYWHEEL_TAU_MICROS 120000.0f
+#define BENCH_FLYWHEEL_TARGET 30000
+#define BENCH_FLYWHEEL_PERIOD 3000000ULL
+#define BENCH_FLYWHEEL_REV 1500000ULL
+#define BENCH_FLYWHEEL_SHOT_LOSS 0.12f
+
+static void BenchGovernor( const char *Name, bool Governed )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBrushless Brushless;
+  Brushless.SetProtocol( _NARFDUINO_BRUSHLESS_ONESHOT125 );
+  Brushless.Init();
+  NarfduinoGovernor Governor;
+  if( Governed )
+    Governor.Init( 2 );
+  Governor.SetMaxRPM( (unsigned int)BENCH_FLYWHEEL_MAX_RPM );
+  Governor.AttachBrushless( &Brushless, _NARFDUINO_BRUSHLESS_CHANNEL_9 );
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long Calls = 0;
+  float RPM = 0;
+  float Phase = 0; // Revolutions, 0 - 1
+  bool Revving = false;
+  unsigned long long RevStart = 0;
+  unsigned long long ReadyAt = 0; // When the flywheel was first within 5% of the target in this rev
+  unsigned long long ShotAt = 0;
+  unsigned long Revs = 0; // Revs that got up to speed
+  unsigned long RevsStarted = 0;
+  unsigned long long ReadyTotal = 0;
+  unsigned long long ReadyMax = 0;
+  unsigned long Recoveries = 0;
+  unsigned long long RecoveryTotal = 0;
+  unsigned long FalseReady = 0;
+  unsigned long long OffSpeedSince = 0;
+  bool ShotSeen = false; // Ready has gone false since the shot
+  float WorstError = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    unsigned long long Now = NarfduinoSim::Now();
+    unsigned long long InPeriod = Now % BENCH_FLYWHEEL_PERIOD;
+    float Voltage = 12.6f - 1.8f * (float)c / (float)BenchIterations;
+
+    // Start and stop
+    if( InPeriod < BENCH_FLYWHEEL_REV && !Revving )
+    {
+      Revving = true;
+      RevStart = Now;
+      RevsStarted++;
+      ReadyAt = 0;
+      ShotAt = 0;
+      if( Governed )
+        Governor.SetTargetRPM( BENCH_FLYWHEEL_TARGET );
+      else
+      {
+        Timer.Start();
+        Brushless.UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9, 1000 + (int)(1000.0f * BENCH_FLYWHEEL_TARGET / BENCH_FLYWHEEL_MAX_RPM + 0.5f) );
+        Timer.Stop();
+        Calls++;
+      }
+    }
+    else if( InPeriod >= BENCH_FLYWHEEL_REV && Revving )
+    {
+      // How far off the target it ended up
+      float Error = fabsf( RPM - BENCH_FLYWHEEL_TARGET ) / BENCH_FLYWHEEL_TARGET * 100.0f;
+      if( Error > WorstError )
+        WorstError = Error;
+      Revving = false;
+      if( Governed )
+        Governor.SetTargetRPM( 0 );
+      else
+        Brushless.UpdateSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9, 1000 );
+    }
+
+    // Ready to fire - the governor says so, or it's close enough to the target
+    bool Close = fabsf( RPM - BENCH_FLYWHEEL_TARGET ) <= BENCH_FLYWHEEL_TARGET * 0.05f;
+    bool Ready = Governed ? Governor.IsAtSpeed() : Close;
+    // The governor only looks every interval, and needs a tach pulse to see the change - give it a few ms
+    if( fabsf( RPM - BENCH_FLYWHEEL_TARGET ) <= BENCH_FLYWHEEL_TARGET * 0.08f )
+      OffSpeedSince = 0;
+    else if( !OffSpeedSince )
+      OffSpeedSince = Now;
+    if( Governed && Ready && OffSpeedSince && Now - OffSpeedSince > 3 * _NARFDUINO_GOVERNOR_INTERVAL * 1000UL )
+      FalseReady++;
+    if( Revving && Ready && !ReadyAt )
+    {
+      ReadyAt = Now;
+      ReadyTotal += Now - RevStart;
+      if( Now - RevStart > ReadyMax )
+        ReadyMax = Now - RevStart;
+      Revs++;
+    }
+    if( ShotAt && !Ready )
+      ShotSeen = true;
+    if( ShotAt && Ready && ShotSeen )
+    {
+      RecoveryTotal += Now - ShotAt;
+      Recoveries++;
+      ShotAt = 0;
+    }
+
+    // 3 shots, spread out once it's ready
+    if( Revving && ReadyAt && !ShotAt && Now - ReadyAt < 900000ULL && (Now - ReadyAt) % 300000ULL < BENCH_LOOP_MICROS )
+    {
+      RPM *= 1.0f - BENCH_FLYWHEEL_SHOT_LOSS;
+      ShotAt = Now;
+      ShotSeen = false;
+    }
+
+    // Move the flywheel on by a loop. A tach pulse lands on the cycle it happens.
+    float Throttle = (Brushless.GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9 ) - 1000) / 1000.0f;
+    float FreeRPM = Throttle * BENCH_FLYWHEEL_MAX_RPM * Voltage / 12.6f;
+    RPM += (FreeRPM - RPM) * BENCH_LOOP_MICROS / BENCH_FLYWHEEL_TAU_MICROS;
+    float Step = RPM / 60000000.0f * BENCH_LOOP_MICROS;
+    float NewPhase = Phase + Step;
+    unsigned long long LoopCycles = BENCH_LOOP_MICROS * (F_CPU / 1000000UL);
+    if( Phase < 0.5f && NewPhase >= 0.5f )
+    {
+      unsigned long long EdgeCycles = (unsigned long long)((0.5f - Phase) / Step * LoopCycles);
+      NarfduinoSim::AdvanceCycles( EdgeCycles );
+      NarfduinoSim::SetPinInput( 2, LOW );
+      NarfduinoSim::AdvanceCycles( LoopCycles - EdgeCycles );
+    }
+    else if( NewPhase >= 1.0f )
+    {
+      unsigned long long EdgeCycles = (unsigned long long)((1.0f - Phase) / Step * LoopCycles);
+      NarfduinoSim::AdvanceCycles( EdgeCycles );
+      NarfduinoSim::SetPinInput( 2, HIGH );
+      NarfduinoSim::AdvanceCycles( LoopCycles - EdgeCycles );
+      NewPhase -= 1.0f;
+    }
+    else
+      NarfduinoSim::AdvanceCycles( LoopCycles );
+    Phase = NewPhase;
+
+    if( Governed )
+    {
+      Timer.Start();
+      Governor.ProcessGovernor();
+      Timer.Stop();
+      Calls++;
+    }
+  }
+
+  PrintResult( Name, Calls ? Calls : 1, Timer, Revs );
+  printf( "  %s: ready in %lu of %lu revs, after avg %llums max %llums, back to speed after a shot avg %llums, worst error at end of rev %.1f%%", Name,
+    Revs, RevsStarted, Revs ? ReadyTotal / Revs / 1000 : 0, ReadyMax / 1000, Recoveries ? RecoveryTotal / Recoveries / 1000 : 0, WorstError );
+  if( Governed )
+    printf( ", ready while off speed %lu", FalseReady );
+  printf( "\n" );
+  if( Governed && (FalseReady || WorstError > 2.0f || Revs != RevsStarted || ReadyMax > 400000ULL) )
+    BenchFailed = true;
+}
+
+// Tired 3S pack - 11.4V down to 9.9V at rest over the run, with 120mOhms of internal resistance. Full auto with the flywheels
+// at full throttle, 1s on and 1s off. The board resets if the pack drops under 7V while it's loaded, and takes 300ms to come back.
+// Governed - NarfduinoPowerGovernor holds the outputs back, otherwise the sketch runs flat out and sets the load hints itself.
+// Fails if the governed board resets, or the pack goes more than 200mV under the governor's floor after the first 10s.
+#define BENCH_POWER_IR_OHMS 0.120f
+#define BENCH_POWER_RESET_VOLTS 7.0f
+#define BENCH_POWER_REBOOT_MICROS 300000ULL
+#define BENCH_POWER_SETTLE_MICROS 10000000ULL
+
+static void BenchPowerGovernor( const char *Name, bool Governed )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+  Battery.EnableBackgroundSampling();
+  NarfduinoBridge Pusher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Pusher.Init();
+  Pusher.SetBridgeSpeed( 100 );
+  NarfduinoBrushless Brushless;
+  Brushless.SetProtocol( _NARFDUINO_BRUSHLESS_ONESHOT125 );
+  Brushless.Init();
+  Brushless.UpdateSpeed( 1000 );
+  NarfduinoPowerGovernor Governor;
+  Governor.AttachBattery( &Battery );
+  Governor.AttachBridge( &Pusher );
+  Governor.AttachBrushless( &Brushless );
+  NarfduinoSim::ResetCounters();
+
+  PusherModel Model;
+  BenchTimer Timer;
+  bool Firing = false;
+  unsigned long Darts = 0;
+  unsigned long Resets = 0;
+  unsigned long LimitChanges = 0;
+  unsigned int LastLimit = 1000;
+  unsigned long long LimitTotal = 0;
+  unsigned long LimitSamples = 0;
+  unsigned long long RebootUntil = 0;
+  float MinLoaded = 99.0f;
+  float MinSettled = 99.0f;
+  unsigned long Noise = 12345;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+    float RestingVoltage = 11.4f - 1.5f * (float)c / (float)BenchIterations;
+
+    // The pack current, from what the outputs are actually doing
+    float LoadAmps = 0.0f;
+    if( Pusher.IsBridgeRunning() )
+      LoadAmps += 12.0f * min( (unsigned int)Pusher.GetBridgeSpeed() * 10, Pusher.GetSpeedLimitFine() ) / 1000.0f;
+    LoadAmps += 20.0f * (Brushless.GetSpeed() - 1000) / 1000.0f;
+    float Loaded = RestingVoltage - LoadAmps * BENCH_POWER_IR_OHMS;
+    Noise = Noise * 1103515245UL + 12345UL;
+    NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( Loaded ) + (int)((Noise >> 16) % 3) - 1 );
+
+    // Trigger and board, outside of the measured call
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    if( Now < RebootUntil )
+    {
+      NarfduinoSim::Counters = Outside;
+      continue;
+    }
+    if( Loaded < BENCH_POWER_RESET_VOLTS )
+    {
+      // Brown-out. Everything stops until the board is back up.
+      Resets++;
+      Firing = false;
+      Pusher.StopBridge();
+      Brushless.UpdateSpeed( 1000 );
+      RebootUntil = Now + BENCH_POWER_REBOOT_MICROS;
+      NarfduinoSim::Counters = Outside;
+      continue;
+    }
+    // The governor has nothing to go on until the battery has its first reading, 3s in, and the resistance takes a few bursts to learn
+    if( Loaded < MinLoaded )
+      MinLoaded = Loaded;
+    if( Now >= BENCH_POWER_SETTLE_MICROS && Loaded < MinSettled )
+      MinSettled = Loaded;
+
+    bool Trigger = (Now % 2000000ULL) < 1000000ULL;
+    if( Trigger != Firing )
+    {
+      Firing = Trigger;
+      Brushless.UpdateSpeed( Firing ? 2000 : 1000 );
+      if( Firing )
+        Pusher.StartBridge();
+      else
+        Pusher.StopBridge();
+    }
+    int RunDuty = Pusher.IsBridgeRunning() ? (int)(255UL * min( (unsigned int)Pusher.GetBridgeSpeed() * 10, Pusher.GetSpeedLimitFine() ) / 1000) : 0;
+    if( Model.Step( RunDuty, NarfduinoSim::GetPinOutput( _NARFDUINOPIN_BRIDGE_STOP ), BENCH_LOOP_MICROS ) )
+    {
+      Pusher.PusherHeartbeat();
+      Darts++;
+    }
+    if( Pusher.HasJammed() )
+      Pusher.ResetJam();
+    Battery.ProcessBatteryMonitor();
+    Pusher.ProcessBridge();
+    NarfduinoSim::Counters = Outside;
+
+    Timer.Start();
+    if( Governed )
+      Governor.ProcessPowerGovernor();
+    else
+    {
+      Battery.SetBridgeLoad( Pusher.IsBridgeRunning(), Pusher.GetBridgeSpeed() );
+      Battery.SetBrushlessLoad( Brushless.GetSpeed() );
+    }
+    Timer.Stop();
+
+    LimitTotal += Governor.GetPowerLimit();
+    LimitSamples++;
+    if( Governor.GetPowerLimit() != LastLimit )
+    {
+      LastLimit = Governor.GetPowerLimit();
+      LimitChanges++;
+    }
+  }
+
+  PrintResult( Name, BenchIterations, Timer, LimitChanges );
+  printf( "  %s: %lu darts, %lu resets, lowest pack voltage under load %.2fV, %.2fV after 10s, floor %.2fV\n", Name, Darts, Resets, 
+    MinLoaded, MinSettled, Governor.GetFloorMillivolts() / 1000.0f );
+  if( Governed )
+    printf( "  %s: average output %.1f%%, learnt IR %umOhm\n", Name, LimitTotal / 10.0 / max( LimitSamples, 1UL ), Battery.GetInternalResistance() );
+  if( Governed && (Resets || MinSettled < Governor.GetFloorMillivolts() / 1000.0f - 0.2f) )
+  {
+    printf( "  %s: the pack went under the floor\n", Name );
+    BenchFailed = true;
+  }
+}
+
+// Sketch tasks for the scheduler scenario. Each one takes a fixed time, passed in as the context.
+static void BenchSketchTask( void *Context )
+{
+  NarfduinoSim::AdvanceMicros( *(unsigned long *)Context );
+}
+
+// The scheduler running the bridge and battery monitor with a sketch's own tasks - a 1ms control task at high priority,
+// and a display update and a logger at low priority. Budget - the loop budget, 0 for none.
+static void BenchScheduler( const char *Name, unsigned int Budget )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+  NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( 11.8f ) );
+
+  static unsigned long ControlCost = 100;
+  static unsigned long DisplayCost = 1500;
+  static unsigned long LogCost = 300;
+  const unsigned long ControlPeriod = 1000;
+  const unsigned long DisplayPeriod = 20000;
+  const unsigned long LogPeriod = 5000;
+
+  NarfduinoScheduler Scheduler;
+  byte BridgeTask = Scheduler.AddBridge( &Bridge );
+  byte BatteryTask = Scheduler.AddBattery( &Battery );
+  byte ControlTask = Scheduler.AddTask( BenchSketchTask, &ControlCost, ControlPeriod, _NARFDUINO_SCHEDULER_HIGH );
+  byte DisplayTask = Scheduler.AddTask( BenchSketchTask, &DisplayCost, DisplayPeriod, _NARFDUINO_SCHEDULER_LOW );
+  byte LogTask = Scheduler.AddTask( BenchSketchTask, &LogCost, LogPeriod, _NARFDUINO_SCHEDULER_LOW );
+  Scheduler.SetLoopBudget( Budget );
+  NarfduinoSim::ResetCounters();
+
+  BridgeWatcher Watcher( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  BenchTimer Timer;
+  unsigned long long Start = NarfduinoSim::Now();
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    // Run the bridge for 30ms in every 100ms
+    unsigned long long Phase = (NarfduinoSim::Now() - Start) % 100000ULL;
+    if( Phase < 30000ULL && !Bridge.IsBridgeRunning() )
+    {
+      Bridge.StartBridge();
+      Watcher.StartRequested();
+    }
+    else if( Phase >= 30000ULL && Bridge.IsBridgeRunning() )
+      Bridge.StopBridge();
+
+    Timer.Start();
+    Scheduler.Run();
+    Timer.Stop();
+    Watcher.Sample();
+  }
+
+  unsigned long long Elapsed = NarfduinoSim::Now() - Start;
+  PrintResult( Name, BenchIterations, Timer, Watcher.Transitions );
+  printf( "  %s: loop max %luus, pass max %luus, bridge max gap %luus\n", Name, Scheduler.GetMaxLoopTime(), Scheduler.GetMaxPassTime(), Scheduler.GetTaskMaxLate( BridgeTask ) );
+
+  // Each task should have run close to once a period, and no later than the longest low priority task could hold it up
+  struct { const char *TaskName; byte Task; unsigned long Period; } Report[] = {
+    { "control", ControlTask, ControlPeriod }, { "battery", BatteryTask, _NARFDUINO_SCHEDULER_BATTERY_PERIOD },
+    { "display", DisplayTask, DisplayPeriod }, { "log", LogTask, LogPeriod } };
+  for( byte i = 0; i < sizeof( Report ) / sizeof( Report[0] ); i++ )
+  {
+    unsigned long Expected = Elapsed / Report[i].Period;
+    unsigned long Runs = Scheduler.GetTaskRuns( Report[i].Task );
+    printf( "  %s: %s ran %lu of %lu, late %lu, max late %luus, max run %luus\n", Name, Report[i].TaskName, Runs, Expected,
+      Scheduler.GetTaskLateRuns( Report[i].Task ), Scheduler.GetTaskMaxLate( Report[i].Task ), Scheduler.GetTaskMaxRunTime( Report[i].Task ) );
+    if( Runs < Expected * 9 / 10 )
+      BenchFailed = true;
+  }
+  ReportBridgeSafety( Name, Watcher );
+
+  unsigned long LongestLowTask = max( Scheduler.GetTaskMaxRunTime( DisplayTask ), max( Scheduler.GetTaskMaxRunTime( LogTask ), Scheduler.GetTaskMaxRunTime( BatteryTask ) ) );
+  if( Budget && Scheduler.GetTaskMaxLate( ControlTask ) > LongestLowTask + Scheduler.GetTaskMaxRunTime( BridgeTask ) + 2 * BENCH_LOOP_MICROS )
+    BenchFailed = true;
+}
+
+// Telemetry out of the simulated Serial, into the decoder
+static NarfduinoTelemetryDecoder *TelemetryDecoder = NULL;
+static unsigned long TelemetryReports = 0;
+static NarfduinoTelemetryDecoder::Status TelemetryLast;
+
+static void TelemetryByte( uint8_t Byte )
+{
+  if( TelemetryDecoder )
+  {
+    if( TelemetryDecoder->Feed( Byte ) && NarfduinoTelemetryDecoder::DecodeStatus( TelemetryDecoder->GetFrame(), TelemetryLast ) )
+      TelemetryReports++;
+  }
+  else if( Byte == '\n' )
+    TelemetryReports++;
+}
+
+// Reporting the bridge, battery and brushless 200 times a second at 115200 baud, while the bridge fires bursts.
+// Binary - NarfduinoTelemetry. Otherwise the same values printed as text, the way the examples do it.
+static void BenchTelemetry( const char *Name, bool Binary )
+{
+  NarfduinoSim::Reset();
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.DisableAntiJam();
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+  NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( 11.8f ) );
+  NarfduinoBrushless Brushless;
+  Brushless.Init();
+  Brushless.UpdateSpeed( 1500 );
+
+  Serial.begin( 115200 );
+  NarfduinoTelemetryDecoder Decoder;
+  TelemetryDecoder = Binary ? &Decoder : NULL;
+  TelemetryReports = 0;
+  memset( &TelemetryLast, 0, sizeof( TelemetryLast ) );
+  NarfduinoSim::SetSerialCallback( TelemetryByte );
+
+  NarfduinoTelemetry Telemetry;
+  Telemetry.Init( Serial, 200 );
+  Telemetry.AttachBridge( &Bridge );
+  Telemetry.AttachBattery( &Battery );
+  Telemetry.AttachBrushless( &Brushless );
+  NarfduinoSim::ResetCounters();
+
+  BenchTimer Timer;
+  unsigned long long Start = NarfduinoSim::Now();
+  unsigned long long LastText = Start;
+  unsigned long long MaxCallMicros = 0;
+  unsigned long Calls = 0;
+
+  // Both run for the same simulated time. The text one gets through fewer loops in it.
+  while( NarfduinoSim::Now() - Start < (unsigned long long)BenchIterations * BENCH_LOOP_MICROS )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+
+    // Run the bridge for 30ms in every 100ms
+    unsigned long long Phase = (NarfduinoSim::Now() - Start) % 100000ULL;
+    if( Phase < 30000ULL && !Bridge.IsBridgeRunning() )
+      Bridge.StartBridge();
+    else if( Phase >= 30000ULL && Bridge.IsBridgeRunning() )
+      Bridge.StopBridge();
+    // The rest of the loop, outside of the measured call. Its core calls are not counted.
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    Bridge.ProcessBridge();
+    Battery.ProcessBatteryMonitor();
+    NarfduinoSim::Counters = Outside;
+
+    unsigned long long CallStart = NarfduinoSim::Now();
+    if( Binary )
+    {
+      Timer.Start();
+      Telemetry.ProcessTelemetry();
+      Timer.Stop();
+      Calls++;
+    }
+    else if( NarfduinoSim::Now() - LastText >= 5000ULL )
+    {
+      LastText += 5000ULL;
+      if( NarfduinoSim::Now() - LastText >= 5000ULL )
+        LastText = NarfduinoSim::Now();
+      Timer.Start();
+      Serial.print( "Battery mV = " );
+      Serial.println( Battery.GetCurrentMillivolts() );
+      Serial.print( "Battery % = " );
+      Serial.println( Battery.GetBatteryPercent() );
+      Serial.print( "Bridge running = " );
+      Serial.println( (int)Bridge.IsBridgeRunning() );
+      Serial.print( "Jammed = " );
+      Serial.println( (int)Bridge.HasJammed() );
+      Serial.print( "Brushless = " );
+      Serial.print( Brushless.GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_9 ) );
+      Serial.print( ' ' );
+      Serial.println( Brushless.GetSpeed( _NARFDUINO_BRUSHLESS_CHANNEL_10 ) );
+      Timer.Stop();
+      Calls++;
+    }
+    if( NarfduinoSim::Now() - CallStart > MaxCallMicros )
+      MaxCallMicros = NarfduinoSim::Now() - CallStart;
+  }
+
+  unsigned long long Elapsed = NarfduinoSim::Now() - Start;
+  unsigned long Expected = Elapsed / 5000ULL;
+  // Text reports are 7 lines each
+  unsigned long Reports = Binary ? TelemetryReports : TelemetryReports / 7;
+  double BlockedMicros = (double)NarfduinoSim::Counters.SerialBlockedCycles / (F_CPU / 1000000UL);
+  NarfduinoSim::SetSerialCallback( NULL );
+  TelemetryDecoder = NULL;
+
+  PrintResult( Name, Calls ? Calls : 1, Timer, Reports );
+  printf( "  %s: %lu of %lu reports sent, Serial blocked %.1f%% of the time, longest call %lluus", Name, Reports, Expected,
+    BlockedMicros * 100.0 / (double)Elapsed, MaxCallMicros );
+  if( Binary )
+  {
+    printf( ", bad frames %lu, lost frames %lu, dropped %u, last report %umV %u%%\n", Decoder.BadFrames, Decoder.LostFrames,
+      Telemetry.GetDroppedFrames(), TelemetryLast.Millivolts, TelemetryLast.Percent );
+    if( BlockedMicros > 0 || Decoder.BadFrames || Decoder.LostFrames || Reports < Expected * 99 / 100 ||
+        TelemetryLast.Millivolts != Battery.GetCurrentMillivolts() || TelemetryLast.Brushless9 != 1500 )
+      BenchFailed = true;
+  }
+  else
+    printf( "\n" );
+}
+
+
+
+// The log the way a sketch would write it without the recorder - each record straight to EEPROM as the event happens
+static void NaiveRecord( byte &Slot, uint16_t &Sequence, byte Event, byte Data )
+{
+  byte Packed[_NARFDUINO_RECORDER_RECORD_SIZE];
+  unsigned long Now = millis();
+  Packed[0] = Sequence & 0xFF;
+  Packed[1] = Sequence >> 8;
+  Packed[2] = Event;
+  Packed[3] = Data;
+  Packed[4] = Now & 0xFF;
+  Packed[5] = (Now >> 8) & 0xFF;
+  Packed[6] = (Now >> 16) & 0xFF;
+  byte Sum = 0;
+  for( byte i = 0; i < _NARFDUINO_RECORDER_RECORD_SIZE - 1; i++ )
+    Sum += Packed[i];
+  Packed[7] = ~Sum;
+  uint8_t *Address = (uint8_t *)(uintptr_t)(_NARFDUINO_RECORDER_START + (unsigned int)Slot * _NARFDUINO_RECORDER_RECORD_SIZE);
+  for( byte i = 0; i < _NARFDUINO_RECORDER_RECORD_SIZE; i++ )
+    eeprom_write_byte( Address + i, Packed[i] );
+  Slot = (Slot + 1) % _NARFDUINO_RECORDER_SLOTS;
+  Sequence++;
+}
+
+// Black box - the bridge fires a burst every 2s, and every other burst jams. The battery runs down from 12.4V to 9.0V.
+// Buffered - NarfduinoRecorder. Otherwise each event is written to EEPROM as it happens. The log is decoded at the end and
+// checked against the events seen, then the power is cut part way through a record to check the log picks up again at power on.
+static void BenchRecorder( const char *Name, bool Buffered )
+{
+  NarfduinoSim::Reset();
+  NarfduinoSim::EraseEEPROM();
+  NarfduinoBridge Bridge( _NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP );
+  Bridge.Init();
+  Bridge.SetBridgeSpeed( 80 );
+  NarfduinoBattery Battery( _NARFDUINO_PIN_BATTERY );
+  Battery.Init();
+  Battery.SetBatteryS( 3 );
+
+  NarfduinoRecorder Recorder;
+  if( Buffered )
+  {
+    Recorder.Init();
+    Recorder.AttachBridge( &Bridge );
+    Recorder.AttachBattery( &Battery );
+  }
+  byte NaiveSlot = 0;
+  uint16_t NaiveSequence = 0;
+  NarfduinoSim::ResetCounters();
+
+  // Events as the bench sees them, after the power on
+  std::vector<std::pair<byte, byte> > Expected;
+  Expected.push_back( std::make_pair( (byte)_NARFDUINO_RECORDER_POWER_ON, (byte)0 ) );
+  if( !Buffered )
+    NaiveRecord( NaiveSlot, NaiveSequence, _NARFDUINO_RECORDER_POWER_ON, 0 );
+  bool WasRunning = false;
+  bool WasJammed = false;
+  bool WasFlat = false;
+  byte LastS = 0;
+
+  BenchTimer Timer;
+  unsigned long long MaxCallMicros = 0;
+  unsigned long long LastHeartbeat = 0;
+  unsigned long Bursts = 0;
+
+  for( unsigned long c = 0; c < BenchIterations; c++ )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    unsigned long long Now = NarfduinoSim::Now();
+
+    // The rest of the loop, outside of the measured call. Its core calls are not counted.
+    NarfduinoSim::CoreCounters Outside = NarfduinoSim::Counters;
+    unsigned long long Phase = Now % 2000000ULL;
+    if( Phase < BENCH_LOOP_MICROS )
+    {
+      Bridge.ResetJam();
+      Bridge.StartBridge();
+      LastHeartbeat = Now;
+      Bursts++;
+    }
+    // Even bursts fire 5 darts and stop, odd ones never get round and jam
+    if( Bridge.IsBridgeRunning() && (Bursts & 1) == 0 && Now - LastHeartbeat >= 60000ULL )
+    {
+      LastHeartbeat = Now;
+      Bridge.PusherHeartbeat();
+      if( Phase >= 300000ULL )
+        Bridge.StopBridge();
+    }
+    float PackVoltage = 12.4f - 3.4f * (float)c / (float)BenchIterations;
+    NarfduinoSim::SetAnalogValue( _NARFDUINO_PIN_BATTERY, BatteryCounts( PackVoltage ) );
+    Bridge.ProcessBridge();
+    Battery.ProcessBatteryMonitor();
+
+    // The same edges the recorder looks for
+    std::vector<std::pair<byte, byte> > Events;
+    if( Bridge.HasJammed() && !WasJammed )
+      Events.push_back( std::make_pair( (byte)_NARFDUINO_RECORDER_JAM, Bridge.GetBridgeSpeed() ) );
+    WasJammed = Bridge.HasJammed();
+    if( Bridge.IsBridgeRunning() != WasRunning )
+      Events.push_back( std::make_pair( (byte)(Bridge.IsBridgeRunning() ? _NARFDUINO_RECORDER_BRIDGE_START : _NARFDUINO_RECORDER_BRIDGE_STOP),
+        (byte)(Bridge.IsBridgeRunning() ? Bridge.GetBridgeSpeed() : 0) ) );
+    WasRunning = Bridge.IsBridgeRunning();
+    if( Battery.IsBatteryFlat() && !WasFlat )
+      Events.push_back( std::make_pair( (byte)_NARFDUINO_RECORDER_BATTERY_FLAT, (byte)min( Battery.GetCurrentMillivolts() / 100, 255U ) ) );
+    WasFlat = Battery.IsBatteryFlat();
+    if( Battery.GetBatteryS() != LastS && Battery.GetBatteryS() )
+      Events.push_back( std::make_pair( (byte)_NARFDUINO_RECORDER_BATTERY_S, Battery.GetBatteryS() ) );
+    LastS = Battery.GetBatteryS();
+    Expected.insert( Expected.end(), Events.begin(), Events.end() );
+    NarfduinoSim::Counters = Outside;
+
+    unsigned long long CallStart = NarfduinoSim::Now();
+    Timer.Start();
+    if( Buffered )
+      Recorder.ProcessRecorder();
+    else
+      for( const std::pair<byte, byte> &Event : Events )
+        NaiveRecord( NaiveSlot, NaiveSequence, Event.first, Event.second );
+    Timer.Stop();
+    if( NarfduinoSim::Now() - CallStart > MaxCallMicros )
+      MaxCallMicros = NarfduinoSim::Now() - CallStart;
+  }
+
+  // Let the last records go out
+  while( Buffered && !Recorder.IsIdle() )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    Recorder.ProcessRecorder();
+  }
+
+  NarfduinoRecorderDecoder Decoder;
+  Decoder.Decode( NarfduinoSim::GetEEPROM(), _NARFDUINO_SIM_EEPROM_SIZE );
+  size_t Logged = Decoder.Records.size();
+  size_t Matched = 0;
+  for( size_t i = 0; i < Logged && i < Expected.size(); i++ )
+  {
+    const NarfduinoRecorderDecoder::Record &In = Decoder.Records[Logged - 1 - i];
+    const std::pair<byte, byte> &Event = Expected[Expected.size() - 1 - i];
+    if( In.Event != Event.first || In.Data != Event.second )
+      break;
+    Matched++;
+  }
+  unsigned long Writes = NarfduinoSim::Counters.EEPROMWrites;
+  double BlockedMicros = (double)NarfduinoSim::Counters.EEPROMBlockedCycles / (F_CPU / 1000000UL);
+
+  PrintResult( Name, BenchIterations, Timer, Expected.size() );
+  printf( "  %s: %zu events, last %zu of %zu logged match, EEPROM writes %lu, blocked %.0fms, longest call %lluus",
+    Name, Expected.size(), Matched, Logged, Writes, BlockedMicros / 1000.0, MaxCallMicros );
+  if( !Buffered )
+  {
+    printf( "\n" );
+    return;
+  }
+  printf( ", dropped %u\n", Recorder.GetDroppedEvents() );
+  if( Matched != Logged || Logged != min( Expected.size(), (size_t)_NARFDUINO_RECORDER_SLOTS ) || Decoder.BadSlots || Decoder.GetGaps() ||
+      BlockedMicros > 0 || MaxCallMicros > 0 || Recorder.GetDroppedEvents() )
+    BenchFailed = true;
+
+  // Power cut part way through a record. The one being written is lost, and the log carries on from the one before it.
+  uint16_t LastSequence = Decoder.Records.back().Sequence;
+  Recorder.LogEvent( _NARFDUINO_RECORDER_USER, 0x42 );
+  unsigned long WritesBefore = NarfduinoSim::Counters.EEPROMWrites;
+  while( NarfduinoSim::Counters.EEPROMWrites < WritesBefore + 3 )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    Recorder.ProcessRecorder();
+  }
+  NarfduinoSim::Reset();
+  Decoder.Decode( NarfduinoSim::GetEEPROM(), _NARFDUINO_SIM_EEPROM_SIZE );
+  unsigned int TornSlots = Decoder.BadSlots;
+
+  NarfduinoRecorder PowerOn;
+  PowerOn.Init();
+  while( !PowerOn.IsIdle() )
+  {
+    NarfduinoSim::AdvanceMicros( BENCH_LOOP_MICROS );
+    PowerOn.ProcessRecorder();
+  }
+  Decoder.Decode( NarfduinoSim::GetEEPROM(), _NARFDUINO_SIM_EEPROM_SIZE );
+  const NarfduinoRecorderDecoder::Record &Newest = Decoder.Records.back();
+  printf( "  %s: power cut mid-record - %u torn, next power on logged as %u after %u, %u bad slots after\n", Name, TornSlots,
+    Newest.Sequence, LastSequence, Decoder.BadSlots );
+  if( TornSlots != 1 || Newest.Event != _NARFDUINO_RECORDER_POWER_ON || Newest.Sequence != (uint16_t)(LastSequence + 1) ||
+      Decoder.BadSlots || Decoder.GetGaps() || Decoder.Records.size() != _NARFDUINO_RECORDER_SLOTS )
+    BenchFailed = true;
+}
+
+
+#ifdef _NARFDUINO_ENABLE_PROFILER
+// Can the profiler tell when Timer1 is taken? The sim starts with Timer1 stopped, but on the board the core's init() has already 
+// set it running at /64 in 8 bit phase correct PWM, for analogWrite(). Each owner is set up from there.
+static void BenchProfilerTimer1( const char *Name )
+{
+  static const char *Owners[] = { "nothing", "brushless", "bridge Timer1 PWM", "Servo", "analogWrite()" };
+  bool Free[5];
+  for( byte Owner = 0; Owner < 5; Owner++ )
+  {
+    NarfduinoSim::Reset();
+    TCCR1A = (1 << WGM10);
+    TCCR1B = (1 << CS11) | (1 << CS10);
+    if( Owner == 1 )
+    {
+      NarfduinoBrushless Brushless;
+      Brushless.Init();
+    }
+    else if( Owner == 2 )
+    {
+      NarfduinoBridge Bridge( 9, _NARFDUINOPIN_BRIDGE_STOP );
+      Bridge.Init();
+      Bridge.SetPWMMode( _NARFDUINO_BRIDGE_PWM_TIMER1 );
+    }
+    else if( Owner == 3 )
+    {
+      // What Servo::attach() does
+      TCCR1A = 0;
+      TCCR1B = (1 << CS11);
+      TIMSK1 |= (1 << OCIE1A);
+    }
+    else if( Owner == 4 )
+    {
+      // What the core's analogWrite() on pin 9 does. The sim's doesn't touch the timer registers.
+      TCCR1A |= (1 << COM1A1);
+      OCR1A = 128;
+    }
+    Free[Owner] = NarfduinoProfiler::IsTimer1Free();
+  }
+  NarfduinoSim::Reset();
+
+  printf( "%s:", Name );
+  for( byte Owner = 0; Owner < 5; Owner++ )
+    printf( "%s %s %s", Owner ? "," : "", Owners[Owner], Free[Owner] ? "free" : "taken" );
+  printf( "\n" );
+  if( !Free[0] || Free[1] || Free[2] || Free[3] || Free[4] )
+    BenchFailed = true;
+}
+#endif
+
+int main( int argc, char **argv )
+{
+  if( argc > 1 )
+    BenchIterations = strtoul( argv[1], NULL, 10 );
+  if( BenchIterations == 0 )
+    BenchIterations = 1;
+
+  CalibrateTimer();
+  NarfduinoProfiler::Init();
+  printf( "Narfduino host benchmark - %lu iterations, %dus simulated loop, timer overhead %.1fns\n\n", BenchIterations, BENCH_LOOP_MICROS, TimerOverheadTicks * NanosPerTick );
+  PrintHeader();
+
+  BenchBridgePusher( "ProcessBridge pusher 100%", 100 );
+  BenchBridgePusher( "ProcessBridge pusher 70%", 70 );
+  BenchBridgePusher( "ProcessBridge pusher timed", 100, 200, 100 );
+  BenchBridgePusher<BenchFixedBridge>( "ProcessBridge pusher fixed pins", 100 );
+  BenchBridgePusher<BenchFixedBridge>( "ProcessBridge timed fixed pins", 100, 200, 100 );
+  BenchBridgeSizes();
+  BenchBridgeFlywheel( "ProcessBridge flywheel" );
+  BenchBridgeGroup( "ProcessBridge x2", false );
+  BenchBridgeGroup( "ProcessBridges group", true );
+  BenchPusherSwitch( "ProcessBridge switch interrupt", true );
+  BenchPusherSwitch( "ProcessBridge switch polled", false );
+  BenchSoftStart( "ProcessBridge hard start", false );
+  BenchSoftStart( "ProcessBridge soft start", true );
+  BenchBridgePWM( "ProcessBridge PWM analogWrite", _NARFDUINO_BRIDGE_PWM_ANALOGWRITE, _NARFDUINOPIN_BRIDGE_RUN );
+  BenchBridgePWM( "ProcessBridge PWM Timer1 20kHz", _NARFDUINO_BRIDGE_PWM_TIMER1, 9 );
+  BenchBridgePWM( "ProcessBridge PWM Timer2 20kHz", _NARFDUINO_BRIDGE_PWM_TIMER2, 3 );
+  BenchAntiJam( "ProcessBridge anti-jam", true );
+  BenchAntiJam( "ProcessBridge anti-jam fixed", false );
+  BenchPusher( "ProcessPusher", true, 0 );
+  BenchPusher( "ProcessPusher 12 darts/s", true, 12 );
+  BenchPusher( "ProcessBridge stop on heartbeat", false, 0 );
+  BenchBattery( "ProcessBatteryMonitor", false );
+  BenchBattery( "ProcessBatteryMonitor bg", true );
+  BenchBatteryLoad( "ProcessBatteryMonitor load", true );
+  BenchBatteryLoad( "ProcessBatteryMonitor no hints", false );
+  BenchBatteryDetect( "ProcessBatteryMonitor detect", false );
+  BenchBatteryDetect( "ProcessBatteryMonitor detect bg", true );
+  BenchBatteryDetectLoad( "ProcessBatteryMonitor detect load" );
+  BenchCellMonitor( "ProcessCellMonitor 3 taps", 3 );
+  BenchCellMonitor( "ProcessCellMonitor 6 taps", 6 );
+  BenchBrushless( "UpdateSpeed PWM 50Hz", _NARFDUINO_BRUSHLESS_PWM, 1000.0f, 1000.0f );
+  BenchBrushless( "UpdateSpeed OneShot125", _NARFDUINO_BRUSHLESS_ONESHOT125, 125.0f, 125.0f );
+  BenchBrushless( "UpdateSpeed OneShot42", _NARFDUINO_BRUSHLESS_ONESHOT42, 42.0f, 42.0f );
+  BenchBrushless( "UpdateSpeed Multishot", _NARFDUINO_BRUSHLESS_MULTISHOT, 5.0f, 20.0f );
+  BenchBrushlessRamp( "UpdateSpeed OneShot125 ramp" );
+  BenchDShot( "UpdateSpeed DShot150", _NARFDUINO_BRUSHLESS_DSHOT150, 107, 80, 40 );
+  BenchDShot( "UpdateSpeed DShot300", _NARFDUINO_BRUSHLESS_DSHOT300, 53, 40, 20 );
+  BenchGovernor( "ProcessGovernor", true );
+  BenchGovernor( "Flywheel open loop", false );
+  BenchPowerGovernor( "ProcessPowerGovernor", true );
+  BenchPowerGovernor( "No power governor", false );
+  BenchScheduler( "Run scheduler", 0 );
+  BenchScheduler( "Run scheduler 500us budget", 500 );
+  BenchTelemetry( "ProcessTelemetry 200Hz", true );
+  BenchTelemetry( "Serial.print 200Hz", false );
+  BenchRecorder( "ProcessRecorder", true );
+  BenchRecorder( "EEPROM write on event", false );
+
+#ifdef _NARFDUINO_ENABLE_PROFILER
+  // Every scenario's calls, timed with the simulated micros(). Only the blocking calls take any simulated time.
+  printf( "\n" );
+  NarfduinoProfiler::Dump( Serial );
+  BenchProfilerTimer1( "Profiler Timer1 clock" );
+  if( NarfduinoProfiler::GetMax( _NARFDUINO_PROFILE_BATTERY ) < _NARFDUINO_SIM_ANALOGREAD_MICROS )
+  {
+    printf( "Profiler missed the blocking analogRead() in ProcessBatteryMonitor()\n" );
+    BenchFailed = true;
+  }
+#endif
+
+  if( BenchFailed )
+  {
+    printf( "\nFAILED - see above\n" );
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ *  Narfduino Libraries - Recorder decoder
+ *
+ *  Pulls the NarfduinoRecorder log back out of an EEPROM image, oldest record first. Used by the narfduino_blackbox tool and the benchmark.
+ *  Slots that fail the check are skipped - empty ones, and one cut off by a power loss.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_RECORDER_DECODER_H
+#define _NARFDUINO_RECORDER_DECODER_H
+
+#include <vector>
+
+#include "NarfduinoRecorder.h"
+
+class NarfduinoRecorderDecoder
+{
+  public:
+    struct Record
+    {
+      uint16_t Sequence;
+      uint8_t Event;
+      uint8_t Data;
+      uint32_t Millis;
+      unsigned int Slot;
+    };
+
+    // Decode the log at Start, Size bytes long, from an image of the EEPROM. Returns false if it doesn't fit in the image.
+    bool Decode( const uint8_t *Image, size_t ImageSize, unsigned int Start = _NARFDUINO_RECORDER_START, unsigned int Size = _NARFDUINO_RECORDER_SIZE )
+    {
+      Records.clear();
+      EmptySlots = BadSlots = 0;
+      if( (size_t)Start + Size > ImageSize )
+        return false;
+
+      for( unsigned int Slot = 0; Slot < Size / _NARFDUINO_RECORDER_RECORD_SIZE; Slot++ )
+      {
+        const uint8_t *p = Image + Start + Slot * _NARFDUINO_RECORDER_RECORD_SIZE;
+        uint8_t Sum = 0;
+        bool Empty = true;
+        for( int i = 0; i < _NARFDUINO_RECORDER_RECORD_SIZE - 1; i++ )
+        {
+          Sum += p[i];
+          Empty = Empty && p[i] == 0xFF;
+        }
+        if( p[_NARFDUINO_RECORDER_RECORD_SIZE - 1] != (uint8_t)~Sum )
+        {
+          if( Empty && p[_NARFDUINO_RECORDER_RECORD_SIZE - 1] == 0xFF )
+            EmptySlots++;
+          else
+            BadSlots++;
+          continue;
+        }
+        Record In;
+        In.Sequence = p[0] | (p[1] << 8);
+        In.Event = p[2];
+        In.Data = p[3];
+        In.Millis = p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16);
+        In.Slot = Slot;
+        Records.push_back( In );
+      }
+      if( Records.empty() )
+        return true;
+
+      // The log is written round the slots in order, so it starts after the newest record. The sequence can go round,
+      // so the newest is found by measuring from one of them.
+      size_t Newest = 0;
+      for( size_t i = 1; i < Records.size(); i++ )
+        if( (int16_t)(Records[i].Sequence - Records[Newest].Sequence) > 0 )
+          Newest = i;
+      std::vector<Record> InOrder( Records.begin() + Newest + 1, Records.end() );
+      InOrder.insert( InOrder.end(), Records.begin(), Records.begin() + Newest + 1 );
+      Records.swap( InOrder );
+      return true;
+    }
+
+    // Records that are missing from the sequence - written over, or never finished
+    unsigned long GetGaps()
+    {
+      unsigned long Gaps = 0;
+      for( size_t i = 1; i < Records.size(); i++ )
+        Gaps += (uint16_t)(Records[i].Sequence - Records[i - 1].Sequence - 1);
+      return Gaps;
+    }
+
+    static const char *EventName( uint8_t Event )
+    {
+      switch( Event )
+      {
+        case _NARFDUINO_RECORDER_POWER_ON: return "power_on";
+        case _NARFDUINO_RECORDER_JAM: return "jam";
+        case _NARFDUINO_RECORDER_BATTERY_FLAT: return "battery_flat";
+        case _NARFDUINO_RECORDER_BATTERY_S: return "battery_s";
+        case _NARFDUINO_RECORDER_BRIDGE_START: return "bridge_start";
+        case _NARFDUINO_RECORDER_BRIDGE_STOP: return "bridge_stop";
+      }
+      return Event >= _NARFDUINO_RECORDER_USER ? "user" : "unknown";
+    }
+
+    std::vector<Record> Records;
+    unsigned int EmptySlots = 0;
+    unsigned int BadSlots = 0; // Written, but failed the check
+};
+
+#endif
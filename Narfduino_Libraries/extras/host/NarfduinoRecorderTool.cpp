@@ -0,0 +1,89 @@
+/*
+ *  Narfduino Libraries - Black box tool
+ *
+ *  Turns the NarfduinoRecorder log in an EEPROM image into CSV, oldest event first. Pull the image off the board with avrdude:
+ *    avrdude -p m328p -c arduino -P /dev/ttyUSB0 -U eeprom:r:blackbox.bin:r
+ *    narfduino_blackbox blackbox.bin > blackbox.csv
+ *
+ *  Usage: narfduino_blackbox [-s start] [-n size] [image]
+ *    -s and -n are the _NARFDUINO_RECORDER_START and _NARFDUINO_RECORDER_SIZE the sketch was built with. The image is read from stdin without one.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#include <stdio.h>
+
+#include "NarfduinoRecorderDecoder.h"
+
+int main( int argc, char **argv )
+{
+  unsigned long Start = _NARFDUINO_RECORDER_START;
+  unsigned long Size = _NARFDUINO_RECORDER_SIZE;
+  const char *Path = NULL;
+  for( int i = 1; i < argc; i++ )
+  {
+    if( strcmp( argv[i], "-s" ) == 0 && i + 1 < argc )
+      Start = strtoul( argv[++i], NULL, 0 );
+    else if( strcmp( argv[i], "-n" ) == 0 && i + 1 < argc )
+      Size = strtoul( argv[++i], NULL, 0 );
+    else if( argv[i][0] == '-' && argv[i][1] )
+    {
+      fprintf( stderr, "Usage: %s [-s start] [-n size] [image]\n", argv[0] );
+      return 2;
+    }
+    else
+      Path = argv[i];
+  }
+  if( Size % _NARFDUINO_RECORDER_RECORD_SIZE )
+  {
+    fprintf( stderr, "Size has to be a multiple of %d\n", _NARFDUINO_RECORDER_RECORD_SIZE );
+    return 2;
+  }
+
+  FILE *Input = stdin;
+  if( Path && strcmp( Path, "-" ) != 0 )
+  {
+    Input = fopen( Path, "rb" );
+    if( !Input )
+    {
+      perror( Path );
+      return 1;
+    }
+  }
+  std::vector<uint8_t> Image;
+  uint8_t Bytes[256];
+  size_t Count;
+  while( (Count = fread( Bytes, 1, sizeof( Bytes ), Input )) > 0 )
+    Image.insert( Image.end(), Bytes, Bytes + Count );
+
+  NarfduinoRecorderDecoder Decoder;
+  if( !Decoder.Decode( Image.data(), Image.size(), Start, Size ) )
+  {
+    fprintf( stderr, "The image is %zu bytes - too small for a log at %lu, %lu bytes long\n", Image.size(), Start, Size );
+    return 1;
+  }
+
+  // Millis starts again from 0 at each power on
+  printf( "sequence,millis,event,data\n" );
+  for( const NarfduinoRecorderDecoder::Record &In : Decoder.Records )
+  {
+    if( In.Event >= _NARFDUINO_RECORDER_USER )
+      printf( "%u,%lu,user_0x%02X,%u\n", In.Sequence, (unsigned long)In.Millis, In.Event, In.Data );
+    else
+      printf( "%u,%lu,%s,%u\n", In.Sequence, (unsigned long)In.Millis, NarfduinoRecorderDecoder::EventName( In.Event ), In.Data );
+  }
+
+  fprintf( stderr, "%zu records, %u empty slots, %u bad, %lu missing from the sequence\n", Decoder.Records.size(), Decoder.EmptySlots,
+    Decoder.BadSlots, Decoder.GetGaps() );
+  return 0;
+}
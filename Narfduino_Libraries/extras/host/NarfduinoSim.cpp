@@ -0,0 +1,1046 @@
+/*
+ *  Narfduino Libraries - Host Simulation HAL
+ *
+ *  Implementation of the simulated core. See NarfduinoSim.h
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#include <stdio.h>
+
+#include "NarfduinoSim.h"
+#include "avr/eeprom.h"
+
+// Registers
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t SREG;
+
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+volatile uint8_t TIMSK1;
+SimFlagRegister TIFR1;
+
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+SimFlagRegister TIFR2;
+
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+SimFlagRegister PCIFR;
+
+volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADC;
+
+// Default vectors, for when nothing in the build claims them
+extern "C" __attribute__((weak)) void TIMER1_COMPA_vect( void ) {}
+extern "C" __attribute__((weak)) void TIMER1_COMPB_vect( void ) {}
+extern "C" __attribute__((weak)) void TIMER1_OVF_vect( void ) {}
+extern "C" __attribute__((weak)) void TIMER2_COMPA_vect( void ) {}
+extern "C" __attribute__((weak)) void TIMER2_COMPB_vect( void ) {}
+extern "C" __attribute__((weak)) void ADC_vect( void ) {}
+extern "C" __attribute__((weak)) void PCINT0_vect( void ) {}
+extern "C" __attribute__((weak)) void PCINT1_vect( void ) {}
+extern "C" __attribute__((weak)) void PCINT2_vect( void ) {}
+
+namespace NarfduinoSim
+{
+  CoreCounters Counters;
+  unsigned long InterruptsServiced = 0;
+
+  #define CYCLES_PER_MICRO (F_CPU / 1000000UL)
+
+  static unsigned long long CurrentCycles = 0;
+  static unsigned long Timer1Fraction = 0; // CPU cycles into the current Timer1 tick
+  static uint16_t Timer1CompareA = 0; // The compare values in use. Double buffered in the PWM mode - picked up at BOTTOM.
+  static uint16_t Timer1CompareB = 0;
+  static bool Timer1OutputA = false;
+  static bool Timer1OutputB = false;
+  static EdgeCallback Edges = NULL;
+  static SerialCallback SerialBytes = NULL;
+  static uint8_t EEPROM[_NARFDUINO_SIM_EEPROM_SIZE];
+  static bool EEPROMErased = false;
+  static unsigned long long EEPROMDoneAt = 0; // Cycle the write going on now finishes
+  static unsigned long SerialCyclesPerByte = 0; // 0 = begin() not called. Bytes go straight out.
+  static uint8_t SerialQueued = 0; // Bytes in the TX buffer
+  static unsigned long long SerialNextSent = 0; // Cycle the byte going out now is done
+  static unsigned long long DelayedCycles = 0; // Counted delays since the last interrupt handler or AdvanceCycles() started
+  static unsigned long Timer2Fraction = 0; // CPU cycles into the current Timer2 tick
+  static uint8_t Timer2CompareA = 0; // Double buffered in the PWM modes, like Timer1
+  static uint8_t Timer2CompareB = 0;
+  static bool Timer2OutputB = false;
+  static bool ADCConverting = false;
+  static unsigned long long ADCDoneAt = 0; // Cycle the running conversion finishes
+  static uint16_t AnalogValues[8];
+  static int PWMDuty[NUM_SIM_PINS]; // -1 = PWM not connected
+  static uint8_t InputLevels[NUM_SIM_PINS];
+  static void (*ExternalHandlers[2])( void ); // attachInterrupt() handlers for INT0 / INT1
+  static int ExternalModes[2];
+  static bool ExternalPending[2];
+
+  static bool HasPWM( uint8_t Pin )
+  {
+    return Pin == 3 || Pin == 5 || Pin == 6 || Pin == 9 || Pin == 10 || Pin == 11;
+  }
+
+  void ResetCounters()
+  {
+    memset( &Counters, 0, sizeof( Counters ) );
+  }
+
+  void Reset()
+  {
+    CurrentCycles = 0;
+    Timer1Fraction = 0;
+    Timer1CompareA = Timer1CompareB = 0;
+    Timer1OutputA = Timer1OutputB = false;
+    Edges = NULL;
+    SerialBytes = NULL;
+    SerialCyclesPerByte = 0;
+    SerialQueued = 0;
+    EEPROMDoneAt = 0;
+    DelayedCycles = 0;
+    Timer2Fraction = 0;
+    Timer2CompareA = Timer2CompareB = 0;
+    Timer2OutputB = false;
+    InterruptsServiced = 0;
+    PORTB = PORTC = PORTD = 0;
+    DDRB = DDRC = DDRD = 0;
+    PINB = PINC = PIND = 0;
+    SREG = (1 << SREG_I);
+    TCCR1A = TCCR1B = 0;
+    TCNT1 = ICR1 = OCR1A = OCR1B = 0;
+    TIMSK1 = 0;
+    TIFR1.Reset();
+    TCCR2A = TCCR2B = TCNT2 = OCR2A = OCR2B = TIMSK2 = 0;
+    TIFR2.Reset();
+    PCICR = PCMSK0 = PCMSK1 = PCMSK2 = 0;
+    PCIFR.Reset();
+    // The core turns the ADC on with a /128 prescaler
+    ADMUX = 0;
+    ADCSRA = (1 << ADEN) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+    ADCSRB = 0;
+    ADC = 0;
+    ADCConverting = false;
+    for( uint8_t c = 0; c < NUM_SIM_PINS; c++ )
+    {
+      PWMDuty[c] = -1;
+      InputLevels[c] = LOW;
+    }
+    memset( AnalogValues, 0, sizeof( AnalogValues ) );
+    for( uint8_t c = 0; c < 2; c++ )
+    {
+      ExternalHandlers[c] = NULL;
+      ExternalPending[c] = false;
+    }
+    ResetCounters();
+  }
+
+  unsigned long long EstimatedCoreCycles()
+  {
+    return (unsigned long long)Counters.DigitalWrites * _NARFDUINO_SIM_CYCLES_DIGITALWRITE
+      + (unsigned long long)Counters.DigitalReads * _NARFDUINO_SIM_CYCLES_DIGITALREAD
+      + (unsigned long long)Counters.AnalogWrites * _NARFDUINO_SIM_CYCLES_ANALOGWRITE
+      + (unsigned long long)Counters.AnalogReads * _NARFDUINO_SIM_CYCLES_ANALOGREAD
+      + (unsigned long long)Counters.Millis * _NARFDUINO_SIM_CYCLES_MILLIS
+      + (unsigned long long)Counters.Micros * _NARFDUINO_SIM_CYCLES_MICROS;
+  }
+
+  // Runs an interrupt handler the way the hardware does - interrupts off while it runs, flag cleared on entry.
+  static void RunInterrupt( SimFlagRegister &FlagRegister, uint8_t Flag, void (*Vector)( void ) )
+  {
+    FlagRegister = (1 << Flag);
+    SREG &= ~(1 << SREG_I);
+    DelayedCycles = 0;
+    Vector();
+    SREG |= (1 << SREG_I);
+    InterruptsServiced++;
+  }
+
+  // Any raised, enabled interrupt runs as soon as interrupts are on.
+  static void DispatchPending()
+  {
+    if( !(SREG & (1 << SREG_I)) )
+      return;
+    // INT0 and INT1 come first on the AVR
+    for( uint8_t c = 0; c < 2; c++ )
+    {
+      if( !ExternalPending[c] )
+        continue;
+      ExternalPending[c] = false;
+      SREG &= ~(1 << SREG_I);
+      DelayedCycles = 0;
+      if( ExternalHandlers[c] )
+        ExternalHandlers[c]();
+      SREG |= (1 << SREG_I);
+      InterruptsServiced++;
+    }
+    // Then the pin changes
+    static void (*const PinChangeVectors[3])( void ) = { PCINT0_vect, PCINT1_vect, PCINT2_vect };
+    for( uint8_t c = 0; c < 3; c++ )
+    {
+      if( (PCIFR & (1 << c)) && (PCICR & (1 << c)) )
+        RunInterrupt( PCIFR, c, PinChangeVectors[c] );
+    }
+    if( (TIFR2 & (1 << OCF2A)) && (TIMSK2 & (1 << OCIE2A)) )
+      RunInterrupt( TIFR2, OCF2A, TIMER2_COMPA_vect );
+    if( (TIFR2 & (1 << OCF2B)) && (TIMSK2 & (1 << OCIE2B)) )
+      RunInterrupt( TIFR2, OCF2B, TIMER2_COMPB_vect );
+    if( (TIFR1 & (1 << OCF1A)) && (TIMSK1 & (1 << OCIE1A)) )
+      RunInterrupt( TIFR1, OCF1A, TIMER1_COMPA_vect );
+    if( (TIFR1 & (1 << OCF1B)) && (TIMSK1 & (1 << OCIE1B)) )
+      RunInterrupt( TIFR1, OCF1B, TIMER1_COMPB_vect );
+    if( (TIFR1 & (1 << TOV1)) && (TIMSK1 & (1 << TOIE1)) )
+      RunInterrupt( TIFR1, TOV1, TIMER1_OVF_vect );
+    if( (ADCSRA & (1 << ADIF)) && (ADCSRA & (1 << ADIE)) )
+    {
+      ADCSRA &= ~(1 << ADIF);
+      SREG &= ~(1 << SREG_I);
+      ADC_vect();
+      SREG |= (1 << SREG_I);
+      InterruptsServiced++;
+    }
+  }
+
+  // Picks up a conversion started by setting ADSC. 13 ADC clocks, ADC clock is the CPU clock / prescaler.
+  static void ADCCheckStart()
+  {
+    if( ADCConverting || !(ADCSRA & (1 << ADSC)) || !(ADCSRA & (1 << ADEN)) )
+      return;
+    static const unsigned int Prescalers[8] = { 2, 2, 4, 8, 16, 32, 64, 128 };
+    ADCConverting = true;
+    ADCDoneAt = CurrentCycles + 13UL * Prescalers[ADCSRA & 0x07];
+  }
+
+  // CPU cycles until the running conversion is done. 0 = nothing running.
+  static unsigned long long ADCNextEvent()
+  {
+    if( !ADCConverting )
+      return 0;
+    return ADCDoneAt - CurrentCycles;
+  }
+
+  static uint16_t ConvertChannel( uint8_t Channel );
+
+  // Finish the conversion if it's due
+  static void ADCAdvance()
+  {
+    if( !ADCConverting || CurrentCycles < ADCDoneAt )
+      return;
+    ADCConverting = false;
+    ADC = ConvertChannel( ADMUX & 0x07 );
+    ADCSRA = (ADCSRA & ~(1 << ADSC)) | (1 << ADIF);
+  }
+
+  // Timer1 waveform generation mode, from the WGM bits split over the two control registers
+  static uint8_t Timer1Mode()
+  {
+    return (((TCCR1B >> WGM12) & 0x03) << 2) | (TCCR1A & 0x03);
+  }
+
+  static bool Timer1PWM()
+  {
+    return Timer1Mode() == 14;
+  }
+
+  // Timer1 prescaler from the clock select bits. 0 = stopped (or an external clock, which isn't simulated).
+  static unsigned long Timer1Prescaler()
+  {
+    static const unsigned int Prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    return Prescalers[TCCR1B & 0x07];
+  }
+
+  static uint16_t Timer1Top()
+  {
+    switch( Timer1Mode() )
+    {
+      case 4: return OCR1A;
+      case 12:
+      case 14: return ICR1;
+    }
+    return 0xFFFF;
+  }
+
+  // Ticks until Timer1 wraps back to BOTTOM. If TOP has been moved below the count, it runs on to 0xFFFF first - like the hardware.
+  static unsigned long Timer1TicksToBottom( uint16_t Top )
+  {
+    if( TCNT1 <= Top )
+      return (unsigned long)Top - TCNT1 + 1;
+    return 0x10000UL - TCNT1;
+  }
+
+  // Ticks until Timer1 next reaches a value. A full wrap if it's already there. 0 = never.
+  static unsigned long Timer1TicksUntil( uint16_t Value, uint16_t Top )
+  {
+    if( Value > Top )
+      return 0;
+    if( Value > TCNT1 )
+      return Value - TCNT1;
+    return Timer1TicksToBottom( Top ) + Value;
+  }
+
+  static unsigned long Timer1TicksToEvent()
+  {
+    uint16_t Top = Timer1Top();
+    unsigned long Ticks = Timer1TicksToBottom( Top );
+    unsigned long Compare = Timer1TicksUntil( Top, Top );
+    if( Compare && Compare < Ticks )
+      Ticks = Compare;
+    Compare = Timer1TicksUntil( Timer1PWM() ? Timer1CompareA : OCR1A, Top );
+    if( Compare && Compare < Ticks )
+      Ticks = Compare;
+    Compare = Timer1TicksUntil( Timer1PWM() ? Timer1CompareB : OCR1B, Top );
+    if( Compare && Compare < Ticks )
+      Ticks = Compare;
+    return Ticks;
+  }
+
+  // CPU cycles until Timer1 next does something. 0 = nothing coming.
+  static unsigned long long Timer1NextEvent()
+  {
+    unsigned long Prescaler = Timer1Prescaler();
+    if( !Prescaler )
+      return 0;
+    return (unsigned long long)Timer1TicksToEvent() * Prescaler - Timer1Fraction;
+  }
+
+  static void TimerSetOutput( bool &Output, uint8_t Pin, bool Level, unsigned long long Cycle )
+  {
+    if( Output == Level )
+      return;
+    Output = Level;
+    if( Edges )
+      Edges( Pin, Level, Cycle );
+  }
+
+  // Moves Timer1 on an event at a time, raising the flags and driving the outputs for everything it reaches.
+  static void Timer1Advance( unsigned long long Cycles )
+  {
+    unsigned long Prescaler = Timer1Prescaler();
+    if( !Prescaler )
+      return;
+    unsigned long long Cycle = CurrentCycles - Timer1Fraction; // When the current tick started
+    unsigned long long Total = Cycles + Timer1Fraction;
+    unsigned long long Ticks = Total / Prescaler;
+    Timer1Fraction = Total % Prescaler;
+
+    while( Ticks )
+    {
+      uint16_t Top = Timer1Top();
+      unsigned long Step = Timer1TicksToEvent();
+      if( Step > Ticks )
+        Step = Ticks;
+      Ticks -= Step;
+      Cycle += (unsigned long long)Step * Prescaler;
+
+      bool Wrapped = (Step == Timer1TicksToBottom( Top ));
+      TCNT1 = Wrapped ? 0 : TCNT1 + Step;
+      bool PWM = Timer1PWM();
+
+      if( Wrapped )
+      {
+        if( PWM )
+        {
+          Timer1CompareA = OCR1A;
+          Timer1CompareB = OCR1B;
+          // OCR1x = 0 is a single tick pulse, as on the hardware
+          if( TCCR1A & (1 << COM1A1) )
+            TimerSetOutput( Timer1OutputA, 9, true, Cycle );
+          if( TCCR1A & (1 << COM1B1) )
+            TimerSetOutput( Timer1OutputB, 10, true, Cycle );
+        }
+        else if( Top == 0xFFFF )
+        {
+          TIFR1.Raise( TOV1 );
+        }
+      }
+      if( TCNT1 == Top && PWM )
+        TIFR1.Raise( TOV1 );
+      // The output clears on the tick after the match, so the pulse is OCR1x + 1 ticks, and OCR1x = TOP stays high
+      if( TCNT1 == (PWM ? Timer1CompareA : OCR1A) )
+      {
+        TIFR1.Raise( OCF1A );
+        if( PWM && (TCCR1A & (1 << COM1A1)) && TCNT1 != Top )
+          TimerSetOutput( Timer1OutputA, 9, false, Cycle + Prescaler );
+      }
+      if( TCNT1 == (PWM ? Timer1CompareB : OCR1B) )
+      {
+        TIFR1.Raise( OCF1B );
+        if( PWM && (TCCR1A & (1 << COM1B1)) && TCNT1 != Top )
+          TimerSetOutput( Timer1OutputB, 10, false, Cycle + Prescaler );
+      }
+    }
+  }
+
+  // Timer2 prescaler from the clock select bits. 0 = stopped.
+  static unsigned long Timer2Prescaler()
+  {
+    static const unsigned int Prescalers[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+    return Prescalers[TCCR2B & 0x07];
+  }
+
+  // Timer2 waveform generation mode, from the WGM bits split over the two control registers
+  static uint8_t Timer2Mode()
+  {
+    return (((TCCR2B >> WGM22) & 0x01) << 2) | (TCCR2A & 0x03);
+  }
+
+  // Fast PWM, TOP = 0xFF or OCR2A
+  static bool Timer2PWM()
+  {
+    return Timer2Mode() == 3 || Timer2Mode() == 7;
+  }
+
+  static uint8_t Timer2Top()
+  {
+    switch( Timer2Mode() )
+    {
+      case 2: return OCR2A;
+      case 7: return Timer2CompareA;
+    }
+    return 0xFF;
+  }
+
+  // Ticks until the counter next reaches a value. Counting from Count, wrapping after Top.
+  static unsigned int TicksUntil( uint8_t Count, uint8_t Value, uint8_t Top )
+  {
+    if( Value > Top )
+      return 0;
+    unsigned int Ticks = (Value > Count) ? (Value - Count) : (Top + 1 - Count + Value);
+    return Ticks;
+  }
+
+  // CPU cycles until Timer2 next raises something. 0 = nothing coming.
+  static unsigned long long Timer2NextEvent()
+  {
+    unsigned long Prescaler = Timer2Prescaler();
+    if( !Prescaler )
+      return 0;
+    uint8_t Top = Timer2Top();
+    unsigned int Ticks = TicksUntil( TCNT2, Top, Top );
+    unsigned int CompareA = TicksUntil( TCNT2, Timer2PWM() ? Timer2CompareA : OCR2A, Top );
+    unsigned int CompareB = TicksUntil( TCNT2, Timer2PWM() ? Timer2CompareB : OCR2B, Top );
+    if( CompareA && CompareA < Ticks )
+      Ticks = CompareA;
+    if( CompareB && CompareB < Ticks )
+      Ticks = CompareB;
+    return (unsigned long long)Ticks * Prescaler - Timer2Fraction;
+  }
+
+  // Moves Timer2 on, raising the flags for anything it reaches. Drives OC2B on pin 3 in the PWM modes, the same way as Timer1.
+  static void Timer2Advance( unsigned long long Cycles )
+  {
+    unsigned long Prescaler = Timer2Prescaler();
+    if( !Prescaler )
+      return;
+    unsigned long long Cycle = CurrentCycles - Timer2Fraction; // When the current tick started
+    unsigned long long Total = Cycles + Timer2Fraction;
+    unsigned long long Ticks = Total / Prescaler;
+    Timer2Fraction = Total % Prescaler;
+    bool PWM = Timer2PWM();
+    while( Ticks-- )
+    {
+      uint8_t Top = Timer2Top();
+      Cycle += Prescaler;
+      if( TCNT2 == Top )
+      {
+        TCNT2 = 0;
+        if( PWM )
+        {
+          Timer2CompareA = OCR2A;
+          Timer2CompareB = OCR2B;
+          if( TCCR2A & (1 << COM2B1) )
+            TimerSetOutput( Timer2OutputB, 3, true, Cycle );
+        }
+        else if( Top == 0xFF )
+          TIFR2.Raise( TOV2 );
+      }
+      else
+      {
+        TCNT2 = TCNT2 + 1;
+      }
+      if( TCNT2 == (PWM ? Timer2CompareA : OCR2A) )
+        TIFR2.Raise( OCF2A );
+      if( TCNT2 == (PWM ? Timer2CompareB : OCR2B) )
+      {
+        TIFR2.Raise( OCF2B );
+        if( PWM && (TCCR2A & (1 << COM2B1)) && TCNT2 != Timer2Top() )
+          TimerSetOutput( Timer2OutputB, 3, false, Cycle + Prescaler );
+      }
+    }
+  }
+
+  void AdvanceCycles( unsigned long long Cycles )
+  {
+    unsigned long long Target = CurrentCycles + Cycles;
+    DelayedCycles = 0;
+    ADCCheckStart();
+    DispatchPending();
+    while( CurrentCycles < Target )
+    {
+      // Step to the next hardware event, or to the end
+      unsigned long long Step = Target - CurrentCycles;
+      unsigned long long Next = Timer1NextEvent();
+      if( Next && Next < Step )
+        Step = Next;
+      Next = Timer2NextEvent();
+      if( Next && Next < Step )
+        Step = Next;
+      Next = ADCNextEvent();
+      if( Next && Next < Step )
+        Step = Next;
+      Timer1Advance( Step );
+      Timer2Advance( Step );
+      CurrentCycles += Step;
+      ADCAdvance();
+      DispatchPending();
+      // An interrupt handler may have started the next conversion
+      ADCCheckStart();
+    }
+  }
+
+  void AdvanceMicros( unsigned long Micros )
+  {
+    AdvanceCycles( (unsigned long long)Micros * CYCLES_PER_MICRO );
+  }
+
+  unsigned long long Now()
+  {
+    return CurrentCycles / CYCLES_PER_MICRO;
+  }
+
+  unsigned long long NowCycles()
+  {
+    return CurrentCycles;
+  }
+
+  void SetAnalogValue( uint8_t Pin, uint16_t Value )
+  {
+    if( Pin >= A0 )
+      Pin -= A0;
+    AnalogValues[Pin & 7] = Value & 0x3FF;
+  }
+
+  void SetPinInput( uint8_t Pin, bool Level )
+  {
+    if( Pin >= NUM_DIGITAL_PINS )
+      return;
+    bool Changed = InputLevels[Pin] != (Level ? HIGH : LOW);
+    InputLevels[Pin] = Level ? HIGH : LOW;
+    volatile uint8_t *InputReg = portInputRegister( digitalPinToPort( Pin ) );
+    uint8_t Mask = digitalPinToBitMask( Pin );
+    if( Level )
+      *InputReg |= Mask;
+    else
+      *InputReg &= ~Mask;
+
+    // External interrupt on the edge
+    int Interrupt = digitalPinToInterrupt( Pin );
+    if( Changed && Interrupt != NOT_AN_INTERRUPT && ExternalHandlers[Interrupt] )
+    {
+      int Mode = ExternalModes[Interrupt];
+      if( Mode == CHANGE || (Mode == RISING && Level) || (Mode == FALLING && !Level) )
+      {
+        ExternalPending[Interrupt] = true;
+        DispatchPending();
+      }
+    }
+
+    // Pin change interrupt on either edge, if the pin is in the mask
+    if( Changed && (*digitalPinToPCMSK( Pin ) & (1 << digitalPinToPCMSKbit( Pin ))) )
+    {
+      PCIFR.Raise( digitalPinToPCICRbit( Pin ) );
+      DispatchPending();
+    }
+  }
+
+  int GetPinOutput( uint8_t Pin )
+  {
+    if( Pin >= NUM_DIGITAL_PINS )
+      return 0;
+    // Timer1 has the pin
+    if( Pin == 9 && (TCCR1A & (1 << COM1A1)) )
+      return Timer1OutputA ? 255 : 0;
+    if( Pin == 10 && (TCCR1A & (1 << COM1B1)) )
+      return Timer1OutputB ? 255 : 0;
+    if( Pin == 3 && (TCCR2A & (1 << COM2B1)) )
+      return Timer2OutputB ? 255 : 0;
+    if( PWMDuty[Pin] >= 0 )
+      return PWMDuty[Pin];
+    volatile uint8_t *OutputReg = portOutputRegister( digitalPinToPort( Pin ) );
+    return (*OutputReg & digitalPinToBitMask( Pin )) ? 255 : 0;
+  }
+
+  void SetEdgeCallback( EdgeCallback Callback )
+  {
+    Edges = Callback;
+  }
+
+  uint8_t *GetEEPROM()
+  {
+    if( !EEPROMErased )
+      EraseEEPROM();
+    return EEPROM;
+  }
+
+  void EraseEEPROM()
+  {
+    memset( EEPROM, 0xFF, sizeof( EEPROM ) );
+    EEPROMErased = true;
+  }
+
+  static bool EEPROMReady()
+  {
+    return CurrentCycles >= EEPROMDoneAt;
+  }
+
+  // Wait out a write that's still going. The time waited is counted.
+  static void EEPROMWait()
+  {
+    if( EEPROMReady() )
+      return;
+    unsigned long long Wait = EEPROMDoneAt - CurrentCycles;
+    Counters.EEPROMBlockedCycles += Wait;
+    AdvanceCycles( Wait );
+  }
+
+  static uint8_t EEPROMRead( uintptr_t Address )
+  {
+    EEPROMWait();
+    return GetEEPROM()[Address % _NARFDUINO_SIM_EEPROM_SIZE];
+  }
+
+  static void EEPROMWrite( uintptr_t Address, uint8_t Value )
+  {
+    EEPROMWait();
+    GetEEPROM()[Address % _NARFDUINO_SIM_EEPROM_SIZE] = Value;
+    EEPROMDoneAt = CurrentCycles + _NARFDUINO_SIM_EEPROM_WRITE_CYCLES;
+    Counters.EEPROMWrites++;
+  }
+
+  void SetSerialCallback( SerialCallback Callback )
+  {
+    SerialBytes = Callback;
+  }
+
+  // 10 bits a byte - start, 8 data, stop
+  static void SerialBegin( unsigned long Baud )
+  {
+    SerialCyclesPerByte = Baud ? F_CPU * 10 / Baud : 0;
+    SerialQueued = 0;
+  }
+
+  // Take off whatever has been sent since the last look
+  static void SerialSend()
+  {
+    while( SerialQueued && CurrentCycles >= SerialNextSent )
+    {
+      SerialQueued--;
+      SerialNextSent += SerialCyclesPerByte;
+    }
+  }
+
+  static int SerialRoom()
+  {
+    if( !SerialCyclesPerByte )
+      return _NARFDUINO_SIM_SERIAL_BUFFER;
+    SerialSend();
+    return _NARFDUINO_SIM_SERIAL_BUFFER - SerialQueued;
+  }
+
+  // Waits for room like the core does. The time waited is counted.
+  static void SerialWrite( uint8_t Byte )
+  {
+    if( SerialCyclesPerByte )
+    {
+      SerialSend();
+      if( SerialQueued >= _NARFDUINO_SIM_SERIAL_BUFFER )
+      {
+        unsigned long long Wait = SerialNextSent - CurrentCycles;
+        Counters.SerialBlockedCycles += Wait;
+        AdvanceCycles( Wait );
+        SerialSend();
+      }
+      if( !SerialQueued )
+        SerialNextSent = CurrentCycles + SerialCyclesPerByte;
+      SerialQueued++;
+    }
+    if( SerialBytes )
+      SerialBytes( Byte );
+    else
+      putchar( Byte );
+  }
+
+  // Port writes from SimPortWrite(). Reports each pin that changes.
+  static void PortWrite( volatile uint8_t *Port, uint8_t Value )
+  {
+    uint8_t Changed = *Port ^ Value;
+    *Port = Value;
+    if( !Changed || !Edges )
+      return;
+    uint8_t FirstPin = (Port == &PORTB) ? 8 : ((Port == &PORTC) ? 14 : 0);
+    for( uint8_t Bit = 0; Bit < 8; Bit++ )
+    {
+      if( Changed & (1 << Bit) )
+        Edges( FirstPin + Bit, (Value >> Bit) & 1, CurrentCycles + DelayedCycles );
+    }
+  }
+
+  static void DelayCycles( unsigned long Cycles )
+  {
+    DelayedCycles += Cycles;
+  }
+
+  // Used by the core functions below
+  static void AttachExternal( uint8_t Interrupt, void (*Handler)( void ), int Mode )
+  {
+    if( Interrupt > 1 )
+      return;
+    ExternalHandlers[Interrupt] = Handler;
+    ExternalModes[Interrupt] = Mode;
+    ExternalPending[Interrupt] = false;
+  }
+
+  static void DisconnectPWM( uint8_t Pin )
+  {
+    if( Pin < NUM_SIM_PINS )
+      PWMDuty[Pin] = -1;
+  }
+
+  static void ConnectPWM( uint8_t Pin, int Duty )
+  {
+    if( Pin < NUM_SIM_PINS )
+      PWMDuty[Pin] = Duty;
+  }
+
+  static uint16_t ConvertChannel( uint8_t Channel )
+  {
+    return AnalogValues[Channel & 7];
+  }
+}
+
+// Core functions
+unsigned long millis()
+{
+  NarfduinoSim::Counters.Millis++;
+  return (unsigned long)(uint32_t)(NarfduinoSim::Now() / 1000ULL);
+}
+
+unsigned long micros()
+{
+  NarfduinoSim::Counters.Micros++;
+  return (unsigned long)(uint32_t)NarfduinoSim::Now();
+}
+
+void delay( unsigned long ms )
+{
+  NarfduinoSim::AdvanceMicros( ms * 1000UL );
+}
+
+void delayMicroseconds( unsigned int us )
+{
+  NarfduinoSim::AdvanceMicros( us );
+}
+
+uint8_t digitalPinToPort( uint8_t pin )
+{
+  if( pin < 8 )
+    return PD;
+  if( pin < 14 )
+    return PB;
+  if( pin < NUM_DIGITAL_PINS )
+    return PC;
+  return NOT_A_PIN;
+}
+
+uint8_t digitalPinToBitMask( uint8_t pin )
+{
+  if( pin < 8 )
+    return 1 << pin;
+  if( pin < 14 )
+    return 1 << (pin - 8);
+  if( pin < NUM_DIGITAL_PINS )
+    return 1 << (pin - 14);
+  return 0;
+}
+
+volatile uint8_t *portOutputRegister( uint8_t port )
+{
+  switch( port )
+  {
+    case PB: return &PORTB;
+    case PC: return &PORTC;
+    case PD: return &PORTD;
+  }
+  return NULL;
+}
+
+volatile uint8_t *portInputRegister( uint8_t port )
+{
+  switch( port )
+  {
+    case PB: return &PINB;
+    case PC: return &PINC;
+    case PD: return &PIND;
+  }
+  return NULL;
+}
+
+volatile uint8_t *portModeRegister( uint8_t port )
+{
+  switch( port )
+  {
+    case PB: return &DDRB;
+    case PC: return &DDRC;
+    case PD: return &DDRD;
+  }
+  return NULL;
+}
+
+void pinMode( uint8_t pin, uint8_t mode )
+{
+  NarfduinoSim::Counters.PinModes++;
+  uint8_t Port = digitalPinToPort( pin );
+  if( Port == NOT_A_PIN )
+    return;
+  uint8_t Mask = digitalPinToBitMask( pin );
+  if( mode == OUTPUT )
+  {
+    *portModeRegister( Port ) |= Mask;
+  }
+  else
+  {
+    *portModeRegister( Port ) &= ~Mask;
+    if( mode == INPUT_PULLUP )
+      *portOutputRegister( Port ) |= Mask;
+    else
+      *portOutputRegister( Port ) &= ~Mask;
+  }
+}
+
+void digitalWrite( uint8_t pin, uint8_t val )
+{
+  NarfduinoSim::Counters.DigitalWrites++;
+  uint8_t Port = digitalPinToPort( pin );
+  if( Port == NOT_A_PIN )
+    return;
+
+  // Same as the core - a digital write disconnects the PWM from the pin
+  NarfduinoSim::DisconnectPWM( pin );
+
+  uint8_t Mask = digitalPinToBitMask( pin );
+  uint8_t OldSREG = SREG;
+  cli();
+  if( val == LOW )
+    *portOutputRegister( Port ) &= ~Mask;
+  else
+    *portOutputRegister( Port ) |= Mask;
+  SREG = OldSREG;
+}
+
+int digitalRead( uint8_t pin )
+{
+  NarfduinoSim::Counters.DigitalReads++;
+  uint8_t Port = digitalPinToPort( pin );
+  if( Port == NOT_A_PIN )
+    return LOW;
+  uint8_t Mask = digitalPinToBitMask( pin );
+  // Output pins read back what they drive
+  if( *portModeRegister( Port ) & Mask )
+    return (*portOutputRegister( Port ) & Mask) ? HIGH : LOW;
+  return (*portInputRegister( Port ) & Mask) ? HIGH : LOW;
+}
+
+int analogRead( uint8_t pin )
+{
+  NarfduinoSim::Counters.AnalogReads++;
+  if( pin >= A0 )
+    pin -= A0;
+
+  // Blocking conversion - the time passes
+  NarfduinoSim::AdvanceMicros( _NARFDUINO_SIM_ANALOGREAD_MICROS );
+  return NarfduinoSim::ConvertChannel( pin );
+}
+
+void analogWrite( uint8_t pin, int val )
+{
+  NarfduinoSim::Counters.AnalogWrites++;
+
+  // Same decisions as the core. 0 and 255 are digital writes, non PWM pins round to a digital level.
+  pinMode( pin, OUTPUT );
+  NarfduinoSim::Counters.PinModes--;
+  if( val <= 0 )
+  {
+    digitalWrite( pin, LOW );
+    NarfduinoSim::Counters.DigitalWrites--;
+  }
+  else if( val >= 255 )
+  {
+    digitalWrite( pin, HIGH );
+    NarfduinoSim::Counters.DigitalWrites--;
+  }
+  else if( NarfduinoSim::HasPWM( pin ) )
+  {
+    NarfduinoSim::ConnectPWM( pin, val );
+  }
+  else
+  {
+    digitalWrite( pin, val < 128 ? LOW : HIGH );
+    NarfduinoSim::Counters.DigitalWrites--;
+  }
+}
+
+void SimPortWrite( volatile uint8_t *Port, uint8_t Value )
+{
+  NarfduinoSim::PortWrite( Port, Value );
+}
+
+void SimDelayCycles( unsigned long Cycles )
+{
+  NarfduinoSim::DelayCycles( Cycles );
+}
+
+void attachInterrupt( uint8_t interruptNum, void (*userFunc)( void ), int mode )
+{
+  NarfduinoSim::AttachExternal( interruptNum, userFunc, mode );
+}
+
+void detachInterrupt( uint8_t interruptNum )
+{
+  NarfduinoSim::AttachExternal( interruptNum, NULL, 0 );
+}
+
+long map( long x, long in_min, long in_max, long out_min, long out_max )
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void cli()
+{
+  SREG &= ~(1 << SREG_I);
+}
+
+void sei()
+{
+  SREG |= (1 << SREG_I);
+}
+
+
+size_t Print::write( const uint8_t *buffer, size_t size )
+{
+  size_t n = 0;
+  while( size-- )
+    n += write( *buffer++ );
+  return n;
+}
+
+size_t Print::print( unsigned long n, int base )
+{
+  char Digits[33];
+  char *Out = &Digits[sizeof( Digits ) - 1];
+  *Out = 0;
+  if( base < 2 )
+    base = 10;
+  do
+  {
+    unsigned long Digit = n % base;
+    n /= base;
+    *--Out = Digit < 10 ? '0' + Digit : 'A' + Digit - 10;
+  } while( n );
+  return write( Out );
+}
+
+size_t Print::print( long n, int base )
+{
+  if( n < 0 && base == 10 )
+  {
+    size_t Written = print( '-' );
+    return Written + print( (unsigned long)-n, base );
+  }
+  return print( (unsigned long)n, base );
+}
+
+// As the core does it - rounded to the digits, and no exponent
+size_t Print::print( double n, int digits )
+{
+  if( n != n )
+    return print( "nan" );
+  if( n > 4294967040.0 || n < -4294967040.0 )
+    return print( "ovf" );
+  size_t Written = 0;
+  if( n < 0.0 )
+  {
+    Written += print( '-' );
+    n = -n;
+  }
+  double Rounding = 0.5;
+  for( int i = 0; i < digits; i++ )
+    Rounding /= 10.0;
+  n += Rounding;
+  unsigned long Whole = (unsigned long)n;
+  double Remainder = n - (double)Whole;
+  Written += print( Whole );
+  if( digits > 0 )
+    Written += print( '.' );
+  while( digits-- > 0 )
+  {
+    Remainder *= 10.0;
+    unsigned int Digit = (unsigned int)Remainder;
+    Written += print( Digit );
+    Remainder -= Digit;
+  }
+  return Written;
+}
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin( unsigned long baud )
+{
+  NarfduinoSim::SerialBegin( baud );
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return NarfduinoSim::SerialRoom();
+}
+
+size_t HardwareSerial::write( uint8_t c )
+{
+  NarfduinoSim::SerialWrite( c );
+  return 1;
+}
+
+bool eeprom_is_ready()
+{
+  return NarfduinoSim::EEPROMReady();
+}
+
+void eeprom_busy_wait()
+{
+  NarfduinoSim::EEPROMWait();
+}
+
+uint8_t eeprom_read_byte( const uint8_t *addr )
+{
+  return NarfduinoSim::EEPROMRead( (uintptr_t)addr );
+}
+
+void eeprom_write_byte( uint8_t *addr, uint8_t value )
+{
+  NarfduinoSim::EEPROMWrite( (uintptr_t)addr, value );
+}
+
+void eeprom_update_byte( uint8_t *addr, uint8_t value )
+{
+  if( eeprom_read_byte( addr ) != value )
+    eeprom_write_byte( addr, value );
+}
@@ -0,0 +1,115 @@
+/*
+ *  Narfduino Libraries - Host Simulation HAL control
+ *
+ *  Drives the simulated hardware behind the host Arduino.h
+ *    - Virtual clock. Time only moves when the host calls AdvanceMicros(), or when a blocking core call (delay, analogRead) would have taken time.
+ *      The clock counts CPU cycles, so the timers run at their real resolution.
+ *    - Timer1 in normal, CTC and fast PWM (TOP = ICR1) modes. The OC1A / OC1B outputs on pins 9 and 10 are driven in the PWM mode.
+ *    - Timer2 in normal, CTC and fast PWM modes, with the compare match interrupts delivered at the cycle they would happen. OC2B on pin 3 is driven in the PWM modes.
+ *    - External interrupts on pins 2 and 3, and pin change interrupts on every pin, raised by SetPinInput().
+ *    - 1KB of EEPROM through avr/eeprom.h, with the 3.4ms byte write time.
+ *    - Serial, sending at its baud rate from a 63 byte buffer.
+ *    - Virtual pins and ADC channels. Conversions started through the ADC registers take 13 ADC clocks and raise the ADC interrupt.
+ *    - Counters of every core call, so the cost of a hot path can be estimated in AVR cycles.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_SIM_H
+#define _NARFDUINO_SIM_H
+
+#include "Arduino.h"
+
+// Approximate cost of the AVR core calls, in CPU cycles at 16MHz. Used to estimate the cost of a hot path.
+#define _NARFDUINO_SIM_CYCLES_DIGITALWRITE 56
+#define _NARFDUINO_SIM_CYCLES_DIGITALREAD 52
+#define _NARFDUINO_SIM_CYCLES_ANALOGWRITE 80
+#define _NARFDUINO_SIM_CYCLES_ANALOGREAD 1780
+#define _NARFDUINO_SIM_CYCLES_MILLIS 28
+#define _NARFDUINO_SIM_CYCLES_MICROS 52
+
+// Serial TX buffer, in bytes. The core's is 64, with one always empty.
+#define _NARFDUINO_SIM_SERIAL_BUFFER 63
+
+// Time an EEPROM byte write takes, in CPU cycles - 3.4ms
+#define _NARFDUINO_SIM_EEPROM_WRITE_CYCLES 54400UL
+#define _NARFDUINO_SIM_EEPROM_SIZE 1024
+
+// Time a blocking analogRead() takes on the real hardware - 13 ADC clocks at 125kHz, plus overhead.
+#define _NARFDUINO_SIM_ANALOGREAD_MICROS 112
+
+namespace NarfduinoSim
+{
+  // Counts of the core calls made since the last Reset / ResetCounters
+  struct CoreCounters
+  {
+    unsigned long DigitalWrites;
+    unsigned long DigitalReads;
+    unsigned long AnalogWrites;
+    unsigned long AnalogReads;
+    unsigned long Millis;
+    unsigned long Micros;
+    unsigned long PinModes;
+    unsigned long long SerialBlockedCycles; // CPU cycles Serial.write() spent waiting for room in the buffer
+    unsigned long EEPROMWrites;
+    unsigned long long EEPROMBlockedCycles; // CPU cycles spent waiting for an EEPROM write to finish
+  };
+
+  extern CoreCounters Counters;
+
+  // Put the simulated board back to power-on state. Clock back to 0.
+  void Reset();
+
+  // Zero the core call counters.
+  void ResetCounters();
+
+  // Estimated AVR cycles spent inside core calls, from the counters.
+  unsigned long long EstimatedCoreCycles();
+
+  // Move the virtual clock forward. Any interrupts that fall due are run at the time they happen.
+  void AdvanceMicros( unsigned long Micros );
+  void AdvanceCycles( unsigned long long Cycles );
+
+  // Current virtual time in us, and in CPU cycles.
+  unsigned long long Now();
+  unsigned long long NowCycles();
+
+  // Number of interrupt handlers run since the last Reset.
+  extern unsigned long InterruptsServiced;
+
+  // Sets the raw 10-bit value an ADC channel will convert to. Accepts a channel number or A0..A7.
+  void SetAnalogValue( uint8_t Pin, uint16_t Value );
+
+  // Drives an input pin from the outside world. An edge on pin 2 or 3 runs the attachInterrupt() handler, and an edge on a pin in a PCMSK
+  // register runs its pin change interrupt, straight away if interrupts are on.
+  void SetPinInput( uint8_t Pin, bool Level );
+
+  // The level the pin is actually driving. 0 = low, 255 = high, anything else is the PWM duty.
+  int GetPinOutput( uint8_t Pin );
+
+  // Called at the exact cycle a timer driven output (OC1A on pin 9, OC1B on pin 10, OC2B on pin 3), or a pin written with SimPortWrite(), changes level. NULL to stop.
+  // Counted delays (SimDelayCycles) inside an interrupt handler or a single call push the time of the following writes on, 
+  // but the rest of the simulation doesn't see that time pass.
+  typedef void (*EdgeCallback)( uint8_t Pin, bool Level, unsigned long long Cycle );
+  void SetEdgeCallback( EdgeCallback Callback );
+
+  // The EEPROM contents. They survive Reset(), like the real thing. EraseEEPROM() sets every byte to 0xFF.
+  uint8_t *GetEEPROM();
+  void EraseEEPROM();
+
+  // Called with each byte written to Serial. NULL = print them to stdout.
+  typedef void (*SerialCallback)( uint8_t Byte );
+  void SetSerialCallback( SerialCallback Callback );
+}
+
+#endif
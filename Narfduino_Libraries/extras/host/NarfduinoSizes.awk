@@ -0,0 +1,31 @@
+# Narfduino Libraries - adds up avr-nm -S -C -t d output for make avr-sizes. See NarfduinoSizes.cpp
+{
+  if( NF < 4 )
+    next
+  Size = $2 + 0
+  Type = $3
+  Name = $4
+  for( i = 5; i <= NF; i++ )
+    Name = Name " " $i
+  Code = (Type ~ /^[tTwW]$/)
+  Data = (Type ~ /^[bBdDvV]$/)
+
+  if( Data && Name == "SizeBridge" )
+    BridgeRAM = Size
+  else if( Data && Name == "SizeBridgePins" )
+    PinsRAM = Size
+  else if( Data && Name ~ /^NarfduinoBridgeBase::/ )
+    SharedRAM += Size
+  else if( Code && (Name ~ /NarfduinoBridgePins</ || Name ~ /^SizeBridgePinsCalls/) )
+    PinsFlash += Size
+  else if( Code && (Name ~ /^NarfduinoBridgeDriver<NarfduinoBridge>::/ || Name ~ /^NarfduinoBridge::/ || Name ~ /^SizeBridgeCalls/) )
+    BridgeFlash += Size
+  else if( Code && Name ~ /^NarfduinoBridgeBase::/ )
+    SharedFlash += Size
+}
+END {
+  printf( "RAM per bridge:    NarfduinoBridge %d bytes, NarfduinoBridgePins %d bytes\n", BridgeRAM, PinsRAM )
+  printf( "RAM shared:        %d bytes of NarfduinoBridgeBase statics\n", SharedRAM )
+  printf( "Flash per type:    NarfduinoBridge %d bytes, NarfduinoBridgePins %d bytes - the driver, pin functions and the calls to them\n", BridgeFlash, PinsFlash )
+  printf( "Flash shared:      %d bytes of NarfduinoBridgeBase\n", SharedFlash )
+}
@@ -0,0 +1,47 @@
+/*
+ *  Narfduino Libraries - AVR size report
+ *
+ *  Built for the ATmega328P by make avr-sizes, with avr-g++ and the Arduino AVR core - not part of the host build.
+ *  One NarfduinoBridge and one NarfduinoBridgePins, each with everything a sketch would call on it, so avr-nm can measure
+ *  the RAM each takes and the code built for each. NarfduinoSizes.awk adds them up.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#include "Arduino.h"
+#include "NarfduinoBridge.h"
+#include "NarfduinoBridgePins.h"
+#include "NarfduinoBridgeGroup.h"
+
+NarfduinoBridge SizeBridge;
+NarfduinoBridgePins<_NARFDUINOPIN_BRIDGE_RUN, _NARFDUINOPIN_BRIDGE_STOP> SizeBridgePins;
+NarfduinoBridgeGroup SizeGroup;
+
+// The fixed pins driver is built here, and whatever of it the compiler inlines lands in these, so each bridge's calls count towards it
+void SizeBridgeCalls()
+{
+  SizeBridge.Init();
+  SizeBridge.SetPWMMode( _NARFDUINO_BRIDGE_PWM_TIMER1 );
+  SizeBridge.EnableTimedDeadTime();
+  SizeBridge.ProcessBridge();
+  SizeGroup.AddBridge( &SizeBridge );
+}
+
+void SizeBridgePinsCalls()
+{
+  SizeBridgePins.Init();
+  SizeBridgePins.SetPWMMode( _NARFDUINO_BRIDGE_PWM_TIMER1 );
+  SizeBridgePins.EnableTimedDeadTime();
+  SizeBridgePins.ProcessBridge();
+  SizeGroup.AddBridge( &SizeBridgePins );
+}
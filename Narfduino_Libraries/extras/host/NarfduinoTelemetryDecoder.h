@@ -0,0 +1,165 @@
+/*
+ *  Narfduino Libraries - Telemetry decoder
+ *
+ *  Pulls NarfduinoTelemetry frames back out of a byte stream. Used by the narfduino_telemetry tool and the benchmark.
+ *  A frame with a bad checksum is thrown away, and it starts looking for the next sync. Dropped frames show up as gaps in the sequence.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_TELEMETRY_DECODER_H
+#define _NARFDUINO_TELEMETRY_DECODER_H
+
+#include "NarfduinoTelemetry.h"
+
+class NarfduinoTelemetryDecoder
+{
+  public:
+    struct Frame
+    {
+      uint8_t Type;
+      uint8_t Sequence;
+      uint8_t Length;
+      uint8_t Payload[_NARFDUINO_TELEMETRY_MAX_PAYLOAD];
+    };
+
+    struct Status
+    {
+      uint32_t Millis;
+      uint16_t Millivolts;
+      uint8_t Percent;
+      uint8_t Flags;
+      uint8_t BridgeSpeed;
+      uint16_t Brushless9;
+      uint16_t Brushless10;
+      uint16_t LoopMax;
+      uint16_t Loops;
+    };
+
+    // Feed the next byte. Returns true when a whole frame with a good checksum has come in - it's in GetFrame() until the next one.
+    bool Feed( uint8_t Byte )
+    {
+      switch( State )
+      {
+        case WaitSync1:
+          if( Byte == _NARFDUINO_TELEMETRY_SYNC1 )
+            State = WaitSync2;
+          return false;
+
+        case WaitSync2:
+          if( Byte == _NARFDUINO_TELEMETRY_SYNC2 )
+          {
+            State = WaitLength;
+            Sum1 = Sum2 = 0;
+          }
+          else if( Byte != _NARFDUINO_TELEMETRY_SYNC1 )
+            State = WaitSync1;
+          return false;
+
+        case WaitLength:
+          AddToSum( Byte );
+          if( Byte > _NARFDUINO_TELEMETRY_MAX_PAYLOAD )
+          {
+            BadFrames++;
+            State = WaitSync1;
+            return false;
+          }
+          Building.Length = Byte;
+          State = WaitType;
+          return false;
+
+        case WaitType:
+          AddToSum( Byte );
+          Building.Type = Byte;
+          State = WaitSequence;
+          return false;
+
+        case WaitSequence:
+          AddToSum( Byte );
+          Building.Sequence = Byte;
+          Received = 0;
+          State = Building.Length ? WaitPayload : WaitCheck1;
+          return false;
+
+        case WaitPayload:
+          AddToSum( Byte );
+          Building.Payload[Received++] = Byte;
+          if( Received >= Building.Length )
+            State = WaitCheck1;
+          return false;
+
+        case WaitCheck1:
+          Check1 = Byte;
+          State = WaitCheck2;
+          return false;
+
+        case WaitCheck2:
+          State = WaitSync1;
+          if( Check1 != Sum1 || Byte != Sum2 )
+          {
+            BadFrames++;
+            return false;
+          }
+          if( Frames && Building.Sequence != (uint8_t)(LastSequence + 1) )
+            LostFrames += (uint8_t)(Building.Sequence - LastSequence - 1);
+          LastSequence = Building.Sequence;
+          Frames++;
+          Done = Building;
+          return true;
+      }
+      return false;
+    }
+
+    const Frame &GetFrame() { return Done; }
+
+    // Unpack a status frame. Returns false if it isn't one.
+    static bool DecodeStatus( const Frame &In, Status &Out )
+    {
+      if( In.Type != _NARFDUINO_TELEMETRY_STATUS || In.Length < _NARFDUINO_TELEMETRY_STATUS_SIZE )
+        return false;
+      const uint8_t *p = In.Payload;
+      Out.Millis = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+      Out.Millivolts = p[4] | (p[5] << 8);
+      Out.Percent = p[6];
+      Out.Flags = p[7];
+      Out.BridgeSpeed = p[8];
+      Out.Brushless9 = p[9] | (p[10] << 8);
+      Out.Brushless10 = p[11] | (p[12] << 8);
+      Out.LoopMax = p[13] | (p[14] << 8);
+      Out.Loops = p[15] | (p[16] << 8);
+      return true;
+    }
+
+    unsigned long Frames = 0;
+    unsigned long BadFrames = 0; // Failed the checksum
+    unsigned long LostFrames = 0; // Missing from the sequence - dropped on the board, or lost to a bad frame
+
+  private:
+    enum { WaitSync1, WaitSync2, WaitLength, WaitType, WaitSequence, WaitPayload, WaitCheck1, WaitCheck2 } State = WaitSync1;
+
+    void AddToSum( uint8_t Byte )
+    {
+      Sum1 = (Sum1 + Byte) % 255;
+      Sum2 = (Sum2 + Sum1) % 255;
+    }
+
+    Frame Building;
+    Frame Done;
+    uint8_t Received = 0;
+    uint8_t Sum1 = 0;
+    uint8_t Sum2 = 0;
+    uint8_t Check1 = 0;
+    uint8_t LastSequence = 0;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ *  Narfduino Libraries - Telemetry decoder tool
+ *
+ *  Turns a NarfduinoTelemetry stream into CSV, one line per status frame. Reads a serial port, a file captured from one, or stdin.
+ *  Frames of your own come out as the type and the payload in hex. The frame counts go to stderr at the end.
+ *
+ *  Usage: narfduino_telemetry [-b baud] [port or file]
+ *    narfduino_telemetry -b 115200 /dev/ttyUSB0 > session.csv
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "NarfduinoTelemetryDecoder.h"
+
+static volatile sig_atomic_t Stopping = 0;
+
+static void Stop( int )
+{
+  Stopping = 1;
+}
+
+static speed_t BaudToSpeed( unsigned long Baud )
+{
+  switch( Baud )
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+  }
+  return B0;
+}
+
+// Raw mode at the baud rate, so nothing gets translated on the way in
+static bool SetupPort( int Port, unsigned long Baud )
+{
+  struct termios Settings;
+  if( tcgetattr( Port, &Settings ) != 0 )
+    return false;
+  speed_t Speed = BaudToSpeed( Baud );
+  if( Speed == B0 )
+  {
+    fprintf( stderr, "Unsupported baud rate %lu\n", Baud );
+    return false;
+  }
+  cfmakeraw( &Settings );
+  cfsetispeed( &Settings, Speed );
+  cfsetospeed( &Settings, Speed );
+  Settings.c_cc[VMIN] = 1;
+  Settings.c_cc[VTIME] = 0;
+  return tcsetattr( Port, TCSANOW, &Settings ) == 0;
+}
+
+int main( int argc, char **argv )
+{
+  unsigned long Baud = 115200;
+  const char *Path = NULL;
+  for( int i = 1; i < argc; i++ )
+  {
+    if( strcmp( argv[i], "-b" ) == 0 && i + 1 < argc )
+      Baud = strtoul( argv[++i], NULL, 10 );
+    else if( argv[i][0] == '-' && argv[i][1] )
+    {
+      fprintf( stderr, "Usage: %s [-b baud] [port or file]\n", argv[0] );
+      return 2;
+    }
+    else
+      Path = argv[i];
+  }
+
+  int Input = STDIN_FILENO;
+  if( Path && strcmp( Path, "-" ) != 0 )
+  {
+    Input = open( Path, O_RDONLY | O_NOCTTY );
+    if( Input < 0 )
+    {
+      perror( Path );
+      return 1;
+    }
+  }
+  if( isatty( Input ) && !SetupPort( Input, Baud ) )
+  {
+    fprintf( stderr, "Couldn't set up %s\n", Path ? Path : "stdin" );
+    return 1;
+  }
+
+  signal( SIGINT, Stop );
+  signal( SIGTERM, Stop );
+
+  printf( "millis,millivolts,percent,running,jammed,flat,bridge_speed,brushless_9,brushless_10,loop_max_us,loops\n" );
+
+  NarfduinoTelemetryDecoder Decoder;
+  uint8_t Bytes[256];
+  while( !Stopping )
+  {
+    ssize_t Count = read( Input, Bytes, sizeof( Bytes ) );
+    if( Count <= 0 )
+      break;
+    for( ssize_t i = 0; i < Count; i++ )
+    {
+      if( !Decoder.Feed( Bytes[i] ) )
+        continue;
+      const NarfduinoTelemetryDecoder::Frame &In = Decoder.GetFrame();
+      NarfduinoTelemetryDecoder::Status Status;
+      if( NarfduinoTelemetryDecoder::DecodeStatus( In, Status ) )
+      {
+        printf( "%lu,%u,%u,%d,%d,%d,%u,%u,%u,%u,%u\n", (unsigned long)Status.Millis, Status.Millivolts, Status.Percent,
+          (Status.Flags & _NARFDUINO_TELEMETRY_FLAG_RUNNING) != 0, (Status.Flags & _NARFDUINO_TELEMETRY_FLAG_JAMMED) != 0,
+          (Status.Flags & _NARFDUINO_TELEMETRY_FLAG_FLAT) != 0, Status.BridgeSpeed, Status.Brushless9, Status.Brushless10,
+          Status.LoopMax, Status.Loops );
+        continue;
+      }
+      printf( "# type 0x%02X:", In.Type );
+      for( uint8_t b = 0; b < In.Length; b++ )
+        printf( " %02X", In.Payload[b] );
+      printf( "\n" );
+    }
+    fflush( stdout );
+  }
+
+  fprintf( stderr, "%lu frames, %lu bad, %lu lost\n", Decoder.Frames, Decoder.BadFrames, Decoder.LostFrames );
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ *  Narfduino Libraries - Host Simulation HAL - avr/eeprom.h
+ *
+ *  Stand-in for the avr-libc EEPROM calls. 1KB of EEPROM, like the ATmega328P, that keeps its contents across NarfduinoSim::Reset().
+ *  A byte write takes 3.4ms. A write started while the last one is still going waits for it, like the real one does.
+ *
+ *  (c) 2019 - Ireland Software
+ *  License:
+ *    - You are free to use this software for non-commercial use.
+ *    - If you purchase a Narfduino board from Airzone's Blasters (or other authorised supplier),
+ *      then you can use this software commercially for software loaded on that board.
+ *    - Commercial use on other boards requires a paid license
+ *    - Modifications to the software follow this license
+ *
+ *  Warranty:
+ *    - No warranty, expressed or implied. Software is provided as-is. Use at own risk.
+ *
+ */
+
+#ifndef _NARFDUINO_SIM_EEPROM_H
+#define _NARFDUINO_SIM_EEPROM_H
+
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+bool eeprom_is_ready();
+void eeprom_busy_wait();
+uint8_t eeprom_read_byte( const uint8_t *addr );
+void eeprom_write_byte( uint8_t *addr, uint8_t value );
+void eeprom_update_byte( uint8_t *addr, uint8_t value );
+
+#endif